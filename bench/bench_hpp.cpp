@@ -0,0 +1,177 @@
+// Times the ntfs_parser.hpp ranges against the C loops they replace, over
+// the same open files. The C and C++ loops of a pair do the same work and
+// must agree on the checksum, only the time per item should differ
+#include "ntfs_parser.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cwchar>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr int Rounds = 7;
+
+uint16_t IndexName[] = { '$', 'I', '3', '0' };
+
+// Keeps the sums alive so the loops are not folded away
+volatile uint64_t Sink;
+
+struct Timing {
+    double   Seconds;
+    uint64_t Items;
+    uint64_t Sum;
+};
+
+template <typename Body>
+Timing Time(uint64_t Passes, Body &Loop)
+{
+    Timing            Result = {};
+    Clock::time_point Start  = Clock::now();
+    for (uint64_t Pass = 0; Pass < Passes; Pass++) {
+        Loop(&Result.Items, &Result.Sum);
+        Sink = Result.Sum;
+    }
+    Result.Seconds = std::chrono::duration<double>(Clock::now() - Start).count();
+
+    return Result;
+}
+
+// Best of a few rounds, the two loops take turns so a slow stretch of the
+// machine hits both of them
+template <typename CBody, typename CppBody>
+void Measure(const char *Name, uint64_t Passes, CBody &CLoop, CppBody &CppLoop)
+{
+    Timing C   = {};
+    Timing Cpp = {};
+    for (int Round = 0; Round < Rounds; Round++) {
+        Timing CRound   = Time(Passes, CLoop);
+        Timing CppRound = Time(Passes, CppLoop);
+        if (Round == 0 || CRound.Seconds < C.Seconds) {
+            C = CRound;
+        }
+
+        if (Round == 0 || CppRound.Seconds < Cpp.Seconds) {
+            Cpp = CppRound;
+        }
+    }
+
+    double CNs   = C.Items ? C.Seconds * 1e9 / C.Items : 0;
+    double CppNs = Cpp.Items ? Cpp.Seconds * 1e9 / Cpp.Items : 0;
+    printf("%-10s %12llu items  C %8.2f ns  C++ %8.2f ns  ratio %.3f%s\n", Name,
+           static_cast<unsigned long long>(C.Items), CNs, CppNs, CNs ? CppNs / CNs : 0,
+           C.Sum == Cpp.Sum && C.Items == Cpp.Items ? "" : "  checksum mismatch");
+}
+
+}   // namespace
+
+int wmain(int Argc, wchar_t **Argv)
+{
+    if (Argc < 2) {
+        printf("Usage: %ls ntfs_volume [records] [passes]\n", Argv[0]);
+        printf("    ntfs_volume - volume letter or path to a VHD or raw image\n");
+        printf("    records     - first MFT records opened, 4096 by default\n");
+        printf("    passes      - times a loop goes over them per round, 1000 by default\n");
+        return 1;
+    }
+
+    uint64_t RecordCount = Argc > 2 ? wcstoull(Argv[2], nullptr, 10) : 4096;
+    uint64_t Passes      = Argc > 3 ? wcstoull(Argv[3], nullptr, 10) : 1000;
+
+    ntfs::Volume Volume = wcslen(Argv[1]) == 1 ? ntfs::Volume::open(Argv[1][0])
+                                               : ntfs::Volume::openFile(Argv[1]);
+    if (!Volume) {
+        printf("error: Failed to load volume - %s\n", NTFS_ErrorToString(Volume.error()));
+        return 1;
+    }
+
+    // Free and corrupt records are skipped, only the loops are timed
+    std::vector<ntfs::File>   Files;
+    std::vector<ntfs::File *> Dirs;
+    Files.reserve(RecordCount);
+    for (uint64_t Index = 0; Index < RecordCount; Index++) {
+        ntfs::File File = Volume.file(Index);
+        if (File) {
+            Files.push_back(std::move(File));
+        }
+    }
+    for (ntfs::File &File : Files) {
+        if (File->Record.IsDir) {
+            Dirs.push_back(&File);
+        }
+    }
+    printf("%zu files, %zu directories, %llu passes\n", Files.size(), Dirs.size(),
+           static_cast<unsigned long long>(Passes));
+
+    // $FILE_NAME views, the C loop is what AttrRange expands to
+    auto AttrC = [&](uint64_t *Items, uint64_t *Sum) {
+        for (ntfs::File &File : Files) {
+            ntfs_attr *List  = File->Record.AttrList;
+            size_t     Count = NTFS__ListLen(List);
+            for (size_t Index = 0; Index < Count; Index++) {
+                ntfs_file_name Name;
+                if (List[Index].Type == NTFS_AttributeType_FileName &&
+                    NTFS__FileNameParse(List + Index, &Name)) {
+                    *Items += 1;
+                    *Sum   += Name.ParentIndex + Name.NameLength;
+                }
+            }
+        }
+    };
+    auto AttrCpp = [&](uint64_t *Items, uint64_t *Sum) {
+        for (ntfs::File &File : Files) {
+            for (const ntfs_file_name &Name : File.attributes<NTFS_AttributeType_FileName>()) {
+                *Items += 1;
+                *Sum   += Name.ParentIndex + Name.NameLength;
+            }
+        }
+    };
+    Measure("attributes", Passes, AttrC, AttrCpp);
+
+    // Same attributes decoded from the record bytes, for scale against the
+    // parsed list both loops above walk
+    auto Cursor = [&](uint64_t *Items, uint64_t *Sum) {
+        for (ntfs::File &File : Files) {
+            ntfs_attr_cursor AttrCursor =
+                NTFS_AttrCursorBegin(Volume.get(), &File.get()->Record);
+            ntfs_attr Attr;
+            while (NTFS_AttrCursorNext(&AttrCursor, NTFS_AttributeType_FileName, &Attr)) {
+                ntfs_file_name Name;
+                if (NTFS__FileNameParse(&Attr, &Name)) {
+                    *Items += 1;
+                    *Sum   += Name.ParentIndex + Name.NameLength;
+                }
+            }
+        }
+    };
+    Timing CursorTime = Time(Passes, Cursor);
+    printf("%-10s %12llu items  C %8.2f ns\n", "cursor",
+           static_cast<unsigned long long>(CursorTime.Items),
+           CursorTime.Items ? CursorTime.Seconds * 1e9 / CursorTime.Items : 0);
+
+    // $I30 entries, index blocks are read again every pass by both loops
+    auto IndexC = [&](uint64_t *Items, uint64_t *Sum) {
+        for (ntfs::File *Dir : Dirs) {
+            ntfs_index_cursor IndexCursor = NTFS_IndexCursorBegin(Dir->get(), IndexName, 4);
+            ntfs_index_entry  Entry;
+            while (NTFS_IndexCursorNext(&IndexCursor, &Entry)) {
+                *Items += 1;
+                *Sum   += *reinterpret_cast<uint64_t *>(Entry.Entry) & 0xFFFFFFFFFFFF;
+            }
+            NTFS_IndexCursorEnd(&IndexCursor);
+        }
+    };
+    auto IndexCpp = [&](uint64_t *Items, uint64_t *Sum) {
+        for (ntfs::File *Dir : Dirs) {
+            for (ntfs::DirectoryEntry Entry : Dir->entries()) {
+                *Items += 1;
+                *Sum   += Entry.recordIndex();
+            }
+        }
+    };
+    Measure("index", Passes / 10 ? Passes / 10 : 1, IndexC, IndexCpp);
+
+    return 0;
+}
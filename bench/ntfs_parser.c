@@ -0,0 +1,4 @@
+// The C++ layer is header only over the C API, the implementation still
+// comes from a C translation unit
+#define NTFS_PARSER_IMPLEMENTATION
+#include "ntfs_parser.h"
@@ -175,19 +175,8 @@ void PrintHexDump(void *Buffer, size_t Size)
 
 void PrintFileTime(uint64_t FileTime)
 {
-    FILETIME  FileTime_ = {
-        .dwHighDateTime = FileTime >> 32,
-        .dwLowDateTime  = FileTime  & 0xFFFFFFFF,
-    };
-    SYSTEMTIME SystemTime = { 0 };
-    FileTimeToSystemTime(&FileTime_, &SystemTime);
-
-    wchar_t TimeStr[260];
-    wchar_t DateStr[260];
-    GetDateFormatW(LOCALE_SYSTEM_DEFAULT, DATE_SHORTDATE,
-                   &SystemTime, 0, DateStr, ARRAYSIZE(TimeStr));
-    GetTimeFormatW(LOCALE_SYSTEM_DEFAULT, TIME_FORCE24HOURFORMAT,
-                   &SystemTime, 0, TimeStr, ARRAYSIZE(TimeStr));
-
-    printf("%ls %ls", DateStr, TimeStr);
+    char TimeStr[NTFS_ISO8601_MAX_SIZE];
+    NTFS_FileTimeToIso8601(FileTime, TimeStr);
+
+    printf("%s", TimeStr);
 }
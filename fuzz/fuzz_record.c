@@ -0,0 +1,42 @@
+// libFuzzer target, every input is a single MFT file record parsed under the
+// tolerant policy, the way a bulk scan meets a corrupted record
+#define NTFS_PARSER_IMPLEMENTATION
+#include "ntfs_parser.h"
+
+#define FUZZ_RECORD_SIZE 1024
+
+static ntfs_volume FuzzVolume = {
+    .SectorsPerCluster = 8,
+    .BytesPerSector    = 512,
+    .BytesPerCluster   = 4096,
+    .BytesPerMftEntry  = FUZZ_RECORD_SIZE,
+    .MftRecordCount    = 1,
+    .ParsePolicy       = NTFS_ParsePolicy_Tolerant,
+};
+
+int LLVMFuzzerTestOneInput(const uint8_t *Data, size_t Size)
+{
+    static ntfs_arena Arena;
+    if (Arena.Buffer == 0) {
+        Arena = NTFS__ArenaDefault();
+    }
+
+    if (Size > FUZZ_RECORD_SIZE) {
+        Size = FUZZ_RECORD_SIZE;
+    }
+
+    // Fixups are applied in place, the input itself stays read only
+    uint8_t Buffer[FUZZ_RECORD_SIZE] = { 0 };
+    NTFS_MEM_COPY(Buffer, sizeof(Buffer), Data, Size);
+
+    // Header, attribute cursor and data runs of every non-resident attribute
+    NTFS__RecordParseEx(&FuzzVolume, &Arena, Buffer, 0, true);
+
+    // Raw input as a run list, without a valid record around it the decoder
+    // sees lengths the cursor would have rejected
+    ntfs_error Error = NTFS_Error_Success;
+    NTFS__DataRunsLoad(&Arena, NTFS_CAST(void *, Data), Size, &Error);
+
+    NTFS__ArenaReset(&Arena);
+    return 0;
+}
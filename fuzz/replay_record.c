@@ -0,0 +1,93 @@
+// Replays a corpus through the fuzz target without libFuzzer, so the seed
+// corpus doubles as a record parsing benchmark
+#include "fuzz_record.c"
+
+#include <stdio.h>
+#include <windows.h>
+#include <wchar.h>
+
+typedef struct {
+    uint8_t *Data;
+    size_t   Size;
+} fuzz_input;
+
+
+int wmain(int Argc, wchar_t **Argv)
+{
+    int         Result = 0;
+    ntfs_arena  Arena  = NTFS__ArenaDefault();
+    fuzz_input *Inputs = 0;
+
+    if (Arena.Buffer == 0) {
+        printf("error: no memory\n");
+        NTFS_RETURN(Result, 1);
+    }
+
+    if (Argc < 2) {
+        printf("Usage: %ls corpus_dir [passes]\n", Argv[0]);
+        printf("    corpus_dir - directory with one file record per file\n");
+        printf("    passes     - times the whole corpus is parsed, 10000 by default\n");
+        NTFS_RETURN(Result, 1);
+    }
+
+    uint64_t Passes = Argc > 2 ? _wtoi64(Argv[2]) : 10000;
+
+    wchar_t Pattern[MAX_PATH];
+    swprintf(Pattern, MAX_PATH, L"%ls\\*", Argv[1]);
+
+    WIN32_FIND_DATAW Find;
+    HANDLE           FindHandle = FindFirstFileW(Pattern, &Find);
+    if (FindHandle == INVALID_HANDLE_VALUE) {
+        printf("error: cannot list %ls\n", Argv[1]);
+        NTFS_RETURN(Result, 1);
+    }
+
+    do {
+        if (Find.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+            continue;
+        }
+
+        wchar_t Path[MAX_PATH];
+        swprintf(Path, MAX_PATH, L"%ls\\%ls", Argv[1], Find.cFileName);
+
+        void *Handle = NTFS__Win32FileOpen(Path);
+        if (Handle == 0) {
+            continue;
+        }
+
+        fuzz_input Input = { .Size = NTFS__Win32FileSize(Handle) };
+        Input.Data       = NTFS__ArenaAlloc(&Arena, Input.Size);
+        if (NTFS__Win32FileRead(Handle, 0, Input.Data, Input.Size)) {
+            NTFS__ListPush(&Arena, Inputs, Input);
+        }
+        CloseHandle(Handle);
+    } while (FindNextFileW(FindHandle, &Find));
+    FindClose(FindHandle);
+
+    size_t InputCount = NTFS__ListLen(Inputs);
+    if (InputCount == 0) {
+        printf("error: no inputs in %ls\n", Argv[1]);
+        NTFS_RETURN(Result, 1);
+    }
+
+    LARGE_INTEGER Frequency, Start, End;
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+    for (uint64_t Pass = 0; Pass < Passes; Pass++) {
+        for (size_t Index = 0; Index < InputCount; Index++) {
+            LLVMFuzzerTestOneInput(Inputs[Index].Data, Inputs[Index].Size);
+        }
+    }
+    QueryPerformanceCounter(&End);
+
+    double Seconds = NTFS_CAST(double, End.QuadPart - Start.QuadPart) / Frequency.QuadPart;
+    uint64_t Records = Passes * InputCount;
+    printf("%zu inputs, %llu records in %.3f s, %.0f records/s\n",
+           InputCount, Records, Seconds, Records / Seconds);
+
+skip:
+    if (Arena.Buffer) {
+        NTFS__ArenaDestroy(&Arena);
+    }
+    return Result;
+}
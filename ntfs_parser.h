@@ -5,6 +5,10 @@
 #include <stdint.h>
 #include <stddef.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 // Helper macros
 #define NTFS_STATEMENT(statement) \
     do {                          \
@@ -16,6 +20,12 @@
 #define NTFS_RETURN(name, value)    \
     NTFS_STATEMENT((name) = (value); goto skip;)
 
+#if defined(__GNUC__) || defined(__clang__)
+    #define NTFS_UNLIKELY(cond) __builtin_expect(!!(cond), 0)
+#else
+    #define NTFS_UNLIKELY(cond) (cond)
+#endif
+
 #define NTFS_WSTRINGIFY_(s) L ## s
 #define NTFS_WSTRINGIFY(s)  NTFS_WSTRINGIFY_(s)
 
@@ -24,6 +34,14 @@
         memcpy_s(dest, dest_size, src, src_size)
 #endif
 
+#ifndef NTFS_MEM_SET
+    #define NTFS_MEM_SET(dest, value, size) memset(dest, value, size)
+#endif
+
+#ifndef NTFS_MEM_COMPARE
+    #define NTFS_MEM_COMPARE(left, right, size) memcmp(left, right, size)
+#endif
+
 #ifndef NTFS_ASSERT
     #define NTFS_ASSERT(cond, msg)                                      \
         NTFS_STATEMENT(                                                 \
@@ -53,12 +71,15 @@ typedef struct {
 
 #define NTFS__ARENA_KILOBYTE(value) (value * 1024)
 #define NTFS__ARENA_MEGABYTE(value) (value * 1024 * 1024)
+#define NTFS__ARENA_GIGABYTE(value) (NTFS_CAST(size_t, value) * 1024 * 1024 * 1024)
 #define NTFS__ARENA_DEFAULT_COMMIT   NTFS__ARENA_MEGABYTE(1)
 #define NTFS__ARENA_DEFAULT_RESERVED NTFS__ARENA_MEGABYTE(16)
 
 NTFS_API ntfs_arena NTFS__ArenaDefault(void);
+NTFS_API ntfs_arena NTFS__ArenaCreate(size_t ReservedSize, size_t CommittedSize);
 NTFS_API void       NTFS__ArenaDestroy(ntfs_arena *Arena);
 NTFS_API void      *NTFS__ArenaAlloc(ntfs_arena *Arena, size_t Size);
+NTFS_API void      *NTFS__ArenaAllocAligned(ntfs_arena *Arena, size_t Size, size_t Alignment);
 NTFS_API void      *NTFS__PushCopyWStringZ(ntfs_arena *Arena, uint16_t *String, size_t Length);
 NTFS_API void      *NTFS__ArenaResizeAlloc(ntfs_arena *Arena, void *Address, size_t Size);
 NTFS_API void       NTFS__ArenaReset(ntfs_arena *Arena);
@@ -97,12 +118,78 @@ typedef enum {
     // File related errors
     NTFS_Error_RecordFailedRead,
     NTFS_Error_RecordFailedValidation,
+    NTFS_Error_RecordFixupMismatch,
+    NTFS_Error_RecordBadAttribute,
+    NTFS_Error_RecordBadRunList,
+    NTFS_Error_RecordOutOfBounds,
+    NTFS_Error_RecordBadAttributeList,
     NTFS_Error_FileFailedInfoValidation,
     NTFS_Error_FileReadDataAttrNotFound,
     NTFS_Error_FileReadFailed,
+
+    // Bitmap related errors
+    NTFS_Error_BitmapFailedOpen,
+    NTFS_Error_BitmapFailedRead,
+
+    // Scan related errors
+    NTFS_Error_ScanFailedOpenMft,
+    NTFS_Error_ScanFailedRead,
+
+    // Hash related errors
+    NTFS_Error_HashFailedInit,
+    NTFS_Error_HashUnsupportedData,
+
+    // Recovery related errors
+    NTFS_Error_CarveFailedRead,
+
+    // Stream related errors
+    NTFS_Error_StreamNotFound,
+
+    // Disk related errors
+    NTFS_Error_DiskOpen,
+    NTFS_Error_DiskReadPartitionTable,
+
+    // Container related errors
+    NTFS_Error_ContainerInvalid,
+    NTFS_Error_ContainerUnsupported,
+
+    // Timeline related errors
+    NTFS_Error_TimelineFailedWrite,
+    NTFS_Error_TimelineFailedSpill,
+
+    // Path export related errors
+    NTFS_Error_PathFailedWrite,
+    NTFS_Error_PathFailedSpill,
+
+    // Index related errors
+    NTFS_Error_IndexFailedValidation,
+
+    // Security related errors
+    NTFS_Error_SecurityFailedLoad,
+
+    // Reparse related errors
+    NTFS_Error_ReparseInvalid,
+    NTFS_Error_ReparseUnsupported,
+    NTFS_Error_ReparseLoop,
+    NTFS_Error_PathNotFound,
+
+    // WOF related errors
+    NTFS_Error_WofInvalid,
+    NTFS_Error_WofUnsupported,
+    NTFS_Error_WofFailedDecompress,
+
+    // Dupes related errors
+    NTFS_Error_DupesTooManyVolumes,
+
+    // Match related errors
+    NTFS_Error_MatchInvalidPattern,
+    NTFS_Error_MatchFailedRead,
+
+    // Diff related errors
+    NTFS_Error_DiffMismatchedRecordSize,
 } ntfs_error;
 
-static inline char *NTFS_ErrorToString(ntfs_error Error)
+static inline const char *NTFS_ErrorToString(ntfs_error Error)
 {
     switch (Error) {
     case NTFS_Error_Success:                   return "ntfs success";
@@ -117,18 +204,136 @@ static inline char *NTFS_ErrorToString(ntfs_error Error)
     case NTFS_Error_VolumeFailedLoadCaseTable: return "ntfs failed volume load case table";
     case NTFS_Error_RecordFailedRead:          return "ntfs failed reading mft file record";
     case NTFS_Error_RecordFailedValidation:    return "ntfs failed file record validation";
+    case NTFS_Error_RecordFixupMismatch:       return "ntfs failed file record update sequence mismatch";
+    case NTFS_Error_RecordBadAttribute:        return "ntfs failed file record attribute validation";
+    case NTFS_Error_RecordBadRunList:          return "ntfs failed file record data runs validation";
+    case NTFS_Error_RecordOutOfBounds:         return "ntfs failed file record index is outside of mft";
+    case NTFS_Error_RecordBadAttributeList:    return "ntfs failed reading file record attribute list";
     case NTFS_Error_FileFailedInfoValidation:  return "ntfs failed file validation extra info";
     case NTFS_Error_FileReadDataAttrNotFound:  return "ntfs failed file unnamed data attribute was not found";
     case NTFS_Error_FileReadFailed:            return "ntfs failed file read";
+    case NTFS_Error_BitmapFailedOpen:          return "ntfs failed opening volume bitmap file";
+    case NTFS_Error_BitmapFailedRead:          return "ntfs failed reading volume bitmap";
+    case NTFS_Error_ScanFailedOpenMft:         return "ntfs failed opening mft for scan";
+    case NTFS_Error_ScanFailedRead:            return "ntfs failed reading mft during scan";
+    case NTFS_Error_HashFailedInit:            return "ntfs failed initializing hash providers";
+    case NTFS_Error_HashUnsupportedData:       return "ntfs failed hashing compressed, encrypted or listed data";
+    case NTFS_Error_CarveFailedRead:           return "ntfs failed reading unallocated clusters";
+    case NTFS_Error_StreamNotFound:            return "ntfs failed stream was not found";
+    case NTFS_Error_DiskOpen:                  return "ntfs failed opening handle to disk";
+    case NTFS_Error_DiskReadPartitionTable:    return "ntfs failed reading disk partition table";
+    case NTFS_Error_ContainerInvalid:          return "ntfs failed parsing virtual disk container";
+    case NTFS_Error_ContainerUnsupported:      return "ntfs failed unsupported virtual disk container";
+    case NTFS_Error_TimelineFailedWrite:       return "ntfs failed writing timeline";
+    case NTFS_Error_TimelineFailedSpill:       return "ntfs failed spilling timeline to temporary file";
+    case NTFS_Error_PathFailedWrite:           return "ntfs failed writing path export";
+    case NTFS_Error_PathFailedSpill:           return "ntfs failed spilling paths to temporary file";
+    case NTFS_Error_IndexFailedValidation:     return "ntfs failed index validation";
+    case NTFS_Error_SecurityFailedLoad:        return "ntfs failed loading security descriptors";
+    case NTFS_Error_ReparseInvalid:            return "ntfs failed reparse point validation";
+    case NTFS_Error_ReparseUnsupported:        return "ntfs failed reparse point target is not on the volume";
+    case NTFS_Error_ReparseLoop:               return "ntfs failed reparse points form a loop";
+    case NTFS_Error_PathNotFound:              return "ntfs failed path was not found";
+    case NTFS_Error_WofInvalid:                return "ntfs failed WOF compressed file validation";
+    case NTFS_Error_WofUnsupported:            return "ntfs failed WOF data is not stored in the file";
+    case NTFS_Error_WofFailedDecompress:       return "ntfs failed decompressing WOF chunk";
+    case NTFS_Error_DupesTooManyVolumes:       return "ntfs failed too many volumes to search for duplicates";
+    case NTFS_Error_MatchInvalidPattern:       return "ntfs failed match pattern is empty or too long";
+    case NTFS_Error_MatchFailedRead:           return "ntfs failed reading clusters for matching";
+    case NTFS_Error_DiffMismatchedRecordSize:  return "ntfs failed diff of volumes with different record sizes";
     }
 
     return "";
 }
 
+// Container API
+typedef enum {
+    NTFS_Container_Raw,
+    NTFS_Container_Vhd,
+    NTFS_Container_Vhdx,
+} ntfs_container_type;
+
+typedef struct {
+    ntfs_error          Error;
+    ntfs_container_type Type;
+    uint64_t            VirtualSize;
+
+    // File offset of every block payload, zero when the block is not
+    // allocated and reads back as zeros
+    uint64_t  BlockSize;
+    uint64_t  BlockCount;
+    uint64_t *BlockTable;
+} ntfs_container;
+
+#define NTFS_VHD_COOKIE              0x78697463656E6F63
+#define NTFS_VHD_DYNAMIC_COOKIE      0x6573726170737863
+#define NTFS_VHD_TYPE_FIXED          2
+#define NTFS_VHD_TYPE_DYNAMIC        3
+#define NTFS_VHD_UNUSED_BLOCK        0xFFFFFFFF
+#define NTFS_VHDX_SIGNATURE          0x656C696678646876
+#define NTFS_VHDX_REGION_SIGNATURE   0x69676572
+#define NTFS_VHDX_METADATA_SIGNATURE 0x617461646174656D
+#define NTFS_VHDX_REGION_TABLE       NTFS__ARENA_KILOBYTE(192)
+#define NTFS_VHDX_TABLE_SIZE         NTFS__ARENA_KILOBYTE(64)
+#define NTFS_VHDX_FULLY_PRESENT      6
+#define NTFS_VHDX_HAS_PARENT         0x02
+
+NTFS_API ntfs_container NTFS__ContainerOpen(void *Handle);
+NTFS_API void           NTFS__ContainerClose(ntfs_container *Container);
+NTFS_API bool           NTFS__ContainerRead(ntfs_container *Container, void *Handle,
+                                            uint64_t Offset, void *Buffer, size_t Size);
+
+// Direct I/O API
+// Aligned bounce buffers shared by every thread reading a volume directly
+typedef struct ntfs__direct_pool ntfs__direct_pool;
+
+#define NTFS_DIRECT_ALIGNMENT    4096
+#define NTFS_DIRECT_MIN_SIZE     NTFS__ARENA_KILOBYTE(64)
+#define NTFS_DIRECT_BUFFER_SIZE  NTFS__ARENA_MEGABYTE(1)
+#define NTFS_DIRECT_BUFFER_COUNT 8
+
+NTFS_API ntfs__direct_pool *NTFS__DirectPoolCreate(void);
+NTFS_API bool               NTFS__DirectRead(ntfs__direct_pool *Pool, void *Handle,
+                                             uint64_t Offset, void *Buffer, size_t Size);
+NTFS_API bool               NTFS__ContainerReadDirect(ntfs_container *Container, void *Handle,
+                                                      ntfs__direct_pool *Pool, uint64_t Offset,
+                                                      void *Buffer, size_t Size);
+
 // Volume API
+typedef enum {
+    NTFS_ParsePolicy_Strict,
+    NTFS_ParsePolicy_Tolerant,
+} ntfs_parse_policy;
+
 typedef struct {
-    ntfs_error Error;
-    void      *Handle;
+    uint64_t   RecordIndex;
+    uint32_t   Offset;
+    ntfs_error Reason;
+} ntfs_parse_report;
+
+// Called concurrently when the volume is shared between threads
+typedef void ntfs_parse_report_callback(void *Context, ntfs_parse_report *Report);
+
+typedef struct ntfs_data_run ntfs_data_run;
+
+// Never written after open, so one volume can be read from any number of
+// threads. Every read is positional, the parse policy has to be set before
+// the volume is shared, and each thread should read through its own
+// context so the reads do not queue on a single handle
+typedef struct ntfs_volume ntfs_volume;
+
+struct ntfs_volume {
+    ntfs_error     Error;
+    void          *Handle;
+    ntfs_container Container;
+
+    // Volume a context was created from, zero for the volume itself
+    ntfs_volume *Shared;
+
+    // With direct I/O on, reads of at least NTFS_DIRECT_MIN_SIZE skip the
+    // OS cache through a second handle, metadata keeps the cached one
+    void              *DirectHandle;
+    ntfs__direct_pool *DirectPool;
 
     uint64_t StartOffset;
     uint64_t SectorsPerCluster;
@@ -137,12 +342,27 @@ typedef struct {
     uint64_t BytesPerCluster;
     uint64_t BytesPerMftEntry;
     uint64_t SerialNumber;
+    uint64_t TotalClusters;
 
     uint16_t  Name[128];
     uint16_t *CaseTable;
-} ntfs_volume;
+
+    // Location of the $MFT data, records are mapped through it
+    ntfs_data_run *MftRunList;
+    size_t         MftRunCount;
+    uint64_t       MftRecordCount;
+
+    // Strict fails corrupt records, tolerant keeps what was parsed before
+    // the corruption and reports each record once, up to the report limit
+    ntfs_parse_policy           ParsePolicy;
+    ntfs_parse_report_callback *ParseReport;
+    void                       *ParseReportContext;
+    uint64_t                    ParseReportLimit;
+    volatile int64_t            ParseReportCount;
+};
 
 #define NTFS_BOOT_RECORD_SIZE                512
+#define NTFS_MAX_SECTOR_SIZE                 4096
 #define NTFS_BOOT_RECORD_SIGNATURE           0xAA55
 #define NTFS_BOOT_RECORD_PARTITION_OFFSET    0x01BE
 #define NTFS_BOOT_RECORD_PARITION_ENTRY_SIZE 0x10
@@ -152,9 +372,57 @@ NTFS_API ntfs_volume NTFS_VolumeOpenFromFile(wchar_t *Path);
 NTFS_API void        NTFS_VolumeClose(ntfs_volume *Volume);
 NTFS_API bool        NTFS_VolumeRead(ntfs_volume *Volume, uint64_t From,
                                      void *Buffer, size_t Size);
+NTFS_API void        NTFS_VolumeSetParsePolicy(ntfs_volume *Volume, ntfs_parse_policy Policy,
+                                               ntfs_parse_report_callback *Callback,
+                                               void *Context, uint64_t ReportLimit);
+NTFS_API bool        NTFS_VolumeSetDirectIo(ntfs_volume *Volume, bool IsEnabled);
 
-NTFS_API ntfs_volume NTFS__VolumeLoad(void *VolumeHandle, size_t VbrOffset);
+NTFS_API ntfs_volume NTFS__VolumeLoad(void *VolumeHandle, ntfs_container Container,
+                                      size_t VbrOffset);
 NTFS_API void        NTFS__VolumeLoadInformation(ntfs_volume *Volume);
+NTFS_API void        NTFS__VolumeLoadMftRuns(ntfs_volume *Volume);
+
+// Disk API
+typedef struct {
+    uint32_t Number;
+    uint64_t Offset;
+    uint64_t Size;
+    uint8_t  Type;
+    uint8_t  TypeGuid[16];
+    bool     IsNtfs;
+} ntfs_partition;
+
+typedef struct {
+    ntfs_error     Error;
+    void          *Handle;
+    ntfs_container Container;
+    ntfs_arena     Arena;
+
+    wchar_t        *Path;
+    ntfs_partition *Partitions;
+} ntfs_disk;
+
+typedef void ntfs_volume_callback(void *Context, ntfs_partition *Partition,
+                                  ntfs_volume *Volume);
+
+#define NTFS_GPT_SIGNATURE            0x5452415020494645
+#define NTFS_GPT_MAX_ENTRIES          1024
+#define NTFS_GPT_MAX_ENTRY_SIZE       4096
+#define NTFS_BOOT_RECORD_OEM_ID       0x202020205346544E
+#define NTFS_PARTITION_TYPE_GPT       0xEE
+#define NTFS_PARTITION_MAX_LOGICAL    128
+
+NTFS_API ntfs_disk NTFS_DiskOpen(wchar_t *Path);
+NTFS_API void      NTFS_DiskClose(ntfs_disk *Disk);
+NTFS_API size_t    NTFS_DiskOpenVolumes(ntfs_disk *Disk, ntfs_volume *Volumes, size_t Count);
+NTFS_API void      NTFS_DiskProcessVolumes(ntfs_disk *Disk, ntfs_volume_callback *Callback,
+                                           void *Context);
+
+NTFS_API ntfs_error NTFS__DiskDiscover(void *Handle, ntfs_container *Container,
+                                       ntfs_arena *Arena, ntfs_partition **Partitions);
+NTFS_API void       NTFS__DiskAddPartition(void *Handle, ntfs_container *Container,
+                                           ntfs_arena *Arena, ntfs_partition **Partitions,
+                                           ntfs_partition Partition);
 
 enum {
     NTFS_SystemFile_Mft        =  0,
@@ -196,7 +464,7 @@ typedef enum {
     NTFS_AttributeType_LoggedUtilityStream = 0x100,
 } ntfs_attr_type;
 
-static inline char *NTFS_AttrTypeToString(ntfs_attr_type Type)
+static inline const char *NTFS_AttrTypeToString(ntfs_attr_type Type)
 {
     switch (Type) {
         case NTFS_AttributeType_StandardInformation: return "Standard Information";
@@ -236,10 +504,11 @@ enum {
     NTFS_FileFlags_Encrypted         = 0x4000,
 };
 
-typedef struct {
+struct ntfs_data_run {
     uint64_t StartVCN;
     uint64_t Count;
-} ntfs_data_run;
+    bool     IsSparse;
+};
 
 typedef struct {
     ntfs_attr_type Type;
@@ -255,6 +524,7 @@ typedef struct {
     } Resident;
 
     struct {
+        uint64_t FirstVCN;
         uint64_t Size;
         uint64_t AlignedSize;
         ntfs_data_run *RunList;
@@ -265,11 +535,35 @@ typedef struct {
     ntfs_error Error;
 
     uint64_t  Index;
+    uint64_t  BaseIndex;
     uint8_t   *Buffer;
     ntfs_attr *AttrList;
     bool      IsDir;
+    bool      IsInUse;
+
+    // Corruption tolerated by NTFS_ParsePolicy_Tolerant, with the offset
+    // inside the record where parsing stopped
+    ntfs_error Issue;
+    uint32_t   IssueOffset;
 } ntfs_record;
 
+typedef enum {
+    NTFS_NameSpace_Posix      = 0,
+    NTFS_NameSpace_Win32      = 1,
+    NTFS_NameSpace_Dos        = 2,
+    NTFS_NameSpace_Win32AndDos = 3,
+} ntfs_name_space;
+
+typedef struct {
+    uint64_t  ParentIndex;
+    uint16_t  ParentSequence;
+    uint8_t   NameSpace;
+    uint8_t   NameLength;
+    uint16_t *Name;
+} ntfs_file_name;
+
+typedef struct ntfs_wof ntfs_wof;
+
 typedef struct {
     ntfs_error   Error;
     ntfs_arena   Arena;
@@ -301,25 +595,900 @@ typedef struct {
 
         uint32_t Value;
     } Flags;
+    uint32_t  SecurityId;
     uint64_t  ParentIndex;
     uint64_t  AlignedSize;
     uint64_t  Size;
-    uint16_t *Name;
+
+    // Preferred name, Win32 over POSIX over the DOS 8.3 alias, and every
+    // hard link of the base record
+    uint16_t       *Name;
+    uint8_t         NameSpace;
+    ntfs_file_name *Names;
+
+    // Chunk table of WOF compressed files, loaded by the first read
+    ntfs_wof *Wof;
 } ntfs_file;
 
 #define NTFS_FILE_RECORD_MAGIC           0x454C4946
 #define NTFS_FILE_RECORD_ATTR_END_MARKER 0xFFFFFFFF
+#define NTFS_FILE_RECORD_FIXUP_STRIDE    512
 
 NTFS_API ntfs_file NTFS_FileOpenFromIndex(ntfs_volume *Volume, size_t Index);
 NTFS_API void      NTFS_FileClose(ntfs_file *File);
 NTFS_API size_t    NTFS_FileRead(ntfs_file *File, uint64_t Offset,
                                  uint8_t *Buffer, size_t Size);
 
+NTFS_API ntfs_attr *NTFS_FileFindAttr(ntfs_file *File, ntfs_attr_type Type,
+                                      uint16_t *Name, size_t NameLength);
+NTFS_API size_t     NTFS_FileReadAttr(ntfs_file *File, ntfs_attr *Attr, uint64_t Offset,
+                                      uint8_t *Buffer, size_t Size);
+
 NTFS_API ntfs_record    NTFS__RecordLoadFromIndex(ntfs_volume *Volume,
                                                   ntfs_arena *Arena,
                                                   size_t Index);
-NTFS_API ntfs_data_run *NTFS__DataRunsLoad(ntfs_arena *Arena,
-                                           void *Buffer, size_t Size);
+NTFS_API ntfs_error     NTFS__RecordLoadExtensions(ntfs_volume *Volume, ntfs_arena *Arena,
+                                                   ntfs_record *Record);
+NTFS_API ntfs_record    NTFS__RecordParse(ntfs_volume *Volume, ntfs_arena *Arena,
+                                          uint8_t *FileRecord, size_t Index);
+NTFS_API ntfs_record    NTFS__RecordParseEx(ntfs_volume *Volume, ntfs_arena *Arena,
+                                            uint8_t *FileRecord, size_t Index,
+                                            bool IncludeFree);
+NTFS_API ntfs_record    NTFS__RecordParseHeader(ntfs_volume *Volume, uint8_t *FileRecord,
+                                                size_t Index, bool IncludeFree);
+NTFS_API ntfs_error     NTFS__RecordApplyFixups(uint8_t *FileRecord, size_t Size);
+NTFS_API bool           NTFS__RecordReport(ntfs_volume *Volume, ntfs_record *Record,
+                                           ntfs_error Reason, uint32_t Offset);
+NTFS_API ntfs_data_run *NTFS__DataRunsLoad(ntfs_arena *Arena, void *Buffer, size_t Size,
+                                           ntfs_error *Error);
+NTFS_API bool           NTFS__NameEquals(ntfs_volume *Volume,
+                                         uint16_t *Name, size_t NameLength,
+                                         uint16_t *Other, size_t OtherLength);
+NTFS_API int            NTFS__NameCompare(ntfs_volume *Volume,
+                                          uint16_t *Name, size_t NameLength,
+                                          uint16_t *Other, size_t OtherLength);
+NTFS_API bool           NTFS__FileNameParse(ntfs_attr *Attr, ntfs_file_name *FileName);
+NTFS_API size_t         NTFS__DataRunsRead(ntfs_volume *Volume, ntfs_data_run *RunList,
+                                           uint64_t Offset, uint8_t *Buffer, size_t Size,
+                                           ntfs_error *Error);
+
+// Attribute cursor API
+typedef struct {
+    ntfs_error   Error;
+    uint32_t     ErrorOffset;
+    ntfs_volume *Volume;
+    uint8_t     *RecordPtr;
+    uint8_t     *AttrPtr;
+    uint8_t     *AttrEndPtr;
+
+    // Mapping pairs of the last non resident attribute returned,
+    // decoded only when asked for
+    uint8_t *RunsPtr;
+    size_t   RunsSize;
+    uint64_t RunsVCNCount;
+} ntfs_attr_cursor;
+
+NTFS_API ntfs_attr_cursor NTFS_AttrCursorBegin(ntfs_volume *Volume, ntfs_record *Record);
+NTFS_API bool             NTFS_AttrCursorNext(ntfs_attr_cursor *Cursor, ntfs_attr_type Type,
+                                              ntfs_attr *Attr);
+NTFS_API bool             NTFS_AttrCursorFind(ntfs_attr_cursor *Cursor, ntfs_attr_type Type,
+                                              uint16_t *Name, size_t NameLength,
+                                              ntfs_attr *Attr);
+NTFS_API ntfs_data_run   *NTFS_AttrCursorRuns(ntfs_attr_cursor *Cursor, ntfs_arena *Arena);
+
+// Bitmap API
+typedef struct {
+    uint64_t StartLCN;
+    uint64_t Count;
+} ntfs_extent;
+
+typedef struct {
+    ntfs_error Error;
+    ntfs_file  File;
+
+    uint64_t TotalClusters;
+    uint64_t Cursor;
+
+    // Only a single window of the bitmap is kept in memory at a time
+    uint8_t *Window;
+    size_t   WindowSize;
+    uint64_t WindowLCN;
+    uint64_t WindowClusters;
+} ntfs_bitmap;
+
+#define NTFS_BITMAP_WINDOW_SIZE NTFS__ARENA_MEGABYTE(1)
+
+NTFS_API ntfs_bitmap NTFS_BitmapOpen(ntfs_volume *Volume);
+NTFS_API void        NTFS_BitmapClose(ntfs_bitmap *Bitmap);
+NTFS_API bool        NTFS_BitmapIsAllocated(ntfs_bitmap *Bitmap, uint64_t LCN);
+NTFS_API uint64_t    NTFS_BitmapFreeClusters(ntfs_bitmap *Bitmap);
+NTFS_API uint64_t    NTFS_BitmapRangeFree(ntfs_bitmap *Bitmap, uint64_t LCN, uint64_t Count);
+NTFS_API size_t      NTFS_BitmapLargestFree(ntfs_bitmap *Bitmap,
+                                            ntfs_extent *Extents, size_t Count);
+NTFS_API void        NTFS_BitmapRewind(ntfs_bitmap *Bitmap, uint64_t LCN);
+NTFS_API bool        NTFS_BitmapNextExtent(ntfs_bitmap *Bitmap, bool Allocated,
+                                           ntfs_extent *Extent);
+
+NTFS_API bool     NTFS__BitmapLoadWindow(ntfs_bitmap *Bitmap, uint64_t LCN);
+NTFS_API uint64_t NTFS__BitmapFind(ntfs_bitmap *Bitmap, uint64_t LCN, bool Allocated);
+
+// MFT scan API
+typedef struct {
+    ntfs_error   Error;
+    ntfs_volume *Volume;
+    ntfs_file    Mft;
+    ntfs_arena   Arena;
+
+    uint64_t RecordCount;
+    uint64_t NextIndex;
+    bool     IncludeFree;
+
+    // Skips building the attribute list, use the attribute cursor instead
+    bool     HeadersOnly;
+
+    // Records are read in large chunks following the $MFT data runs
+    uint8_t *Buffer;
+    size_t   BufferSize;
+    uint64_t BufferIndex;
+    uint64_t BufferCount;
+} ntfs_mft_scan;
+
+#define NTFS_MFT_SCAN_BUFFER_SIZE NTFS__ARENA_MEGABYTE(4)
+
+NTFS_API ntfs_mft_scan NTFS_MftScanBegin(ntfs_volume *Volume);
+NTFS_API bool          NTFS_MftScanNext(ntfs_mft_scan *Scan, ntfs_record *Record);
+NTFS_API void          NTFS_MftScanEnd(ntfs_mft_scan *Scan);
+
+NTFS_API uint8_t *NTFS__MftScanRecordBuffer(ntfs_mft_scan *Scan, uint64_t Index);
+
+// Cluster owner API
+typedef struct {
+    uint64_t StartLCN;
+    uint64_t Count;
+    uint64_t MaxEndLCN;
+    uint64_t VCN;
+    uint64_t RecordIndex;
+    ntfs_attr_type Type;
+    uint16_t       AttrId;
+} ntfs_owner_extent;
+
+typedef struct {
+    uint64_t Attributes;
+    uint64_t FragmentedAttributes;
+    uint64_t Extents;
+    uint64_t AllocatedClusters;
+    uint64_t MaxFragments;
+    uint64_t MaxFragmentsIndex;
+} ntfs_fragmentation;
+
+typedef struct {
+    ntfs_error Error;
+    ntfs_arena Arena;
+
+    // Sorted by StartLCN and searched as an implicit balanced tree, the
+    // middle of every range being its root. MaxEndLCN is the largest extent
+    // end under each root, so one long extent only prunes its own subtree
+    ntfs_owner_extent *Extents;
+    ntfs_fragmentation Fragmentation;
+} ntfs_owner_map;
+
+#define NTFS_OWNER_MAP_RESERVED NTFS__ARENA_GIGABYTE(64)
+
+NTFS_API ntfs_owner_map     NTFS_OwnerMapBuild(ntfs_volume *Volume);
+NTFS_API void               NTFS_OwnerMapDestroy(ntfs_owner_map *Map);
+NTFS_API ntfs_owner_extent *NTFS_OwnerMapFind(ntfs_owner_map *Map, uint64_t LCN);
+NTFS_API size_t             NTFS_OwnerMapQuery(ntfs_owner_map *Map, uint64_t LCN,
+                                               uint64_t Count, ntfs_owner_extent *Results,
+                                               size_t MaxResults);
+
+NTFS_API void NTFS__RadixSort(void *Items, void *Scratch, size_t Count,
+                              size_t ItemSize, size_t KeyOffset);
+
+// Hash API
+enum {
+    NTFS_HashAlgorithm_Md5    = 0x01,
+    NTFS_HashAlgorithm_Sha1   = 0x02,
+    NTFS_HashAlgorithm_Sha256 = 0x04,
+};
+
+typedef struct {
+    ntfs_error Error;
+    uint64_t   RecordIndex;
+    uint64_t   Size;
+
+    uint8_t Md5[16];
+    uint8_t Sha1[20];
+    uint8_t Sha256[32];
+} ntfs_hash_result;
+
+// Called concurrently from the hashing threads
+typedef void ntfs_hash_callback(void *Context, ntfs_hash_result *Result);
+
+typedef struct {
+    uint32_t Algorithms;
+    uint32_t ReaderThreads;
+    uint32_t HashThreads;
+    size_t   BufferSize;
+    size_t   BufferCount;
+
+    ntfs_hash_callback *Callback;
+    void               *Context;
+} ntfs_hash_options;
+
+typedef struct {
+    ntfs_error Error;
+    uint64_t   Files;
+    uint64_t   ResidentFiles;
+    uint64_t   FailedFiles;
+    uint64_t   BytesRead;
+} ntfs_hash_summary;
+
+#define NTFS_HASH_ALGORITHM_COUNT   3
+#define NTFS_HASH_DEFAULT_READERS   2
+#define NTFS_HASH_DEFAULT_BUFFER    NTFS__ARENA_MEGABYTE(8)
+#define NTFS_HASH_RESERVED          NTFS__ARENA_GIGABYTE(64)
+
+NTFS_API ntfs_hash_summary NTFS_HashVolume(ntfs_volume *Volume, ntfs_hash_options *Options);
+
+// Recovery API
+typedef struct {
+    ntfs_attr_type Type;
+    uint64_t       VCN;
+    uint64_t       LCN;
+    uint64_t       Count;
+    uint64_t       FreeCount;
+} ntfs_deleted_run;
+
+typedef struct {
+    ntfs_record *Record;
+    uint64_t     ParentIndex;
+    uint16_t    *Name;
+    uint8_t      NameLength;
+    uint64_t     Size;
+
+    // Clusters referenced by the record runs and how many are still free
+    uint64_t Clusters;
+    uint64_t FreeClusters;
+
+    // Non sparse runs of every non resident attribute, a run can be read
+    // back safely when all of its clusters are still free
+    ntfs_deleted_run *Runs;
+} ntfs_deleted_file;
+
+typedef struct {
+    uint64_t LCN;
+    uint64_t Offset;
+    uint32_t Signature;
+    uint8_t *Data;
+    size_t   Size;
+} ntfs_carve_hit;
+
+typedef void ntfs_deleted_callback(void *Context, ntfs_deleted_file *File);
+typedef void ntfs_carve_callback(void *Context, ntfs_carve_hit *Hit);
+
+typedef struct {
+    ntfs_error Error;
+    uint64_t   Records;
+    uint64_t   Recoverable;
+} ntfs_recover_summary;
+
+typedef struct {
+    ntfs_error Error;
+    uint64_t   BytesScanned;
+    uint64_t   FileHits;
+    uint64_t   IndexHits;
+} ntfs_carve_summary;
+
+#define NTFS_INDEX_RECORD_MAGIC     0x58444E49
+#define NTFS_CARVE_BUFFER_SIZE      NTFS__ARENA_MEGABYTE(8)
+#define NTFS_CARVE_GAP_SIZE         NTFS__ARENA_KILOBYTE(256)
+
+NTFS_API ntfs_recover_summary NTFS_RecoverDeleted(ntfs_volume *Volume,
+                                                  ntfs_deleted_callback *Callback,
+                                                  void *Context);
+NTFS_API ntfs_carve_summary   NTFS_CarveUnallocated(ntfs_volume *Volume,
+                                                    ntfs_carve_callback *Callback,
+                                                    void *Context);
+
+// Stream API
+typedef struct {
+    uint64_t   RecordIndex;
+    ntfs_attr *Attr;
+    uint64_t   Size;
+} ntfs_stream;
+
+typedef void ntfs_stream_callback(void *Context, ntfs_stream *Stream);
+
+NTFS_API bool       NTFS_FileNextStream(ntfs_file *File, size_t *Cursor, ntfs_stream *Stream);
+NTFS_API size_t     NTFS_FileReadStream(ntfs_file *File, uint16_t *Name, size_t NameLength,
+                                        uint64_t Offset, uint8_t *Buffer, size_t Size);
+NTFS_API ntfs_error NTFS_StreamScan(ntfs_volume *Volume, ntfs_stream_callback *Callback,
+                                    void *Context);
+
+// Timeline API
+enum {
+    NTFS_Macb_Modified = 0x01,
+    NTFS_Macb_Accessed = 0x02,
+    NTFS_Macb_Changed  = 0x04,
+    NTFS_Macb_Born     = 0x08,
+};
+
+enum {
+    NTFS_TimelineFlag_Dir     = 0x01,
+    NTFS_TimelineFlag_Deleted = 0x02,
+};
+
+typedef enum {
+    NTFS_TimelineSource_StandardInformation,
+    NTFS_TimelineSource_FileName,
+} ntfs_timeline_source;
+
+// One entry per distinct timestamp of an attribute, Macb has a bit for
+// every timestamp sharing that time. Layout is also the binary format
+typedef struct {
+    uint64_t Time;
+    uint64_t RecordIndex;
+    uint64_t ParentIndex;
+    uint32_t NameOffset;
+    uint8_t  NameLength;
+    uint8_t  Macb;
+    uint8_t  Source;
+    uint8_t  Flags;
+} ntfs_timeline_entry;
+
+typedef struct {
+    ntfs_error Error;
+    ntfs_arena Arena;
+    ntfs_arena NameArena;
+
+    ntfs_timeline_entry *Entries;
+    uint16_t            *Names;
+} ntfs_timeline;
+
+typedef enum {
+    NTFS_TimelineFormat_Csv,
+    NTFS_TimelineFormat_Binary,
+} ntfs_timeline_format;
+
+#define NTFS_TIMELINE_RESERVED     NTFS__ARENA_GIGABYTE(64)
+#define NTFS_TIMELINE_MAGIC        0x31304C545346544E
+#define NTFS_TIMELINE_WRITE_BUFFER NTFS__ARENA_MEGABYTE(4)
+#define NTFS_TIMELINE_MIN_BUDGET   NTFS__ARENA_MEGABYTE(16)
+#define NTFS_TIMELINE_RUN_BUFFER   NTFS__ARENA_KILOBYTE(64)
+#define NTFS_TIMELINE_CSV_HEADER   "Time,MACB,Source,Record,Parent,Type,Deleted,Name\r\n"
+#define NTFS_ISO8601_MAX_SIZE      30
+
+NTFS_API ntfs_timeline NTFS_TimelineBuild(ntfs_volume *Volume, bool IncludeFree);
+NTFS_API void          NTFS_TimelineDestroy(ntfs_timeline *Timeline);
+NTFS_API ntfs_error    NTFS_TimelineWriteBinary(ntfs_timeline *Timeline, wchar_t *Path);
+NTFS_API ntfs_error    NTFS_TimelineWriteCsv(ntfs_timeline *Timeline, wchar_t *Path);
+NTFS_API ntfs_error    NTFS_TimelineExport(ntfs_volume *Volume, bool IncludeFree,
+                                           size_t MemoryBudget, ntfs_timeline_format Format,
+                                           wchar_t *Path);
+NTFS_API size_t        NTFS_FileTimeToIso8601(uint64_t FileTime, char *Buffer);
+
+NTFS_API void   NTFS__RadixSortParallel(void *Items, void *Scratch, size_t Count,
+                                        size_t ItemSize, size_t KeyOffset,
+                                        uint32_t ThreadCount);
+NTFS_API size_t NTFS__Utf16ToUtf8(uint16_t *String, size_t Length, char *Buffer);
+
+// Path index API
+typedef struct {
+    uint64_t  SortKey;
+    uint64_t  RecordIndex;
+    uint64_t  ParentIndex;
+    uint16_t  ParentSequence;
+    uint8_t   NameSpace;
+    uint8_t   NameLength;
+    uint32_t  NameOffset;
+    uint16_t *Name;
+} ntfs_link;
+
+// Links are grouped by record, the preferred name of a record first
+typedef struct {
+    ntfs_error Error;
+    ntfs_arena Arena;
+    ntfs_arena NameArena;
+
+    ntfs_link *Links;
+    uint16_t  *Names;
+    uint64_t  *FirstLink;
+    uint16_t  *Sequences;
+    uint64_t   RecordCount;
+} ntfs_path_index;
+
+#define NTFS_PATH_INDEX_RESERVED    NTFS__ARENA_GIGABYTE(64)
+#define NTFS_PATH_MAX_DEPTH         1024
+#define NTFS_PATH_EXPORT_MIN_BUDGET NTFS__ARENA_MEGABYTE(16)
+#define NTFS_PATH_EXPORT_MAX_LENGTH 32767
+#define NTFS_PATH_RUN_BUFFER        NTFS__ARENA_KILOBYTE(128)
+#define NTFS_PATH_CSV_HEADER        "Record,Parent,Path\r\n"
+
+NTFS_API ntfs_path_index NTFS_PathIndexBuild(ntfs_volume *Volume);
+NTFS_API void            NTFS_PathIndexDestroy(ntfs_path_index *Index);
+NTFS_API size_t          NTFS_PathIndexLinks(ntfs_path_index *Index, uint64_t RecordIndex,
+                                             ntfs_link **Links);
+NTFS_API size_t          NTFS_PathIndexGetPath(ntfs_path_index *Index, ntfs_link *Link,
+                                               uint16_t *Buffer, size_t Size);
+NTFS_API ntfs_error      NTFS_PathExport(ntfs_volume *Volume, size_t MemoryBudget,
+                                         wchar_t *Path);
+
+// Index API
+typedef struct {
+    uint8_t *Entry;
+    uint16_t Length;
+    uint16_t Flags;
+    uint8_t *Key;
+    uint16_t KeyLength;
+} ntfs_index_entry;
+
+// Returning false stops the walk
+typedef bool ntfs_index_callback(void *Context, ntfs_index_entry *Entry);
+
+// Negative when the searched key collates before the entry, zero on a match
+typedef int ntfs_index_compare(void *Context, ntfs_index_entry *Entry);
+
+#define NTFS_INDEX_ENTRY_NODE 0x01
+#define NTFS_INDEX_ENTRY_LAST 0x02
+#define NTFS_INDEX_READ_SIZE  NTFS__ARENA_MEGABYTE(1)
+#define NTFS_INDEX_MAX_DEPTH  32
+
+// Entries come from the root first and then from every in use
+// allocation block in on disk order, not in collation order
+typedef struct {
+    ntfs_error Error;
+    ntfs_file *File;
+    ntfs_arena Arena;
+
+    uint8_t *Node;
+    uint32_t NodeOffset;
+    uint32_t NodeEnd;
+
+    ntfs_attr *Alloc;
+    uint32_t   BlockSize;
+    uint64_t   NextBlock;
+    uint8_t   *Bitmap;
+    uint64_t   BitmapSize;
+    uint8_t   *Buffer;
+    size_t     BufferSize;
+    uint64_t   BufferOffset;
+    size_t     ChunkSize;
+} ntfs_index_cursor;
+
+NTFS_API ntfs_index_cursor NTFS_IndexCursorBegin(ntfs_file *File, uint16_t *Name,
+                                                 size_t NameLength);
+NTFS_API bool              NTFS_IndexCursorNext(ntfs_index_cursor *Cursor,
+                                                ntfs_index_entry *Entry);
+NTFS_API void              NTFS_IndexCursorEnd(ntfs_index_cursor *Cursor);
+
+NTFS_API ntfs_error NTFS__IndexWalk(ntfs_file *File, uint16_t *Name, size_t NameLength,
+                                    ntfs_index_callback *Callback, void *Context);
+NTFS_API ntfs_error NTFS__IndexFind(ntfs_file *File, uint16_t *Name, size_t NameLength,
+                                    ntfs_index_compare *Compare, void *Context,
+                                    bool *IsFound);
+NTFS_API bool       NTFS__IndexCursorEnterNode(ntfs_index_cursor *Cursor, uint8_t *Node,
+                                               size_t Size);
+NTFS_API bool       NTFS__IndexCursorNextBlock(ntfs_index_cursor *Cursor);
+
+// Security API
+typedef struct {
+    uint32_t SecurityId;
+    uint32_t Hash;
+    uint16_t Control;
+    uint32_t Size;
+
+    // Self relative descriptor and its parts, null when not present
+    uint8_t *Data;
+    uint8_t *Owner;
+    uint8_t *Group;
+    uint8_t *Sacl;
+    uint8_t *Dacl;
+} ntfs_security_descriptor;
+
+typedef struct {
+    ntfs_error Error;
+    ntfs_arena Arena;
+
+    // Descriptors point into the in memory copy of $SDS, which already
+    // stores each distinct descriptor once. Slots is an open addressed
+    // table of descriptor index + 1 keyed by security ID
+    uint8_t                  *Stream;
+    uint64_t                  StreamSize;
+    ntfs_security_descriptor *Descriptors;
+    uint32_t                 *Slots;
+    uint32_t                  SlotMask;
+} ntfs_security_cache;
+
+#define NTFS_SECURITY_RESERVED    NTFS__ARENA_GIGABYTE(64)
+#define NTFS_SDS_HEADER_SIZE      0x14
+#define NTFS_SECURITY_HEADER_SIZE 0x14
+
+NTFS_API ntfs_security_cache       NTFS_SecurityCacheLoad(ntfs_volume *Volume);
+NTFS_API void                      NTFS_SecurityCacheDestroy(ntfs_security_cache *Cache);
+NTFS_API ntfs_security_descriptor *NTFS_SecurityCacheFind(ntfs_security_cache *Cache,
+                                                          uint32_t SecurityId);
+
+// Reparse API
+typedef struct {
+    ntfs_error Error;
+    uint32_t   Tag;
+
+    // Only junctions and symbolic links have a target, both names point
+    // into the file record, or into the file arena when the data is not
+    // resident
+    bool      IsRelative;
+    uint16_t *Target;
+    uint16_t  TargetLength;
+    uint16_t *PrintName;
+    uint16_t  PrintNameLength;
+} ntfs_reparse_point;
+
+typedef struct {
+    uint64_t   RecordIndex;
+    uint64_t   TargetIndex;
+    ntfs_error Error;
+    bool       IsResolving;
+} ntfs_reparse_memo;
+
+// Name is upcased and copied into the resolver arena
+typedef struct {
+    uint64_t  DirIndex;
+    uint64_t  RecordIndex;
+    uint16_t *Name;
+    uint32_t  NameLength;
+    uint32_t  Hash;
+} ntfs_reparse_lookup;
+
+// Remembers the final target of every link it resolved, including the
+// ones that failed, and every name it found in a directory, not safe to
+// share between threads
+typedef struct {
+    ntfs_error   Error;
+    ntfs_volume *Volume;
+    ntfs_arena   Arena;
+
+    ntfs_reparse_memo *Slots;
+    uint32_t           SlotMask;
+    uint32_t           Count;
+    uint64_t           Hits;
+    uint64_t           Misses;
+
+    ntfs_reparse_lookup *Lookups;
+    uint32_t             LookupMask;
+    uint32_t             LookupCount;
+    uint64_t             LookupHits;
+} ntfs_reparse_resolver;
+
+#define NTFS_REPARSE_TAG_MOUNT_POINT 0xA0000003
+#define NTFS_REPARSE_TAG_SYMLINK     0xA000000C
+#define NTFS_REPARSE_TAG_DEDUP       0x80000013
+#define NTFS_REPARSE_TAG_WOF         0x80000017
+#define NTFS_REPARSE_TAG_CLOUD       0x9000001A
+#define NTFS_REPARSE_MAX_DEPTH       63
+#define NTFS_REPARSE_MAX_SIZE        16384
+#define NTFS_REPARSE_SLOT_COUNT      256
+
+NTFS_API ntfs_reparse_point    NTFS_FileReparsePoint(ntfs_file *File);
+NTFS_API ntfs_reparse_resolver NTFS_ReparseResolverCreate(ntfs_volume *Volume);
+NTFS_API void                  NTFS_ReparseResolverDestroy(ntfs_reparse_resolver *Resolver);
+NTFS_API ntfs_error            NTFS_ReparseResolve(ntfs_reparse_resolver *Resolver,
+                                                   uint64_t RecordIndex, uint64_t *TargetIndex);
+NTFS_API ntfs_error            NTFS_PathLookup(ntfs_reparse_resolver *Resolver, uint16_t *Path,
+                                               size_t Length, bool FollowLast,
+                                               uint64_t *RecordIndex);
+
+NTFS_API ntfs_error NTFS__DirectoryFind(ntfs_file *Dir, uint16_t *Name, size_t NameLength,
+                                        uint64_t *RecordIndex);
+NTFS_API ntfs_error NTFS__DirectoryLookup(ntfs_volume *Volume, uint64_t DirIndex,
+                                          uint16_t *Name, size_t NameLength,
+                                          uint64_t *RecordIndex);
+
+// Context API
+// Per thread view of a shared volume, it borrows everything loaded at open
+// and only owns a handle of its own. Files opened through Context.Volume
+// keep their errors and buffers private to the thread
+typedef struct {
+    ntfs_error  Error;
+    ntfs_volume Volume;
+} ntfs_context;
+
+NTFS_API ntfs_context NTFS_ContextCreate(ntfs_volume *Volume);
+NTFS_API void         NTFS_ContextDestroy(ntfs_context *Context);
+
+// Reader API
+typedef struct ntfs__readahead ntfs__readahead;
+
+// Sequential reads of one attribute at any offset and size. The window
+// after the one being consumed is read in the background, it doubles on
+// every sequential step up to the max and halves on every seek
+typedef struct {
+    ntfs_error   Error;
+    ntfs_arena   Arena;
+    ntfs_volume *Volume;
+    ntfs_attr   *Attr;
+    uint64_t     Size;
+    uint64_t     Offset;
+
+    uint8_t *Window;
+    uint64_t WindowOffset;
+    size_t   WindowLength;
+    size_t   WindowSize;
+
+    ntfs__readahead *Readahead;
+} ntfs_reader;
+
+#define NTFS_READER_MIN_WINDOW NTFS__ARENA_KILOBYTE(64)
+#define NTFS_READER_MAX_WINDOW NTFS__ARENA_MEGABYTE(4)
+
+NTFS_API ntfs_reader NTFS_ReaderOpen(ntfs_file *File, ntfs_attr *Attr);
+NTFS_API void        NTFS_ReaderClose(ntfs_reader *Reader);
+NTFS_API size_t      NTFS_ReaderRead(ntfs_reader *Reader, uint8_t *Buffer, size_t Size);
+NTFS_API size_t      NTFS_ReaderNext(ntfs_reader *Reader, uint8_t **Data);
+NTFS_API void        NTFS_ReaderSeek(ntfs_reader *Reader, uint64_t Offset);
+
+// WOF API
+enum {
+    NTFS_WofAlgorithm_Xpress4K  = 0,
+    NTFS_WofAlgorithm_Lzx       = 1,
+    NTFS_WofAlgorithm_Xpress8K  = 2,
+    NTFS_WofAlgorithm_Xpress16K = 3,
+};
+
+// Files compressed by the Windows Overlay Filter keep a sparse unnamed
+// stream of the full size, the data is in independently compressed
+// chunks of the WofCompressedData stream behind a table of chunk ends
+struct ntfs_wof {
+    ntfs_error   Error;
+    ntfs_arena   Arena;
+    ntfs_volume *Volume;
+    ntfs_attr   *Stream;
+
+    uint32_t Algorithm;
+    uint32_t ChunkSize;
+    uint64_t Size;
+    uint64_t StreamSize;
+    uint64_t ChunkCount;
+
+    // Chunk 0 starts right after the table, every entry is the start of
+    // the next chunk relative to the end of the table
+    uint8_t *Table;
+    uint64_t TableSize;
+    uint32_t EntrySize;
+};
+
+#define NTFS_WOF_PROVIDER_FILE     2
+#define NTFS_WOF_LZX_CHUNK_SIZE    NTFS__ARENA_KILOBYTE(32)
+#define NTFS_WOF_BATCH_SIZE        NTFS__ARENA_KILOBYTE(256)
+#define NTFS_WOF_PARALLEL_MIN_SIZE NTFS__ARENA_MEGABYTE(1)
+
+// Any offset and size, reads of at least the parallel minimum decompress
+// their chunks on every processor
+NTFS_API ntfs_wof NTFS_WofOpen(ntfs_file *File);
+NTFS_API void     NTFS_WofClose(ntfs_wof *Wof);
+NTFS_API size_t   NTFS_WofRead(ntfs_wof *Wof, uint64_t Offset, uint8_t *Buffer, size_t Size);
+
+NTFS_API bool NTFS__XpressDecompress(uint8_t *Input, size_t InputSize,
+                                     uint8_t *Output, size_t OutputSize);
+NTFS_API bool NTFS__LzxDecompress(uint8_t *Input, size_t InputSize,
+                                  uint8_t *Output, size_t OutputSize);
+
+// Usage API
+// Totals of the subtree under a record, the record itself included. Hard
+// links are counted once, under the parent of the preferred name
+typedef struct {
+    uint64_t Size;
+    uint64_t AllocatedSize;
+    uint32_t Files;
+    uint32_t Dirs;
+} ntfs_usage_entry;
+
+// Built from one MFT scan of headers. Records whose parent is gone, reused
+// or not a directory are the top of their own subtree, records on a parent
+// loop never reach a top and are counted as unresolved
+typedef struct {
+    ntfs_error Error;
+    ntfs_arena Arena;
+
+    ntfs_usage_entry *Entries;
+    uint32_t         *Parents;
+    uint64_t          RecordCount;
+    uint64_t          Unresolved;
+} ntfs_usage;
+
+#define NTFS_USAGE_RESERVED  NTFS__ARENA_GIGABYTE(64)
+#define NTFS_USAGE_NO_PARENT 0xFFFFFFFF
+
+NTFS_API ntfs_usage        NTFS_UsageBuild(ntfs_volume *Volume);
+NTFS_API void              NTFS_UsageDestroy(ntfs_usage *Usage);
+NTFS_API ntfs_usage_entry *NTFS_UsageGet(ntfs_usage *Usage, uint64_t RecordIndex);
+NTFS_API size_t            NTFS_UsageTop(ntfs_usage *Usage, uint64_t *RecordIndexes, size_t Count);
+
+// Duplicates API
+typedef struct {
+    uint32_t VolumeIndex;
+    uint64_t RecordIndex;
+} ntfs_dupe_file;
+
+// Files of a group have the same size and the same SHA-256 of their data
+typedef struct {
+    uint64_t        Size;
+    uint8_t         Sha256[32];
+    ntfs_dupe_file *Files;
+    size_t          FileCount;
+} ntfs_dupe_group;
+
+// Files are grouped by their size from the MFT, then by a hash of their
+// first and last clusters, and only files still colliding are read in full.
+// Groups are ordered by size, largest first. Compressed and encrypted NTFS
+// data can not be read and is skipped
+typedef struct {
+    ntfs_error Error;
+    ntfs_arena Arena;
+
+    ntfs_dupe_group *Groups;
+    size_t           GroupCount;
+
+    uint64_t Files;
+    uint64_t PartialFiles;
+    uint64_t FullFiles;
+    uint64_t FailedFiles;
+    uint64_t TotalBytes;
+    uint64_t BytesRead;
+} ntfs_dupes;
+
+#define NTFS_DUPES_MAX_VOLUMES  64
+#define NTFS_DUPES_FIRST_RECORD 16
+#define NTFS_DUPES_BUFFER_SIZE  NTFS__ARENA_MEGABYTE(8)
+#define NTFS_DUPES_RESERVED     NTFS__ARENA_GIGABYTE(64)
+
+NTFS_API ntfs_dupes NTFS_DupesFind(ntfs_volume **Volumes, size_t VolumeCount, uint64_t MinSize);
+NTFS_API void       NTFS_DupesDestroy(ntfs_dupes *Dupes);
+
+// Check API
+enum {
+    NTFS_CheckIssue_MirrorMismatch,
+    NTFS_CheckIssue_ClusterOutOfBounds,
+    NTFS_CheckIssue_ClusterNotAllocated,
+    NTFS_CheckIssue_ClusterCrossLinked,
+    NTFS_CheckIssue_ClusterLeaked,
+    NTFS_CheckIssue_OrphanRecord,
+    NTFS_CheckIssue_DanglingParent,
+};
+
+// Cluster issues cover Count clusters from LCN, claimed by RecordIndex when
+// found in a run list. Record issues name the record they were found in and
+// the record it references, which is the record itself for in use records
+// without any name
+typedef struct {
+    uint32_t Type;
+    uint64_t RecordIndex;
+    uint64_t TargetIndex;
+    uint64_t LCN;
+    uint64_t Count;
+} ntfs_check_issue;
+
+// Called concurrently from the checking threads
+typedef void ntfs_check_callback(void *Context, ntfs_check_issue *Issue);
+
+#define NTFS_CHECK_ISSUE_COUNT    7
+#define NTFS_CHECK_MIRROR_RECORDS 4
+#define NTFS_CHECK_RESERVED       NTFS__ARENA_GIGABYTE(64)
+
+// Issues counts the reports of every issue type
+typedef struct {
+    ntfs_error Error;
+    uint64_t   Records;
+    uint64_t   Clusters;
+    uint64_t   Issues[NTFS_CHECK_ISSUE_COUNT];
+} ntfs_check_summary;
+
+NTFS_API ntfs_check_summary NTFS_VolumeCheck(ntfs_volume *Volume, ntfs_check_callback *Callback,
+                                             void *Context);
+
+// Match API
+typedef struct {
+    uint8_t *Data;
+    size_t   Size;
+} ntfs_pattern;
+
+// Hits in clusters report where the pattern starts on the volume and, for
+// clusters of a run list, in which attribute. The file offset of hits in
+// the slack after the data is past its size. Hits in the MFT are reported
+// from the record after its fixups with a zero volume offset, inside a
+// resident value by its attribute and otherwise by the record index and
+// the offset in the record, without an owner
+typedef struct {
+    uint32_t       Pattern;
+    uint64_t       RecordIndex;
+    ntfs_attr_type Type;
+    uint16_t       AttrId;
+    uint64_t       FileOffset;
+
+    uint64_t LCN;
+    uint64_t Offset;
+    bool     IsResident;
+    bool     HasOwner;
+} ntfs_match_hit;
+
+typedef void ntfs_match_callback(void *Context, ntfs_match_hit *Hit);
+
+// Patterns are bucketed by their first two bytes, a position is only
+// compared against a bucket when both bytes can start a pattern and the
+// pair belongs to one
+typedef struct {
+    ntfs_error Error;
+    ntfs_arena Arena;
+
+    ntfs_pattern *Patterns;
+    size_t        PatternCount;
+    size_t        MaxSize;
+
+    uint8_t   Bytes[256];
+    uint8_t   Sets[3][2][16];
+    uint64_t  Pairs[1024];
+    uint32_t *PairStart;
+    uint32_t *PairOrder;
+    uint32_t  SingleStart[257];
+    uint32_t *SingleOrder;
+} ntfs_matcher;
+
+typedef struct {
+    ntfs_error Error;
+    uint64_t   Hits;
+    uint64_t   RecordBytes;
+    uint64_t   BytesScanned;
+} ntfs_match_summary;
+
+#define NTFS_MATCH_MAX_PATTERN_SIZE NTFS__ARENA_KILOBYTE(64)
+#define NTFS_MATCH_BUFFER_SIZE      NTFS__ARENA_MEGABYTE(8)
+#define NTFS_MATCH_RESERVED         NTFS__ARENA_GIGABYTE(4)
+
+NTFS_API ntfs_matcher       NTFS_MatcherCreate(ntfs_pattern *Patterns, size_t Count);
+NTFS_API void               NTFS_MatcherDestroy(ntfs_matcher *Matcher);
+NTFS_API ntfs_match_summary NTFS_MatchVolume(ntfs_volume *Volume, ntfs_matcher *Matcher,
+                                             ntfs_match_callback *Callback, void *Context);
+
+// Diff API
+enum {
+    NTFS_DiffChange_Added,
+    NTFS_DiffChange_Removed,
+    NTFS_DiffChange_Modified,
+};
+
+// Changes are reported per file, RecordIndex is always a base record and
+// Sequence its sequence number. Attributes has NTFS_DIFF_ATTR_BIT set for
+// the type of every attribute added, removed or changed, including the
+// ones of extension records, which report as a modification of their base
+// record. Non resident data is compared through its sizes and runs only
+typedef struct {
+    uint32_t Change;
+    uint64_t RecordIndex;
+    uint16_t Sequence;
+    uint32_t Attributes;
+} ntfs_diff_entry;
+
+typedef void ntfs_diff_callback(void *Context, ntfs_diff_entry *Entry);
+
+#define NTFS_DIFF_CHANGE_COUNT   3
+#define NTFS_DIFF_ATTR_BIT(type) (1u << ((type) >> 4))
+
+// Parsed counts the records whose bytes differ, the only ones decoded.
+// Corrupt counts the sides of those records that are in use but fail
+// validation, no change is reported for a record with a corrupt side
+typedef struct {
+    ntfs_error Error;
+    uint64_t   Records;
+    uint64_t   Parsed;
+    uint64_t   Corrupt;
+    uint64_t   Changes[NTFS_DIFF_CHANGE_COUNT];
+} ntfs_diff_summary;
+
+NTFS_API ntfs_diff_summary NTFS_VolumeDiff(ntfs_volume *Old, ntfs_volume *New,
+                                           ntfs_diff_callback *Callback, void *Context);
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif   // NTFS_PARSER_H
 
@@ -366,17 +1535,74 @@ static inline bool NTFS__IsAligned(size_t Value, size_t Alignment)
 
 #define WIN32_LEAN_AND_MEAN
 #include <Windows.h>
+#include <bcrypt.h>
+#include <intrin.h>
 
-// Platform specific APIs
-static void  NTFS__Win32Log(wchar_t *Message, wchar_t *FileName, size_t Line);
-static void *NTFS__Win32FileOpen(wchar_t *FilePath);
-static bool  NTFS__Win32FileRead(void *Handle, uint64_t Offset, void *Buffer, size_t Size);
-static void *NTFS__Win32MemoryAllocate(size_t Size, size_t CommittedSize);
-static void *NTFS__Win32MemoryCommit(void *Address, size_t Size);
-static bool  NTFS__Win32MemoryFree(void *Address);
+#pragma comment(lib, "bcrypt.lib")
 
-static void NTFS__Win32Log(wchar_t *Message, wchar_t *FileName, size_t Line)
-{
+#if defined(__AVX2__)
+    #include <immintrin.h>
+#endif
+
+static inline uint64_t NTFS__PopCount64(uint64_t Value)
+{
+    uint64_t Result = __popcnt64(Value);
+    return Result;
+}
+
+// Lower is preferred, Win32 names first and the DOS 8.3 alias last
+static inline uint32_t NTFS__NameSpaceRank(uint8_t NameSpace)
+{
+    static const uint8_t Ranks[4] = { 1, 0, 2, 0 };
+    uint32_t Result = (NameSpace < 4) ? Ranks[NameSpace] : 3;
+    return Result;
+}
+
+static inline uint32_t NTFS__ReadBigEndian32(uint8_t *Buffer)
+{
+    uint32_t Result = NTFS_CAST(uint32_t, Buffer[0]) << 24 | NTFS_CAST(uint32_t, Buffer[1]) << 16
+                    | NTFS_CAST(uint32_t, Buffer[2]) <<  8 | NTFS_CAST(uint32_t, Buffer[3]);
+    return Result;
+}
+
+static inline uint64_t NTFS__ReadBigEndian64(uint8_t *Buffer)
+{
+    uint64_t Result = NTFS_CAST(uint64_t, NTFS__ReadBigEndian32(Buffer)) << 32
+                    | NTFS__ReadBigEndian32(Buffer + 4);
+    return Result;
+}
+
+static inline uint64_t NTFS__CountTrailingZeros64(uint64_t Value)
+{
+    unsigned long Result = 64;
+    _BitScanForward64(&Result, Value);
+    return Result;
+}
+
+// Platform specific APIs
+static void  NTFS__Win32Log(wchar_t *Message, wchar_t *FileName, size_t Line);
+static void *NTFS__Win32FileOpen(wchar_t *FilePath);
+static bool  NTFS__Win32FileRead(void *Handle, uint64_t Offset, void *Buffer, size_t Size);
+static size_t NTFS__Win32FileReadSome(void *Handle, uint64_t Offset, void *Buffer, size_t Size);
+static void *NTFS__Win32FileReopen(void *Handle, bool IsDirect);
+static uint64_t NTFS__Win32FileSize(void *Handle);
+static void *NTFS__Win32FileCreate(wchar_t *FilePath);
+static void *NTFS__Win32FileCreateTemp(void);
+static bool  NTFS__Win32FileWrite(void *Handle, void *Buffer, size_t Size);
+static void *NTFS__Win32MemoryAllocate(size_t Size, size_t CommittedSize);
+static void *NTFS__Win32MemoryCommit(void *Address, size_t Size);
+static bool  NTFS__Win32MemoryFree(void *Address);
+static void *NTFS__Win32ThreadCreate(LPTHREAD_START_ROUTINE Proc, void *Param);
+static void  NTFS__Win32ThreadJoin(void *Thread);
+static uint32_t NTFS__Win32ProcessorCount(void);
+static void *NTFS__Win32HashProviderOpen(size_t Algorithm);
+static void  NTFS__Win32HashProviderClose(void *Provider);
+static void *NTFS__Win32HashCreate(void *Provider);
+static bool  NTFS__Win32HashUpdate(void *Hash, void *Buffer, size_t Size);
+static bool  NTFS__Win32HashFinish(void *Hash, uint8_t *Digest, size_t Size);
+
+static void NTFS__Win32Log(wchar_t *Message, wchar_t *FileName, size_t Line)
+{
     DWORD_PTR pArgs[] = {
         NTFS_CAST(DWORD_PTR, FileName),
         NTFS_CAST(DWORD_PTR, Line),
@@ -407,7 +1633,25 @@ static void *NTFS__Win32FileOpen(wchar_t *FilePath)
     return Result;
 }
 
+// ReadFile takes 32bit sizes, larger reads are split in sector aligned
+// pieces so they stay valid on handles opened without buffering
 static bool NTFS__Win32FileRead(void *Handle, uint64_t Offset, void *Buffer, size_t Size)
+{
+    bool     Result = true;
+    uint8_t *Dest   = Buffer;
+    while (Size && Result) {
+        size_t Piece = Size < NTFS__ARENA_GIGABYTE(1) ? Size : NTFS__ARENA_GIGABYTE(1);
+        Result       = NTFS__Win32FileReadSome(Handle, Offset, Dest, Piece) == Piece;
+
+        Offset += Piece;
+        Dest   += Piece;
+        Size   -= Piece;
+    }
+
+    return Result;
+}
+
+static size_t NTFS__Win32FileReadSome(void *Handle, uint64_t Offset, void *Buffer, size_t Size)
 {
     NTFS_ASSERT(Size == NTFS_CAST(uint32_t, Size), "Not supporting reading 64bit size");
 
@@ -418,7 +1662,69 @@ static bool NTFS__Win32FileRead(void *Handle, uint64_t Offset, void *Buffer, siz
     DWORD BytesRead = 0;
     BOOL  Result    =
         ReadFile(Handle, Buffer, NTFS_CAST(DWORD, Size), &BytesRead, &Overlapped);
-    return Result && BytesRead == Size;
+    return Result ? BytesRead : 0;
+}
+
+// Opens a second file object for the same file, reads on one handle are
+// serialized by the I/O manager even when every one of them is positional
+static void *NTFS__Win32FileReopen(void *Handle, bool IsDirect)
+{
+    DWORD  Flags  = IsDirect ? FILE_FLAG_NO_BUFFERING : 0;
+    HANDLE Result =
+        ReOpenFile(Handle, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, Flags);
+    if (Result == INVALID_HANDLE_VALUE) {
+        Result = 0;  // Normalize
+    }
+
+    return Result;
+}
+
+static uint64_t NTFS__Win32FileSize(void *Handle)
+{
+    LARGE_INTEGER Size = { 0 };
+    uint64_t Result    = GetFileSizeEx(Handle, &Size) ? NTFS_CAST(uint64_t, Size.QuadPart) : 0;
+
+    return Result;
+}
+
+static void *NTFS__Win32FileCreate(wchar_t *FilePath)
+{
+    HANDLE Result =
+        CreateFileW(FilePath, GENERIC_WRITE, FILE_SHARE_READ, 0, CREATE_ALWAYS, 0, 0);
+    if (Result == INVALID_HANDLE_VALUE) {
+        Result = 0;  // Normalize
+    }
+
+    return Result;
+}
+
+// Deleted as soon as its handle is closed, a crash leaves nothing behind
+static void *NTFS__Win32FileCreateTemp(void)
+{
+    HANDLE  Result = INVALID_HANDLE_VALUE;
+    wchar_t Directory[MAX_PATH + 1];
+    wchar_t FilePath[MAX_PATH + 1];
+    if (GetTempPathW(MAX_PATH + 1, Directory) &&
+        GetTempFileNameW(Directory, L"ntf", 0, FilePath)) {
+        Result = CreateFileW(FilePath, GENERIC_READ | GENERIC_WRITE, 0, 0, CREATE_ALWAYS,
+                             FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, 0);
+    }
+
+    if (Result == INVALID_HANDLE_VALUE) {
+        Result = 0;  // Normalize
+    }
+
+    return Result;
+}
+
+static bool NTFS__Win32FileWrite(void *Handle, void *Buffer, size_t Size)
+{
+    NTFS_ASSERT(Size == NTFS_CAST(uint32_t, Size), "Not supporting writing 64bit size");
+
+    DWORD BytesWritten = 0;
+    BOOL  Result       =
+        WriteFile(Handle, Buffer, NTFS_CAST(DWORD, Size), &BytesWritten, 0);
+    return Result && BytesWritten == Size;
 }
 
 static void *NTFS__Win32MemoryAllocate(size_t Size, size_t CommittedSize)
@@ -445,39 +1751,101 @@ static void *NTFS__Win32MemoryCommit(void *Address, size_t Size)
 
 static bool NTFS__Win32MemoryFree(void *Address)
 {
-    bool Result = VirtualFree(Address, 0, MEM_FREE) != 0;
+    bool Result = VirtualFree(Address, 0, MEM_RELEASE) != 0;
+    return Result;
+}
+
+static void *NTFS__Win32ThreadCreate(LPTHREAD_START_ROUTINE Proc, void *Param)
+{
+    void *Result = CreateThread(0, 0, Proc, Param, 0, 0);
+    return Result;
+}
+
+static void NTFS__Win32ThreadJoin(void *Thread)
+{
+    WaitForSingleObject(Thread, INFINITE);
+    CloseHandle(Thread);
+}
+
+static uint32_t NTFS__Win32ProcessorCount(void)
+{
+    SYSTEM_INFO Info = { 0 };
+    GetSystemInfo(&Info);
+
+    uint32_t Result = Info.dwNumberOfProcessors ? Info.dwNumberOfProcessors : 1;
+    return Result;
+}
+
+static void *NTFS__Win32HashProviderOpen(size_t Algorithm)
+{
+    static const wchar_t *Names[NTFS_HASH_ALGORITHM_COUNT] = {
+        BCRYPT_MD5_ALGORITHM, BCRYPT_SHA1_ALGORITHM, BCRYPT_SHA256_ALGORITHM,
+    };
+
+    BCRYPT_ALG_HANDLE Result = 0;
+    if (!BCRYPT_SUCCESS(BCryptOpenAlgorithmProvider(&Result, Names[Algorithm], 0, 0))) {
+        Result = 0;  // Normalize
+    }
+
+    return Result;
+}
+
+static void NTFS__Win32HashProviderClose(void *Provider)
+{
+    BCryptCloseAlgorithmProvider(Provider, 0);
+}
+
+static void *NTFS__Win32HashCreate(void *Provider)
+{
+    BCRYPT_HASH_HANDLE Result = 0;
+    if (!BCRYPT_SUCCESS(BCryptCreateHash(Provider, &Result, 0, 0, 0, 0, 0))) {
+        Result = 0;  // Normalize
+    }
+
+    return Result;
+}
+
+static bool NTFS__Win32HashUpdate(void *Hash, void *Buffer, size_t Size)
+{
+    NTFS_ASSERT(Size == NTFS_CAST(uint32_t, Size), "Not supporting hashing 64bit size");
+
+    bool Result = BCRYPT_SUCCESS(BCryptHashData(Hash, Buffer, NTFS_CAST(ULONG, Size), 0));
+    return Result;
+}
+
+static bool NTFS__Win32HashFinish(void *Hash, uint8_t *Digest, size_t Size)
+{
+    bool Result = BCRYPT_SUCCESS(BCryptFinishHash(Hash, Digest, NTFS_CAST(ULONG, Size), 0));
+    BCryptDestroyHash(Hash);
+
     return Result;
 }
 
 
 // Arena APIs
 ntfs_arena NTFS__ArenaDefault(void)
+{
+    ntfs_arena Result = NTFS__ArenaCreate(NTFS__ARENA_DEFAULT_RESERVED,
+                                          NTFS__ARENA_DEFAULT_COMMIT);
+    return Result;
+}
+
+ntfs_arena NTFS__ArenaCreate(size_t ReservedSize, size_t CommittedSize)
 {
     ntfs_arena Result    = { 0 };
-    Result.ReservedSize  = NTFS__ARENA_DEFAULT_RESERVED;
-    Result.CommittedSize = NTFS__ARENA_DEFAULT_COMMIT;
+    Result.ReservedSize  = ReservedSize;
+    Result.CommittedSize = CommittedSize;
     Result.Buffer        =
         NTFS__Win32MemoryAllocate(Result.ReservedSize, Result.CommittedSize);
 
     return Result;
 }
 
-void NTFS__ArenaDestroy(ntfs_arena *Arena)
-{
-    NTFS__Win32MemoryFree(Arena->Buffer);
-    *Arena = (ntfs_arena) { 0 };
-}
-
-void *NTFS__ArenaAlloc(ntfs_arena *Arena, size_t Size)
+static void NTFS__ArenaCommit(ntfs_arena *Arena, size_t Offset)
 {
-    size_t SizeAligned = NTFS__Align(Size + sizeof(ntfs_arena_header), sizeof(void *));
-
     // TODO: Change to support growing arena when needed instead of crashing
-    NTFS_ASSERT(Arena->Offset + SizeAligned <= Arena->ReservedSize,
-                "growing arenas are not supported");
-    while (Arena->CommittedSize < Arena->ReservedSize
-           && (Arena->Offset + SizeAligned) >= Arena->CommittedSize) {
-
+    NTFS_ASSERT(Offset <= Arena->ReservedSize, "growing arenas are not supported");
+    while (Arena->CommittedSize < Arena->ReservedSize && Offset >= Arena->CommittedSize) {
         Arena->CommittedSize *= 2;
         if (Arena->CommittedSize > Arena->ReservedSize) {
             Arena->CommittedSize = Arena->ReservedSize;
@@ -485,6 +1853,18 @@ void *NTFS__ArenaAlloc(ntfs_arena *Arena, size_t Size)
 
         NTFS__Win32MemoryCommit(Arena->Buffer, Arena->CommittedSize);
     }
+}
+
+void NTFS__ArenaDestroy(ntfs_arena *Arena)
+{
+    NTFS__Win32MemoryFree(Arena->Buffer);
+    *Arena = (ntfs_arena) { 0 };
+}
+
+void *NTFS__ArenaAlloc(ntfs_arena *Arena, size_t Size)
+{
+    size_t SizeAligned = NTFS__Align(Size + sizeof(ntfs_arena_header), sizeof(void *));
+    NTFS__ArenaCommit(Arena, Arena->Offset + SizeAligned);
 
     uint8_t *Result = &NTFS_CAST(uint8_t *, Arena->Buffer)[Arena->Offset];
     Arena->Offset  += SizeAligned;
@@ -495,6 +1875,15 @@ void *NTFS__ArenaAlloc(ntfs_arena *Arena, size_t Size)
     return Result;
 }
 
+// Direct reads need buffers aligned to the device sector size
+void *NTFS__ArenaAllocAligned(ntfs_arena *Arena, size_t Size, size_t Alignment)
+{
+    uint8_t *Result = NTFS__ArenaAlloc(Arena, Size + Alignment);
+    Result         += NTFS__Align(NTFS_CAST(size_t, Result), Alignment) - NTFS_CAST(size_t, Result);
+
+    return Result;
+}
+
 void *NTFS__PushCopyWStringZ(ntfs_arena *Arena, uint16_t *String, size_t Length)
 {
     size_t SrcSize  = Length * sizeof(String[0]);
@@ -515,13 +1904,15 @@ void *NTFS__ArenaResizeAlloc(ntfs_arena *Arena, void *Address, size_t Size)
     void *Result = &NTFS_CAST(uint8_t *, Arena->Buffer)[(Arena->Offset - Header->Size)];
     if (Result == Header) {  // Provided allocation is last allocation
         size_t SizeAligned = NTFS__Align(Size + sizeof(*Header), sizeof(void *));
+        NTFS__ArenaCommit(Arena, Arena->Offset - Header->Size + SizeAligned);
         Arena->Offset = Arena->Offset - Header->Size + SizeAligned;
         Header->Size  = SizeAligned;
         Result        = NTFS_CAST(uint8_t *, Result) + sizeof(*Header);
 
     } else {
+        size_t OldSize = Header->Size - sizeof(*Header);
         Result = NTFS__ArenaAlloc(Arena, Size);
-        NTFS_MEM_COPY(Result, Header->Size, Address, Size);
+        NTFS_MEM_COPY(Result, Size, Address, (OldSize < Size) ? OldSize : Size);
     }
 
     return Result;
@@ -563,7 +1954,7 @@ ntfs_volume NTFS_VolumeOpen(wchar_t DriveLetter)
         NTFS_RETURN(Result.Error, NTFS_Error_VolumeOpen);
     }
 
-    Result = NTFS__VolumeLoad(VolumeHandle, 0);
+    Result = NTFS__VolumeLoad(VolumeHandle, (ntfs_container) { 0 }, 0);
 
 skip:
     return Result;
@@ -572,36 +1963,51 @@ skip:
 ntfs_volume NTFS_VolumeOpenFromFile(wchar_t *Path)
 {
     ntfs_volume Result = { 0 };
+    ntfs_arena  Arena  = NTFS__ArenaDefault();
 
     void *VolumeHandle = NTFS__Win32FileOpen(Path);
     if (VolumeHandle == 0) {
         NTFS_RETURN(Result.Error, NTFS_Error_VolumeOpen);
     }
 
-    uint8_t BootSector[NTFS_BOOT_RECORD_SIZE];
-    if (!NTFS__Win32FileRead(VolumeHandle, 0, &BootSector, sizeof(BootSector))) {
-        NTFS_RETURN(Result.Error, NTFS_Error_VolumeReadBootRecord);
+    if (Arena.Buffer == 0) {
+        CloseHandle(VolumeHandle);
+        NTFS_RETURN(Result.Error, NTFS_Error_MemoryError);
     }
 
-    uint16_t Signature = *NTFS_CAST(uint16_t *, &BootSector[510]);
-    if (Signature != NTFS_BOOT_RECORD_SIGNATURE) {
-        NTFS_RETURN(Result.Error, NTFS_Error_VolumeUnknownSignature);
+    ntfs_container Container = NTFS__ContainerOpen(VolumeHandle);
+    if (Container.Error) {
+        CloseHandle(VolumeHandle);
+        NTFS_RETURN(Result.Error, Container.Error);
     }
 
-    uint8_t *PartitionTable = &BootSector[NTFS_BOOT_RECORD_PARTITION_OFFSET];
-    Result.Error            = NTFS_Error_VolumePartitionNotFound;
-    for (int i = 0; i < 4; i++) {
-        uint8_t PartitionType = PartitionTable[0x04];
-        if (PartitionType != 0) {
-            uint32_t FirstSector = *NTFS_CAST(uint32_t *, &PartitionTable[0x08]);
-            Result = NTFS__VolumeLoad(VolumeHandle, FirstSector * sizeof(BootSector));
+    ntfs_partition *Partitions = 0;
+    ntfs_error      Error      = NTFS__DiskDiscover(VolumeHandle, &Container, &Arena, &Partitions);
+    if (Error) {
+        NTFS__ContainerClose(&Container);
+        CloseHandle(VolumeHandle);
+        NTFS_RETURN(Result.Error, Error);
+    }
+
+    // Opens the first NTFS partition, use the disk API for the rest
+    Result.Error = NTFS_Error_VolumePartitionNotFound;
+    for (size_t Index = 0; Index < NTFS__ListLen(Partitions); Index++) {
+        if (Partitions[Index].IsNtfs) {
+            Result = NTFS__VolumeLoad(VolumeHandle, Container, Partitions[Index].Offset);
             break;
         }
+    }
 
-        PartitionTable += NTFS_BOOT_RECORD_PARITION_ENTRY_SIZE;
+    if (Result.Handle == 0) {
+        NTFS__ContainerClose(&Container);
+        CloseHandle(VolumeHandle);
     }
 
 skip:
+    if (Arena.Buffer) {
+        NTFS__ArenaDestroy(&Arena);
+    }
+
     return Result;
 }
 
@@ -611,11 +2017,18 @@ void NTFS_VolumeClose(ntfs_volume *Volume)
         CloseHandle(Volume->Handle);
     }
 
+    NTFS__ContainerClose(&Volume->Container);
+    NTFS_VolumeSetDirectIo(Volume, false);
+
     // TODO: Remove once volume will have better arena handling
     if (Volume->CaseTable) {
         NTFS__Win32MemoryFree(Volume->CaseTable);
     }
 
+    if (Volume->MftRunList) {
+        NTFS__Win32MemoryFree(Volume->MftRunList);
+    }
+
     // Dont override the error
     *Volume = (ntfs_volume) { .Error = Volume->Error};
 }
@@ -627,15 +2040,66 @@ bool NTFS_VolumeRead(ntfs_volume *Volume, uint64_t From, void *Buffer, size_t Si
     NTFS_ASSERT(NTFS__IsAligned(Size, Volume->BytesPerSector),
                 "volume read size is not aligned to volume sector size");
 
-    bool Result = NTFS__Win32FileRead(Volume->Handle, From + Volume->StartOffset,
-                                      Buffer, Size);
+    bool Result = false;
+    if (Volume->DirectHandle && Size >= NTFS_DIRECT_MIN_SIZE) {
+        Result = NTFS__ContainerReadDirect(&Volume->Container, Volume->DirectHandle,
+                                           Volume->DirectPool, From + Volume->StartOffset,
+                                           Buffer, Size);
+    } else {
+        Result = NTFS__ContainerRead(&Volume->Container, Volume->Handle,
+                                     From + Volume->StartOffset, Buffer, Size);
+    }
+
+    return Result;
+}
+
+void NTFS_VolumeSetParsePolicy(ntfs_volume *Volume, ntfs_parse_policy Policy,
+                               ntfs_parse_report_callback *Callback, void *Context,
+                               uint64_t ReportLimit)
+{
+    Volume->ParsePolicy        = Policy;
+    Volume->ParseReport        = Callback;
+    Volume->ParseReportContext = Context;
+    Volume->ParseReportLimit   = ReportLimit;
+    Volume->ParseReportCount   = 0;
+}
+
+// Like the parse policy it has to be set before the volume is shared,
+// contexts created afterwards reopen the direct handle as well
+bool NTFS_VolumeSetDirectIo(ntfs_volume *Volume, bool IsEnabled)
+{
+    bool Result = true;
+
+    if (Volume->DirectHandle) {
+        CloseHandle(Volume->DirectHandle);
+    }
+
+    if (Volume->DirectPool) {
+        NTFS__Win32MemoryFree(Volume->DirectPool);
+    }
+
+    Volume->DirectHandle = 0;
+    Volume->DirectPool   = 0;
+    if (!IsEnabled || Volume->Handle == 0) {
+        NTFS_RETURN(Result, !IsEnabled);
+    }
+
+    Volume->DirectHandle = NTFS__Win32FileReopen(Volume->Handle, true);
+    Volume->DirectPool   = NTFS__DirectPoolCreate();
+    if (Volume->DirectHandle == 0 || Volume->DirectPool == 0) {
+        NTFS_VolumeSetDirectIo(Volume, false);
+        NTFS_RETURN(Result, false);
+    }
+
+skip:
     return Result;
 }
 
-ntfs_volume NTFS__VolumeLoad(void *VolumeHandle, size_t VbrOffset)
+ntfs_volume NTFS__VolumeLoad(void *VolumeHandle, ntfs_container Container, size_t VbrOffset)
 {
     ntfs_volume Result = {
         .Handle         = VolumeHandle,
+        .Container      = Container,
         .StartOffset    = VbrOffset,
         .BytesPerSector = NTFS_BOOT_RECORD_SIZE,
     };
@@ -655,20 +2119,32 @@ ntfs_volume NTFS__VolumeLoad(void *VolumeHandle, size_t VbrOffset)
     Result.MftCluster        = *NTFS_CAST(uint64_t *, &BootSector[0x30]);
     Result.BytesPerCluster   = Result.BytesPerSector * Result.SectorsPerCluster;
     Result.SerialNumber      = *NTFS_CAST(uint64_t *, BootSector + 0x48);
+    uint64_t TotalSectors    = *NTFS_CAST(uint64_t *, &BootSector[0x28]);
 
     int8_t ClustersPerFileRecord = *NTFS_CAST(int8_t *, &BootSector[0x40]);
     if (ClustersPerFileRecord < 0) {
-        Result.BytesPerMftEntry = NTFS_CAST(uint64_t, 1 << (-ClustersPerFileRecord));
+        Result.BytesPerMftEntry = (-ClustersPerFileRecord < 32)
+                                  ? NTFS_CAST(uint64_t, 1) << (-ClustersPerFileRecord) : 0;
     } else {
         Result.BytesPerMftEntry = ClustersPerFileRecord * Result.BytesPerCluster;
     }
 
     bool IsValid = NTFS__IsPowerOf2(Result.BytesPerSector);
+    IsValid     &= Result.BytesPerSector >= NTFS_BOOT_RECORD_SIZE;
+    IsValid     &= Result.BytesPerSector <= NTFS_MAX_SECTOR_SIZE;
     IsValid     &= NTFS__IsPowerOf2(Result.SectorsPerCluster);
+    IsValid     &= NTFS__IsPowerOf2(Result.BytesPerMftEntry);
+    IsValid     &= Result.BytesPerMftEntry >= NTFS_FILE_RECORD_FIXUP_STRIDE;
     IsValid     &= Result.BytesPerMftEntry <= Result.BytesPerCluster;
     if (!IsValid) {
         NTFS_RETURN(Result.Error, NTFS_Error_VolumeFailedValidation);
     }
+    Result.TotalClusters = TotalSectors / Result.SectorsPerCluster;
+
+    NTFS__VolumeLoadMftRuns(&Result);
+    if (Result.Error) {
+        NTFS_RETURN(Result.Error, Result.Error);
+    }
 
     NTFS__VolumeLoadInformation(&Result);
 
@@ -686,11 +2162,15 @@ void NTFS__VolumeLoadInformation(ntfs_volume *Volume)
     for (size_t Index = 0; Index < NTFS__ListLen(VolumeFile.Record.AttrList); Index++) {
         ntfs_attr *Attr = VolumeFile.Record.AttrList + Index;
 
-        if (Attr->Type == NTFS_AttributeType_VolumeName) {
+        if (Attr->Type == NTFS_AttributeType_VolumeName && !Attr->NonResFlag) {
             NTFS_MEM_COPY(Volume->Name, sizeof(Volume->Name) - 2,
                           Attr->Resident.Data, Attr->Resident.Size);
 
         } else if (Attr->Type == NTFS_AttributeType_VolumeInformation) {
+            if (Attr->NonResFlag || Attr->Resident.Size < 0x0A) {
+                NTFS_RETURN(Volume->Error, NTFS_Error_VolumeFailedLoadInfoFile);
+            }
+
             uint8_t Major = Attr->Resident.Data[0x08];
             uint8_t Minor = Attr->Resident.Data[0x09];
             if (!(Major == 3 && Minor == 1)) {
@@ -739,6 +2219,65 @@ skip:
     NTFS_FileClose(&UpCase);
 }
 
+void NTFS__VolumeLoadMftRuns(ntfs_volume *Volume)
+{
+    // First records of the $MFT are always at the start of its data,
+    // so the $MFT record itself can be loaded before the runs are known
+    ntfs_arena  Arena = NTFS__ArenaDefault();
+    ntfs_record Mft   = { 0 };
+    if (Arena.Buffer == 0) {
+        NTFS_RETURN(Volume->Error, NTFS_Error_MemoryError);
+    }
+
+    Mft = NTFS__RecordLoadFromIndex(Volume, &Arena, NTFS_SystemFile_Mft);
+    if (Mft.Error) {
+        NTFS_RETURN(Volume->Error, NTFS_Error_VolumeFailedLoadInfoFile);
+    }
+
+    size_t DataIndex = 0;
+    for (; DataIndex < NTFS__ListLen(Mft.AttrList); DataIndex++) {
+        ntfs_attr *Attr = Mft.AttrList + DataIndex;
+        if (Attr->Type == NTFS_AttributeType_Data && Attr->Name == 0) {
+            break;
+        }
+    }
+
+    ntfs_attr *DataAttr = Mft.AttrList + DataIndex;
+    if (DataIndex == NTFS__ListLen(Mft.AttrList) || !DataAttr->NonResFlag ||
+        DataAttr->NonResident.RunList == 0) {
+        NTFS_RETURN(Volume->Error, NTFS_Error_VolumeFailedLoadInfoFile);
+    }
+
+    // A fragmented $MFT continues its runs in extension records, which are
+    // reached through the runs of the base record
+    Volume->MftRunList     = DataAttr->NonResident.RunList;
+    Volume->MftRunCount    = NTFS__ListLen(DataAttr->NonResident.RunList);
+    Volume->MftRecordCount = DataAttr->NonResident.Size / Volume->BytesPerMftEntry;
+    ntfs_error Extensions  = NTFS__RecordLoadExtensions(Volume, &Arena, &Mft);
+    Volume->MftRunList     = 0;
+    Volume->MftRunCount    = 0;
+    if (Extensions) {
+        NTFS_RETURN(Volume->Error, NTFS_Error_VolumeFailedLoadInfoFile);
+    }
+
+    DataAttr = Mft.AttrList + DataIndex;
+    size_t RunCount = NTFS__ListLen(DataAttr->NonResident.RunList);
+    size_t RunsSize = NTFS__Align(RunCount * sizeof(ntfs_data_run), 4096);
+    Volume->MftRunList = NTFS__Win32MemoryAllocate(RunsSize, 0);
+    if (Volume->MftRunList == 0) {
+        NTFS_RETURN(Volume->Error, NTFS_Error_MemoryError);
+    }
+
+    NTFS_MEM_COPY(Volume->MftRunList, RunsSize, DataAttr->NonResident.RunList,
+                  RunCount * sizeof(ntfs_data_run));
+    Volume->MftRunCount = RunCount;
+
+skip:
+    if (Arena.Buffer) {
+        NTFS__ArenaDestroy(&Arena);
+    }
+}
+
 ntfs_file NTFS_FileOpenFromIndex(ntfs_volume *Volume, size_t Index)
 {
     ntfs_file Result = {
@@ -755,6 +2294,11 @@ ntfs_file NTFS_FileOpenFromIndex(ntfs_volume *Volume, size_t Index)
         NTFS_RETURN(Result.Error, Result.Record.Error);
     }
 
+    ntfs_error Extensions = NTFS__RecordLoadExtensions(Volume, &Result.Arena, &Result.Record);
+    if (Extensions) {
+        NTFS_RETURN(Result.Error, Extensions);
+    }
+
     bool HasStdInfo  = false;
     bool HasFileName = false;
     for (size_t i = 0; i < NTFS__ListLen(Result.Record.AttrList); i++) {
@@ -762,6 +2306,9 @@ ntfs_file NTFS_FileOpenFromIndex(ntfs_volume *Volume, size_t Index)
 
         if (Attr->Type == NTFS_AttributeType_StandardInformation) {
             HasStdInfo = true;
+            if (Attr->NonResFlag || Attr->Resident.Size < 0x24) {
+                NTFS_RETURN(Result.Error, NTFS_Error_FileFailedInfoValidation);
+            }
 
             Result.CreationTime = *NTFS_CAST(uint64_t *, Attr->Resident.Data + 0x00);
             Result.ModifiedTime = *NTFS_CAST(uint64_t *, Attr->Resident.Data + 0x08);
@@ -769,6 +2316,11 @@ ntfs_file NTFS_FileOpenFromIndex(ntfs_volume *Volume, size_t Index)
             Result.ReadTime     = *NTFS_CAST(uint64_t *, Attr->Resident.Data + 0x18);
             Result.Flags.Value  = *NTFS_CAST(uint32_t *, Attr->Resident.Data + 0x20);
 
+            // Volumes older than NTFS 3.0 keep security in each file instead
+            if (Attr->Resident.Size >= 0x38) {
+                Result.SecurityId = *NTFS_CAST(uint32_t *, Attr->Resident.Data + 0x34);
+            }
+
             bool IsValid = (Result.CreationTime & INT64_MIN) == 0;
             IsValid     &= (Result.ModifiedTime & INT64_MIN) == 0;
             IsValid     &= (Result.ChangedTime  & INT64_MIN) == 0;
@@ -778,28 +2330,21 @@ ntfs_file NTFS_FileOpenFromIndex(ntfs_volume *Volume, size_t Index)
             }
 
         } else if (Attr->Type == NTFS_AttributeType_FileName) {
-            HasFileName = true;
-
-            Result.ParentIndex =
-                *NTFS_CAST(uint64_t *, Attr->Resident.Data + 0x00) & ~(INT64_MIN >> 16);
-            // Result.AlignedSize = *NTFS_CAST(uint64_t *, Attr->Resident.Data + 0x28);
-            // Result.Size        = *NTFS_CAST(uint64_t *, Attr->Resident.Data + 0x30);
-
-            if (Result.Size > Result.AlignedSize ||
-                !NTFS__IsAligned(Result.AlignedSize, Volume->BytesPerCluster)) {
+            ntfs_file_name FileName = { 0 };
+            if (!NTFS__FileNameParse(Attr, &FileName)) {
                 NTFS_RETURN(Result.Error, NTFS_Error_FileFailedInfoValidation);
             }
-
-            uint8_t NameLength = Attr->Resident.Data[0x40];
-            // uint8_t NameSpace  = Attr->Resident.Data[0x41];
-            if (NameLength > (Attr->Resident.Size - 0x42)) {
-                NTFS_RETURN(Result.Error, NTFS_Error_FileFailedInfoValidation);
+            NTFS__ListPush(&Result.Arena, Result.Names, FileName);
+
+            // Keep the first name of the best namespace
+            if (!HasFileName ||
+                NTFS__NameSpaceRank(FileName.NameSpace) < NTFS__NameSpaceRank(Result.NameSpace)) {
+                Result.ParentIndex = FileName.ParentIndex;
+                Result.NameSpace   = FileName.NameSpace;
+                Result.Name        = NTFS__PushCopyWStringZ(&Result.Arena, FileName.Name,
+                                                            FileName.NameLength);
             }
-
-            Result.Name =
-                NTFS__PushCopyWStringZ(&Result.Arena,
-                                       NTFS_CAST(uint16_t *, Attr->Resident.Data + 0x42),
-                                       NameLength);
+            HasFileName = true;
 
         } else if (Attr->Type == NTFS_AttributeType_Data && !Attr->Name) {
             if (Attr->NonResFlag) {
@@ -824,96 +2369,291 @@ ntfs_record NTFS__RecordLoadFromIndex(ntfs_volume *Volume, ntfs_arena *Arena, si
 {
     ntfs_record Result = { 0 };
 
-    uint64_t RecordOffset = Volume->MftCluster * Volume->BytesPerCluster
-                            + (Index * Volume->BytesPerMftEntry);
-    uint8_t *FileRecord   = NTFS__ArenaAlloc(Arena, Volume->BytesPerMftEntry);
+    // Until the $MFT runs are loaded only its first records are reachable
+    uint64_t RecordOffset = NTFS_CAST(uint64_t, Index) * Volume->BytesPerMftEntry;
+    uint64_t RecordVCN    = RecordOffset / Volume->BytesPerCluster;
+    uint64_t RecordLCN    = Volume->MftCluster + RecordVCN;
+    if (Volume->MftRunList) {
+        if (NTFS_UNLIKELY(Index >= Volume->MftRecordCount)) {
+            NTFS_RETURN(Result.Error, NTFS_Error_RecordOutOfBounds);
+        }
+
+        size_t RunIndex = 0;
+        for (; RunIndex < Volume->MftRunCount; RunIndex++) {
+            ntfs_data_run *Run = Volume->MftRunList + RunIndex;
+            if (RecordVCN < Run->Count) {
+                break;
+            }
+
+            RecordVCN -= Run->Count;
+        }
+
+        if (RunIndex == Volume->MftRunCount || Volume->MftRunList[RunIndex].IsSparse) {
+            NTFS_RETURN(Result.Error, NTFS_Error_RecordOutOfBounds);
+        }
+        RecordLCN = Volume->MftRunList[RunIndex].StartVCN + RecordVCN;
+    }
+
+    RecordOffset        = RecordLCN * Volume->BytesPerCluster
+                          + RecordOffset % Volume->BytesPerCluster;
+    uint8_t *FileRecord = NTFS__ArenaAlloc(Arena, Volume->BytesPerMftEntry);
     if (!NTFS_VolumeRead(Volume, RecordOffset, FileRecord, Volume->BytesPerMftEntry)) {
         NTFS_RETURN(Result.Error, NTFS_Error_RecordFailedRead);
     }
 
-    uint32_t Magic     = *NTFS_CAST(uint32_t *, FileRecord + 0x00);
-    uint16_t Offset    = *NTFS_CAST(uint16_t *, FileRecord + 0x14);
-    uint16_t Flags     = *NTFS_CAST(uint16_t *, FileRecord + 0x16);
-    uint32_t RealSize  = *NTFS_CAST(uint32_t *, FileRecord + 0x18);
-    uint32_t AllocSize = *NTFS_CAST(uint32_t *, FileRecord + 0x1C);
-    uint32_t MftIndex  = *NTFS_CAST(uint32_t *, FileRecord + 0x2C);
+    Result = NTFS__RecordParse(Volume, Arena, FileRecord, Index);
 
-    bool IsValid = Magic == NTFS_FILE_RECORD_MAGIC;
-    IsValid     &= Offset < RealSize;
-    IsValid     &= RealSize <= AllocSize && AllocSize == Volume->BytesPerMftEntry;
-    IsValid     &= MftIndex == Index;
-    IsValid     &= Flags & 0x01;
-    if (!IsValid) {
-        NTFS_RETURN(Result.Error, NTFS_Error_RecordFailedValidation);
-    }
-    Result.IsDir = Flags & 0x02;
-    Result.Index = MftIndex;
+skip:
+    return Result;
+}
 
-    uint8_t *AttrPtr    = FileRecord + Offset;
-    uint8_t *AttrEndPtr = AttrPtr + RealSize;
-    while (AttrPtr < AttrEndPtr) {
-        uint32_t Marker = *NTFS_CAST(uint32_t *, AttrPtr);
-        if (Marker == NTFS_FILE_RECORD_ATTR_END_MARKER) {
+// Attributes that do not fit the base record move to extension records
+// listed in its $ATTRIBUTE_LIST. They are appended to the base record, an
+// attribute split across records gets the runs of every later piece
+ntfs_error NTFS__RecordLoadExtensions(ntfs_volume *Volume, ntfs_arena *Arena,
+                                      ntfs_record *Record)
+{
+    ntfs_error Result = NTFS_Error_Success;
+
+    ntfs_attr *ListAttr = 0;
+    for (size_t Index = 0; Index < NTFS__ListLen(Record->AttrList); Index++) {
+        if (Record->AttrList[Index].Type == NTFS_AttributeType_AttributeList) {
+            ListAttr = Record->AttrList + Index;
             break;
         }
+    }
 
-        uint32_t AttrTotalSize  = *NTFS_CAST(uint32_t *, AttrPtr + 0x04);
-        uint32_t AttrNameOffset = *NTFS_CAST(uint16_t *, AttrPtr + 0x0A);
-        if (AttrPtr + AttrTotalSize > AttrEndPtr) {
-            NTFS_RETURN(Result.Error, NTFS_Error_RecordFailedValidation);
+    if (ListAttr == 0) {
+        NTFS_RETURN(Result, NTFS_Error_Success);
+    }
+
+    uint8_t *List     = ListAttr->Resident.Data;
+    size_t   ListSize = ListAttr->Resident.Size;
+    if (ListAttr->NonResFlag) {
+        ListSize = ListAttr->NonResident.Size;
+        List     = NTFS__ArenaAlloc(Arena, ListAttr->NonResident.AlignedSize);
+        NTFS__DataRunsRead(Volume, ListAttr->NonResident.RunList, 0, List,
+                           ListAttr->NonResident.AlignedSize, &Result);
+        if (Result) {
+            NTFS_RETURN(Result, NTFS_Error_RecordBadAttributeList);
         }
+    }
 
-        ntfs_attr Attr  = { 0 };
-        Attr.Type       = *NTFS_CAST(uint32_t *, AttrPtr + 0x00);
-        Attr.NonResFlag = AttrPtr[0x08] == 1;
-        Attr.NameLength = *NTFS_CAST(uint8_t  *, AttrPtr + 0x09);
-        Attr.Flags      = *NTFS_CAST(uint16_t *, AttrPtr + 0x0C);
-        Attr.Id         = *NTFS_CAST(uint16_t *, AttrPtr + 0x0E);
-        if (Attr.NameLength) {
-            if (AttrNameOffset + Attr.NameLength >= AttrTotalSize) {
-                NTFS_RETURN(Result.Error, NTFS_Error_RecordFailedValidation);
-            }
+    // Entries of one record follow each other, so only the last extension
+    // record is kept around
+    ntfs_record Extension = { 0 };
+    for (size_t Offset = 0; Offset + 0x1A <= ListSize;) {
+        uint8_t *Entry      = List + Offset;
+        uint32_t Type       = *NTFS_CAST(uint32_t *, Entry + 0x00);
+        uint16_t EntrySize  = *NTFS_CAST(uint16_t *, Entry + 0x04);
+        uint64_t RecordRef  = *NTFS_CAST(uint64_t *, Entry + 0x10) & 0xFFFFFFFFFFFF;
+        uint16_t AttrId     = *NTFS_CAST(uint16_t *, Entry + 0x18);
+        if (EntrySize < 0x1A || EntrySize > ListSize - Offset) {
+            NTFS_RETURN(Result, NTFS_Error_RecordBadAttributeList);
+        }
+        Offset += EntrySize;
 
-            Attr.Name = NTFS_CAST(uint16_t *, AttrPtr + AttrNameOffset);
+        if (RecordRef == Record->Index) {
+            continue;
         }
 
-        if (Attr.NonResFlag) {
-            uint16_t AttrOffset    = *NTFS_CAST(uint16_t *, AttrPtr + 0x20);
-            uint64_t AttrAllocSize = *NTFS_CAST(uint64_t *, AttrPtr + 0x28);
-            uint64_t AttrRealSize  = *NTFS_CAST(uint64_t *, AttrPtr + 0x30);
-            if (AttrRealSize > AttrAllocSize ||
-                !NTFS__IsAligned(AttrAllocSize, Volume->BytesPerCluster)) {
-                NTFS_RETURN(Result.Error, NTFS_Error_RecordFailedValidation);
+        if (Extension.Buffer == 0 || Extension.Index != RecordRef) {
+            Extension = NTFS__RecordLoadFromIndex(Volume, Arena, RecordRef);
+            if (Extension.Error || Extension.BaseIndex != Record->Index) {
+                NTFS_RETURN(Result, NTFS_Error_RecordBadAttributeList);
             }
+        }
 
-            Attr.NonResident.Size        = AttrRealSize;
-            Attr.NonResident.AlignedSize = AttrAllocSize;
-            Attr.NonResident.RunList =
-                NTFS__DataRunsLoad(Arena, AttrPtr + AttrOffset,
-                                   AttrTotalSize - AttrOffset);
+        ntfs_attr *Attr = 0;
+        for (size_t Index = 0; Index < NTFS__ListLen(Extension.AttrList); Index++) {
+            ntfs_attr *Other = Extension.AttrList + Index;
+            if (Other->Type == Type && Other->Id == AttrId) {
+                Attr = Other;
+                break;
+            }
+        }
 
-        } else {
-            uint32_t AttrSize   = *NTFS_CAST(uint32_t *, AttrPtr + 0x10);
-            uint16_t AttrOffset = *NTFS_CAST(uint16_t *, AttrPtr + 0x14);
-            if (AttrOffset + AttrSize > AttrTotalSize) {
-                NTFS_RETURN(Result.Error, NTFS_Error_RecordFailedValidation);
+        if (Attr == 0) {
+            NTFS_RETURN(Result, NTFS_Error_RecordBadAttributeList);
+        }
+
+        ntfs_attr *First = 0;
+        if (Attr->NonResFlag && Attr->NonResident.FirstVCN) {
+            for (size_t Index = 0; Index < NTFS__ListLen(Record->AttrList); Index++) {
+                ntfs_attr *Other = Record->AttrList + Index;
+                if (Other->Type == Attr->Type && Other->NonResFlag &&
+                    Other->NameLength == Attr->NameLength &&
+                    NTFS_MEM_COMPARE(Other->Name, Attr->Name,
+                                     Attr->NameLength * sizeof(uint16_t)) == 0) {
+                    First = Other;
+                }
+            }
+        }
+
+        if (First) {
+            for (size_t Index = 0; Index < NTFS__ListLen(Attr->NonResident.RunList); Index++) {
+                NTFS__ListPush(Arena, First->NonResident.RunList, Attr->NonResident.RunList[Index]);
             }
+        } else {
+            NTFS__ListPush(Arena, Record->AttrList, *Attr);
+        }
+    }
+
+skip:
+    return Result;
+}
+
+ntfs_record NTFS__RecordParse(ntfs_volume *Volume, ntfs_arena *Arena,
+                              uint8_t *FileRecord, size_t Index)
+{
+    ntfs_record Result = NTFS__RecordParseEx(Volume, Arena, FileRecord, Index, false);
+    return Result;
+}
+
+ntfs_error NTFS__RecordApplyFixups(uint8_t *FileRecord, size_t Size)
+{
+    ntfs_error Result = NTFS_Error_Success;
+
+    uint16_t UsaOffset = *NTFS_CAST(uint16_t *, FileRecord + 0x04);
+    uint16_t UsaCount  = *NTFS_CAST(uint16_t *, FileRecord + 0x06);
+
+    bool IsValid = UsaCount > 1;
+    IsValid     &= (UsaCount - 1) * NTFS_FILE_RECORD_FIXUP_STRIDE == Size;
+    IsValid     &= UsaOffset + UsaCount * sizeof(uint16_t) <= NTFS_FILE_RECORD_FIXUP_STRIDE;
+    if (!IsValid) {
+        NTFS_RETURN(Result, NTFS_Error_RecordFailedValidation);
+    }
+
+    // Last two bytes of every stride hold the update sequence number,
+    // the original values are kept in the update sequence array.
+    // Mismatching strides are still fixed up so tolerant parsing can go on
+    uint16_t *Usa = NTFS_CAST(uint16_t *, FileRecord + UsaOffset);
+    for (size_t Index = 1; Index < UsaCount; Index++) {
+        uint16_t *StrideEnd =
+            NTFS_CAST(uint16_t *, FileRecord + Index * NTFS_FILE_RECORD_FIXUP_STRIDE - 2);
+        if (NTFS_UNLIKELY(*StrideEnd != Usa[0])) {
+            Result = NTFS_Error_RecordFixupMismatch;
+        }
 
-            Attr.Resident.Size = AttrSize;
-            if (Attr.Resident.Size > 0) {
-                Attr.Resident.Data = AttrPtr + AttrOffset;
+        *StrideEnd = Usa[Index];
+    }
+
+skip:
+    return Result;
+}
+
+bool NTFS__RecordReport(ntfs_volume *Volume, ntfs_record *Record,
+                        ntfs_error Reason, uint32_t Offset)
+{
+    // Contexts report against the volume they came from, so the limit
+    // holds across every thread
+    if (Volume->Shared) {
+        Volume = Volume->Shared;
+    }
+
+    bool Result = Volume->ParsePolicy == NTFS_ParsePolicy_Tolerant;
+
+    if (Result && Record->Issue == NTFS_Error_Success) {
+        Record->Issue       = Reason;
+        Record->IssueOffset = Offset;
+
+        int64_t Count = InterlockedIncrement64(NTFS_CAST(volatile LONG64 *,
+                                                         &Volume->ParseReportCount));
+        if (Volume->ParseReport &&
+            (Volume->ParseReportLimit == 0 || Count <= NTFS_CAST(int64_t, Volume->ParseReportLimit))) {
+            ntfs_parse_report Report = {
+                .RecordIndex = Record->Index,
+                .Offset      = Offset,
+                .Reason      = Reason,
+            };
+            Volume->ParseReport(Volume->ParseReportContext, &Report);
+        }
+    }
+
+    return Result;
+}
+
+ntfs_record NTFS__RecordParseEx(ntfs_volume *Volume, ntfs_arena *Arena,
+                                uint8_t *FileRecord, size_t Index, bool IncludeFree)
+{
+    ntfs_record Result = NTFS__RecordParseHeader(Volume, FileRecord, Index, IncludeFree);
+    if (Result.Error) {
+        NTFS_RETURN(Result.Error, Result.Error);
+    }
+
+    ntfs_attr        Attr   = { 0 };
+    ntfs_attr_cursor Cursor = NTFS_AttrCursorBegin(Volume, &Result);
+    while (NTFS_AttrCursorNext(&Cursor, 0, &Attr)) {
+        if (Attr.NonResFlag) {
+            Attr.NonResident.RunList = NTFS_AttrCursorRuns(&Cursor, Arena);
+            if (Cursor.Error) {
+                break;
             }
         }
 
         NTFS__ListPush(Arena, Result.AttrList, Attr);
-        AttrPtr += AttrTotalSize;
+    }
+
+    // Tolerant policy keeps the attributes before the corrupted one
+    if (NTFS_UNLIKELY(Cursor.Error) &&
+        !NTFS__RecordReport(Volume, &Result, Cursor.Error, Cursor.ErrorOffset)) {
+        NTFS_RETURN(Result.Error, NTFS_Error_RecordFailedValidation);
+    }
+
+skip:
+    return Result;
+}
+
+ntfs_record NTFS__RecordParseHeader(ntfs_volume *Volume, uint8_t *FileRecord,
+                                    size_t Index, bool IncludeFree)
+{
+    ntfs_record Result = { .Buffer = FileRecord };
+
+    uint32_t Magic     = *NTFS_CAST(uint32_t *, FileRecord + 0x00);
+    uint16_t Offset    = *NTFS_CAST(uint16_t *, FileRecord + 0x14);
+    uint16_t Flags     = *NTFS_CAST(uint16_t *, FileRecord + 0x16);
+    uint32_t RealSize  = *NTFS_CAST(uint32_t *, FileRecord + 0x18);
+    uint32_t AllocSize = *NTFS_CAST(uint32_t *, FileRecord + 0x1C);
+    uint64_t BaseRef   = *NTFS_CAST(uint64_t *, FileRecord + 0x20);
+    uint32_t MftIndex  = *NTFS_CAST(uint32_t *, FileRecord + 0x2C);
+
+    bool IsValid = Magic == NTFS_FILE_RECORD_MAGIC;
+    IsValid     &= IncludeFree || (Flags & 0x01);
+    if (!IsValid) {
+        NTFS_RETURN(Result.Error, NTFS_Error_RecordFailedValidation);
+    }
+    Result.IsDir     = Flags & 0x02;
+    Result.IsInUse   = Flags & 0x01;
+    Result.Index     = Index;
+    // Extension records of the $MFT reference index 0, only the sequence
+    // number tells them from a base record
+    Result.BaseIndex = BaseRef ? (BaseRef & 0xFFFFFFFFFFFF) : Index;
+
+    // Anything off past the magic is corruption, worth a report
+    IsValid  = Offset >= 0x30 && NTFS__IsAligned(Offset, 8);
+    IsValid &= Offset < RealSize;
+    IsValid &= RealSize <= AllocSize && AllocSize == Volume->BytesPerMftEntry;
+    IsValid &= MftIndex == Index;
+    if (NTFS_UNLIKELY(!IsValid)) {
+        NTFS__RecordReport(Volume, &Result, NTFS_Error_RecordFailedValidation, 0x14);
+        NTFS_RETURN(Result.Error, NTFS_Error_RecordFailedValidation);
+    }
+
+    ntfs_error Fixups = NTFS__RecordApplyFixups(FileRecord, Volume->BytesPerMftEntry);
+    if (NTFS_UNLIKELY(Fixups == NTFS_Error_RecordFailedValidation)) {
+        NTFS__RecordReport(Volume, &Result, Fixups, 0x04);
+        NTFS_RETURN(Result.Error, Fixups);
+
+    } else if (NTFS_UNLIKELY(Fixups) && !NTFS__RecordReport(Volume, &Result, Fixups, 0x04)) {
+        NTFS_RETURN(Result.Error, NTFS_Error_RecordFailedValidation);
     }
 
 skip:
     return Result;
 }
 
-ntfs_data_run *NTFS__DataRunsLoad(ntfs_arena *Arena, void *Buffer, size_t Size)
+ntfs_data_run *NTFS__DataRunsLoad(ntfs_arena *Arena, void *Buffer, size_t Size,
+                                  ntfs_error *Error)
 {
     uint8_t *DataRunPtr    = NTFS_CAST(uint8_t *, Buffer);
     uint8_t *DataRunEndPtr = DataRunPtr + Size;
@@ -925,31 +2665,50 @@ ntfs_data_run *NTFS__DataRunsLoad(ntfs_arena *Arena, void *Buffer, size_t Size)
             break;
         }
 
+        // Single check per run for both field sizes and the buffer end
         uint8_t LenSize =  *DataRunPtr & 0x0F;
         uint8_t OffSize = (*DataRunPtr & 0xF0) >> 4;
         DataRunPtr++;
+        if (NTFS_UNLIKELY(LenSize == 0 || LenSize > 8 || OffSize > 8 ||
+                          LenSize + OffSize > DataRunEndPtr - DataRunPtr)) {
+            NTFS_RETURN(*Error, NTFS_Error_RecordBadRunList);
+        }
 
         uint64_t Length = 0;
         for (int j = 0; j < LenSize; j++) {
-            Length |= *DataRunPtr << (8 * j);
+            Length |= NTFS_CAST(uint64_t, *DataRunPtr) << (8 * j);
             DataRunPtr++;
         }
 
-        int64_t Offset = 0;
+        // Offset is relative to previous run and sign extended
+        uint64_t Offset = 0;
         for (int j = 0; j < OffSize; j++) {
-            Offset |= *DataRunPtr << (8 * j);
+            Offset |= NTFS_CAST(uint64_t, *DataRunPtr) << (8 * j);
             DataRunPtr++;
         }
+        if (OffSize && OffSize < 8 && (DataRunPtr[-1] & 0x80)) {
+            Offset |= UINT64_MAX << (8 * OffSize);
+        }
 
-        ntfs_data_run Run = { .Count = Length, .StartVCN = (PrevVCN += Offset) };
+        // Sparse runs have no offset and are not backed by clusters
+        ntfs_data_run Run = {
+            .Count    = Length,
+            .StartVCN = (PrevVCN += Offset),
+            .IsSparse = OffSize == 0,
+        };
         NTFS__ListPush(Arena, Result, Run);
     }
 
+skip:
     return Result;
 }
 
 void NTFS_FileClose(ntfs_file *File)
 {
+    if (File->Wof) {
+        NTFS_WofClose(File->Wof);
+    }
+
     if (File->Arena.Buffer) {
         NTFS__ArenaDestroy(&File->Arena);
     }
@@ -959,54 +2718,222 @@ void NTFS_FileClose(ntfs_file *File)
 
 size_t NTFS_FileRead(ntfs_file *File, uint64_t Offset, uint8_t *Buffer, size_t Size)
 {
-    // TODO: Add support for unaligned params
-    NTFS_ASSERT(NTFS__IsAligned(Offset, File->Volume->BytesPerCluster),
-                "Offset must be aligned to cluster size");
-    NTFS_ASSERT(NTFS__IsAligned(Size, File->Volume->BytesPerCluster),
-                "Size must be aligned to cluster size");
-
     size_t Result = 0;
 
-    ntfs_attr *DataAttr = 0;
+    // WOF compressed data is decompressed transparently, files without an
+    // arena of their own open the chunk table for this read only
+    if (File->Wof == 0 && File->Flags.F.ReparsePoint &&
+        NTFS_FileReparsePoint(File).Tag == NTFS_REPARSE_TAG_WOF) {
+        ntfs_wof Wof = NTFS_WofOpen(File);
+        if (File->Arena.Buffer == 0) {
+            Result = NTFS_WofRead(&Wof, Offset, Buffer, Size);
+            if (Wof.Error) {
+                File->Error = Wof.Error;
+            }
+
+            NTFS_WofClose(&Wof);
+            NTFS_RETURN(Result, Result);
+        }
+
+        File->Wof  = NTFS__ArenaAlloc(&File->Arena, sizeof(*File->Wof));
+        *File->Wof = Wof;
+    }
+
+    if (File->Wof) {
+        Result = NTFS_WofRead(File->Wof, Offset, Buffer, Size);
+        if (File->Wof->Error) {
+            NTFS_RETURN(File->Error, File->Wof->Error);
+        }
+
+        NTFS_RETURN(Result, Result);
+    }
+
+    ntfs_attr *DataAttr = NTFS_FileFindAttr(File, NTFS_AttributeType_Data, 0, 0);
+    if (DataAttr == 0) {
+        NTFS_RETURN(File->Error, NTFS_Error_FileReadDataAttrNotFound);
+    }
+
+    Result = NTFS_FileReadAttr(File, DataAttr, Offset, Buffer, Size);
+
+skip:
+    return Result;
+}
+
+ntfs_attr *NTFS_FileFindAttr(ntfs_file *File, ntfs_attr_type Type,
+                             uint16_t *Name, size_t NameLength)
+{
+    ntfs_attr *Result = 0;
+
     for (size_t Index = 0; Index < NTFS__ListLen(File->Record.AttrList); Index++) {
         ntfs_attr *Attr = File->Record.AttrList + Index;
 
-        if (Attr->Type == NTFS_AttributeType_Data && !Attr->Name) {
-            DataAttr = Attr;
+        if (Attr->Type == Type &&
+            NTFS__NameEquals(File->Volume, Attr->Name, Attr->NameLength, Name, NameLength)) {
+            NTFS_RETURN(Result, Attr);
+        }
+    }
+
+skip:
+    return Result;
+}
+
+size_t NTFS_FileReadAttr(ntfs_file *File, ntfs_attr *Attr, uint64_t Offset,
+                         uint8_t *Buffer, size_t Size)
+{
+    size_t Result = 0;
+
+    if (!Attr->NonResFlag) {
+        if (Offset < Attr->Resident.Size) {
+            size_t SrcSize = Attr->Resident.Size - Offset;
+            if (SrcSize > Size) {
+                SrcSize = Size;
+            }
+
+            NTFS_MEM_COPY(Buffer, Size, Attr->Resident.Data + Offset, SrcSize);
+            Result = SrcSize;
+        }
+
+        NTFS_RETURN(Result, Result);
+    }
+
+    // The volume is read in whole sectors, a partial sector at either end
+    // goes through a bounce buffer
+    uint64_t SectorSize = File->Volume->BytesPerSector;
+    while (Size) {
+        uint64_t Skip = Offset % SectorSize;
+        if (Skip == 0 && Size >= SectorSize) {
+            size_t ReadSize  = Size - Size % SectorSize;
+            size_t BytesRead = NTFS__DataRunsRead(File->Volume, Attr->NonResident.RunList,
+                                                  Offset, Buffer + Result, ReadSize,
+                                                  &File->Error);
+            Result += BytesRead;
+            Offset += BytesRead;
+            Size   -= BytesRead;
+            if (BytesRead < ReadSize) {
+                break;
+            }
+
+            continue;
+        }
+
+        uint8_t Bounce[NTFS_MAX_SECTOR_SIZE];
+        size_t  BytesRead = NTFS__DataRunsRead(File->Volume, Attr->NonResident.RunList,
+                                               Offset - Skip, Bounce, SectorSize,
+                                               &File->Error);
+        if (BytesRead <= Skip) {
+            break;
+        }
+
+        size_t CopySize = BytesRead - Skip;
+        if (CopySize > Size) {
+            CopySize = Size;
+        }
+
+        NTFS_MEM_COPY(Buffer + Result, Size, Bounce + Skip, CopySize);
+        Result += CopySize;
+        Offset += CopySize;
+        Size   -= CopySize;
+        if (BytesRead < SectorSize) {
             break;
         }
     }
 
-    if (DataAttr == 0) {
-        NTFS_RETURN(File->Error, NTFS_Error_FileReadDataAttrNotFound);
+skip:
+    return Result;
+}
+
+bool NTFS__FileNameParse(ntfs_attr *Attr, ntfs_file_name *FileName)
+{
+    bool Result = !Attr->NonResFlag && Attr->Resident.Size >= 0x42;
+    if (!Result) {
+        NTFS_RETURN(Result, false);
+    }
+
+    uint8_t *Data    = Attr->Resident.Data;
+    uint64_t Parent  = *NTFS_CAST(uint64_t *, Data + 0x00);
+    *FileName        = (ntfs_file_name) {
+        .ParentIndex    = Parent & 0xFFFFFFFFFFFF,
+        .ParentSequence = NTFS_CAST(uint16_t, Parent >> 48),
+        .NameLength     = Data[0x40],
+        .NameSpace      = Data[0x41],
+        .Name           = NTFS_CAST(uint16_t *, Data + 0x42),
+    };
+
+    Result = FileName->NameLength * sizeof(uint16_t) <= Attr->Resident.Size - 0x42u;
+
+skip:
+    return Result;
+}
+
+bool NTFS__NameEquals(ntfs_volume *Volume, uint16_t *Name, size_t NameLength,
+                      uint16_t *Other, size_t OtherLength)
+{
+    bool Result = NameLength == OtherLength;
+
+    // Names are compared the same way NTFS does, through the volume $UpCase
+    for (size_t Index = 0; Result && Index < NameLength; Index++) {
+        uint16_t Char      = Name[Index];
+        uint16_t OtherChar = Other[Index];
+        if (Volume->CaseTable) {
+            Char      = Volume->CaseTable[Char];
+            OtherChar = Volume->CaseTable[OtherChar];
+        }
+
+        Result = Char == OtherChar;
     }
 
-    if (!DataAttr->NonResFlag) {
-        size_t SrcSize =
-            (DataAttr->Resident.Size > Size) ? Size : DataAttr->Resident.Size;
-        NTFS_MEM_COPY(Buffer, Size, DataAttr->Resident.Data, SrcSize);
-        NTFS_RETURN(Result, SrcSize);
+    return Result;
+}
+
+int NTFS__NameCompare(ntfs_volume *Volume, uint16_t *Name, size_t NameLength,
+                      uint16_t *Other, size_t OtherLength)
+{
+    int Result = 0;
+
+    // Same order $I30 indexes are sorted in, upcased code units first and
+    // the shorter name on a common prefix
+    for (size_t Index = 0; Result == 0 && Index < NameLength && Index < OtherLength; Index++) {
+        uint16_t Char      = Name[Index];
+        uint16_t OtherChar = Other[Index];
+        if (Volume->CaseTable) {
+            Char      = Volume->CaseTable[Char];
+            OtherChar = Volume->CaseTable[OtherChar];
+        }
+
+        Result = (Char > OtherChar) - (Char < OtherChar);
     }
 
-    uint64_t FileOffset   = 0;
-    uint64_t BufferOffset = 0;
-    for (size_t Index = 0; Index < NTFS__ListLen(DataAttr->NonResident.RunList) && Size; Index++) {
-        ntfs_data_run *Run = DataAttr->NonResident.RunList + Index;
+    if (Result == 0) {
+        Result = (NameLength > OtherLength) - (NameLength < OtherLength);
+    }
+
+    return Result;
+}
 
-        size_t   ReadSize   = Run->Count * File->Volume->BytesPerCluster;
-        uint64_t ReadOffset = Run->StartVCN * File->Volume->BytesPerCluster;
+size_t NTFS__DataRunsRead(ntfs_volume *Volume, ntfs_data_run *RunList, uint64_t Offset,
+                          uint8_t *Buffer, size_t Size, ntfs_error *Error)
+{
+    size_t Result = 0;
 
-        if (Offset <= FileOffset + ReadSize) {
+    uint64_t FileOffset   = 0;
+    uint64_t BufferOffset = 0;
+    for (size_t Index = 0; Index < NTFS__ListLen(RunList) && Size; Index++) {
+        ntfs_data_run *Run = RunList + Index;
+
+        uint64_t RunSize = Run->Count * Volume->BytesPerCluster;
+        if (Offset < FileOffset + RunSize) {
+            uint64_t RunSkip    = Offset - FileOffset;
+            uint64_t ReadOffset = Run->StartVCN * Volume->BytesPerCluster + RunSkip;
+            size_t   ReadSize   = RunSize - RunSkip;
             if (Size < ReadSize) {
                 ReadSize = Size;
             }
 
-            if (FileOffset < Offset) {
-                ReadOffset += Offset - FileOffset;
-            }
+            if (Run->IsSparse) {
+                NTFS_MEM_SET(Buffer + BufferOffset, 0, ReadSize);
 
-            if (!NTFS_VolumeRead(File->Volume, ReadOffset, Buffer + BufferOffset, ReadSize)) {
-                NTFS_RETURN(File->Error, NTFS_Error_FileReadFailed);
+            } else if (!NTFS_VolumeRead(Volume, ReadOffset, Buffer + BufferOffset, ReadSize)) {
+                NTFS_RETURN(*Error, NTFS_Error_FileReadFailed);
             }
 
             Offset += ReadSize;
@@ -1015,11 +2942,7833 @@ size_t NTFS_FileRead(ntfs_file *File, uint64_t Offset, uint8_t *Buffer, size_t S
             Size -= ReadSize;
         }
 
-        FileOffset += ReadSize;
+        FileOffset += RunSize;
+    }
+
+skip:
+    return Result;
+}
+
+// Bitmap API
+static inline size_t NTFS__BitmapSkipWords(uint64_t *Words, size_t Index, size_t End,
+                                           uint64_t Pattern)
+{
+#if defined(__AVX2__)
+    __m256i Fill = _mm256_set1_epi64x(NTFS_CAST(int64_t, Pattern));
+    while (Index + 4 <= End) {
+        __m256i Block = _mm256_loadu_si256(NTFS_CAST(__m256i *, Words + Index));
+        __m256i Diff  = _mm256_xor_si256(Block, Fill);
+        if (!_mm256_testz_si256(Diff, Diff)) {
+            break;
+        }
+
+        Index += 4;
+    }
+#endif
+
+    while (Index < End && Words[Index] == Pattern) {
+        Index++;
+    }
+
+    return Index;
+}
+
+static inline uint64_t NTFS__PopCountWords(uint64_t *Words, size_t Count)
+{
+    uint64_t Result = 0;
+    size_t   Index  = 0;
+
+#if defined(__AVX2__)
+    // Nibble lookup popcount, accumulated per 64bit lane with sad
+    const __m256i Lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                            0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i LowMask = _mm256_set1_epi8(0x0F);
+    __m256i Total = _mm256_setzero_si256();
+    for (; Index + 4 <= Count; Index += 4) {
+        __m256i Block = _mm256_loadu_si256(NTFS_CAST(__m256i *, Words + Index));
+        __m256i Low   = _mm256_and_si256(Block, LowMask);
+        __m256i High  = _mm256_and_si256(_mm256_srli_epi16(Block, 4), LowMask);
+        __m256i Bits  = _mm256_add_epi8(_mm256_shuffle_epi8(Lookup, Low),
+                                        _mm256_shuffle_epi8(Lookup, High));
+        Total = _mm256_add_epi64(Total, _mm256_sad_epu8(Bits, _mm256_setzero_si256()));
+    }
+
+    uint64_t Lanes[4];
+    _mm256_storeu_si256(NTFS_CAST(__m256i *, Lanes), Total);
+    Result = Lanes[0] + Lanes[1] + Lanes[2] + Lanes[3];
+#endif
+
+    for (; Index < Count; Index++) {
+        Result += NTFS__PopCount64(Words[Index]);
+    }
+
+    return Result;
+}
+
+ntfs_bitmap NTFS_BitmapOpen(ntfs_volume *Volume)
+{
+    ntfs_bitmap Result = {
+        .File = NTFS_FileOpenFromIndex(Volume, NTFS_SystemFile_Bitmap),
+    };
+
+    if (Result.File.Error) {
+        NTFS_RETURN(Result.Error, NTFS_Error_BitmapFailedOpen);
+    }
+
+    Result.TotalClusters = Volume->TotalClusters;
+    if (Result.TotalClusters > Result.File.Size * 8) {
+        Result.TotalClusters = Result.File.Size * 8;
+    }
+
+    Result.WindowSize = NTFS__Align(NTFS_BITMAP_WINDOW_SIZE, Volume->BytesPerCluster);
+    Result.Window     = NTFS__ArenaAlloc(&Result.File.Arena, Result.WindowSize);
+
+skip:
+    return Result;
+}
+
+void NTFS_BitmapClose(ntfs_bitmap *Bitmap)
+{
+    NTFS_FileClose(&Bitmap->File);
+
+    *Bitmap = (ntfs_bitmap) { .Error = Bitmap->Error };
+}
+
+bool NTFS_BitmapIsAllocated(ntfs_bitmap *Bitmap, uint64_t LCN)
+{
+    bool Result = false;
+
+    if (LCN < Bitmap->TotalClusters && NTFS__BitmapLoadWindow(Bitmap, LCN)) {
+        uint64_t Bit = LCN - Bitmap->WindowLCN;
+        Result = (Bitmap->Window[Bit / 8] >> (Bit % 8)) & 1;
+    }
+
+    return Result;
+}
+
+// Unread clusters are neither free nor allocated, a failed read returns
+// UINT64_MAX with the reason in Bitmap->Error
+uint64_t NTFS_BitmapFreeClusters(ntfs_bitmap *Bitmap)
+{
+    uint64_t Result    = UINT64_MAX;
+    uint64_t Allocated = 0;
+
+    for (uint64_t LCN = 0; LCN < Bitmap->TotalClusters; LCN += Bitmap->WindowClusters) {
+        if (!NTFS__BitmapLoadWindow(Bitmap, LCN)) {
+            NTFS_RETURN(Result, UINT64_MAX);
+        }
+
+        uint64_t *Words     = NTFS_CAST(uint64_t *, Bitmap->Window);
+        size_t    FullWords = Bitmap->WindowClusters / 64;
+        size_t    TailBits  = Bitmap->WindowClusters % 64;
+
+        Allocated += NTFS__PopCountWords(Words, FullWords);
+        if (TailBits) {
+            Allocated += NTFS__PopCount64(Words[FullWords] & ((1ULL << TailBits) - 1));
+        }
     }
 
+    Result = Bitmap->TotalClusters - Allocated;
+
 skip:
     return Result;
 }
 
+uint64_t NTFS_BitmapRangeFree(ntfs_bitmap *Bitmap, uint64_t LCN, uint64_t Count)
+{
+    uint64_t Result = 0;
+    uint64_t EndLCN = LCN + Count;
+    if (EndLCN > Bitmap->TotalClusters) {
+        EndLCN = Bitmap->TotalClusters;
+    }
+
+    while (LCN < EndLCN) {
+        uint64_t FreeStart = NTFS__BitmapFind(Bitmap, LCN, false);
+        if (FreeStart >= EndLCN) {
+            break;
+        }
+
+        uint64_t FreeEnd = NTFS__BitmapFind(Bitmap, FreeStart, true);
+        if (FreeEnd > EndLCN) {
+            FreeEnd = EndLCN;
+        }
+
+        Result += FreeEnd - FreeStart;
+        LCN     = FreeEnd;
+    }
+
+    return Result;
+}
+
+size_t NTFS_BitmapLargestFree(ntfs_bitmap *Bitmap, ntfs_extent *Extents, size_t Count)
+{
+    size_t Result = 0;
+
+    // Extents is kept sorted from largest to smallest, most extents are
+    // rejected by the comparison against the last one
+    ntfs_extent Extent = { 0 };
+    NTFS_BitmapRewind(Bitmap, 0);
+    while (Count && NTFS_BitmapNextExtent(Bitmap, false, &Extent)) {
+        if (Result == Count && Extent.Count <= Extents[Count - 1].Count) {
+            continue;
+        }
+
+        size_t Index = (Result < Count) ? Result++ : Count - 1;
+        while (Index > 0 && Extents[Index - 1].Count < Extent.Count) {
+            Extents[Index] = Extents[Index - 1];
+            Index--;
+        }
+        Extents[Index] = Extent;
+    }
+
+    return Result;
+}
+
+void NTFS_BitmapRewind(ntfs_bitmap *Bitmap, uint64_t LCN)
+{
+    Bitmap->Cursor = LCN;
+}
+
+bool NTFS_BitmapNextExtent(ntfs_bitmap *Bitmap, bool Allocated, ntfs_extent *Extent)
+{
+    bool Result = false;
+
+    uint64_t Start = NTFS__BitmapFind(Bitmap, Bitmap->Cursor, Allocated);
+    if (Start >= Bitmap->TotalClusters || Bitmap->Error) {
+        Bitmap->Cursor = Bitmap->TotalClusters;
+        NTFS_RETURN(Result, false);
+    }
+
+    uint64_t End   = NTFS__BitmapFind(Bitmap, Start, !Allocated);
+    Bitmap->Cursor = End;
+
+    *Extent = (ntfs_extent) { .StartLCN = Start, .Count = End - Start };
+    Result  = true;
+
+skip:
+    return Result;
+}
+
+bool NTFS__BitmapLoadWindow(ntfs_bitmap *Bitmap, uint64_t LCN)
+{
+    bool Result = false;
+
+    uint64_t WindowBits = Bitmap->WindowSize * 8;
+    uint64_t WindowLCN  = LCN - (LCN % WindowBits);
+    if (Bitmap->WindowClusters && Bitmap->WindowLCN == WindowLCN) {
+        NTFS_RETURN(Result, true);
+    }
+
+    uint64_t ReadOffset = WindowLCN / 8;
+    size_t   ReadSize   = Bitmap->WindowSize;
+    if (ReadOffset + ReadSize > Bitmap->File.AlignedSize) {
+        ReadSize = Bitmap->File.AlignedSize - ReadOffset;
+    }
+
+    Bitmap->WindowClusters = 0;
+    size_t BytesRead = NTFS_FileRead(&Bitmap->File, ReadOffset, Bitmap->Window, ReadSize);
+    if (BytesRead == 0) {
+        NTFS_RETURN(Bitmap->Error, NTFS_Error_BitmapFailedRead);
+    }
+
+    Bitmap->WindowLCN      = WindowLCN;
+    Bitmap->WindowClusters = BytesRead * 8;
+    if (Bitmap->WindowClusters > Bitmap->TotalClusters - WindowLCN) {
+        Bitmap->WindowClusters = Bitmap->TotalClusters - WindowLCN;
+    }
+    Result = true;
+
+skip:
+    return Result;
+}
+
+uint64_t NTFS__BitmapFind(ntfs_bitmap *Bitmap, uint64_t LCN, bool Allocated)
+{
+    uint64_t Result = Bitmap->TotalClusters;
+    uint64_t Invert = Allocated ? 0 : UINT64_MAX;
+
+    while (LCN < Bitmap->TotalClusters && NTFS__BitmapLoadWindow(Bitmap, LCN)) {
+        uint64_t *Words = NTFS_CAST(uint64_t *, Bitmap->Window);
+        uint64_t  Bit   = LCN - Bitmap->WindowLCN;
+        size_t    Index = Bit / 64;
+        size_t    End   = (Bitmap->WindowClusters + 63) / 64;
+
+        uint64_t Word = (Words[Index] ^ Invert) & (UINT64_MAX << (Bit % 64));
+        if (Word == 0) {
+            Index = NTFS__BitmapSkipWords(Words, Index + 1, End, Invert);
+            Word  = (Index < End) ? Words[Index] ^ Invert : 0;
+        }
+
+        if (Word) {
+            uint64_t Found = Index * 64 + NTFS__CountTrailingZeros64(Word);
+            if (Found < Bitmap->WindowClusters) {
+                NTFS_RETURN(Result, Bitmap->WindowLCN + Found);
+            }
+        }
+
+        LCN = Bitmap->WindowLCN + Bitmap->WindowClusters;
+    }
+
+skip:
+    return Result;
+}
+
+// MFT scan API
+ntfs_mft_scan NTFS_MftScanBegin(ntfs_volume *Volume)
+{
+    ntfs_mft_scan Result = {
+        .Volume = Volume,
+        .Mft    = NTFS_FileOpenFromIndex(Volume, NTFS_SystemFile_Mft),
+        .Arena  = NTFS__ArenaDefault(),
+    };
+
+    if (Result.Mft.Error) {
+        NTFS_RETURN(Result.Error, NTFS_Error_ScanFailedOpenMft);
+    }
+
+    if (Result.Arena.Buffer == 0) {
+        NTFS_RETURN(Result.Error, NTFS_Error_MemoryError);
+    }
+
+    Result.RecordCount = Result.Mft.Size / Volume->BytesPerMftEntry;
+    Result.BufferSize  = NTFS__Align(NTFS_MFT_SCAN_BUFFER_SIZE, Volume->BytesPerCluster);
+    Result.Buffer      = NTFS__ArenaAllocAligned(&Result.Mft.Arena, Result.BufferSize,
+                                                 NTFS_DIRECT_ALIGNMENT);
+
+skip:
+    return Result;
+}
+
+bool NTFS_MftScanNext(ntfs_mft_scan *Scan, ntfs_record *Record)
+{
+    bool Result = false;
+
+    while (!Scan->Error && Scan->NextIndex < Scan->RecordCount) {
+        uint64_t Index      = Scan->NextIndex++;
+        uint8_t *FileRecord = NTFS__MftScanRecordBuffer(Scan, Index);
+        if (FileRecord == 0) {
+            break;
+        }
+
+        // Records are only valid until the next call
+        if (Scan->HeadersOnly) {
+            *Record = NTFS__RecordParseHeader(Scan->Volume, FileRecord, Index,
+                                              Scan->IncludeFree);
+        } else {
+            NTFS__ArenaReset(&Scan->Arena);
+            *Record = NTFS__RecordParseEx(Scan->Volume, &Scan->Arena, FileRecord, Index,
+                                          Scan->IncludeFree);
+        }
+        if (Record->Error == NTFS_Error_Success) {
+            NTFS_RETURN(Result, true);
+        }
+    }
+
+skip:
+    return Result;
+}
+
+void NTFS_MftScanEnd(ntfs_mft_scan *Scan)
+{
+    NTFS_FileClose(&Scan->Mft);
+    if (Scan->Arena.Buffer) {
+        NTFS__ArenaDestroy(&Scan->Arena);
+    }
+
+    *Scan = (ntfs_mft_scan) { .Error = Scan->Error };
+}
+
+uint8_t *NTFS__MftScanRecordBuffer(ntfs_mft_scan *Scan, uint64_t Index)
+{
+    uint8_t *Result = 0;
+
+    if (Index < Scan->BufferIndex || Index >= Scan->BufferIndex + Scan->BufferCount) {
+        uint64_t RecordsPerBuffer = Scan->BufferSize / Scan->Volume->BytesPerMftEntry;
+        uint64_t ReadIndex        = Index - (Index % RecordsPerBuffer);
+        uint64_t ReadOffset       = ReadIndex * Scan->Volume->BytesPerMftEntry;
+
+        size_t ReadSize = Scan->BufferSize;
+        if (ReadOffset + ReadSize > Scan->Mft.AlignedSize) {
+            ReadSize = Scan->Mft.AlignedSize - ReadOffset;
+        }
+
+        Scan->BufferCount = 0;
+        size_t BytesRead  = NTFS_FileRead(&Scan->Mft, ReadOffset, Scan->Buffer, ReadSize);
+        if (BytesRead == 0) {
+            NTFS_RETURN(Scan->Error, NTFS_Error_ScanFailedRead);
+        }
+
+        Scan->BufferIndex = ReadIndex;
+        Scan->BufferCount = BytesRead / Scan->Volume->BytesPerMftEntry;
+    }
+
+    Result = Scan->Buffer + (Index - Scan->BufferIndex) * Scan->Volume->BytesPerMftEntry;
+
+skip:
+    return Result;
+}
+
+
+// Cluster owner API
+static void NTFS__OwnerMapAdd(ntfs_owner_map *Map, ntfs_record *Record)
+{
+    ntfs_fragmentation *Stats = &Map->Fragmentation;
+    for (size_t i = 0; i < NTFS__ListLen(Record->AttrList); i++) {
+        ntfs_attr *Attr = Record->AttrList + i;
+        if (!Attr->NonResFlag) {
+            continue;
+        }
+
+        uint64_t VCN       = Attr->NonResident.FirstVCN;
+        uint64_t Fragments = 0;
+        uint64_t PrevEnd   = UINT64_MAX;
+        for (size_t j = 0; j < NTFS__ListLen(Attr->NonResident.RunList); j++) {
+            ntfs_data_run *Run = Attr->NonResident.RunList + j;
+            if (!Run->IsSparse && Run->Count) {
+                ntfs_owner_extent Extent = {
+                    .StartLCN    = Run->StartVCN,
+                    .Count       = Run->Count,
+                    .VCN         = VCN,
+                    .RecordIndex = Record->BaseIndex,
+                    .Type        = Attr->Type,
+                    .AttrId      = Attr->Id,
+                };
+                NTFS__ListPush(&Map->Arena, Map->Extents, Extent);
+
+                // Physically adjacent runs are not a fragment
+                Fragments += Run->StartVCN != PrevEnd;
+                PrevEnd    = Run->StartVCN + Run->Count;
+                Stats->AllocatedClusters += Run->Count;
+            }
+
+            VCN += Run->Count;
+        }
+
+        if (Fragments) {
+            Stats->Attributes++;
+            Stats->FragmentedAttributes += Fragments > 1;
+            if (Fragments > Stats->MaxFragments) {
+                Stats->MaxFragments      = Fragments;
+                Stats->MaxFragmentsIndex = Record->BaseIndex;
+            }
+        }
+    }
+}
+
+static uint64_t NTFS__OwnerMapAugment(ntfs_owner_extent *Extents, size_t Low, size_t High)
+{
+    uint64_t Result = 0;
+
+    if (Low < High) {
+        size_t             Mid    = Low + (High - Low) / 2;
+        ntfs_owner_extent *Extent = Extents + Mid;
+        uint64_t           Left   = NTFS__OwnerMapAugment(Extents, Low, Mid);
+        uint64_t           Right  = NTFS__OwnerMapAugment(Extents, Mid + 1, High);
+
+        Result = Extent->StartLCN + Extent->Count;
+        Result = Left > Result ? Left : Result;
+        Result = Right > Result ? Right : Result;
+        Extent->MaxEndLCN = Result;
+    }
+
+    return Result;
+}
+
+static void NTFS__OwnerMapFinish(ntfs_owner_map *Map)
+{
+    size_t Count = NTFS__ListLen(Map->Extents);
+    if (Count) {
+        void *Scratch = NTFS__ArenaAlloc(&Map->Arena, Count * sizeof(*Map->Extents));
+        NTFS__RadixSort(Map->Extents, Scratch, Count, sizeof(*Map->Extents),
+                        offsetof(ntfs_owner_extent, StartLCN));
+    }
+
+    NTFS__OwnerMapAugment(Map->Extents, 0, Count);
+    Map->Fragmentation.Extents = Count;
+}
+
+ntfs_owner_map NTFS_OwnerMapBuild(ntfs_volume *Volume)
+{
+    ntfs_owner_map Result = {
+        .Arena = NTFS__ArenaCreate(NTFS_OWNER_MAP_RESERVED, NTFS__ARENA_DEFAULT_COMMIT),
+    };
+    ntfs_mft_scan Scan = NTFS_MftScanBegin(Volume);
+
+    if (Result.Arena.Buffer == 0) {
+        NTFS_RETURN(Result.Error, NTFS_Error_MemoryError);
+    }
+
+    if (Scan.Error) {
+        NTFS_RETURN(Result.Error, Scan.Error);
+    }
+
+    ntfs_record Record = { 0 };
+    while (NTFS_MftScanNext(&Scan, &Record)) {
+        NTFS__OwnerMapAdd(&Result, &Record);
+    }
+
+    if (Scan.Error) {
+        NTFS_RETURN(Result.Error, Scan.Error);
+    }
+
+    NTFS__OwnerMapFinish(&Result);
+
+skip:
+    NTFS_MftScanEnd(&Scan);
+    return Result;
+}
+
+void NTFS_OwnerMapDestroy(ntfs_owner_map *Map)
+{
+    if (Map->Arena.Buffer) {
+        NTFS__ArenaDestroy(&Map->Arena);
+    }
+
+    *Map = (ntfs_owner_map) { .Error = Map->Error };
+}
+
+// A left subtree reaching past LCN either holds an owner or only extents
+// starting past LCN, and so does everything right of it. One path down
+ntfs_owner_extent *NTFS_OwnerMapFind(ntfs_owner_map *Map, uint64_t LCN)
+{
+    ntfs_owner_extent *Result = 0;
+
+    size_t Low  = 0;
+    size_t High = NTFS__ListLen(Map->Extents);
+    while (Low < High && Map->Extents[Low + (High - Low) / 2].MaxEndLCN > LCN) {
+        size_t             Mid    = Low + (High - Low) / 2;
+        ntfs_owner_extent *Extent = Map->Extents + Mid;
+        if (Extent->StartLCN <= LCN && Extent->StartLCN + Extent->Count > LCN) {
+            NTFS_RETURN(Result, Extent);
+        }
+
+        size_t LeftMid = Low + (Mid - Low) / 2;
+        if (Low < Mid && Map->Extents[LeftMid].MaxEndLCN > LCN) {
+            High = Mid;
+        } else if (Extent->StartLCN <= LCN) {
+            Low = Mid + 1;
+        } else {
+            break;
+        }
+    }
+
+skip:
+    return Result;
+}
+
+// In order walk of the subtrees that reach past LCN and start before
+// EndLCN, results come out in LCN order
+static size_t NTFS__OwnerMapCollect(ntfs_owner_map *Map, size_t Low, size_t High,
+                                    uint64_t LCN, uint64_t EndLCN,
+                                    ntfs_owner_extent *Results, size_t MaxResults, size_t Found)
+{
+    size_t Result = Found;
+
+    while (Low < High) {
+        size_t             Mid    = Low + (High - Low) / 2;
+        ntfs_owner_extent *Extent = Map->Extents + Mid;
+        if (Extent->MaxEndLCN <= LCN) {
+            break;
+        }
+
+        Result = NTFS__OwnerMapCollect(Map, Low, Mid, LCN, EndLCN, Results, MaxResults, Result);
+        if (Extent->StartLCN >= EndLCN) {
+            break;
+        }
+
+        if (Extent->StartLCN + Extent->Count > LCN) {
+            if (Result < MaxResults) {
+                Results[Result] = *Extent;
+            }
+
+            Result++;
+        }
+        Low = Mid + 1;
+    }
+
+    return Result;
+}
+
+size_t NTFS_OwnerMapQuery(ntfs_owner_map *Map, uint64_t LCN, uint64_t Count,
+                          ntfs_owner_extent *Results, size_t MaxResults)
+{
+    size_t Result = NTFS__OwnerMapCollect(Map, 0, NTFS__ListLen(Map->Extents), LCN, LCN + Count,
+                                          Results, MaxResults, 0);
+    return Result;
+}
+
+void NTFS__RadixSort(void *Items, void *Scratch, size_t Count, size_t ItemSize, size_t KeyOffset)
+{
+    uint8_t *Source = Items;
+    uint8_t *Dest   = Scratch;
+
+    for (size_t Shift = 0; Shift < 64 && Count; Shift += 8) {
+        size_t Offsets[256] = { 0 };
+        for (size_t Index = 0; Index < Count; Index++) {
+            uint64_t Key = *NTFS_CAST(uint64_t *, Source + Index * ItemSize + KeyOffset);
+            Offsets[(Key >> Shift) & 0xFF]++;
+        }
+
+        // Skip passes where every key has the same digit
+        uint64_t FirstKey = *NTFS_CAST(uint64_t *, Source + KeyOffset);
+        if (Offsets[(FirstKey >> Shift) & 0xFF] == Count) {
+            continue;
+        }
+
+        size_t Total = 0;
+        for (size_t Digit = 0; Digit < 256; Digit++) {
+            size_t DigitCount = Offsets[Digit];
+            Offsets[Digit]    = Total;
+            Total            += DigitCount;
+        }
+
+        for (size_t Index = 0; Index < Count; Index++) {
+            uint8_t *Item  = Source + Index * ItemSize;
+            uint64_t Key   = *NTFS_CAST(uint64_t *, Item + KeyOffset);
+            size_t   Digit = (Key >> Shift) & 0xFF;
+            NTFS_MEM_COPY(Dest + Offsets[Digit]++ * ItemSize, ItemSize, Item, ItemSize);
+        }
+
+        uint8_t *Temp = Source;
+        Source        = Dest;
+        Dest          = Temp;
+    }
+
+    if (Source != Items) {
+        NTFS_MEM_COPY(Items, Count * ItemSize, Source, Count * ItemSize);
+    }
+}
+
+// Hash API
+typedef struct {
+    uint64_t       FirstLCN;
+    uint64_t       RecordIndex;
+    uint64_t       Size;
+    ntfs_data_run *RunList;
+
+    ntfs_error Error;
+    uint64_t   NextSequence;
+    void      *Hashes[NTFS_HASH_ALGORITHM_COUNT];
+} ntfs__hash_job;
+
+typedef struct {
+    ntfs__hash_job *Job;
+    uint8_t        *Buffer;
+    uint64_t        Sequence;
+    size_t          Size;
+    bool            IsLast;
+} ntfs__hash_chunk;
+
+typedef struct {
+    ntfs_volume       *Volume;
+    ntfs_hash_options  Options;
+    ntfs_hash_summary  Summary;
+    void              *Providers[NTFS_HASH_ALGORITHM_COUNT];
+
+    ntfs__hash_job *Jobs;
+    volatile LONG64 NextJob;
+
+    SRWLOCK            Lock;
+    CONDITION_VARIABLE BufferFree;
+    CONDITION_VARIABLE ChunkReady;
+    CONDITION_VARIABLE JobAdvanced;
+    uint32_t           ReadersRunning;
+
+    // Buffers cycle from the free stack, through the ready queue, and back
+    uint8_t          **FreeBuffers;
+    size_t             FreeCount;
+    ntfs__hash_chunk  *Queue;
+    size_t             QueueHead;
+    size_t             QueueCount;
+} ntfs__hash_pipeline;
+
+static bool NTFS__HashBegin(ntfs__hash_pipeline *Pipeline, void **Hashes)
+{
+    bool Result = true;
+
+    for (size_t Index = 0; Index < NTFS_HASH_ALGORITHM_COUNT; Index++) {
+        Hashes[Index] = 0;
+        if (Pipeline->Options.Algorithms & (1 << Index)) {
+            Hashes[Index] = NTFS__Win32HashCreate(Pipeline->Providers[Index]);
+            Result       &= Hashes[Index] != 0;
+        }
+    }
+
+    return Result;
+}
+
+static bool NTFS__HashUpdate(void **Hashes, void *Buffer, size_t Size)
+{
+    bool Result = true;
+
+    for (size_t Index = 0; Index < NTFS_HASH_ALGORITHM_COUNT && Size; Index++) {
+        if (Hashes[Index]) {
+            Result &= NTFS__Win32HashUpdate(Hashes[Index], Buffer, Size);
+        }
+    }
+
+    return Result;
+}
+
+static void NTFS__HashFinish(void **Hashes, ntfs_hash_result *Result)
+{
+    uint8_t *Digests[NTFS_HASH_ALGORITHM_COUNT] = { Result->Md5, Result->Sha1, Result->Sha256 };
+    size_t   Sizes[NTFS_HASH_ALGORITHM_COUNT]   = {
+        sizeof(Result->Md5), sizeof(Result->Sha1), sizeof(Result->Sha256),
+    };
+
+    for (size_t Index = 0; Index < NTFS_HASH_ALGORITHM_COUNT; Index++) {
+        if (Hashes[Index]) {
+            if (!NTFS__Win32HashFinish(Hashes[Index], Digests[Index], Sizes[Index])) {
+                Result->Error = NTFS_Error_HashFailedInit;
+            }
+
+            Hashes[Index] = 0;
+        }
+    }
+}
+
+static void NTFS__HashReport(ntfs__hash_pipeline *Pipeline, ntfs_hash_result *Result,
+                             uint64_t BytesRead)
+{
+    AcquireSRWLockExclusive(&Pipeline->Lock);
+    Pipeline->Summary.Files++;
+    Pipeline->Summary.FailedFiles += Result->Error != NTFS_Error_Success;
+    Pipeline->Summary.BytesRead   += BytesRead;
+    ReleaseSRWLockExclusive(&Pipeline->Lock);
+
+    if (Pipeline->Options.Callback) {
+        Pipeline->Options.Callback(Pipeline->Options.Context, Result);
+    }
+}
+
+static void NTFS__HashInline(ntfs__hash_pipeline *Pipeline, uint64_t RecordIndex,
+                             void *Buffer, size_t Size, ntfs_error Error)
+{
+    ntfs_hash_result Result = { .Error = Error, .RecordIndex = RecordIndex, .Size = Size };
+
+    void *Hashes[NTFS_HASH_ALGORITHM_COUNT] = { 0 };
+    if (Result.Error == NTFS_Error_Success) {
+        if (!NTFS__HashBegin(Pipeline, Hashes) || !NTFS__HashUpdate(Hashes, Buffer, Size)) {
+            Result.Error = NTFS_Error_HashFailedInit;
+        }
+        NTFS__HashFinish(Hashes, &Result);
+    }
+
+    NTFS__HashReport(Pipeline, &Result, 0);
+}
+
+static DWORD WINAPI NTFS__HashReaderThread(void *Param)
+{
+    ntfs__hash_pipeline *Pipeline = Param;
+    ntfs_volume         *Volume   = Pipeline->Volume;
+    size_t               JobCount = NTFS__ListLen(Pipeline->Jobs);
+
+    // Readers fall back to the shared handle when it cannot be reopened
+    ntfs_context Context = NTFS_ContextCreate(Volume);
+    if (Context.Error == NTFS_Error_Success) {
+        Volume = &Context.Volume;
+    }
+
+    for (;;) {
+        uint64_t JobIndex = InterlockedIncrement64(&Pipeline->NextJob) - 1;
+        if (JobIndex >= JobCount) {
+            break;
+        }
+
+        ntfs__hash_job *Job      = Pipeline->Jobs + JobIndex;
+        uint64_t        Offset   = 0;
+        uint64_t        Sequence = 0;
+        bool            IsLast   = false;
+        while (!IsLast) {
+            AcquireSRWLockExclusive(&Pipeline->Lock);
+            while (Pipeline->FreeCount == 0) {
+                SleepConditionVariableSRW(&Pipeline->BufferFree, &Pipeline->Lock, INFINITE, 0);
+            }
+            uint8_t *Buffer = Pipeline->FreeBuffers[--Pipeline->FreeCount];
+            ReleaseSRWLockExclusive(&Pipeline->Lock);
+
+            // Reads stay cluster aligned, only the file size is hashed
+            size_t HashSize = Pipeline->Options.BufferSize;
+            if (HashSize > Job->Size - Offset) {
+                HashSize = Job->Size - Offset;
+            }
+            size_t ReadSize = NTFS__Align(HashSize, Volume->BytesPerCluster);
+
+            ntfs_error Error = NTFS_Error_Success;
+            NTFS__DataRunsRead(Volume, Job->RunList, Offset, Buffer, ReadSize, &Error);
+            if (Error) {
+                Job->Error = Error;
+                HashSize   = 0;
+            }
+
+            Offset += HashSize;
+            IsLast  = Error || Offset == Job->Size;
+
+            ntfs__hash_chunk Chunk = {
+                .Job      = Job,
+                .Buffer   = Buffer,
+                .Sequence = Sequence++,
+                .Size     = HashSize,
+                .IsLast   = IsLast,
+            };
+
+            AcquireSRWLockExclusive(&Pipeline->Lock);
+            size_t Tail = (Pipeline->QueueHead + Pipeline->QueueCount) % Pipeline->Options.BufferCount;
+            Pipeline->Queue[Tail] = Chunk;
+            Pipeline->QueueCount++;
+            ReleaseSRWLockExclusive(&Pipeline->Lock);
+            WakeConditionVariable(&Pipeline->ChunkReady);
+        }
+    }
+
+    AcquireSRWLockExclusive(&Pipeline->Lock);
+    Pipeline->ReadersRunning--;
+    ReleaseSRWLockExclusive(&Pipeline->Lock);
+    WakeAllConditionVariable(&Pipeline->ChunkReady);
+
+    NTFS_ContextDestroy(&Context);
+    return 0;
+}
+
+static DWORD WINAPI NTFS__HashWorkerThread(void *Param)
+{
+    ntfs__hash_pipeline *Pipeline = Param;
+
+    for (;;) {
+        AcquireSRWLockExclusive(&Pipeline->Lock);
+        while (Pipeline->QueueCount == 0 && Pipeline->ReadersRunning) {
+            SleepConditionVariableSRW(&Pipeline->ChunkReady, &Pipeline->Lock, INFINITE, 0);
+        }
+
+        if (Pipeline->QueueCount == 0) {
+            ReleaseSRWLockExclusive(&Pipeline->Lock);
+            break;
+        }
+
+        ntfs__hash_chunk Chunk = Pipeline->Queue[Pipeline->QueueHead];
+        Pipeline->QueueHead    = (Pipeline->QueueHead + 1) % Pipeline->Options.BufferCount;
+        Pipeline->QueueCount--;
+
+        // Chunks of a file are queued in order by a single reader, so the
+        // previous chunk was already taken by another worker
+        ntfs__hash_job *Job = Chunk.Job;
+        while (Job->NextSequence != Chunk.Sequence) {
+            SleepConditionVariableSRW(&Pipeline->JobAdvanced, &Pipeline->Lock, INFINITE, 0);
+        }
+        ReleaseSRWLockExclusive(&Pipeline->Lock);
+
+        if (Chunk.Sequence == 0 && !NTFS__HashBegin(Pipeline, Job->Hashes)) {
+            Job->Error = NTFS_Error_HashFailedInit;
+        }
+
+        if (!Job->Error && !NTFS__HashUpdate(Job->Hashes, Chunk.Buffer, Chunk.Size)) {
+            Job->Error = NTFS_Error_HashFailedInit;
+        }
+
+        if (Chunk.IsLast) {
+            ntfs_hash_result Result = {
+                .Error       = Job->Error,
+                .RecordIndex = Job->RecordIndex,
+                .Size        = Job->Size,
+            };
+            NTFS__HashFinish(Job->Hashes, &Result);
+            if (Job->Error) {
+                Result.Error = Job->Error;
+            }
+
+            NTFS__HashReport(Pipeline, &Result, Job->Size);
+        }
+
+        AcquireSRWLockExclusive(&Pipeline->Lock);
+        Job->NextSequence++;
+        Pipeline->FreeBuffers[Pipeline->FreeCount++] = Chunk.Buffer;
+        ReleaseSRWLockExclusive(&Pipeline->Lock);
+        WakeConditionVariable(&Pipeline->BufferFree);
+        WakeAllConditionVariable(&Pipeline->JobAdvanced);
+    }
+
+    return 0;
+}
+
+ntfs_hash_summary NTFS_HashVolume(ntfs_volume *Volume, ntfs_hash_options *Options)
+{
+    ntfs__hash_pipeline Pipeline = {
+        .Volume  = Volume,
+        .Options = *Options,
+    };
+    ntfs_arena    JobArena  = NTFS__ArenaCreate(NTFS_HASH_RESERVED, NTFS__ARENA_DEFAULT_COMMIT);
+    ntfs_arena    RunArena  = NTFS__ArenaCreate(NTFS_HASH_RESERVED, NTFS__ARENA_DEFAULT_COMMIT);
+    ntfs_mft_scan Scan      = NTFS_MftScanBegin(Volume);
+    void        **Threads   = 0;
+    size_t        ThreadCount = 0;
+
+    ntfs_hash_options *Opts = &Pipeline.Options;
+    if (Opts->Algorithms == 0) {
+        Opts->Algorithms = NTFS_HashAlgorithm_Sha256;
+    }
+    if (Opts->ReaderThreads == 0) {
+        Opts->ReaderThreads = NTFS_HASH_DEFAULT_READERS;
+    }
+    if (Opts->HashThreads == 0) {
+        Opts->HashThreads = NTFS__Win32ProcessorCount();
+    }
+    if (Opts->BufferSize == 0) {
+        Opts->BufferSize = NTFS_HASH_DEFAULT_BUFFER;
+    }
+    if (Opts->BufferCount == 0) {
+        Opts->BufferCount = 2 * (Opts->ReaderThreads + Opts->HashThreads);
+    }
+    Opts->BufferSize = NTFS__Align(Opts->BufferSize, Volume->BytesPerCluster);
+
+    InitializeSRWLock(&Pipeline.Lock);
+    InitializeConditionVariable(&Pipeline.BufferFree);
+    InitializeConditionVariable(&Pipeline.ChunkReady);
+    InitializeConditionVariable(&Pipeline.JobAdvanced);
+
+    if (JobArena.Buffer == 0 || RunArena.Buffer == 0) {
+        NTFS_RETURN(Pipeline.Summary.Error, NTFS_Error_MemoryError);
+    }
+
+    if (Scan.Error) {
+        NTFS_RETURN(Pipeline.Summary.Error, Scan.Error);
+    }
+
+    for (size_t Index = 0; Index < NTFS_HASH_ALGORITHM_COUNT; Index++) {
+        if (Opts->Algorithms & (1 << Index)) {
+            Pipeline.Providers[Index] = NTFS__Win32HashProviderOpen(Index);
+            if (Pipeline.Providers[Index] == 0) {
+                NTFS_RETURN(Pipeline.Summary.Error, NTFS_Error_HashFailedInit);
+            }
+        }
+    }
+
+    // Resident and empty files are hashed straight from the MFT pass, the
+    // rest become jobs ordered by their first cluster
+    ntfs_record Record = { 0 };
+    while (NTFS_MftScanNext(&Scan, &Record)) {
+        if (Record.IsDir || Record.BaseIndex != Record.Index) {
+            continue;
+        }
+
+        ntfs_attr *Attr    = 0;
+        bool       HasList = false;
+        for (size_t i = 0; i < NTFS__ListLen(Record.AttrList); i++) {
+            ntfs_attr *Other = Record.AttrList + i;
+            HasList |= Other->Type == NTFS_AttributeType_AttributeList;
+            if (Other->Type == NTFS_AttributeType_Data && !Other->Name && !Attr) {
+                Attr = Other;
+            }
+        }
+
+        // $DATA moved to, or continued in, an extension record is resolved
+        // through the attribute list, its runs are copied before the file is closed
+        ntfs_file File = { 0 };
+        if (HasList) {
+            File = NTFS_FileOpenFromIndex(Volume, Record.Index);
+            Attr = File.Error ? 0 : NTFS_FileFindAttr(&File, NTFS_AttributeType_Data, 0, 0);
+        }
+
+        do {
+            // Files without any unnamed stream have nothing to hash
+            if (Attr == 0) {
+                if (HasList) {
+                    NTFS__HashInline(&Pipeline, Record.Index, 0, 0, NTFS_Error_HashUnsupportedData);
+                }
+                break;
+            }
+
+            if (!Attr->NonResFlag) {
+                Pipeline.Summary.ResidentFiles++;
+                NTFS__HashInline(&Pipeline, Record.Index, Attr->Resident.Data,
+                                 Attr->Resident.Size, NTFS_Error_Success);
+                break;
+            }
+
+            uint64_t Clusters = 0;
+            uint64_t FirstLCN = UINT64_MAX;
+            for (size_t j = 0; j < NTFS__ListLen(Attr->NonResident.RunList); j++) {
+                ntfs_data_run *Run = Attr->NonResident.RunList + j;
+                if (!Run->IsSparse && FirstLCN == UINT64_MAX) {
+                    FirstLCN = Run->StartVCN;
+                }
+
+                Clusters += Run->Count;
+            }
+
+            bool IsSupported = !(Attr->Flags & (NTFS_AttributeFlag_Compressed |
+                                                NTFS_AttributeFlag_Encrypted));
+            IsSupported     &= Attr->NonResident.FirstVCN == 0;
+            IsSupported     &= Clusters * Volume->BytesPerCluster >= Attr->NonResident.Size;
+            if (!IsSupported || Attr->NonResident.Size == 0) {
+                NTFS__HashInline(&Pipeline, Record.Index, 0, 0,
+                                 IsSupported ? NTFS_Error_Success
+                                             : NTFS_Error_HashUnsupportedData);
+                break;
+            }
+
+            ntfs__hash_job Job = {
+                .FirstLCN    = FirstLCN,
+                .RecordIndex = Record.Index,
+                .Size        = Attr->NonResident.Size,
+            };
+
+            size_t RunCount = NTFS__ListLen(Attr->NonResident.RunList);
+            for (size_t j = 0; j < RunCount; j++) {
+                NTFS__ListPush(&RunArena, Job.RunList, Attr->NonResident.RunList[j]);
+            }
+
+            NTFS__ListPush(&JobArena, Pipeline.Jobs, Job);
+        } while (0);
+
+        NTFS_FileClose(&File);
+    }
+
+    if (Scan.Error) {
+        NTFS_RETURN(Pipeline.Summary.Error, Scan.Error);
+    }
+
+    size_t JobCount = NTFS__ListLen(Pipeline.Jobs);
+    if (JobCount) {
+        void *Scratch = NTFS__ArenaAlloc(&JobArena, JobCount * sizeof(*Pipeline.Jobs));
+        NTFS__RadixSort(Pipeline.Jobs, Scratch, JobCount, sizeof(*Pipeline.Jobs),
+                        offsetof(ntfs__hash_job, FirstLCN));
+    }
+
+    Pipeline.FreeBuffers = NTFS__ArenaAlloc(&JobArena, Opts->BufferCount * sizeof(uint8_t *));
+    Pipeline.Queue       = NTFS__ArenaAlloc(&JobArena, Opts->BufferCount * sizeof(*Pipeline.Queue));
+    for (size_t Index = 0; Index < Opts->BufferCount; Index++) {
+        Pipeline.FreeBuffers[Pipeline.FreeCount++] =
+            NTFS__ArenaAllocAligned(&JobArena, Opts->BufferSize, NTFS_DIRECT_ALIGNMENT);
+    }
+
+    // Workers start first, readers would block forever on buffers that no
+    // worker returns
+    Pipeline.ReadersRunning = Opts->ReaderThreads;
+    Threads = NTFS__ArenaAlloc(&JobArena, (Opts->ReaderThreads + Opts->HashThreads) * sizeof(void *));
+    for (size_t Index = 0; Index < Opts->HashThreads; Index++) {
+        Threads[ThreadCount] = NTFS__Win32ThreadCreate(NTFS__HashWorkerThread, &Pipeline);
+        ThreadCount         += Threads[ThreadCount] != 0;
+    }
+
+    if (ThreadCount == 0) {
+        NTFS_RETURN(Pipeline.Summary.Error, NTFS_Error_HashFailedInit);
+    }
+
+    size_t WorkerCount = ThreadCount;
+    for (size_t Index = 0; Index < Opts->ReaderThreads; Index++) {
+        Threads[ThreadCount] = NTFS__Win32ThreadCreate(NTFS__HashReaderThread, &Pipeline);
+        if (Threads[ThreadCount]) {
+            ThreadCount++;
+            continue;
+        }
+
+        // Workers only exit once every reader is accounted for
+        AcquireSRWLockExclusive(&Pipeline.Lock);
+        Pipeline.ReadersRunning--;
+        ReleaseSRWLockExclusive(&Pipeline.Lock);
+        WakeAllConditionVariable(&Pipeline.ChunkReady);
+    }
+
+    for (size_t Index = 0; Index < ThreadCount; Index++) {
+        NTFS__Win32ThreadJoin(Threads[Index]);
+    }
+
+    if (ThreadCount == WorkerCount) {
+        NTFS_RETURN(Pipeline.Summary.Error, NTFS_Error_HashFailedInit);
+    }
+
+skip:
+    for (size_t Index = 0; Index < NTFS_HASH_ALGORITHM_COUNT; Index++) {
+        if (Pipeline.Providers[Index]) {
+            NTFS__Win32HashProviderClose(Pipeline.Providers[Index]);
+        }
+    }
+
+    NTFS_MftScanEnd(&Scan);
+    if (JobArena.Buffer) {
+        NTFS__ArenaDestroy(&JobArena);
+    }
+    if (RunArena.Buffer) {
+        NTFS__ArenaDestroy(&RunArena);
+    }
+
+    return Pipeline.Summary;
+}
+
+// Recovery API
+ntfs_recover_summary NTFS_RecoverDeleted(ntfs_volume *Volume, ntfs_deleted_callback *Callback,
+                                         void *Context)
+{
+    ntfs_recover_summary Result = { 0 };
+    ntfs_bitmap          Bitmap = NTFS_BitmapOpen(Volume);
+    ntfs_mft_scan        Scan   = NTFS_MftScanBegin(Volume);
+    ntfs_arena           Runs   = NTFS__ArenaDefault();
+
+    if (Bitmap.Error) {
+        NTFS_RETURN(Result.Error, Bitmap.Error);
+    }
+
+    if (Scan.Error) {
+        NTFS_RETURN(Result.Error, Scan.Error);
+    }
+
+    Scan.IncludeFree   = true;
+    ntfs_record Record = { 0 };
+    while (NTFS_MftScanNext(&Scan, &Record)) {
+        if (Record.IsInUse) {
+            continue;
+        }
+
+        ntfs_deleted_file File     = { .Record = &Record };
+        uint32_t          NameRank = 0;
+        for (size_t i = 0; i < NTFS__ListLen(Record.AttrList); i++) {
+            ntfs_attr *Attr = Record.AttrList + i;
+
+            ntfs_file_name FileName = { 0 };
+            if (Attr->Type == NTFS_AttributeType_FileName &&
+                NTFS__FileNameParse(Attr, &FileName)) {
+                if (File.Name == 0 || NTFS__NameSpaceRank(FileName.NameSpace) < NameRank) {
+                    File.ParentIndex = FileName.ParentIndex;
+                    File.Name        = FileName.Name;
+                    File.NameLength  = FileName.NameLength;
+                    NameRank         = NTFS__NameSpaceRank(FileName.NameSpace);
+                }
+
+            } else if (Attr->Type == NTFS_AttributeType_Data && !Attr->Name) {
+                File.Size = Attr->NonResFlag ? Attr->NonResident.Size : Attr->Resident.Size;
+            }
+
+            if (!Attr->NonResFlag) {
+                continue;
+            }
+
+            uint64_t VCN = Attr->NonResident.FirstVCN;
+            for (size_t j = 0; j < NTFS__ListLen(Attr->NonResident.RunList); j++) {
+                ntfs_data_run *Run = Attr->NonResident.RunList + j;
+                if (!Run->IsSparse) {
+                    ntfs_deleted_run Free = {
+                        .Type      = Attr->Type,
+                        .VCN       = VCN,
+                        .LCN       = Run->StartVCN,
+                        .Count     = Run->Count,
+                        .FreeCount = NTFS_BitmapRangeFree(&Bitmap, Run->StartVCN, Run->Count),
+                    };
+                    NTFS__ListPush(&Runs, File.Runs, Free);
+
+                    File.Clusters     += Free.Count;
+                    File.FreeClusters += Free.FreeCount;
+                }
+                VCN += Run->Count;
+            }
+        }
+
+        if (Bitmap.Error) {
+            NTFS_RETURN(Result.Error, Bitmap.Error);
+        }
+
+        Result.Records++;
+        Result.Recoverable += File.FreeClusters == File.Clusters;
+        if (Callback) {
+            Callback(Context, &File);
+        }
+        NTFS__ArenaReset(&Runs);
+    }
+
+    if (Scan.Error) {
+        NTFS_RETURN(Result.Error, Scan.Error);
+    }
+
+skip:
+    NTFS_MftScanEnd(&Scan);
+    NTFS_BitmapClose(&Bitmap);
+    if (Runs.Buffer) {
+        NTFS__ArenaDestroy(&Runs);
+    }
+
+    return Result;
+}
+
+ntfs_carve_summary NTFS_CarveUnallocated(ntfs_volume *Volume, ntfs_carve_callback *Callback,
+                                         void *Context)
+{
+    ntfs_carve_summary Result = { 0 };
+    ntfs_bitmap        Bitmap = NTFS_BitmapOpen(Volume);
+    ntfs_arena         Arena  = NTFS__ArenaDefault();
+
+    if (Bitmap.Error) {
+        NTFS_RETURN(Result.Error, Bitmap.Error);
+    }
+
+    if (Arena.Buffer == 0) {
+        NTFS_RETURN(Result.Error, NTFS_Error_MemoryError);
+    }
+
+    uint64_t BufferClusters = NTFS_CARVE_BUFFER_SIZE / Volume->BytesPerCluster;
+    uint64_t GapClusters    = NTFS_CARVE_GAP_SIZE / Volume->BytesPerCluster;
+    if (BufferClusters == 0) {
+        BufferClusters = 1;
+    }
+    uint8_t *Buffer = NTFS__ArenaAlloc(&Arena, BufferClusters * Volume->BytesPerCluster);
+
+    // Free extents separated by small allocated gaps are read as one span so
+    // the device sees long sequential reads, hits in the gaps are dropped
+    ntfs_extent Extent  = { 0 };
+    bool        HasNext = NTFS_BitmapNextExtent(&Bitmap, false, &Extent);
+    while (HasNext) {
+        uint64_t SpanLCN = Extent.StartLCN;
+        uint64_t SpanEnd = Extent.StartLCN + Extent.Count;
+        while ((HasNext = NTFS_BitmapNextExtent(&Bitmap, false, &Extent)) &&
+               Extent.StartLCN - SpanEnd <= GapClusters &&
+               Extent.StartLCN + Extent.Count - SpanLCN <= BufferClusters) {
+            SpanEnd = Extent.StartLCN + Extent.Count;
+        }
+
+        for (uint64_t LCN = SpanLCN; LCN < SpanEnd; LCN += BufferClusters) {
+            uint64_t Clusters = SpanEnd - LCN;
+            if (Clusters > BufferClusters) {
+                Clusters = BufferClusters;
+            }
+
+            size_t ReadSize = Clusters * Volume->BytesPerCluster;
+            if (!NTFS_VolumeRead(Volume, LCN * Volume->BytesPerCluster, Buffer, ReadSize)) {
+                NTFS_RETURN(Result.Error, NTFS_Error_CarveFailedRead);
+            }
+            Result.BytesScanned += ReadSize;
+
+            // Both record kinds start on a sector boundary, one load per sector
+            for (size_t Offset = 0; Offset < ReadSize; Offset += Volume->BytesPerSector) {
+                uint32_t Signature = *NTFS_CAST(uint32_t *, Buffer + Offset);
+                if (Signature != NTFS_FILE_RECORD_MAGIC && Signature != NTFS_INDEX_RECORD_MAGIC) {
+                    continue;
+                }
+
+                uint64_t HitLCN = LCN + Offset / Volume->BytesPerCluster;
+                if (NTFS_BitmapIsAllocated(&Bitmap, HitLCN)) {
+                    continue;
+                }
+
+                ntfs_carve_hit Hit = {
+                    .LCN       = HitLCN,
+                    .Offset    = LCN * Volume->BytesPerCluster + Offset,
+                    .Signature = Signature,
+                    .Data      = Buffer + Offset,
+                    .Size      = ReadSize - Offset,
+                };
+
+                Result.FileHits  += Signature == NTFS_FILE_RECORD_MAGIC;
+                Result.IndexHits += Signature == NTFS_INDEX_RECORD_MAGIC;
+                if (Callback) {
+                    Callback(Context, &Hit);
+                }
+            }
+        }
+    }
+
+    if (Bitmap.Error) {
+        NTFS_RETURN(Result.Error, Bitmap.Error);
+    }
+
+skip:
+    if (Arena.Buffer) {
+        NTFS__ArenaDestroy(&Arena);
+    }
+    NTFS_BitmapClose(&Bitmap);
+
+    return Result;
+}
+
+// Stream API
+bool NTFS_FileNextStream(ntfs_file *File, size_t *Cursor, ntfs_stream *Stream)
+{
+    bool Result = false;
+
+    for (; *Cursor < NTFS__ListLen(File->Record.AttrList); (*Cursor)++) {
+        ntfs_attr *Attr = File->Record.AttrList + *Cursor;
+
+        // A stream split over extension records is reported by its first
+        // piece, the only one holding the size of the whole stream
+        bool IsFirst = !Attr->NonResFlag || Attr->NonResident.FirstVCN == 0;
+        if (Attr->Type == NTFS_AttributeType_Data && Attr->Name && IsFirst) {
+            *Stream = (ntfs_stream) {
+                .RecordIndex = File->Record.BaseIndex,
+                .Attr        = Attr,
+                .Size        = Attr->NonResFlag ? Attr->NonResident.Size : Attr->Resident.Size,
+            };
+
+            (*Cursor)++;
+            NTFS_RETURN(Result, true);
+        }
+    }
+
+skip:
+    return Result;
+}
+
+size_t NTFS_FileReadStream(ntfs_file *File, uint16_t *Name, size_t NameLength,
+                           uint64_t Offset, uint8_t *Buffer, size_t Size)
+{
+    size_t Result = 0;
+
+    ntfs_attr *Attr = NTFS_FileFindAttr(File, NTFS_AttributeType_Data, Name, NameLength);
+    if (Attr == 0) {
+        NTFS_RETURN(File->Error, NTFS_Error_StreamNotFound);
+    }
+
+    Result = NTFS_FileReadAttr(File, Attr, Offset, Buffer, Size);
+
+skip:
+    return Result;
+}
+
+ntfs_error NTFS_StreamScan(ntfs_volume *Volume, ntfs_stream_callback *Callback, void *Context)
+{
+    ntfs_error    Result = NTFS_Error_Success;
+    ntfs_mft_scan Scan   = NTFS_MftScanBegin(Volume);
+
+    if (Scan.Error) {
+        NTFS_RETURN(Result, Scan.Error);
+    }
+
+    // Named streams only need the attribute headers, no data is read
+    ntfs_record Record = { 0 };
+    while (NTFS_MftScanNext(&Scan, &Record)) {
+        ntfs_file File   = { .Volume = Volume, .Record = Record };
+        size_t    Cursor = 0;
+
+        ntfs_stream Stream = { 0 };
+        while (NTFS_FileNextStream(&File, &Cursor, &Stream)) {
+            if (Callback) {
+                Callback(Context, &Stream);
+            }
+        }
+    }
+
+    Result = Scan.Error;
+
+skip:
+    NTFS_MftScanEnd(&Scan);
+    return Result;
+}
+
+// Disk API
+typedef struct {
+    ntfs_disk            *Disk;
+    ntfs_partition       *Partition;
+    ntfs_volume          *Volume;
+    ntfs_volume_callback *Callback;
+    void                 *Context;
+} ntfs__disk_job;
+
+static DWORD WINAPI NTFS__DiskVolumeThread(void *Param)
+{
+    ntfs__disk_job *Job = Param;
+
+    // Every volume reads through its own handle, so the reads of one
+    // partition never queue behind another
+    void          *Handle    = NTFS__Win32FileOpen(Job->Disk->Path);
+    ntfs_container Container = { 0 };
+    if (Handle) {
+        Container = NTFS__ContainerOpen(Handle);
+    }
+
+    if (Handle == 0) {
+        *Job->Volume = (ntfs_volume) { .Error = NTFS_Error_VolumeOpen };
+
+    } else if (Container.Error) {
+        CloseHandle(Handle);
+        *Job->Volume = (ntfs_volume) { .Error = Container.Error };
+
+    } else {
+        *Job->Volume = NTFS__VolumeLoad(Handle, Container, Job->Partition->Offset);
+    }
+
+    if (Job->Callback) {
+        Job->Callback(Job->Context, Job->Partition, Job->Volume);
+        NTFS_VolumeClose(Job->Volume);
+    }
+
+    return 0;
+}
+
+static void NTFS__DiskRunJobs(ntfs_disk *Disk, ntfs_volume *Volumes, size_t Count,
+                              ntfs_volume_callback *Callback, void *Context)
+{
+    ntfs_arena      Arena = NTFS__ArenaDefault();
+    ntfs__disk_job *Jobs  = 0;
+    void          **Threads;
+
+    if (Arena.Buffer == 0) {
+        NTFS_RETURN(Disk->Error, NTFS_Error_MemoryError);
+    }
+
+    Jobs    = NTFS__ArenaAlloc(&Arena, Count * sizeof(*Jobs));
+    Threads = NTFS__ArenaAlloc(&Arena, Count * sizeof(*Threads));
+
+    size_t JobIndex = 0;
+    for (size_t Index = 0; Index < NTFS__ListLen(Disk->Partitions) && JobIndex < Count; Index++) {
+        if (Disk->Partitions[Index].IsNtfs) {
+            Jobs[JobIndex] = (ntfs__disk_job) {
+                .Disk      = Disk,
+                .Partition = Disk->Partitions + Index,
+                .Volume    = Volumes + JobIndex,
+                .Callback  = Callback,
+                .Context   = Context,
+            };
+
+            Threads[JobIndex] = NTFS__Win32ThreadCreate(NTFS__DiskVolumeThread, Jobs + JobIndex);
+            if (Threads[JobIndex] == 0) {
+                NTFS__DiskVolumeThread(Jobs + JobIndex);
+            }
+
+            JobIndex++;
+        }
+    }
+
+    for (size_t Index = 0; Index < JobIndex; Index++) {
+        if (Threads[Index]) {
+            NTFS__Win32ThreadJoin(Threads[Index]);
+        }
+    }
+
+skip:
+    if (Arena.Buffer) {
+        NTFS__ArenaDestroy(&Arena);
+    }
+}
+
+ntfs_disk NTFS_DiskOpen(wchar_t *Path)
+{
+    ntfs_disk Result = {
+        .Handle = NTFS__Win32FileOpen(Path),
+        .Arena  = NTFS__ArenaDefault(),
+    };
+
+    if (Result.Handle == 0) {
+        NTFS_RETURN(Result.Error, NTFS_Error_DiskOpen);
+    }
+
+    if (Result.Arena.Buffer == 0) {
+        NTFS_RETURN(Result.Error, NTFS_Error_MemoryError);
+    }
+
+    size_t PathLength = 0;
+    while (Path[PathLength]) {
+        PathLength++;
+    }
+
+    size_t PathSize = (PathLength + 1) * sizeof(wchar_t);
+    Result.Path     = NTFS__ArenaAlloc(&Result.Arena, PathSize);
+    NTFS_MEM_COPY(Result.Path, PathSize, Path, PathSize);
+
+    Result.Container = NTFS__ContainerOpen(Result.Handle);
+    if (Result.Container.Error) {
+        NTFS_RETURN(Result.Error, Result.Container.Error);
+    }
+
+    Result.Error = NTFS__DiskDiscover(Result.Handle, &Result.Container,
+                                      &Result.Arena, &Result.Partitions);
+
+skip:
+    return Result;
+}
+
+void NTFS_DiskClose(ntfs_disk *Disk)
+{
+    if (Disk->Handle) {
+        CloseHandle(Disk->Handle);
+    }
+
+    NTFS__ContainerClose(&Disk->Container);
+
+    if (Disk->Arena.Buffer) {
+        NTFS__ArenaDestroy(&Disk->Arena);
+    }
+
+    *Disk = (ntfs_disk) { .Error = Disk->Error };
+}
+
+size_t NTFS_DiskOpenVolumes(ntfs_disk *Disk, ntfs_volume *Volumes, size_t Count)
+{
+    size_t Result = 0;
+    for (size_t Index = 0; Index < NTFS__ListLen(Disk->Partitions); Index++) {
+        Result += Disk->Partitions[Index].IsNtfs;
+    }
+
+    if (Result > Count) {
+        Result = Count;
+    }
+
+    if (Result) {
+        NTFS__DiskRunJobs(Disk, Volumes, Result, 0, 0);
+    }
+
+    return Result;
+}
+
+void NTFS_DiskProcessVolumes(ntfs_disk *Disk, ntfs_volume_callback *Callback, void *Context)
+{
+    ntfs_arena Arena = NTFS__ArenaDefault();
+    if (Arena.Buffer == 0) {
+        NTFS_RETURN(Disk->Error, NTFS_Error_MemoryError);
+    }
+
+    size_t Count = 0;
+    for (size_t Index = 0; Index < NTFS__ListLen(Disk->Partitions); Index++) {
+        Count += Disk->Partitions[Index].IsNtfs;
+    }
+
+    if (Count) {
+        ntfs_volume *Volumes = NTFS__ArenaAlloc(&Arena, Count * sizeof(*Volumes));
+        NTFS__DiskRunJobs(Disk, Volumes, Count, Callback, Context);
+    }
+
+skip:
+    if (Arena.Buffer) {
+        NTFS__ArenaDestroy(&Arena);
+    }
+}
+
+ntfs_error NTFS__DiskDiscover(void *Handle, ntfs_container *Container,
+                              ntfs_arena *Arena, ntfs_partition **Partitions)
+{
+    ntfs_error Result = NTFS_Error_Success;
+
+    uint8_t BootSector[NTFS_BOOT_RECORD_SIZE];
+    if (!NTFS__ContainerRead(Container, Handle, 0, &BootSector, sizeof(BootSector))) {
+        NTFS_RETURN(Result, NTFS_Error_VolumeReadBootRecord);
+    }
+
+    uint16_t Signature = *NTFS_CAST(uint16_t *, &BootSector[510]);
+    if (Signature != NTFS_BOOT_RECORD_SIGNATURE) {
+        NTFS_RETURN(Result, NTFS_Error_VolumeUnknownSignature);
+    }
+
+    // Image of a single volume, no partition table
+    if (*NTFS_CAST(uint64_t *, &BootSector[0x03]) == NTFS_BOOT_RECORD_OEM_ID) {
+        ntfs_partition Partition = { .IsNtfs = true };
+        NTFS__ListPush(Arena, *Partitions, Partition);
+        NTFS_RETURN(Result, NTFS_Error_Success);
+    }
+
+    uint64_t ExtendedOffset = 0;
+    uint8_t *PartitionTable = &BootSector[NTFS_BOOT_RECORD_PARTITION_OFFSET];
+    for (int i = 0; i < 4; i++, PartitionTable += NTFS_BOOT_RECORD_PARITION_ENTRY_SIZE) {
+        uint8_t  PartitionType = PartitionTable[0x04];
+        uint64_t FirstSector   = *NTFS_CAST(uint32_t *, &PartitionTable[0x08]);
+        uint64_t SectorCount   = *NTFS_CAST(uint32_t *, &PartitionTable[0x0C]);
+
+        if (PartitionType == NTFS_PARTITION_TYPE_GPT) {
+            uint8_t Header[NTFS_BOOT_RECORD_SIZE];
+
+            // GPT header is at LBA 1, either 512 or 4096 bytes sectors
+            uint64_t SectorSize = NTFS_BOOT_RECORD_SIZE;
+            for (; SectorSize <= 4096; SectorSize *= 8) {
+                if (NTFS__ContainerRead(Container, Handle, SectorSize, Header, sizeof(Header)) &&
+                    *NTFS_CAST(uint64_t *, Header) == NTFS_GPT_SIGNATURE) {
+                    break;
+                }
+            }
+            if (SectorSize > 4096) {
+                NTFS_RETURN(Result, NTFS_Error_DiskReadPartitionTable);
+            }
+
+            uint64_t EntriesLBA = *NTFS_CAST(uint64_t *, Header + 0x48);
+            uint32_t EntryCount = *NTFS_CAST(uint32_t *, Header + 0x50);
+            uint32_t EntrySize  = *NTFS_CAST(uint32_t *, Header + 0x54);
+            // Entries are a power of two of at least 128 bytes by the spec,
+            // the upper bound keeps the table read small
+            if (EntrySize < 0x38 || EntrySize > NTFS_GPT_MAX_ENTRY_SIZE ||
+                (EntrySize & (EntrySize - 1)) || EntryCount > NTFS_GPT_MAX_ENTRIES) {
+                NTFS_RETURN(Result, NTFS_Error_DiskReadPartitionTable);
+            }
+
+            size_t   TableSize = NTFS__Align(NTFS_CAST(size_t, EntryCount) * EntrySize, SectorSize);
+            uint8_t *Table     = NTFS__ArenaAlloc(Arena, TableSize);
+            if (Table == 0) {
+                NTFS_RETURN(Result, NTFS_Error_MemoryError);
+            }
+
+            if (!NTFS__ContainerRead(Container, Handle, EntriesLBA * SectorSize, Table, TableSize)) {
+                NTFS_RETURN(Result, NTFS_Error_DiskReadPartitionTable);
+            }
+
+            for (uint32_t Index = 0; Index < EntryCount; Index++) {
+                uint8_t *Entry    = Table + NTFS_CAST(size_t, Index) * EntrySize;
+                uint64_t FirstLBA = *NTFS_CAST(uint64_t *, Entry + 0x20);
+                uint64_t LastLBA  = *NTFS_CAST(uint64_t *, Entry + 0x28);
+                if (FirstLBA == 0 || LastLBA < FirstLBA) {
+                    continue;
+                }
+
+                ntfs_partition Partition = {
+                    .Number = Index,
+                    .Offset = FirstLBA * SectorSize,
+                    .Size   = (LastLBA - FirstLBA + 1) * SectorSize,
+                };
+                NTFS_MEM_COPY(Partition.TypeGuid, sizeof(Partition.TypeGuid), Entry, 16);
+                NTFS__DiskAddPartition(Handle, Container, Arena, Partitions, Partition);
+            }
+
+            NTFS_RETURN(Result, NTFS_Error_Success);
+        }
+
+        if (PartitionType == 0x05 || PartitionType == 0x0F || PartitionType == 0x85) {
+            ExtendedOffset = FirstSector;
+
+        } else if (PartitionType != 0) {
+            ntfs_partition Partition = {
+                .Number = i,
+                .Offset = FirstSector * NTFS_BOOT_RECORD_SIZE,
+                .Size   = SectorCount * NTFS_BOOT_RECORD_SIZE,
+                .Type   = PartitionType,
+            };
+            NTFS__DiskAddPartition(Handle, Container, Arena, Partitions, Partition);
+        }
+    }
+
+    // Logical partitions are a chain of extended boot records, each one has
+    // the partition relative to itself and the next record relative to the
+    // start of the extended partition
+    uint64_t EbrSector = ExtendedOffset;
+    for (uint32_t Number = 4; EbrSector && Number < 4 + NTFS_PARTITION_MAX_LOGICAL; Number++) {
+        uint8_t Ebr[NTFS_BOOT_RECORD_SIZE];
+        if (!NTFS__ContainerRead(Container, Handle, EbrSector * NTFS_BOOT_RECORD_SIZE, Ebr, sizeof(Ebr)) ||
+            *NTFS_CAST(uint16_t *, &Ebr[510]) != NTFS_BOOT_RECORD_SIGNATURE) {
+            break;
+        }
+
+        uint8_t *Entry = &Ebr[NTFS_BOOT_RECORD_PARTITION_OFFSET];
+        if (Entry[0x04] != 0) {
+            uint64_t FirstSector = *NTFS_CAST(uint32_t *, &Entry[0x08]);
+            uint64_t SectorCount = *NTFS_CAST(uint32_t *, &Entry[0x0C]);
+
+            ntfs_partition Partition = {
+                .Number = Number,
+                .Offset = (EbrSector + FirstSector) * NTFS_BOOT_RECORD_SIZE,
+                .Size   = SectorCount * NTFS_BOOT_RECORD_SIZE,
+                .Type   = Entry[0x04],
+            };
+            NTFS__DiskAddPartition(Handle, Container, Arena, Partitions, Partition);
+        }
+
+        Entry += NTFS_BOOT_RECORD_PARITION_ENTRY_SIZE;
+        uint64_t NextSector = *NTFS_CAST(uint32_t *, &Entry[0x08]);
+        EbrSector = NextSector ? ExtendedOffset + NextSector : 0;
+    }
+
+skip:
+    return Result;
+}
+
+void NTFS__DiskAddPartition(void *Handle, ntfs_container *Container,
+                            ntfs_arena *Arena, ntfs_partition **Partitions,
+                            ntfs_partition Partition)
+{
+    // Partition types lie, the volume boot record does not
+    uint8_t BootSector[NTFS_BOOT_RECORD_SIZE];
+    if (NTFS__ContainerRead(Container, Handle, Partition.Offset, BootSector, sizeof(BootSector))) {
+        Partition.IsNtfs = *NTFS_CAST(uint64_t *, &BootSector[0x03]) == NTFS_BOOT_RECORD_OEM_ID;
+    }
+
+    NTFS__ListPush(Arena, *Partitions, Partition);
+}
+
+// Container API
+static const uint8_t NTFS__VhdxBatGuid[16] = {
+    0x66, 0x77, 0xC2, 0x2D, 0x23, 0xF6, 0x00, 0x42,
+    0x9D, 0x64, 0x11, 0x5E, 0x9B, 0xFD, 0x4A, 0x08,
+};
+static const uint8_t NTFS__VhdxMetadataGuid[16] = {
+    0x06, 0xA2, 0x7C, 0x8B, 0x90, 0x47, 0x9A, 0x4B,
+    0xB8, 0xFE, 0x57, 0x5F, 0x05, 0x0F, 0x88, 0x6E,
+};
+static const uint8_t NTFS__VhdxFileParametersGuid[16] = {
+    0x37, 0x67, 0xA1, 0xCA, 0x36, 0xFA, 0x43, 0x4D,
+    0xB3, 0xB6, 0x33, 0xF0, 0xAA, 0x44, 0xE7, 0x6B,
+};
+static const uint8_t NTFS__VhdxDiskSizeGuid[16] = {
+    0x24, 0x42, 0xA5, 0x2F, 0x1B, 0xCD, 0x76, 0x48,
+    0xB2, 0x11, 0x5D, 0xBE, 0xD8, 0x3B, 0xF4, 0xB8,
+};
+static const uint8_t NTFS__VhdxSectorSizeGuid[16] = {
+    0x1D, 0xBF, 0x41, 0x81, 0x6F, 0xA9, 0x09, 0x47,
+    0xBA, 0x47, 0xF2, 0x33, 0xA8, 0xFA, 0xAB, 0x5F,
+};
+
+static inline bool NTFS__GuidEquals(const uint8_t *Guid, const uint8_t *Other)
+{
+    bool Result = *NTFS_CAST(uint64_t *, Guid)     == *NTFS_CAST(uint64_t *, Other) &&
+                  *NTFS_CAST(uint64_t *, Guid + 8) == *NTFS_CAST(uint64_t *, Other + 8);
+    return Result;
+}
+
+static bool NTFS__ContainerAllocTable(ntfs_container *Container, uint64_t BlockCount)
+{
+    size_t TableSize      = NTFS__Align(BlockCount * sizeof(uint64_t), 4096);
+    Container->BlockCount = BlockCount;
+    Container->BlockTable = NTFS__Win32MemoryAllocate(TableSize, 0);
+
+    bool Result = Container->BlockTable != 0;
+    return Result;
+}
+
+static void NTFS__ContainerLoadVhd(ntfs_container *Container, void *Handle, uint8_t *Footer)
+{
+    uint32_t DiskType = NTFS__ReadBigEndian32(Footer + 0x3C);
+    Container->VirtualSize = NTFS__ReadBigEndian64(Footer + 0x30);
+
+    // Fixed disks are a flat image followed by the footer
+    if (DiskType == NTFS_VHD_TYPE_FIXED) {
+        NTFS_RETURN(Container->Type, NTFS_Container_Raw);
+
+    } else if (DiskType != NTFS_VHD_TYPE_DYNAMIC) {
+        NTFS_RETURN(Container->Error, NTFS_Error_ContainerUnsupported);
+    }
+
+    uint8_t  Header[1024];
+    uint64_t HeaderOffset = NTFS__ReadBigEndian64(Footer + 0x10);
+    if (!NTFS__Win32FileRead(Handle, HeaderOffset, Header, sizeof(Header)) ||
+        *NTFS_CAST(uint64_t *, Header) != NTFS_VHD_DYNAMIC_COOKIE) {
+        NTFS_RETURN(Container->Error, NTFS_Error_ContainerInvalid);
+    }
+
+    uint64_t TableOffset = NTFS__ReadBigEndian64(Header + 0x10);
+    uint32_t EntryCount  = NTFS__ReadBigEndian32(Header + 0x1C);
+    Container->BlockSize = NTFS__ReadBigEndian32(Header + 0x20);
+    if (!NTFS__IsPowerOf2(Container->BlockSize) || Container->BlockSize < 4096) {
+        NTFS_RETURN(Container->Error, NTFS_Error_ContainerInvalid);
+    }
+
+    if (!NTFS__ContainerAllocTable(Container, EntryCount)) {
+        NTFS_RETURN(Container->Error, NTFS_Error_MemoryError);
+    }
+
+    // Read the on disk table in place, it is expanded from the back so
+    // entries are not overwritten before they are converted
+    size_t    TableSize = NTFS__Align(EntryCount * sizeof(uint32_t), NTFS_BOOT_RECORD_SIZE);
+    uint32_t *Entries   = NTFS_CAST(uint32_t *, Container->BlockTable);
+    if (!NTFS__Win32FileRead(Handle, TableOffset, Entries, TableSize)) {
+        NTFS_RETURN(Container->Error, NTFS_Error_ContainerInvalid);
+    }
+
+    // Every block starts with its sector bitmap, padded to a sector
+    uint64_t BitmapSize = NTFS__Align(Container->BlockSize / NTFS_BOOT_RECORD_SIZE / 8,
+                                      NTFS_BOOT_RECORD_SIZE);
+    for (size_t Index = EntryCount; Index-- > 0;) {
+        uint32_t Sector = NTFS__ReadBigEndian32(NTFS_CAST(uint8_t *, Entries + Index));
+        Container->BlockTable[Index] = (Sector != NTFS_VHD_UNUSED_BLOCK)
+            ? NTFS_CAST(uint64_t, Sector) * NTFS_BOOT_RECORD_SIZE + BitmapSize : 0;
+    }
+
+    Container->Type = NTFS_Container_Vhd;
+
+skip:
+    return;
+}
+
+static void NTFS__ContainerLoadVhdx(ntfs_container *Container, void *Handle, uint8_t *Table)
+{
+    // Region table is 64KB, scratch space after it holds the metadata table
+    if (!NTFS__Win32FileRead(Handle, NTFS_VHDX_REGION_TABLE, Table, NTFS_VHDX_TABLE_SIZE) ||
+        *NTFS_CAST(uint32_t *, Table) != NTFS_VHDX_REGION_SIGNATURE) {
+        NTFS_RETURN(Container->Error, NTFS_Error_ContainerInvalid);
+    }
+
+    uint64_t BatOffset      = 0;
+    uint64_t MetadataOffset = 0;
+    uint32_t RegionCount    = *NTFS_CAST(uint32_t *, Table + 0x08);
+    for (uint32_t Index = 0; Index < RegionCount && Index < 2047; Index++) {
+        uint8_t *Entry = Table + 16 + Index * 32;
+        if (NTFS__GuidEquals(Entry, NTFS__VhdxBatGuid)) {
+            BatOffset = *NTFS_CAST(uint64_t *, Entry + 0x10);
+        } else if (NTFS__GuidEquals(Entry, NTFS__VhdxMetadataGuid)) {
+            MetadataOffset = *NTFS_CAST(uint64_t *, Entry + 0x10);
+        }
+    }
+
+    uint8_t *Metadata = Table + NTFS_VHDX_TABLE_SIZE;
+    if (BatOffset == 0 || MetadataOffset == 0 ||
+        !NTFS__Win32FileRead(Handle, MetadataOffset, Metadata, NTFS_VHDX_TABLE_SIZE) ||
+        *NTFS_CAST(uint64_t *, Metadata) != NTFS_VHDX_METADATA_SIGNATURE) {
+        NTFS_RETURN(Container->Error, NTFS_Error_ContainerInvalid);
+    }
+
+    // Items live past the table, each one of interest is at most 8 bytes
+    uint32_t Flags      = 0;
+    uint32_t SectorSize = 0;
+    uint16_t ItemCount  = *NTFS_CAST(uint16_t *, Metadata + 0x0A);
+    for (uint16_t Index = 0; Index < ItemCount && Index < 2047; Index++) {
+        uint8_t *Entry  = Metadata + 32 + Index * 32;
+        uint64_t Offset = MetadataOffset + *NTFS_CAST(uint32_t *, Entry + 0x10);
+        uint64_t Item   = 0;
+
+        if (NTFS__GuidEquals(Entry, NTFS__VhdxFileParametersGuid)) {
+            if (NTFS__Win32FileRead(Handle, Offset, &Item, sizeof(Item))) {
+                Container->BlockSize = NTFS_CAST(uint32_t, Item);
+                Flags                = NTFS_CAST(uint32_t, Item >> 32);
+            }
+        } else if (NTFS__GuidEquals(Entry, NTFS__VhdxDiskSizeGuid)) {
+            if (NTFS__Win32FileRead(Handle, Offset, &Item, sizeof(Item))) {
+                Container->VirtualSize = Item;
+            }
+        } else if (NTFS__GuidEquals(Entry, NTFS__VhdxSectorSizeGuid)) {
+            if (NTFS__Win32FileRead(Handle, Offset, &Item, sizeof(uint32_t))) {
+                SectorSize = NTFS_CAST(uint32_t, Item);
+            }
+        }
+    }
+
+    if (Flags & NTFS_VHDX_HAS_PARENT) {
+        NTFS_RETURN(Container->Error, NTFS_Error_ContainerUnsupported);
+    }
+
+    if (!NTFS__IsPowerOf2(Container->BlockSize) || !NTFS__IsPowerOf2(SectorSize) ||
+        Container->VirtualSize == 0) {
+        NTFS_RETURN(Container->Error, NTFS_Error_ContainerInvalid);
+    }
+
+    // Sector bitmap entries are interleaved after every chunk of payload entries
+    uint64_t BlockCount  = (Container->VirtualSize + Container->BlockSize - 1) / Container->BlockSize;
+    uint64_t ChunkRatio  = (NTFS_CAST(uint64_t, 1) << 23) * SectorSize / Container->BlockSize;
+    uint64_t EntryCount  = BlockCount + (BlockCount - 1) / ChunkRatio;
+    if (!NTFS__ContainerAllocTable(Container, EntryCount)) {
+        NTFS_RETURN(Container->Error, NTFS_Error_MemoryError);
+    }
+
+    size_t TableSize = NTFS__Align(EntryCount * sizeof(uint64_t), NTFS_BOOT_RECORD_SIZE);
+    if (!NTFS__Win32FileRead(Handle, BatOffset, Container->BlockTable, TableSize)) {
+        NTFS_RETURN(Container->Error, NTFS_Error_ContainerInvalid);
+    }
+
+    // Compact into payload entries only, every other state reads as zeros
+    for (uint64_t Index = 0; Index < BlockCount; Index++) {
+        uint64_t Entry = Container->BlockTable[Index + Index / ChunkRatio];
+        Container->BlockTable[Index] =
+            ((Entry & 0x07) == NTFS_VHDX_FULLY_PRESENT) ? (Entry >> 20) << 20 : 0;
+    }
+    Container->BlockCount = BlockCount;
+    Container->Type       = NTFS_Container_Vhdx;
+
+skip:
+    return;
+}
+
+ntfs_container NTFS__ContainerOpen(void *Handle)
+{
+    ntfs_container Result = { 0 };
+    ntfs_arena     Arena  = NTFS__ArenaDefault();
+    if (Arena.Buffer == 0) {
+        NTFS_RETURN(Result.Error, NTFS_Error_MemoryError);
+    }
+
+    uint8_t *Scratch = NTFS__ArenaAlloc(&Arena, 2 * NTFS_VHDX_TABLE_SIZE);
+    if (!NTFS__Win32FileRead(Handle, 0, Scratch, NTFS_BOOT_RECORD_SIZE)) {
+        NTFS_RETURN(Result.Error, NTFS_Error_VolumeReadBootRecord);
+    }
+
+    if (*NTFS_CAST(uint64_t *, Scratch) == NTFS_VHDX_SIGNATURE) {
+        NTFS__ContainerLoadVhdx(&Result, Handle, Scratch);
+        NTFS_RETURN(Result.Error, Result.Error);
+    }
+
+    // Dynamic disks keep a copy of the footer at the start of the file
+    uint64_t FileSize = NTFS__Win32FileSize(Handle);
+    if (*NTFS_CAST(uint64_t *, Scratch) == NTFS_VHD_COOKIE) {
+        NTFS__ContainerLoadVhd(&Result, Handle, Scratch);
+
+    } else if (FileSize >= NTFS_BOOT_RECORD_SIZE &&
+               NTFS__Win32FileRead(Handle, FileSize - NTFS_BOOT_RECORD_SIZE,
+                                   Scratch, NTFS_BOOT_RECORD_SIZE) &&
+               *NTFS_CAST(uint64_t *, Scratch) == NTFS_VHD_COOKIE) {
+        NTFS__ContainerLoadVhd(&Result, Handle, Scratch);
+    }
+
+skip:
+    if (Arena.Buffer) {
+        NTFS__ArenaDestroy(&Arena);
+    }
+
+    if (Result.Error) {
+        NTFS__ContainerClose(&Result);
+    }
+
+    return Result;
+}
+
+void NTFS__ContainerClose(ntfs_container *Container)
+{
+    if (Container->BlockTable) {
+        NTFS__Win32MemoryFree(Container->BlockTable);
+    }
+
+    *Container = (ntfs_container) { .Error = Container->Error };
+}
+
+bool NTFS__ContainerRead(ntfs_container *Container, void *Handle, uint64_t Offset,
+                         void *Buffer, size_t Size)
+{
+    return NTFS__ContainerReadDirect(Container, Handle, 0, Offset, Buffer, Size);
+}
+
+// Reads through the pool when one is given, the handle is then expected
+// to be opened without buffering
+bool NTFS__ContainerReadDirect(ntfs_container *Container, void *Handle,
+                               ntfs__direct_pool *Pool, uint64_t Offset,
+                               void *Buffer, size_t Size)
+{
+    if (Container->Type == NTFS_Container_Raw) {
+        return Pool ? NTFS__DirectRead(Pool, Handle, Offset, Buffer, Size)
+                    : NTFS__Win32FileRead(Handle, Offset, Buffer, Size);
+    }
+
+    bool     Result = true;
+    uint8_t *Dest   = Buffer;
+    while (Size && Result) {
+        uint64_t Block     = Offset / Container->BlockSize;
+        uint64_t InBlock   = Offset % Container->BlockSize;
+        if (Block >= Container->BlockCount) {
+            NTFS_RETURN(Result, false);
+        }
+
+        // Extend over following blocks that are adjacent in the file, or
+        // that are all unallocated, so they turn into a single operation.
+        // Dynamic VHD payloads are split by each block's sector bitmap, so
+        // only their unallocated blocks merge
+        uint64_t FileOffset = Container->BlockTable[Block];
+        uint64_t Length     = Container->BlockSize - InBlock;
+        bool     CanMerge   = FileOffset == 0 || Container->Type != NTFS_Container_Vhd;
+        for (uint64_t Next = Block + 1;
+             CanMerge && Length < Size && Next < Container->BlockCount; Next++) {
+            uint64_t Expected = FileOffset ? FileOffset + (Next - Block) * Container->BlockSize : 0;
+            if (Container->BlockTable[Next] != Expected) {
+                break;
+            }
+
+            Length += Container->BlockSize;
+        }
+
+        if (Length > Size) {
+            Length = Size;
+        }
+
+        if (FileOffset) {
+            Result = Pool ? NTFS__DirectRead(Pool, Handle, FileOffset + InBlock, Dest, Length)
+                          : NTFS__Win32FileRead(Handle, FileOffset + InBlock, Dest, Length);
+        } else {
+            NTFS_MEM_SET(Dest, 0, Length);
+        }
+
+        Dest   += Length;
+        Offset += Length;
+        Size   -= Length;
+    }
+
+skip:
+    return Result;
+}
+
+// Attribute cursor API
+ntfs_attr_cursor NTFS_AttrCursorBegin(ntfs_volume *Volume, ntfs_record *Record)
+{
+    ntfs_attr_cursor Result = { .Volume = Volume };
+
+    if (Record->Error || Record->Buffer == 0) {
+        NTFS_RETURN(Result.Error, NTFS_Error_RecordFailedValidation);
+    }
+
+    uint16_t Offset   = *NTFS_CAST(uint16_t *, Record->Buffer + 0x14);
+    uint32_t RealSize = *NTFS_CAST(uint32_t *, Record->Buffer + 0x18);
+    Result.RecordPtr  = Record->Buffer;
+    Result.AttrPtr    = Record->Buffer + Offset;
+    Result.AttrEndPtr = Record->Buffer + RealSize;
+
+skip:
+    return Result;
+}
+
+bool NTFS_AttrCursorNext(ntfs_attr_cursor *Cursor, ntfs_attr_type Type, ntfs_attr *Attr)
+{
+    bool Result = false;
+
+    // Attributes are decoded in place, the run list is left for
+    // NTFS_AttrCursorRuns so nothing is allocated here.
+    // Every field is validated against the attribute size, which is
+    // validated once against the record used size
+    while (!Cursor->Error && Cursor->AttrEndPtr - Cursor->AttrPtr >= 8) {
+        uint8_t *AttrPtr = Cursor->AttrPtr;
+        uint32_t Marker  = *NTFS_CAST(uint32_t *, AttrPtr);
+        if (Marker == NTFS_FILE_RECORD_ATTR_END_MARKER) {
+            break;
+        }
+
+        uint32_t AttrTotalSize = *NTFS_CAST(uint32_t *, AttrPtr + 0x04);
+        if (NTFS_UNLIKELY(AttrTotalSize < 0x18 || !NTFS__IsAligned(AttrTotalSize, 8) ||
+                          AttrTotalSize > Cursor->AttrEndPtr - AttrPtr)) {
+            goto corrupt;
+        }
+        Cursor->AttrPtr += AttrTotalSize;
+
+        if (Type && Marker != Type) {
+            continue;
+        }
+
+        uint32_t AttrNameOffset = *NTFS_CAST(uint16_t *, AttrPtr + 0x0A);
+        *Attr            = (ntfs_attr) { 0 };
+        Attr->Type       = Marker;
+        Attr->NonResFlag = AttrPtr[0x08] == 1;
+        Attr->NameLength = *NTFS_CAST(uint8_t  *, AttrPtr + 0x09);
+        Attr->Flags      = *NTFS_CAST(uint16_t *, AttrPtr + 0x0C);
+        Attr->Id         = *NTFS_CAST(uint16_t *, AttrPtr + 0x0E);
+        if (Attr->NameLength) {
+            if (NTFS_UNLIKELY(AttrNameOffset + Attr->NameLength * sizeof(uint16_t) >
+                              AttrTotalSize)) {
+                goto corrupt;
+            }
+
+            Attr->Name = NTFS_CAST(uint16_t *, AttrPtr + AttrNameOffset);
+        }
+
+        if (Attr->NonResFlag) {
+            if (NTFS_UNLIKELY(AttrTotalSize < 0x40)) {
+                goto corrupt;
+            }
+
+            uint16_t AttrOffset    = *NTFS_CAST(uint16_t *, AttrPtr + 0x20);
+            uint64_t AttrFirstVCN  = *NTFS_CAST(uint64_t *, AttrPtr + 0x10);
+            uint64_t AttrLastVCN   = *NTFS_CAST(uint64_t *, AttrPtr + 0x18);
+            uint64_t AttrAllocSize = *NTFS_CAST(uint64_t *, AttrPtr + 0x28);
+            uint64_t AttrRealSize  = *NTFS_CAST(uint64_t *, AttrPtr + 0x30);
+            if (NTFS_UNLIKELY(AttrRealSize > AttrAllocSize || AttrOffset > AttrTotalSize ||
+                              AttrLastVCN + 1 < AttrFirstVCN ||
+                              !NTFS__IsAligned(AttrAllocSize,
+                                               Cursor->Volume->BytesPerCluster))) {
+                goto corrupt;
+            }
+
+            Attr->NonResident.FirstVCN    = AttrFirstVCN;
+            Attr->NonResident.Size        = AttrRealSize;
+            Attr->NonResident.AlignedSize = AttrAllocSize;
+            Cursor->RunsPtr      = AttrPtr + AttrOffset;
+            Cursor->RunsSize     = AttrTotalSize - AttrOffset;
+            Cursor->RunsVCNCount = AttrLastVCN + 1 - AttrFirstVCN;
+
+        } else {
+            uint32_t AttrSize   = *NTFS_CAST(uint32_t *, AttrPtr + 0x10);
+            uint16_t AttrOffset = *NTFS_CAST(uint16_t *, AttrPtr + 0x14);
+            if (NTFS_UNLIKELY(NTFS_CAST(uint64_t, AttrOffset) + AttrSize > AttrTotalSize)) {
+                goto corrupt;
+            }
+
+            Attr->Resident.Size = AttrSize;
+            if (Attr->Resident.Size > 0) {
+                Attr->Resident.Data = AttrPtr + AttrOffset;
+            }
+            Cursor->RunsPtr  = 0;
+            Cursor->RunsSize = 0;
+        }
+
+        NTFS_RETURN(Result, true);
+
+    corrupt:
+        Cursor->Error       = NTFS_Error_RecordBadAttribute;
+        Cursor->ErrorOffset = NTFS_CAST(uint32_t, AttrPtr - Cursor->RecordPtr);
+        break;
+    }
+
+skip:
+    return Result;
+}
+
+bool NTFS_AttrCursorFind(ntfs_attr_cursor *Cursor, ntfs_attr_type Type,
+                         uint16_t *Name, size_t NameLength, ntfs_attr *Attr)
+{
+    bool Result = false;
+
+    while (NTFS_AttrCursorNext(Cursor, Type, Attr)) {
+        if (NTFS__NameEquals(Cursor->Volume, Attr->Name, Attr->NameLength, Name, NameLength)) {
+            NTFS_RETURN(Result, true);
+        }
+    }
+
+skip:
+    return Result;
+}
+
+ntfs_data_run *NTFS_AttrCursorRuns(ntfs_attr_cursor *Cursor, ntfs_arena *Arena)
+{
+    ntfs_data_run *Result = 0;
+
+    if (Cursor->RunsPtr) {
+        ntfs_error Error = NTFS_Error_Success;
+        Result = NTFS__DataRunsLoad(Arena, Cursor->RunsPtr, Cursor->RunsSize, &Error);
+
+        // Runs must cover exactly the VCN range of the attribute header
+        uint64_t VCNCount = 0;
+        for (size_t Index = 0; !Error && Index < NTFS__ListLen(Result); Index++) {
+            VCNCount += Result[Index].Count;
+        }
+
+        if (NTFS_UNLIKELY(Error || (Result && VCNCount != Cursor->RunsVCNCount))) {
+            Cursor->Error       = NTFS_Error_RecordBadRunList;
+            Cursor->ErrorOffset = NTFS_CAST(uint32_t, Cursor->RunsPtr - Cursor->RecordPtr);
+            Result              = 0;
+        }
+    }
+
+    return Result;
+}
+
+// Timeline API
+typedef struct {
+    uint8_t *Items;
+    uint8_t *Scratch;
+    size_t   Count;
+    size_t   ItemSize;
+    size_t   KeyOffset;
+    size_t   Shift;
+
+    // Start of every top digit bucket, plus the end of the last one
+    size_t        Buckets[257];
+    volatile LONG NextBucket;
+} ntfs__radix_sort;
+
+typedef struct {
+    ntfs__radix_sort *Sort;
+    uint32_t          Phase;
+    size_t            Begin;
+    size_t            End;
+    uint64_t          Diff;
+    size_t            Offsets[256];
+} ntfs__radix_job;
+
+enum {
+    NTFS__RadixPhase_Diff,
+    NTFS__RadixPhase_Count,
+    NTFS__RadixPhase_Scatter,
+    NTFS__RadixPhase_Sort,
+};
+
+#define NTFS__RADIX_PARALLEL_MIN 65536
+
+typedef struct {
+    void      *Handle;
+    ntfs_arena Arena;
+    uint8_t   *Buffer;
+    size_t     Used;
+    bool       Failed;
+} ntfs__writer;
+
+static const char NTFS__DigitPairs[201] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+static inline char *NTFS__PutDigits2(char *Buffer, uint32_t Value)
+{
+    Buffer[0] = NTFS__DigitPairs[Value * 2];
+    Buffer[1] = NTFS__DigitPairs[Value * 2 + 1];
+    return Buffer + 2;
+}
+
+static size_t NTFS__PutDecimal(char *Buffer, uint64_t Value)
+{
+    char  Digits[20];
+    char *Ptr = Digits + sizeof(Digits);
+    while (Value >= 100) {
+        Ptr -= 2;
+        NTFS__PutDigits2(Ptr, NTFS_CAST(uint32_t, Value % 100));
+        Value /= 100;
+    }
+
+    if (Value >= 10) {
+        Ptr -= 2;
+        NTFS__PutDigits2(Ptr, NTFS_CAST(uint32_t, Value));
+    } else {
+        *--Ptr = NTFS_CAST(char, '0' + Value);
+    }
+
+    size_t Result = Digits + sizeof(Digits) - Ptr;
+    NTFS_MEM_COPY(Buffer, Result, Ptr, Result);
+    return Result;
+}
+
+static void NTFS__TimelinePush(ntfs_timeline *Timeline, uint64_t *Times,
+                               ntfs_timeline_entry Entry)
+{
+    // Times are in MACB order, equal ones collapse into a single entry
+    for (size_t Index = 0; Index < 4; Index++) {
+        uint64_t Time = Times[Index];
+        bool     Seen = Time == 0;
+        for (size_t Prev = 0; Prev < Index; Prev++) {
+            Seen |= Times[Prev] == Time;
+        }
+
+        if (!Seen) {
+            Entry.Time = Time;
+            Entry.Macb = 0;
+            for (size_t Next = Index; Next < 4; Next++) {
+                Entry.Macb |= NTFS_CAST(uint8_t, (Times[Next] == Time) << Next);
+            }
+
+            NTFS__ListPush(&Timeline->Arena, Timeline->Entries, Entry);
+        }
+    }
+}
+
+// Names are numbered from NameBase, the names of earlier chunks when the
+// timeline is built in pieces
+static void NTFS__TimelineAdd(ntfs_timeline *Timeline, ntfs_volume *Volume, ntfs_record *Record,
+                              uint64_t NameBase)
+{
+    ntfs_timeline_entry Entry = {
+        .RecordIndex = Record->BaseIndex,
+        .Flags       = (Record->IsDir ? NTFS_TimelineFlag_Dir : 0)
+                     | (Record->IsInUse ? 0 : NTFS_TimelineFlag_Deleted),
+    };
+    ntfs_timeline_entry SiEntry  = Entry;
+    uint8_t            *StdInfo  = 0;
+    bool                HasName  = false;
+    uint32_t            NameRank = 0;
+
+    ntfs_attr        Attr   = { 0 };
+    ntfs_attr_cursor Cursor = NTFS_AttrCursorBegin(Volume, Record);
+    while (NTFS_AttrCursorNext(&Cursor, 0, &Attr)) {
+        if (Attr.NonResFlag) {
+            continue;
+        }
+
+        uint8_t       *Data     = Attr.Resident.Data;
+        ntfs_file_name FileName = { 0 };
+        if (Attr.Type == NTFS_AttributeType_StandardInformation &&
+            Attr.Resident.Size >= 0x20) {
+            StdInfo = Data;
+
+        } else if (Attr.Type == NTFS_AttributeType_FileName &&
+                   NTFS__FileNameParse(&Attr, &FileName)) {
+            // DOS names always come with a long name holding the same times
+            if (FileName.NameSpace == NTFS_NameSpace_Dos) {
+                continue;
+            }
+
+            Entry.ParentIndex = FileName.ParentIndex;
+            Entry.NameOffset  = NTFS_CAST(uint32_t, NameBase + NTFS__ListLen(Timeline->Names));
+            Entry.NameLength  = FileName.NameLength;
+            Entry.Source      = NTFS_TimelineSource_FileName;
+            for (size_t Index = 0; Index < FileName.NameLength; Index++) {
+                NTFS__ListPush(&Timeline->NameArena, Timeline->Names, FileName.Name[Index]);
+            }
+
+            uint64_t Times[4];
+            Times[0] = *NTFS_CAST(uint64_t *, Data + 0x10);
+            Times[1] = *NTFS_CAST(uint64_t *, Data + 0x20);
+            Times[2] = *NTFS_CAST(uint64_t *, Data + 0x18);
+            Times[3] = *NTFS_CAST(uint64_t *, Data + 0x08);
+            NTFS__TimelinePush(Timeline, Times, Entry);
+
+            // Hard links share one $STANDARD_INFORMATION, it is named
+            // after the preferred link
+            uint32_t Rank = NTFS__NameSpaceRank(FileName.NameSpace);
+            if (!HasName || Rank < NameRank) {
+                SiEntry  = Entry;
+                NameRank = Rank;
+            }
+            HasName = true;
+        }
+    }
+
+    if (StdInfo) {
+        Entry        = SiEntry;
+        Entry.Source = NTFS_TimelineSource_StandardInformation;
+
+        uint64_t Times[4];
+        Times[0] = *NTFS_CAST(uint64_t *, StdInfo + 0x08);
+        Times[1] = *NTFS_CAST(uint64_t *, StdInfo + 0x18);
+        Times[2] = *NTFS_CAST(uint64_t *, StdInfo + 0x10);
+        Times[3] = *NTFS_CAST(uint64_t *, StdInfo + 0x00);
+        NTFS__TimelinePush(Timeline, Times, Entry);
+    }
+}
+
+static void NTFS__TimelineSort(ntfs_timeline *Timeline)
+{
+    size_t Count = NTFS__ListLen(Timeline->Entries);
+    if (Count) {
+        void *Scratch = NTFS__ArenaAlloc(&Timeline->Arena, Count * sizeof(*Timeline->Entries));
+        NTFS__RadixSortParallel(Timeline->Entries, Scratch, Count, sizeof(*Timeline->Entries),
+                                offsetof(ntfs_timeline_entry, Time),
+                                NTFS__Win32ProcessorCount());
+    }
+}
+
+ntfs_timeline NTFS_TimelineBuild(ntfs_volume *Volume, bool IncludeFree)
+{
+    ntfs_timeline Result = {
+        .Arena     = NTFS__ArenaCreate(NTFS_TIMELINE_RESERVED, NTFS__ARENA_DEFAULT_COMMIT),
+        .NameArena = NTFS__ArenaCreate(NTFS_TIMELINE_RESERVED, NTFS__ARENA_DEFAULT_COMMIT),
+    };
+    ntfs_mft_scan Scan = NTFS_MftScanBegin(Volume);
+
+    if (Result.Arena.Buffer == 0 || Result.NameArena.Buffer == 0) {
+        NTFS_RETURN(Result.Error, NTFS_Error_MemoryError);
+    }
+
+    if (Scan.Error) {
+        NTFS_RETURN(Result.Error, Scan.Error);
+    }
+
+    // Attributes are read in place, the only allocations are the output
+    Scan.IncludeFree = IncludeFree;
+    Scan.HeadersOnly = true;
+
+    ntfs_record Record = { 0 };
+    while (NTFS_MftScanNext(&Scan, &Record)) {
+        NTFS__TimelineAdd(&Result, Volume, &Record, 0);
+    }
+
+    if (Scan.Error) {
+        NTFS_RETURN(Result.Error, Scan.Error);
+    }
+
+    NTFS__TimelineSort(&Result);
+
+skip:
+    NTFS_MftScanEnd(&Scan);
+    return Result;
+}
+
+void NTFS_TimelineDestroy(ntfs_timeline *Timeline)
+{
+    if (Timeline->Arena.Buffer) {
+        NTFS__ArenaDestroy(&Timeline->Arena);
+    }
+
+    if (Timeline->NameArena.Buffer) {
+        NTFS__ArenaDestroy(&Timeline->NameArena);
+    }
+
+    *Timeline = (ntfs_timeline) { .Error = Timeline->Error };
+}
+
+static bool NTFS__WriterOpenHandle(ntfs__writer *Writer, void *Handle)
+{
+    *Writer = (ntfs__writer) {
+        .Handle = Handle,
+        .Arena  = NTFS__ArenaCreate(NTFS_TIMELINE_WRITE_BUFFER, NTFS_TIMELINE_WRITE_BUFFER),
+    };
+    Writer->Buffer = Writer->Arena.Buffer;
+
+    bool Result = Writer->Handle && Writer->Buffer;
+    return Result;
+}
+
+static bool NTFS__WriterOpen(ntfs__writer *Writer, wchar_t *Path)
+{
+    bool Result = NTFS__WriterOpenHandle(Writer, NTFS__Win32FileCreate(Path));
+    return Result;
+}
+
+static void NTFS__WriterFlush(ntfs__writer *Writer)
+{
+    if (Writer->Used && !Writer->Failed) {
+        Writer->Failed = !NTFS__Win32FileWrite(Writer->Handle, Writer->Buffer, Writer->Used);
+    }
+
+    Writer->Used = 0;
+}
+
+// Reserves space for Size bytes, which must be less than the buffer size
+static char *NTFS__WriterReserve(ntfs__writer *Writer, size_t Size)
+{
+    if (Writer->Used + Size > NTFS_TIMELINE_WRITE_BUFFER) {
+        NTFS__WriterFlush(Writer);
+    }
+
+    char *Result  = NTFS_CAST(char *, Writer->Buffer + Writer->Used);
+    Writer->Used += Size;
+    return Result;
+}
+
+static void NTFS__WriterPut(ntfs__writer *Writer, void *Data, size_t Size)
+{
+    uint8_t *Source = Data;
+    while (Size) {
+        size_t Chunk = NTFS_TIMELINE_WRITE_BUFFER - Writer->Used;
+        if (Chunk > Size) {
+            Chunk = Size;
+        }
+
+        NTFS_MEM_COPY(Writer->Buffer + Writer->Used, Chunk, Source, Chunk);
+        Writer->Used += Chunk;
+        Source       += Chunk;
+        Size         -= Chunk;
+        if (Writer->Used == NTFS_TIMELINE_WRITE_BUFFER) {
+            NTFS__WriterFlush(Writer);
+        }
+    }
+}
+
+static ntfs_error NTFS__WriterClose(ntfs__writer *Writer)
+{
+    ntfs_error Result = NTFS_Error_Success;
+
+    if (Writer->Handle) {
+        NTFS__WriterFlush(Writer);
+        CloseHandle(Writer->Handle);
+    }
+
+    if (Writer->Arena.Buffer) {
+        NTFS__ArenaDestroy(&Writer->Arena);
+    }
+
+    if (Writer->Handle == 0 || Writer->Failed) {
+        Result = NTFS_Error_TimelineFailedWrite;
+    }
+
+    return Result;
+}
+
+ntfs_error NTFS_TimelineWriteBinary(ntfs_timeline *Timeline, wchar_t *Path)
+{
+    ntfs__writer Writer = { 0 };
+    if (NTFS__WriterOpen(&Writer, Path)) {
+        uint64_t Header[4] = {
+            NTFS_TIMELINE_MAGIC,
+            NTFS__ListLen(Timeline->Entries),
+            NTFS__ListLen(Timeline->Names),
+            sizeof(ntfs_timeline_entry),
+        };
+        NTFS__WriterPut(&Writer, Header, sizeof(Header));
+        NTFS__WriterPut(&Writer, Timeline->Entries,
+                        NTFS__ListLen(Timeline->Entries) * sizeof(*Timeline->Entries));
+        NTFS__WriterPut(&Writer, Timeline->Names,
+                        NTFS__ListLen(Timeline->Names) * sizeof(*Timeline->Names));
+    }
+
+    ntfs_error Result = NTFS__WriterClose(&Writer);
+    return Result;
+}
+
+static void NTFS__TimelineCsvRow(ntfs__writer *Writer, ntfs_timeline_entry *Entry, uint16_t *Name)
+{
+    // Longest row is a time, indexes, flags and a fully quoted name
+    size_t MaxRow = NTFS_ISO8601_MAX_SIZE + 2 * 20 + 32 + 2 * 255 * 3 + 8;
+
+    char *Row = NTFS__WriterReserve(Writer, MaxRow);
+    char *Ptr = Row;
+    Ptr += NTFS_FileTimeToIso8601(Entry->Time, Ptr);
+    *Ptr++ = ',';
+    *Ptr++ = (Entry->Macb & NTFS_Macb_Modified) ? 'M' : '.';
+    *Ptr++ = (Entry->Macb & NTFS_Macb_Accessed) ? 'A' : '.';
+    *Ptr++ = (Entry->Macb & NTFS_Macb_Changed)  ? 'C' : '.';
+    *Ptr++ = (Entry->Macb & NTFS_Macb_Born)     ? 'B' : '.';
+    *Ptr++ = ',';
+    *Ptr++ = (Entry->Source == NTFS_TimelineSource_FileName) ? 'F' : 'S';
+    *Ptr++ = (Entry->Source == NTFS_TimelineSource_FileName) ? 'N' : 'I';
+    *Ptr++ = ',';
+    Ptr += NTFS__PutDecimal(Ptr, Entry->RecordIndex);
+    *Ptr++ = ',';
+    Ptr += NTFS__PutDecimal(Ptr, Entry->ParentIndex);
+    *Ptr++ = ',';
+    *Ptr++ = (Entry->Flags & NTFS_TimelineFlag_Dir) ? 'D' : 'F';
+    *Ptr++ = ',';
+    *Ptr++ = (Entry->Flags & NTFS_TimelineFlag_Deleted) ? '1' : '0';
+    *Ptr++ = ',';
+
+    // Names are always quoted, embedded quotes are doubled
+    char   NameUtf8[255 * 3];
+    size_t NameSize = NTFS__Utf16ToUtf8(Name, Entry->NameLength, NameUtf8);
+    *Ptr++ = '"';
+    for (size_t Char = 0; Char < NameSize; Char++) {
+        if (NameUtf8[Char] == '"') {
+            *Ptr++ = '"';
+        }
+        *Ptr++ = NameUtf8[Char];
+    }
+    *Ptr++ = '"';
+    *Ptr++ = '\r';
+    *Ptr++ = '\n';
+
+    // Give back the unused part of the reservation
+    Writer->Used -= MaxRow - (Ptr - Row);
+}
+
+ntfs_error NTFS_TimelineWriteCsv(ntfs_timeline *Timeline, wchar_t *Path)
+{
+    ntfs__writer Writer = { 0 };
+    if (NTFS__WriterOpen(&Writer, Path)) {
+        char Header[] = NTFS_TIMELINE_CSV_HEADER;
+        NTFS__WriterPut(&Writer, Header, sizeof(Header) - 1);
+
+        for (size_t Index = 0; Index < NTFS__ListLen(Timeline->Entries); Index++) {
+            ntfs_timeline_entry *Entry = Timeline->Entries + Index;
+            NTFS__TimelineCsvRow(&Writer, Entry, Timeline->Names + Entry->NameOffset);
+        }
+    }
+
+    ntfs_error Result = NTFS__WriterClose(&Writer);
+    return Result;
+}
+
+// Part of a spill file read back through a buffer
+typedef struct {
+    uint64_t Offset;
+    uint64_t End;
+
+    uint8_t *Buffer;
+    size_t   Size;
+    size_t   Used;
+    size_t   Filled;
+} ntfs__spill_run;
+
+// Sorted runs of entries, each followed by its name for CSV output,
+// laid one after the other in the spill file
+typedef struct {
+    ntfs__spill_run     Spill;
+    ntfs_timeline_entry Entry;
+    uint16_t           *Name;
+} ntfs__timeline_run;
+
+typedef struct {
+    ntfs_timeline_format Format;
+    ntfs_timeline        Chunk;
+    ntfs__writer         Spill;
+    ntfs__writer         NameSpill;
+    uint64_t             SpillSize;
+
+    ntfs_arena          RunArena;
+    ntfs__timeline_run *Runs;
+} ntfs__timeline_export;
+
+// Names are kept in the order they were found, only in binary output
+// whose entries refer to them by offset
+static bool NTFS__TimelineSpill(ntfs__timeline_export *Export, uint64_t NameBase)
+{
+    bool Result = true;
+
+    ntfs_timeline *Chunk = &Export->Chunk;
+    if (Export->Spill.Handle == 0) {
+        Result &= NTFS__WriterOpenHandle(&Export->Spill, NTFS__Win32FileCreateTemp());
+        if (Export->Format == NTFS_TimelineFormat_Binary) {
+            Result &= NTFS__WriterOpenHandle(&Export->NameSpill, NTFS__Win32FileCreateTemp());
+        }
+
+        if (!Result) {
+            NTFS_RETURN(Result, false);
+        }
+    }
+
+    NTFS__TimelineSort(Chunk);
+
+    ntfs__timeline_run Run = { .Spill.Offset = Export->SpillSize };
+    for (size_t Index = 0; Index < NTFS__ListLen(Chunk->Entries); Index++) {
+        ntfs_timeline_entry *Entry = Chunk->Entries + Index;
+        NTFS__WriterPut(&Export->Spill, Entry, sizeof(*Entry));
+        Export->SpillSize += sizeof(*Entry);
+
+        if (Export->Format == NTFS_TimelineFormat_Csv) {
+            size_t NameSize = Entry->NameLength * sizeof(uint16_t);
+            NTFS__WriterPut(&Export->Spill, Chunk->Names + (Entry->NameOffset - NameBase),
+                            NameSize);
+            Export->SpillSize += NameSize;
+        }
+    }
+    Run.Spill.End = Export->SpillSize;
+    NTFS__ListPush(&Export->RunArena, Export->Runs, Run);
+
+    if (Export->Format == NTFS_TimelineFormat_Binary) {
+        NTFS__WriterPut(&Export->NameSpill, Chunk->Names,
+                        NTFS__ListLen(Chunk->Names) * sizeof(*Chunk->Names));
+    }
+
+    NTFS__ArenaReset(&Chunk->Arena);
+    NTFS__ArenaReset(&Chunk->NameArena);
+    Chunk->Entries = 0;
+    Chunk->Names   = 0;
+
+    Result = !Export->Spill.Failed && !Export->NameSpill.Failed;
+
+skip:
+    return Result;
+}
+
+// Returns the next Size bytes of the run, valid until the next call.
+// What is left of the buffer moves to its start before it is refilled
+static uint8_t *NTFS__SpillRunTake(void *Handle, ntfs__spill_run *Run, size_t Size)
+{
+    uint8_t *Result = 0;
+
+    if (Run->Filled - Run->Used < Size) {
+        size_t Left = Run->Filled - Run->Used;
+        for (size_t Index = 0; Index < Left; Index++) {
+            Run->Buffer[Index] = Run->Buffer[Run->Used + Index];
+        }
+
+        size_t ReadSize = Run->Size - Left;
+        if (ReadSize > Run->End - Run->Offset) {
+            ReadSize = NTFS_CAST(size_t, Run->End - Run->Offset);
+        }
+
+        if (ReadSize && !NTFS__Win32FileRead(Handle, Run->Offset, Run->Buffer + Left, ReadSize)) {
+            NTFS_RETURN(Result, 0);
+        }
+
+        Run->Offset += ReadSize;
+        Run->Used    = 0;
+        Run->Filled  = Left + ReadSize;
+        if (Run->Filled < Size) {
+            NTFS_RETURN(Result, 0);
+        }
+    }
+
+    Result     = Run->Buffer + Run->Used;
+    Run->Used += Size;
+
+skip:
+    return Result;
+}
+
+static inline bool NTFS__SpillRunDone(ntfs__spill_run *Run)
+{
+    bool Result = Run->Offset == Run->End && Run->Used == Run->Filled;
+    return Result;
+}
+
+static bool NTFS__TimelineRunNext(ntfs__timeline_export *Export, ntfs__timeline_run *Run,
+                                  bool *Failed)
+{
+    bool Result = false;
+
+    if (NTFS__SpillRunDone(&Run->Spill)) {
+        NTFS_RETURN(Result, false);
+    }
+
+    uint8_t *Entry = NTFS__SpillRunTake(Export->Spill.Handle, &Run->Spill, sizeof(Run->Entry));
+    if (Entry == 0) {
+        NTFS_RETURN(*Failed, true);
+    }
+    NTFS_MEM_COPY(&Run->Entry, sizeof(Run->Entry), Entry, sizeof(Run->Entry));
+
+    if (Export->Format == NTFS_TimelineFormat_Csv) {
+        Run->Name = NTFS_CAST(uint16_t *,
+                              NTFS__SpillRunTake(Export->Spill.Handle, &Run->Spill,
+                                                 Run->Entry.NameLength * sizeof(uint16_t)));
+        if (Run->Name == 0) {
+            NTFS_RETURN(*Failed, true);
+        }
+    }
+    Result = true;
+
+skip:
+    return Result;
+}
+
+// Ties go to the earlier run, which keeps the merge as stable as the sort
+static inline bool NTFS__TimelineRunLess(ntfs__timeline_run *Runs, uint32_t Left, uint32_t Right)
+{
+    bool Result = Runs[Left].Entry.Time < Runs[Right].Entry.Time ||
+                  (Runs[Left].Entry.Time == Runs[Right].Entry.Time && Left < Right);
+    return Result;
+}
+
+static void NTFS__TimelineHeapDown(ntfs__timeline_run *Runs, uint32_t *Heap, size_t Count,
+                                   size_t Index)
+{
+    for (;;) {
+        size_t Smallest = Index;
+        size_t Left     = Index * 2 + 1;
+        size_t Right    = Left + 1;
+        if (Left < Count && NTFS__TimelineRunLess(Runs, Heap[Left], Heap[Smallest])) {
+            Smallest = Left;
+        }
+        if (Right < Count && NTFS__TimelineRunLess(Runs, Heap[Right], Heap[Smallest])) {
+            Smallest = Right;
+        }
+        if (Smallest == Index) {
+            break;
+        }
+
+        uint32_t Swap  = Heap[Index];
+        Heap[Index]    = Heap[Smallest];
+        Heap[Smallest] = Swap;
+        Index          = Smallest;
+    }
+}
+
+static void NTFS__TimelineExportEntry(ntfs__writer *Writer, ntfs_timeline_format Format,
+                                      ntfs_timeline_entry *Entry, uint16_t *Name)
+{
+    if (Format == NTFS_TimelineFormat_Csv) {
+        NTFS__TimelineCsvRow(Writer, Entry, Name);
+    } else {
+        NTFS__WriterPut(Writer, Entry, sizeof(*Entry));
+    }
+}
+
+// Entries are collected until they and the scratch to sort them pass the
+// budget, then they are sorted and spilled as a run. The runs are merged
+// with a heap straight into the output, a volume that fits the budget is
+// written from memory. Output is the same as writing a built timeline
+ntfs_error NTFS_TimelineExport(ntfs_volume *Volume, bool IncludeFree, size_t MemoryBudget,
+                               ntfs_timeline_format Format, wchar_t *Path)
+{
+    ntfs_error            Result = NTFS_Error_Success;
+    ntfs__timeline_export Export = {
+        .Format = Format,
+        .Chunk  = {
+            .Arena     = NTFS__ArenaCreate(NTFS_TIMELINE_RESERVED, NTFS__ARENA_DEFAULT_COMMIT),
+            .NameArena = NTFS__ArenaCreate(NTFS_TIMELINE_RESERVED, NTFS__ARENA_DEFAULT_COMMIT),
+        },
+        .RunArena = NTFS__ArenaDefault(),
+    };
+    ntfs_timeline *Chunk  = &Export.Chunk;
+    ntfs_mft_scan  Scan   = NTFS_MftScanBegin(Volume);
+    ntfs__writer   Writer = { 0 };
+
+    if (Chunk->Arena.Buffer == 0 || Chunk->NameArena.Buffer == 0 || Export.RunArena.Buffer == 0) {
+        NTFS_RETURN(Result, NTFS_Error_MemoryError);
+    }
+
+    if (Scan.Error) {
+        NTFS_RETURN(Result, Scan.Error);
+    }
+
+    if (MemoryBudget < NTFS_TIMELINE_MIN_BUDGET) {
+        MemoryBudget = NTFS_TIMELINE_MIN_BUDGET;
+    }
+
+    Scan.IncludeFree = IncludeFree;
+    Scan.HeadersOnly = true;
+
+    uint64_t    EntryCount = 0;
+    uint64_t    NameBase   = 0;
+    ntfs_record Record     = { 0 };
+    while (NTFS_MftScanNext(&Scan, &Record)) {
+        NTFS__TimelineAdd(Chunk, Volume, &Record, NameBase);
+
+        // Sorting takes as much scratch as the entries themselves
+        if (Chunk->Arena.Offset * 2 + Chunk->NameArena.Offset > MemoryBudget) {
+            EntryCount += NTFS__ListLen(Chunk->Entries);
+            uint64_t NameCount = NTFS__ListLen(Chunk->Names);
+            if (!NTFS__TimelineSpill(&Export, NameBase)) {
+                NTFS_RETURN(Result, NTFS_Error_TimelineFailedSpill);
+            }
+            NameBase += NameCount;
+        }
+    }
+
+    if (Scan.Error) {
+        NTFS_RETURN(Result, Scan.Error);
+    }
+
+    EntryCount += NTFS__ListLen(Chunk->Entries);
+    uint64_t NameCount = NameBase + NTFS__ListLen(Chunk->Names);
+    if (Export.Runs) {
+        if (Chunk->Entries && !NTFS__TimelineSpill(&Export, NameBase)) {
+            NTFS_RETURN(Result, NTFS_Error_TimelineFailedSpill);
+        }
+
+        NTFS__WriterFlush(&Export.Spill);
+        NTFS__WriterFlush(&Export.NameSpill);
+        if (Export.Spill.Failed || Export.NameSpill.Failed) {
+            NTFS_RETURN(Result, NTFS_Error_TimelineFailedSpill);
+        }
+    } else {
+        NTFS__TimelineSort(Chunk);
+    }
+
+    if (!NTFS__WriterOpen(&Writer, Path)) {
+        NTFS_RETURN(Result, NTFS_Error_TimelineFailedWrite);
+    }
+
+    if (Format == NTFS_TimelineFormat_Csv) {
+        char Header[] = NTFS_TIMELINE_CSV_HEADER;
+        NTFS__WriterPut(&Writer, Header, sizeof(Header) - 1);
+    } else {
+        uint64_t Header[4] = {
+            NTFS_TIMELINE_MAGIC,
+            EntryCount,
+            NameCount,
+            sizeof(ntfs_timeline_entry),
+        };
+        NTFS__WriterPut(&Writer, Header, sizeof(Header));
+    }
+
+    if (Export.Runs == 0) {
+        for (size_t Index = 0; Index < NTFS__ListLen(Chunk->Entries); Index++) {
+            ntfs_timeline_entry *Entry = Chunk->Entries + Index;
+            NTFS__TimelineExportEntry(&Writer, Format, Entry, Chunk->Names + Entry->NameOffset);
+        }
+
+        if (Format == NTFS_TimelineFormat_Binary) {
+            NTFS__WriterPut(&Writer, Chunk->Names,
+                            NTFS__ListLen(Chunk->Names) * sizeof(*Chunk->Names));
+        }
+    } else {
+        // The budget is spent again on the read buffers of the runs
+        NTFS__ArenaReset(&Chunk->Arena);
+        uint32_t RunCount   = NTFS_CAST(uint32_t, NTFS__ListLen(Export.Runs));
+        size_t   BufferSize = NTFS__Align(MemoryBudget / RunCount, sizeof(uint64_t));
+        if (BufferSize < NTFS_TIMELINE_RUN_BUFFER) {
+            BufferSize = NTFS_TIMELINE_RUN_BUFFER;
+        }
+
+        uint32_t *Heap      = NTFS__ArenaAlloc(&Chunk->Arena, RunCount * sizeof(*Heap));
+        size_t    HeapCount = 0;
+        bool      Failed    = false;
+        for (uint32_t Index = 0; Index < RunCount; Index++) {
+            ntfs__timeline_run *Run = Export.Runs + Index;
+            Run->Spill.Buffer = NTFS__ArenaAlloc(&Chunk->Arena, BufferSize);
+            Run->Spill.Size   = BufferSize;
+            if (NTFS__TimelineRunNext(&Export, Run, &Failed)) {
+                Heap[HeapCount++] = Index;
+            }
+        }
+
+        for (size_t Index = HeapCount / 2; Index-- > 0;) {
+            NTFS__TimelineHeapDown(Export.Runs, Heap, HeapCount, Index);
+        }
+
+        while (HeapCount && !Failed) {
+            ntfs__timeline_run *Run = Export.Runs + Heap[0];
+            NTFS__TimelineExportEntry(&Writer, Format, &Run->Entry, Run->Name);
+
+            if (!NTFS__TimelineRunNext(&Export, Run, &Failed)) {
+                Heap[0] = Heap[--HeapCount];
+            }
+            NTFS__TimelineHeapDown(Export.Runs, Heap, HeapCount, 0);
+        }
+
+        // Names were spilled in the order they were found, which is the
+        // order of the offsets in the entries
+        if (Format == NTFS_TimelineFormat_Binary && !Failed) {
+            ntfs__spill_run Names = {
+                .End    = NameCount * sizeof(uint16_t),
+                .Buffer = Export.Runs[0].Spill.Buffer,
+                .Size   = BufferSize,
+            };
+            while (Names.Offset < Names.End && !Failed) {
+                size_t   Size = Names.End - Names.Offset < BufferSize ?
+                                NTFS_CAST(size_t, Names.End - Names.Offset) : BufferSize;
+                uint8_t *Data = NTFS__SpillRunTake(Export.NameSpill.Handle, &Names, Size);
+                if (Data == 0) {
+                    Failed = true;
+                    break;
+                }
+                NTFS__WriterPut(&Writer, Data, Size);
+            }
+        }
+
+        if (Failed) {
+            NTFS_RETURN(Result, NTFS_Error_TimelineFailedSpill);
+        }
+    }
+
+skip:
+    if (Writer.Handle || Writer.Arena.Buffer) {
+        ntfs_error WriteResult = NTFS__WriterClose(&Writer);
+        if (Result == NTFS_Error_Success) {
+            Result = WriteResult;
+        }
+    }
+
+    if (Export.Spill.Handle || Export.Spill.Arena.Buffer) {
+        NTFS__WriterClose(&Export.Spill);
+    }
+
+    if (Export.NameSpill.Handle || Export.NameSpill.Arena.Buffer) {
+        NTFS__WriterClose(&Export.NameSpill);
+    }
+
+    NTFS_TimelineDestroy(Chunk);
+    if (Export.RunArena.Buffer) {
+        NTFS__ArenaDestroy(&Export.RunArena);
+    }
+    NTFS_MftScanEnd(&Scan);
+    return Result;
+}
+
+size_t NTFS_FileTimeToIso8601(uint64_t FileTime, char *Buffer)
+{
+    uint64_t Seconds  = FileTime / 10000000;
+    uint32_t Fraction = NTFS_CAST(uint32_t, FileTime % 10000000);
+    uint64_t Days     = Seconds / 86400;
+    uint32_t DayTime  = NTFS_CAST(uint32_t, Seconds % 86400);
+
+    // Civil date from days, shifted so years start in March and leap days
+    // fall at the end of the year. FILETIME epoch is 1601-01-01, which is
+    // day 584694 counting from 0000-03-01
+    uint64_t Shifted   = Days + 584694;
+    uint64_t Era       = Shifted / 146097;
+    uint32_t EraDay    = NTFS_CAST(uint32_t, Shifted - Era * 146097);
+    uint32_t EraYear   = (EraDay - EraDay / 1460 + EraDay / 36524 - EraDay / 146096) / 365;
+    uint32_t YearDay   = EraDay - (365 * EraYear + EraYear / 4 - EraYear / 100);
+    uint32_t MonthBase = (5 * YearDay + 2) / 153;
+    uint32_t Day       = YearDay - (153 * MonthBase + 2) / 5 + 1;
+    uint32_t Month     = (MonthBase < 10) ? MonthBase + 3 : MonthBase - 9;
+    uint64_t Year      = Era * 400 + EraYear + (Month <= 2);
+
+    char *Ptr = Buffer;
+    if (Year >= 10000) {
+        *Ptr++ = NTFS_CAST(char, '0' + Year / 10000);
+    }
+    Ptr    = NTFS__PutDigits2(Ptr, NTFS_CAST(uint32_t, Year / 100 % 100));
+    Ptr    = NTFS__PutDigits2(Ptr, NTFS_CAST(uint32_t, Year % 100));
+    *Ptr++ = '-';
+    Ptr    = NTFS__PutDigits2(Ptr, Month);
+    *Ptr++ = '-';
+    Ptr    = NTFS__PutDigits2(Ptr, Day);
+    *Ptr++ = 'T';
+    Ptr    = NTFS__PutDigits2(Ptr, DayTime / 3600);
+    *Ptr++ = ':';
+    Ptr    = NTFS__PutDigits2(Ptr, DayTime / 60 % 60);
+    *Ptr++ = ':';
+    Ptr    = NTFS__PutDigits2(Ptr, DayTime % 60);
+    *Ptr++ = '.';
+    *Ptr++ = NTFS_CAST(char, '0' + Fraction / 1000000);
+    Ptr    = NTFS__PutDigits2(Ptr, Fraction / 10000 % 100);
+    Ptr    = NTFS__PutDigits2(Ptr, Fraction / 100 % 100);
+    Ptr    = NTFS__PutDigits2(Ptr, Fraction % 100);
+    *Ptr++ = 'Z';
+    *Ptr   = 0;
+
+    size_t Result = Ptr - Buffer;
+    return Result;
+}
+
+static DWORD WINAPI NTFS__RadixSortThread(void *Param)
+{
+    ntfs__radix_job  *Job  = Param;
+    ntfs__radix_sort *Sort = Job->Sort;
+
+    for (size_t Index = Job->Begin; Index < Job->End && Job->Phase != NTFS__RadixPhase_Sort;
+         Index++) {
+        uint8_t *Item = Sort->Items + Index * Sort->ItemSize;
+        uint64_t Key  = *NTFS_CAST(uint64_t *, Item + Sort->KeyOffset);
+
+        if (Job->Phase == NTFS__RadixPhase_Diff) {
+            Job->Diff |= Key ^ *NTFS_CAST(uint64_t *, Sort->Items + Sort->KeyOffset);
+
+        } else if (Job->Phase == NTFS__RadixPhase_Count) {
+            Job->Offsets[(Key >> Sort->Shift) & 0xFF]++;
+
+        } else {
+            size_t Digit = (Key >> Sort->Shift) & 0xFF;
+            NTFS_MEM_COPY(Sort->Scratch + Job->Offsets[Digit]++ * Sort->ItemSize,
+                          Sort->ItemSize, Item, Sort->ItemSize);
+        }
+    }
+
+    // Buckets are handed out one at a time, sorted on the remaining digits
+    // in scratch and copied back in place
+    while (Job->Phase == NTFS__RadixPhase_Sort) {
+        LONG Bucket = InterlockedIncrement(&Sort->NextBucket) - 1;
+        if (Bucket >= 256) {
+            break;
+        }
+
+        size_t Begin = Sort->Buckets[Bucket];
+        size_t Count = Sort->Buckets[Bucket + 1] - Begin;
+        if (Count) {
+            uint8_t *Source = Sort->Scratch + Begin * Sort->ItemSize;
+            uint8_t *Dest   = Sort->Items   + Begin * Sort->ItemSize;
+            NTFS__RadixSort(Source, Dest, Count, Sort->ItemSize, Sort->KeyOffset);
+            NTFS_MEM_COPY(Dest, Count * Sort->ItemSize, Source, Count * Sort->ItemSize);
+        }
+    }
+
+    return 0;
+}
+
+static void NTFS__RadixSortPhase(ntfs__radix_job *Jobs, uint32_t ThreadCount, uint32_t Phase)
+{
+    void *Threads[64] = { 0 };
+    for (uint32_t Index = 0; Index < ThreadCount; Index++) {
+        Jobs[Index].Phase = Phase;
+        Threads[Index]    = NTFS__Win32ThreadCreate(NTFS__RadixSortThread, Jobs + Index);
+        if (Threads[Index] == 0) {
+            NTFS__RadixSortThread(Jobs + Index);
+        }
+    }
+
+    for (uint32_t Index = 0; Index < ThreadCount; Index++) {
+        if (Threads[Index]) {
+            NTFS__Win32ThreadJoin(Threads[Index]);
+        }
+    }
+}
+
+void NTFS__RadixSortParallel(void *Items, void *Scratch, size_t Count, size_t ItemSize,
+                             size_t KeyOffset, uint32_t ThreadCount)
+{
+    if (ThreadCount > 64) {
+        ThreadCount = 64;
+    }
+
+    if (ThreadCount < 2 || Count < NTFS__RADIX_PARALLEL_MIN) {
+        NTFS__RadixSort(Items, Scratch, Count, ItemSize, KeyOffset);
+        return;
+    }
+
+    ntfs__radix_sort Sort = {
+        .Items     = Items,
+        .Scratch   = Scratch,
+        .Count     = Count,
+        .ItemSize  = ItemSize,
+        .KeyOffset = KeyOffset,
+    };
+    ntfs__radix_job Jobs[64] = { 0 };
+    for (uint32_t Index = 0; Index < ThreadCount; Index++) {
+        Jobs[Index].Sort  = &Sort;
+        Jobs[Index].Begin = Count * Index / ThreadCount;
+        Jobs[Index].End   = Count * (Index + 1) / ThreadCount;
+    }
+
+    // Split on the highest digit that differs, keys like timestamps share
+    // most of their top bits
+    NTFS__RadixSortPhase(Jobs, ThreadCount, NTFS__RadixPhase_Diff);
+    uint64_t Diff = 0;
+    for (uint32_t Index = 0; Index < ThreadCount; Index++) {
+        Diff |= Jobs[Index].Diff;
+    }
+
+    if (Diff == 0) {
+        return;
+    }
+    Sort.Shift = 56;
+    while ((Diff >> Sort.Shift) == 0) {
+        Sort.Shift -= 8;
+    }
+
+    // Slices scatter to their own offset inside every bucket, which keeps
+    // the sort stable
+    NTFS__RadixSortPhase(Jobs, ThreadCount, NTFS__RadixPhase_Count);
+    size_t Total = 0;
+    for (size_t Digit = 0; Digit < 256; Digit++) {
+        Sort.Buckets[Digit] = Total;
+        for (uint32_t Index = 0; Index < ThreadCount; Index++) {
+            size_t DigitCount          = Jobs[Index].Offsets[Digit];
+            Jobs[Index].Offsets[Digit] = Total;
+            Total                     += DigitCount;
+        }
+    }
+    Sort.Buckets[256] = Total;
+
+    NTFS__RadixSortPhase(Jobs, ThreadCount, NTFS__RadixPhase_Scatter);
+    NTFS__RadixSortPhase(Jobs, ThreadCount, NTFS__RadixPhase_Sort);
+}
+
+size_t NTFS__Utf16ToUtf8(uint16_t *String, size_t Length, char *Buffer)
+{
+    uint8_t *Ptr = NTFS_CAST(uint8_t *, Buffer);
+
+    for (size_t Index = 0; Index < Length; Index++) {
+        uint32_t Char = String[Index];
+        if (Char >= 0xD800 && Char <= 0xDBFF && Index + 1 < Length &&
+            String[Index + 1] >= 0xDC00 && String[Index + 1] <= 0xDFFF) {
+            Char = 0x10000 + ((Char - 0xD800) << 10) + (String[++Index] - 0xDC00);
+
+        } else if (Char >= 0xD800 && Char <= 0xDFFF) {
+            Char = 0xFFFD;  // Unpaired surrogates are valid in NTFS names
+        }
+
+        if (Char < 0x80) {
+            *Ptr++ = NTFS_CAST(uint8_t, Char);
+        } else if (Char < 0x800) {
+            *Ptr++ = NTFS_CAST(uint8_t, 0xC0 | (Char >> 6));
+            *Ptr++ = NTFS_CAST(uint8_t, 0x80 | (Char & 0x3F));
+        } else if (Char < 0x10000) {
+            *Ptr++ = NTFS_CAST(uint8_t, 0xE0 | (Char >> 12));
+            *Ptr++ = NTFS_CAST(uint8_t, 0x80 | ((Char >> 6) & 0x3F));
+            *Ptr++ = NTFS_CAST(uint8_t, 0x80 | (Char & 0x3F));
+        } else {
+            *Ptr++ = NTFS_CAST(uint8_t, 0xF0 | (Char >> 18));
+            *Ptr++ = NTFS_CAST(uint8_t, 0x80 | ((Char >> 12) & 0x3F));
+            *Ptr++ = NTFS_CAST(uint8_t, 0x80 | ((Char >> 6) & 0x3F));
+            *Ptr++ = NTFS_CAST(uint8_t, 0x80 | (Char & 0x3F));
+        }
+    }
+
+    size_t Result = Ptr - NTFS_CAST(uint8_t *, Buffer);
+    return Result;
+}
+
+// Path index API
+ntfs_path_index NTFS_PathIndexBuild(ntfs_volume *Volume)
+{
+    ntfs_path_index Result = {
+        .Arena     = NTFS__ArenaCreate(NTFS_PATH_INDEX_RESERVED, NTFS__ARENA_DEFAULT_COMMIT),
+        .NameArena = NTFS__ArenaCreate(NTFS_PATH_INDEX_RESERVED, NTFS__ARENA_DEFAULT_COMMIT),
+    };
+    ntfs_mft_scan Scan = NTFS_MftScanBegin(Volume);
+
+    if (Result.Arena.Buffer == 0 || Result.NameArena.Buffer == 0) {
+        NTFS_RETURN(Result.Error, NTFS_Error_MemoryError);
+    }
+
+    if (Scan.Error) {
+        NTFS_RETURN(Result.Error, Scan.Error);
+    }
+
+    // Every $FILE_NAME becomes a link, including the ones in extension
+    // records, so no second pass is needed to find all the names
+    Result.Sequences = NTFS__ArenaAlloc(&Result.Arena, Scan.RecordCount * sizeof(uint16_t));
+    Scan.HeadersOnly = true;
+    ntfs_record Record = { 0 };
+    while (NTFS_MftScanNext(&Scan, &Record)) {
+        if (Record.BaseIndex == Record.Index && Record.Index < Scan.RecordCount) {
+            Result.Sequences[Record.Index] = *NTFS_CAST(uint16_t *, Record.Buffer + 0x10);
+        }
+
+        ntfs_attr        Attr   = { 0 };
+        ntfs_attr_cursor Cursor = NTFS_AttrCursorBegin(Volume, &Record);
+        while (NTFS_AttrCursorNext(&Cursor, NTFS_AttributeType_FileName, &Attr)) {
+            ntfs_file_name FileName = { 0 };
+            if (!NTFS__FileNameParse(&Attr, &FileName) || Record.BaseIndex >= Scan.RecordCount) {
+                continue;
+            }
+
+            ntfs_link Link = {
+                .SortKey        = Record.BaseIndex << 2 | NTFS__NameSpaceRank(FileName.NameSpace),
+                .RecordIndex    = Record.BaseIndex,
+                .ParentIndex    = FileName.ParentIndex,
+                .ParentSequence = FileName.ParentSequence,
+                .NameSpace      = FileName.NameSpace,
+                .NameLength     = FileName.NameLength,
+                .NameOffset     = NTFS_CAST(uint32_t, NTFS__ListLen(Result.Names)),
+            };
+            NTFS__ListPush(&Result.Arena, Result.Links, Link);
+
+            for (size_t Index = 0; Index < FileName.NameLength; Index++) {
+                NTFS__ListPush(&Result.NameArena, Result.Names, FileName.Name[Index]);
+            }
+        }
+    }
+
+    if (Scan.Error) {
+        NTFS_RETURN(Result.Error, Scan.Error);
+    }
+
+    size_t Count = NTFS__ListLen(Result.Links);
+    if (Count) {
+        void *Scratch = NTFS__ArenaAlloc(&Result.Arena, Count * sizeof(*Result.Links));
+        NTFS__RadixSortParallel(Result.Links, Scratch, Count, sizeof(*Result.Links),
+                                offsetof(ntfs_link, SortKey), NTFS__Win32ProcessorCount());
+    }
+
+    // Names are only pointed to once the name list stopped growing
+    Result.RecordCount = Scan.RecordCount;
+    Result.FirstLink   = NTFS__ArenaAlloc(&Result.Arena,
+                                          (Result.RecordCount + 1) * sizeof(uint64_t));
+    size_t LinkIndex   = 0;
+    for (uint64_t Index = 0; Index <= Result.RecordCount; Index++) {
+        Result.FirstLink[Index] = LinkIndex;
+        while (LinkIndex < Count && Result.Links[LinkIndex].RecordIndex == Index) {
+            ntfs_link *Link = Result.Links + LinkIndex++;
+            Link->Name      = Result.Names + Link->NameOffset;
+        }
+    }
+
+skip:
+    NTFS_MftScanEnd(&Scan);
+    return Result;
+}
+
+void NTFS_PathIndexDestroy(ntfs_path_index *Index)
+{
+    if (Index->Arena.Buffer) {
+        NTFS__ArenaDestroy(&Index->Arena);
+    }
+
+    if (Index->NameArena.Buffer) {
+        NTFS__ArenaDestroy(&Index->NameArena);
+    }
+
+    *Index = (ntfs_path_index) { .Error = Index->Error };
+}
+
+size_t NTFS_PathIndexLinks(ntfs_path_index *Index, uint64_t RecordIndex, ntfs_link **Links)
+{
+    size_t Result = 0;
+
+    if (RecordIndex < Index->RecordCount) {
+        *Links = Index->Links + Index->FirstLink[RecordIndex];
+        Result = Index->FirstLink[RecordIndex + 1] - Index->FirstLink[RecordIndex];
+    }
+
+    return Result;
+}
+
+size_t NTFS_PathIndexGetPath(ntfs_path_index *Index, ntfs_link *Link,
+                             uint16_t *Buffer, size_t Size)
+{
+    size_t Result = 0;
+
+    // Built backwards from the end of the buffer, parents follow their
+    // preferred link. Unknown parents, and parents whose record was reused
+    // since the link was written, are shown as a $Orphan folder
+    static const uint16_t Orphan[] = { '$', 'O', 'r', 'p', 'h', 'a', 'n' };
+    size_t Offset = Size;
+    size_t Depth  = 0;
+    while (Link && Link->RecordIndex != NTFS_SystemFile_RootFolder) {
+        if (Offset < Link->NameLength + 1u || ++Depth > NTFS_PATH_MAX_DEPTH) {
+            NTFS_RETURN(Result, 0);
+        }
+
+        Offset -= Link->NameLength;
+        NTFS_MEM_COPY(Buffer + Offset, Link->NameLength * sizeof(uint16_t),
+                      Link->Name, Link->NameLength * sizeof(uint16_t));
+        Buffer[--Offset] = '\\';
+
+        ntfs_link *Parent = 0;
+        if (NTFS_PathIndexLinks(Index, Link->ParentIndex, &Parent) == 0 ||
+            Index->Sequences[Link->ParentIndex] != Link->ParentSequence) {
+            if (Offset < (sizeof(Orphan) / sizeof(*Orphan)) + 1) {
+                NTFS_RETURN(Result, 0);
+            }
+
+            Offset -= (sizeof(Orphan) / sizeof(*Orphan));
+            NTFS_MEM_COPY(Buffer + Offset, sizeof(Orphan), Orphan, sizeof(Orphan));
+            Buffer[--Offset] = '\\';
+            Parent           = 0;
+        }
+
+        Link = Parent;
+    }
+
+    // Root itself is a single separator
+    if (Offset == Size) {
+        if (Size < 2) {
+            NTFS_RETURN(Result, 0);
+        }
+        Buffer[--Offset] = '\\';
+    }
+
+    Result = Size - Offset;
+    if (Result + 1 > Size) {
+        NTFS_RETURN(Result, 0);
+    }
+
+    for (size_t Char = 0; Char < Result; Char++) {
+        Buffer[Char] = Buffer[Offset + Char];
+    }
+    Buffer[Result] = 0;
+
+skip:
+    return Result;
+}
+
+// Path export API
+enum {
+    NTFS__PathItem_Sequence  = 1 << 0,
+    NTFS__PathItem_Parent    = 1 << 1,
+    NTFS__PathItem_Preferred = 1 << 2,
+};
+
+// Links, record sequences and resolved paths share one layout, followed by
+// Length code units of a name or a path
+typedef struct {
+    uint64_t Key;
+    uint64_t RecordIndex;
+    uint64_t ParentIndex;
+    uint16_t ParentSequence;
+    uint16_t Sequence;
+    uint16_t Length;
+    uint16_t Depth;
+    uint32_t Flags;
+} ntfs__path_item;
+
+typedef struct {
+    uint64_t         Key;
+    ntfs__path_item *Item;
+} ntfs__path_key;
+
+typedef struct {
+    ntfs__spill_run Spill;
+    ntfs__path_item Item;
+    uint16_t       *Name;
+} ntfs__path_run;
+
+// Items are kept until they and the scratch to sort their keys pass the
+// budget, then they are written out sorted as a run. Reading merges the
+// runs, or walks the sorted keys when nothing was spilled
+typedef struct {
+    size_t          Budget;
+    uint64_t        Count;
+    ntfs_arena      Arena;
+    ntfs_arena      KeyArena;
+    ntfs__path_key *Keys;
+
+    ntfs__writer    Spill;
+    uint64_t        SpillSize;
+    ntfs_arena      RunArena;
+    ntfs__path_run *Runs;
+
+    uint32_t *Heap;
+    size_t    HeapCount;
+    size_t    Next;
+    bool      IsStarted;
+    bool      Failed;
+} ntfs__path_table;
+
+static ntfs__path_table NTFS__PathTableCreate(size_t Budget)
+{
+    ntfs__path_table Result = {
+        .Budget   = Budget,
+        .Arena    = NTFS__ArenaCreate(NTFS_PATH_INDEX_RESERVED, NTFS__ARENA_DEFAULT_COMMIT),
+        .KeyArena = NTFS__ArenaCreate(NTFS_PATH_INDEX_RESERVED, NTFS__ARENA_DEFAULT_COMMIT),
+        .RunArena = NTFS__ArenaDefault(),
+    };
+
+    Result.Failed = !Result.Arena.Buffer || !Result.KeyArena.Buffer || !Result.RunArena.Buffer;
+    return Result;
+}
+
+static void NTFS__PathTableDestroy(ntfs__path_table *Table)
+{
+    if (Table->Spill.Handle || Table->Spill.Arena.Buffer) {
+        NTFS__WriterClose(&Table->Spill);
+    }
+
+    if (Table->Arena.Buffer) {
+        NTFS__ArenaDestroy(&Table->Arena);
+    }
+
+    if (Table->KeyArena.Buffer) {
+        NTFS__ArenaDestroy(&Table->KeyArena);
+    }
+
+    if (Table->RunArena.Buffer) {
+        NTFS__ArenaDestroy(&Table->RunArena);
+    }
+
+    *Table = (ntfs__path_table) { 0 };
+}
+
+static void NTFS__PathTableSort(ntfs__path_table *Table)
+{
+    size_t Count = NTFS__ListLen(Table->Keys);
+    if (Count) {
+        void *Scratch = NTFS__ArenaAlloc(&Table->KeyArena, Count * sizeof(*Table->Keys));
+        NTFS__RadixSortParallel(Table->Keys, Scratch, Count, sizeof(*Table->Keys),
+                                offsetof(ntfs__path_key, Key), NTFS__Win32ProcessorCount());
+    }
+}
+
+static bool NTFS__PathTableSpill(ntfs__path_table *Table)
+{
+    bool Result = false;
+
+    if (Table->Spill.Handle == 0 &&
+        !NTFS__WriterOpenHandle(&Table->Spill, NTFS__Win32FileCreateTemp())) {
+        NTFS_RETURN(Result, false);
+    }
+
+    NTFS__PathTableSort(Table);
+
+    ntfs__path_run Run = { .Spill.Offset = Table->SpillSize };
+    for (size_t Index = 0; Index < NTFS__ListLen(Table->Keys); Index++) {
+        ntfs__path_item *Item = Table->Keys[Index].Item;
+        size_t           Size = sizeof(*Item) + Item->Length * sizeof(uint16_t);
+        NTFS__WriterPut(&Table->Spill, Item, Size);
+        Table->SpillSize += Size;
+    }
+    Run.Spill.End = Table->SpillSize;
+    NTFS__ListPush(&Table->RunArena, Table->Runs, Run);
+
+    NTFS__ArenaReset(&Table->Arena);
+    NTFS__ArenaReset(&Table->KeyArena);
+    Table->Keys = 0;
+
+    Result = !Table->Spill.Failed;
+
+skip:
+    return Result;
+}
+
+static void NTFS__PathTablePut(ntfs__path_table *Table, ntfs__path_item *Item, uint16_t *Name)
+{
+    size_t           NameSize = Item->Length * sizeof(uint16_t);
+    ntfs__path_item *Copy     = NTFS__ArenaAlloc(&Table->Arena, sizeof(*Item) + NameSize);
+    *Copy = *Item;
+    if (NameSize) {
+        NTFS_MEM_COPY(Copy + 1, NameSize, Name, NameSize);
+    }
+
+    ntfs__path_key Key = { .Key = Item->Key, .Item = Copy };
+    NTFS__ListPush(&Table->KeyArena, Table->Keys, Key);
+    Table->Count++;
+
+    // Sorting takes as much scratch as the keys themselves
+    if (Table->Arena.Offset + Table->KeyArena.Offset * 2 > Table->Budget && !Table->Failed) {
+        Table->Failed = !NTFS__PathTableSpill(Table);
+    }
+}
+
+static bool NTFS__PathRunNext(ntfs__path_table *Table, ntfs__path_run *Run)
+{
+    bool Result = false;
+
+    if (NTFS__SpillRunDone(&Run->Spill)) {
+        NTFS_RETURN(Result, false);
+    }
+
+    uint8_t *Item = NTFS__SpillRunTake(Table->Spill.Handle, &Run->Spill, sizeof(Run->Item));
+    if (Item == 0) {
+        NTFS_RETURN(Table->Failed, true);
+    }
+    NTFS_MEM_COPY(&Run->Item, sizeof(Run->Item), Item, sizeof(Run->Item));
+
+    Run->Name = NTFS_CAST(uint16_t *,
+                          NTFS__SpillRunTake(Table->Spill.Handle, &Run->Spill,
+                                             Run->Item.Length * sizeof(uint16_t)));
+    if (Run->Name == 0) {
+        NTFS_RETURN(Table->Failed, true);
+    }
+    Result = true;
+
+skip:
+    return Result;
+}
+
+// Ties go to the earlier run, which keeps the merge as stable as the sort
+static inline bool NTFS__PathRunLess(ntfs__path_run *Runs, uint32_t Left, uint32_t Right)
+{
+    bool Result = Runs[Left].Item.Key < Runs[Right].Item.Key ||
+                  (Runs[Left].Item.Key == Runs[Right].Item.Key && Left < Right);
+    return Result;
+}
+
+static void NTFS__PathHeapDown(ntfs__path_run *Runs, uint32_t *Heap, size_t Count, size_t Index)
+{
+    for (;;) {
+        size_t Smallest = Index;
+        size_t Left     = Index * 2 + 1;
+        size_t Right    = Left + 1;
+        if (Left < Count && NTFS__PathRunLess(Runs, Heap[Left], Heap[Smallest])) {
+            Smallest = Left;
+        }
+        if (Right < Count && NTFS__PathRunLess(Runs, Heap[Right], Heap[Smallest])) {
+            Smallest = Right;
+        }
+        if (Smallest == Index) {
+            break;
+        }
+
+        uint32_t Swap  = Heap[Index];
+        Heap[Index]    = Heap[Smallest];
+        Heap[Smallest] = Swap;
+        Index          = Smallest;
+    }
+}
+
+// Items are valid until the next call
+static bool NTFS__PathTableNext(ntfs__path_table *Table, ntfs__path_item **Item,
+                                uint16_t **Name)
+{
+    bool Result = false;
+
+    if (Table->Failed) {
+        NTFS_RETURN(Result, false);
+    }
+
+    if (Table->Runs == 0) {
+        if (Table->Next < NTFS__ListLen(Table->Keys)) {
+            *Item  = Table->Keys[Table->Next++].Item;
+            *Name  = NTFS_CAST(uint16_t *, *Item + 1);
+            Result = true;
+        }
+        NTFS_RETURN(Result, Result);
+    }
+
+    // The run handed out last moves on only now that its item is done with
+    if (Table->IsStarted && Table->HeapCount) {
+        if (!NTFS__PathRunNext(Table, Table->Runs + Table->Heap[0])) {
+            Table->Heap[0] = Table->Heap[--Table->HeapCount];
+        }
+        NTFS__PathHeapDown(Table->Runs, Table->Heap, Table->HeapCount, 0);
+    }
+    Table->IsStarted = true;
+
+    if (Table->HeapCount && !Table->Failed) {
+        ntfs__path_run *Run = Table->Runs + Table->Heap[0];
+        *Item  = &Run->Item;
+        *Name  = Run->Name;
+        Result = true;
+    }
+
+skip:
+    return Result;
+}
+
+// The budget is spent again on the read buffers of the runs merged,
+// which must hold the longest item
+static void NTFS__PathTableMerge(ntfs__path_table *Table, uint32_t First, uint32_t Count)
+{
+    size_t BufferSize = NTFS__Align(Table->Budget / Count, sizeof(uint64_t));
+    if (BufferSize < NTFS_PATH_RUN_BUFFER) {
+        BufferSize = NTFS_PATH_RUN_BUFFER;
+    }
+
+    NTFS__ArenaReset(&Table->Arena);
+    Table->Heap      = NTFS__ArenaAlloc(&Table->Arena, Count * sizeof(*Table->Heap));
+    Table->HeapCount = 0;
+    Table->IsStarted = false;
+    for (uint32_t Index = First; Index < First + Count && !Table->Failed; Index++) {
+        ntfs__path_run *Run = Table->Runs + Index;
+        Run->Spill.Buffer = NTFS__ArenaAlloc(&Table->Arena, BufferSize);
+        Run->Spill.Size   = BufferSize;
+        if (NTFS__PathRunNext(Table, Run)) {
+            Table->Heap[Table->HeapCount++] = Index;
+        }
+    }
+
+    for (size_t Index = Table->HeapCount / 2; Index-- > 0;) {
+        NTFS__PathHeapDown(Table->Runs, Table->Heap, Table->HeapCount, Index);
+    }
+}
+
+// Merges groups of runs into a new spill file until the read buffers of
+// all the runs left fit the budget
+static void NTFS__PathTableCascade(ntfs__path_table *Table, uint32_t MaxRuns)
+{
+    while (NTFS__ListLen(Table->Runs) > MaxRuns && !Table->Failed) {
+        ntfs__writer    Spill     = { 0 };
+        uint64_t        SpillSize = 0;
+        ntfs__path_run *Runs      = 0;
+        if (!NTFS__WriterOpenHandle(&Spill, NTFS__Win32FileCreateTemp())) {
+            NTFS__WriterClose(&Spill);
+            Table->Failed = true;
+            break;
+        }
+
+        uint32_t RunCount = NTFS_CAST(uint32_t, NTFS__ListLen(Table->Runs));
+        for (uint32_t First = 0; First < RunCount && !Table->Failed; First += MaxRuns) {
+            NTFS__PathTableMerge(Table, First, RunCount - First < MaxRuns ? RunCount - First
+                                                                           : MaxRuns);
+
+            ntfs__path_run   Run  = { .Spill.Offset = SpillSize };
+            ntfs__path_item *Item = 0;
+            uint16_t        *Name = 0;
+            while (NTFS__PathTableNext(Table, &Item, &Name)) {
+                NTFS__WriterPut(&Spill, Item, sizeof(*Item));
+                NTFS__WriterPut(&Spill, Name, Item->Length * sizeof(uint16_t));
+                SpillSize += sizeof(*Item) + Item->Length * sizeof(uint16_t);
+            }
+            Run.Spill.End = SpillSize;
+            NTFS__ListPush(&Table->RunArena, Runs, Run);
+        }
+
+        NTFS__WriterFlush(&Spill);
+        Table->Failed |= Spill.Failed;
+        NTFS__WriterClose(&Table->Spill);
+        Table->Spill     = Spill;
+        Table->SpillSize = SpillSize;
+        Table->Runs      = Runs;
+    }
+}
+
+// Ends the writing, the items are read back in key order
+static void NTFS__PathTableFinish(ntfs__path_table *Table)
+{
+    if (Table->Runs == 0) {
+        NTFS__PathTableSort(Table);
+    } else {
+        if (Table->Keys && !Table->Failed) {
+            Table->Failed = !NTFS__PathTableSpill(Table);
+        }
+
+        NTFS__WriterFlush(&Table->Spill);
+        Table->Failed |= Table->Spill.Failed;
+
+        uint32_t MaxRuns = NTFS_CAST(uint32_t, Table->Budget / NTFS_PATH_RUN_BUFFER);
+        NTFS__PathTableCascade(Table, MaxRuns < 2 ? 2 : MaxRuns);
+        NTFS__PathTableMerge(Table, 0, NTFS_CAST(uint32_t, NTFS__ListLen(Table->Runs)));
+    }
+}
+
+static void NTFS__PathCsvRow(ntfs__writer *Writer, ntfs__path_item *Item, uint16_t *Path,
+                             size_t Length, char *Utf8)
+{
+    // Longest row is two indexes and a quoted path of three byte characters,
+    // doubled quotes take two
+    size_t MaxRow = 2 * 20 + 6 + Length * 3;
+
+    char *Row = NTFS__WriterReserve(Writer, MaxRow);
+    char *Ptr = Row;
+    Ptr += NTFS__PutDecimal(Ptr, Item->RecordIndex);
+    *Ptr++ = ',';
+    Ptr += NTFS__PutDecimal(Ptr, Item->ParentIndex);
+    *Ptr++ = ',';
+
+    size_t PathSize = NTFS__Utf16ToUtf8(Path, Length, Utf8);
+    *Ptr++ = '"';
+    for (size_t Char = 0; Char < PathSize; Char++) {
+        if (Utf8[Char] == '"') {
+            *Ptr++ = '"';
+        }
+        *Ptr++ = Utf8[Char];
+    }
+    *Ptr++ = '"';
+    *Ptr++ = '\r';
+    *Ptr++ = '\n';
+
+    // Give back the unused part of the reservation
+    Writer->Used -= MaxRow - (Ptr - Row);
+}
+
+// Writes the path of every link the way NTFS_PathIndexGetPath builds it,
+// holding about MemoryBudget bytes. Links are sorted by record to find the
+// preferred one of each, then by parent. The root and orphaned links start
+// the walk, each pass joins the links left with the paths of the pass
+// before, so a pass is a level of the tree. Links under a loop of parents,
+// deeper than NTFS_PATH_MAX_DEPTH or longer than NTFS_PATH_EXPORT_MAX_LENGTH
+// have no path and are left out
+ntfs_error NTFS_PathExport(ntfs_volume *Volume, size_t MemoryBudget, wchar_t *Path)
+{
+    ntfs_error       Result    = NTFS_Error_Success;
+    ntfs_mft_scan    Scan      = NTFS_MftScanBegin(Volume);
+    ntfs_arena       Arena     = NTFS__ArenaDefault();
+    ntfs__writer     Writer    = { 0 };
+    ntfs__path_table Links     = { 0 };
+    ntfs__path_table Paths     = { 0 };
+    ntfs__path_table NextLinks = { 0 };
+    ntfs__path_table NextPaths = { 0 };
+
+    static const uint16_t Orphan[] = { '\\', '$', 'O', 'r', 'p', 'h', 'a', 'n', '\\' };
+    size_t OrphanLength = sizeof(Orphan) / sizeof(*Orphan);
+
+    if (Arena.Buffer == 0) {
+        NTFS_RETURN(Result, NTFS_Error_MemoryError);
+    }
+
+    if (Scan.Error) {
+        NTFS_RETURN(Result, Scan.Error);
+    }
+
+    // Two tables are read while two are written
+    if (MemoryBudget < NTFS_PATH_EXPORT_MIN_BUDGET) {
+        MemoryBudget = NTFS_PATH_EXPORT_MIN_BUDGET;
+    }
+    size_t Budget = MemoryBudget / 4;
+
+    // A record sequence sorts in front of the links of its record, the
+    // links by how preferred their name space is
+    Links            = NTFS__PathTableCreate(Budget);
+    Scan.HeadersOnly = true;
+    ntfs_record Record = { 0 };
+    while (NTFS_MftScanNext(&Scan, &Record) && !Links.Failed) {
+        if (Record.BaseIndex == Record.Index && Record.Index < Scan.RecordCount) {
+            ntfs__path_item Item = {
+                .Key         = Record.Index << 3,
+                .RecordIndex = Record.Index,
+                .Sequence    = *NTFS_CAST(uint16_t *, Record.Buffer + 0x10),
+                .Flags       = NTFS__PathItem_Sequence,
+            };
+            NTFS__PathTablePut(&Links, &Item, 0);
+        }
+
+        ntfs_attr        Attr   = { 0 };
+        ntfs_attr_cursor Cursor = NTFS_AttrCursorBegin(Volume, &Record);
+        while (NTFS_AttrCursorNext(&Cursor, NTFS_AttributeType_FileName, &Attr)) {
+            ntfs_file_name FileName = { 0 };
+            if (!NTFS__FileNameParse(&Attr, &FileName) || Record.BaseIndex >= Scan.RecordCount) {
+                continue;
+            }
+
+            ntfs__path_item Item = {
+                .Key            = Record.BaseIndex << 3 |
+                                  (NTFS__NameSpaceRank(FileName.NameSpace) + 1),
+                .RecordIndex    = Record.BaseIndex,
+                .ParentIndex    = FileName.ParentIndex,
+                .ParentSequence = FileName.ParentSequence,
+                .Length         = FileName.NameLength,
+            };
+            NTFS__PathTablePut(&Links, &Item, FileName.Name);
+        }
+    }
+
+    if (Scan.Error) {
+        NTFS_RETURN(Result, Scan.Error);
+    }
+
+    // The first link of a record is its preferred one. Records with links
+    // can be parents, their sequence goes in front of the links to them
+    NTFS__PathTableFinish(&Links);
+    NextLinks = NTFS__PathTableCreate(Budget);
+
+    ntfs__path_item *Item        = 0;
+    uint16_t        *Name        = 0;
+    uint64_t         RecordIndex = UINT64_MAX;
+    uint16_t         Sequence    = 0;
+    bool             IsFirst     = false;
+    while (NTFS__PathTableNext(&Links, &Item, &Name)) {
+        if (Item->RecordIndex != RecordIndex) {
+            RecordIndex = Item->RecordIndex;
+            Sequence    = 0;
+            IsFirst     = true;
+        }
+
+        if (Item->Flags & NTFS__PathItem_Sequence) {
+            Sequence = Item->Sequence;
+            continue;
+        }
+
+        if (IsFirst) {
+            ntfs__path_item Parent = {
+                .Key         = RecordIndex << 1,
+                .RecordIndex = RecordIndex,
+                .Sequence    = Sequence,
+                .Flags       = NTFS__PathItem_Parent,
+            };
+            NTFS__PathTablePut(&NextLinks, &Parent, 0);
+            Item->Flags |= NTFS__PathItem_Preferred;
+            IsFirst      = false;
+        }
+
+        Item->Key = Item->ParentIndex << 1 | 1;
+        NTFS__PathTablePut(&NextLinks, Item, Name);
+    }
+
+    if (Links.Failed || NextLinks.Failed) {
+        NTFS_RETURN(Result, NTFS_Error_PathFailedSpill);
+    }
+
+    NTFS__PathTableDestroy(&Links);
+    Links     = NextLinks;
+    NextLinks = (ntfs__path_table) { 0 };
+
+    if (!NTFS__WriterOpen(&Writer, Path)) {
+        NTFS_RETURN(Result, NTFS_Error_PathFailedWrite);
+    }
+
+    char Header[] = NTFS_PATH_CSV_HEADER;
+    NTFS__WriterPut(&Writer, Header, sizeof(Header) - 1);
+
+    uint16_t *Buffer = NTFS__ArenaAlloc(&Arena, NTFS_PATH_EXPORT_MAX_LENGTH * sizeof(uint16_t));
+    char     *Utf8   = NTFS__ArenaAlloc(&Arena, NTFS_PATH_EXPORT_MAX_LENGTH * 3);
+
+    // Links to a parent without links, or to one whose record was reused,
+    // are orphaned and go under a $Orphan folder. The root is a single
+    // separator and its children start from nothing
+    NTFS__PathTableFinish(&Links);
+    Paths     = NTFS__PathTableCreate(Budget);
+    NextLinks = NTFS__PathTableCreate(Budget);
+
+    uint64_t ParentIndex = UINT64_MAX;
+    while (NTFS__PathTableNext(&Links, &Item, &Name)) {
+        if (Item->Flags & NTFS__PathItem_Parent) {
+            ParentIndex = Item->RecordIndex;
+            Sequence    = Item->Sequence;
+            continue;
+        }
+
+        bool IsPreferred = Item->Flags & NTFS__PathItem_Preferred;
+        if (Item->RecordIndex == NTFS_SystemFile_RootFolder) {
+            Buffer[0] = '\\';
+            NTFS__PathCsvRow(&Writer, Item, Buffer, 1, Utf8);
+            if (IsPreferred) {
+                ntfs__path_item Root = {
+                    .Key         = Item->RecordIndex,
+                    .RecordIndex = Item->RecordIndex,
+                };
+                NTFS__PathTablePut(&Paths, &Root, 0);
+            }
+
+        } else if (Item->ParentIndex != ParentIndex || Item->ParentSequence != Sequence) {
+            size_t Length = OrphanLength + Item->Length;
+            NTFS_MEM_COPY(Buffer, sizeof(Orphan), Orphan, sizeof(Orphan));
+            NTFS_MEM_COPY(Buffer + OrphanLength, Item->Length * sizeof(uint16_t),
+                          Name, Item->Length * sizeof(uint16_t));
+            NTFS__PathCsvRow(&Writer, Item, Buffer, Length, Utf8);
+            if (IsPreferred) {
+                ntfs__path_item Resolved = {
+                    .Key         = Item->RecordIndex,
+                    .RecordIndex = Item->RecordIndex,
+                    .Length      = NTFS_CAST(uint16_t, Length),
+                    .Depth       = 1,
+                };
+                NTFS__PathTablePut(&Paths, &Resolved, Buffer);
+            }
+
+        } else {
+            Item->Key = Item->ParentIndex;
+            NTFS__PathTablePut(&NextLinks, Item, Name);
+        }
+    }
+
+    if (Links.Failed || Paths.Failed || NextLinks.Failed) {
+        NTFS_RETURN(Result, NTFS_Error_PathFailedSpill);
+    }
+
+    NTFS__PathTableDestroy(&Links);
+    Links     = NextLinks;
+    NextLinks = (ntfs__path_table) { 0 };
+
+    // Both tables are sorted by the parent record, so a pass is a merge
+    // join of the links left with the paths found in the pass before
+    while (Paths.Count && Links.Count) {
+        NTFS__PathTableFinish(&Paths);
+        NTFS__PathTableFinish(&Links);
+        NextPaths = NTFS__PathTableCreate(Budget);
+        NextLinks = NTFS__PathTableCreate(Budget);
+
+        ntfs__path_item *Parent     = 0;
+        uint16_t        *ParentPath = 0;
+        bool             HasParent  = NTFS__PathTableNext(&Paths, &Parent, &ParentPath);
+        while (NTFS__PathTableNext(&Links, &Item, &Name)) {
+            while (HasParent && Parent->RecordIndex < Item->ParentIndex) {
+                HasParent = NTFS__PathTableNext(&Paths, &Parent, &ParentPath);
+            }
+
+            if (!HasParent || Parent->RecordIndex != Item->ParentIndex) {
+                NTFS__PathTablePut(&NextLinks, Item, Name);
+                continue;
+            }
+
+            size_t Length = Parent->Length + 1u + Item->Length;
+            if (Parent->Depth >= NTFS_PATH_MAX_DEPTH || Length > NTFS_PATH_EXPORT_MAX_LENGTH) {
+                continue;
+            }
+
+            NTFS_MEM_COPY(Buffer, Parent->Length * sizeof(uint16_t),
+                          ParentPath, Parent->Length * sizeof(uint16_t));
+            Buffer[Parent->Length] = '\\';
+            NTFS_MEM_COPY(Buffer + Parent->Length + 1, Item->Length * sizeof(uint16_t),
+                          Name, Item->Length * sizeof(uint16_t));
+            NTFS__PathCsvRow(&Writer, Item, Buffer, Length, Utf8);
+
+            if (Item->Flags & NTFS__PathItem_Preferred) {
+                ntfs__path_item Resolved = {
+                    .Key         = Item->RecordIndex,
+                    .RecordIndex = Item->RecordIndex,
+                    .Length      = NTFS_CAST(uint16_t, Length),
+                    .Depth       = NTFS_CAST(uint16_t, Parent->Depth + 1),
+                };
+                NTFS__PathTablePut(&NextPaths, &Resolved, Buffer);
+            }
+        }
+
+        if (Paths.Failed || Links.Failed || NextPaths.Failed || NextLinks.Failed) {
+            NTFS_RETURN(Result, NTFS_Error_PathFailedSpill);
+        }
+
+        NTFS__PathTableDestroy(&Paths);
+        NTFS__PathTableDestroy(&Links);
+        Paths     = NextPaths;
+        Links     = NextLinks;
+        NextPaths = (ntfs__path_table) { 0 };
+        NextLinks = (ntfs__path_table) { 0 };
+    }
+
+skip:
+    if (Writer.Handle || Writer.Arena.Buffer) {
+        if (NTFS__WriterClose(&Writer) != NTFS_Error_Success && Result == NTFS_Error_Success) {
+            Result = NTFS_Error_PathFailedWrite;
+        }
+    }
+
+    NTFS__PathTableDestroy(&Links);
+    NTFS__PathTableDestroy(&Paths);
+    NTFS__PathTableDestroy(&NextLinks);
+    NTFS__PathTableDestroy(&NextPaths);
+    if (Arena.Buffer) {
+        NTFS__ArenaDestroy(&Arena);
+    }
+    NTFS_MftScanEnd(&Scan);
+    return Result;
+}
+
+// Index API
+ntfs_index_cursor NTFS_IndexCursorBegin(ntfs_file *File, uint16_t *Name, size_t NameLength)
+{
+    ntfs_index_cursor Result = { .File = File };
+    ntfs_volume      *Volume = File->Volume;
+
+    ntfs_attr *Root = NTFS_FileFindAttr(File, NTFS_AttributeType_IndexRoot, Name, NameLength);
+    if (!Root || Root->NonResFlag || Root->Resident.Size < 0x20) {
+        NTFS_RETURN(Result.Error, NTFS_Error_IndexFailedValidation);
+    }
+
+    Result.BlockSize = *NTFS_CAST(uint32_t *, Root->Resident.Data + 0x08);
+    if (!NTFS__IndexCursorEnterNode(&Result, Root->Resident.Data + 0x10,
+                                    Root->Resident.Size - 0x10)) {
+        NTFS_RETURN(Result.Error, Result.Error);
+    }
+
+    // Small indexes live entirely in the root
+    Result.Alloc = NTFS_FileFindAttr(File, NTFS_AttributeType_IndexAllocation, Name, NameLength);
+    if (Result.Alloc == 0) {
+        NTFS_RETURN(Result.Error, NTFS_Error_Success);
+    }
+
+    bool IsValid = Result.Alloc->NonResFlag;
+    IsValid     &= Result.BlockSize >= NTFS_FILE_RECORD_FIXUP_STRIDE;
+    IsValid     &= Result.BlockSize <= NTFS_INDEX_READ_SIZE;
+    IsValid     &= (Result.BlockSize & (Result.BlockSize - 1)) == 0;
+    if (!IsValid) {
+        NTFS_RETURN(Result.Error, NTFS_Error_IndexFailedValidation);
+    }
+
+    Result.Arena = NTFS__ArenaDefault();
+    if (Result.Arena.Buffer == 0) {
+        NTFS_RETURN(Result.Error, NTFS_Error_MemoryError);
+    }
+
+    // Blocks clear in the index $BITMAP are free and may hold stale entries
+    ntfs_attr *BitmapAttr =
+        NTFS_FileFindAttr(File, NTFS_AttributeType_Bitmap, Name, NameLength);
+    if (BitmapAttr && !BitmapAttr->NonResFlag) {
+        Result.Bitmap     = BitmapAttr->Resident.Data;
+        Result.BitmapSize = BitmapAttr->Resident.Size;
+
+    } else if (BitmapAttr) {
+        size_t AlignedSize = NTFS__Align(BitmapAttr->NonResident.Size, Volume->BytesPerCluster);
+        Result.Bitmap      = NTFS__ArenaAlloc(&Result.Arena, AlignedSize);
+        Result.BitmapSize  = BitmapAttr->NonResident.Size;
+        if (Result.Bitmap == 0) {
+            NTFS_RETURN(Result.Error, NTFS_Error_MemoryError);
+        }
+
+        NTFS_FileReadAttr(File, BitmapAttr, 0, Result.Bitmap, AlignedSize);
+        if (File->Error) {
+            NTFS_RETURN(Result.Error, File->Error);
+        }
+    }
+
+    Result.ChunkSize = NTFS__Align(NTFS_INDEX_READ_SIZE, Volume->BytesPerCluster);
+    Result.Buffer    = NTFS__ArenaAlloc(&Result.Arena, Result.ChunkSize);
+    if (Result.Buffer == 0) {
+        NTFS_RETURN(Result.Error, NTFS_Error_MemoryError);
+    }
+
+skip:
+    return Result;
+}
+
+bool NTFS_IndexCursorNext(ntfs_index_cursor *Cursor, ntfs_index_entry *Entry)
+{
+    bool Result = false;
+
+    while (!Cursor->Error && (Cursor->Node || NTFS__IndexCursorNextBlock(Cursor))) {
+        uint8_t *Item = Cursor->Node + Cursor->NodeOffset;
+        if (Cursor->NodeEnd - Cursor->NodeOffset < 0x10) {
+            NTFS_RETURN(Cursor->Error, NTFS_Error_IndexFailedValidation);
+        }
+
+        *Entry = (ntfs_index_entry) {
+            .Entry     = Item,
+            .Length    = *NTFS_CAST(uint16_t *, Item + 0x08),
+            .KeyLength = *NTFS_CAST(uint16_t *, Item + 0x0A),
+            .Flags     = *NTFS_CAST(uint16_t *, Item + 0x0C),
+            .Key       = Item + 0x10,
+        };
+
+        if (Entry->Length < 0x10 || Entry->Length > Cursor->NodeEnd - Cursor->NodeOffset) {
+            NTFS_RETURN(Cursor->Error, NTFS_Error_IndexFailedValidation);
+        }
+
+        // Last entry has no key and only points to the subnode past the
+        // greatest key
+        if (Entry->Flags & NTFS_INDEX_ENTRY_LAST) {
+            Cursor->Node = 0;
+            continue;
+        }
+
+        if (0x10u + Entry->KeyLength > Entry->Length) {
+            NTFS_RETURN(Cursor->Error, NTFS_Error_IndexFailedValidation);
+        }
+
+        Cursor->NodeOffset += Entry->Length;
+        NTFS_RETURN(Result, true);
+    }
+
+skip:
+    return Result;
+}
+
+void NTFS_IndexCursorEnd(ntfs_index_cursor *Cursor)
+{
+    if (Cursor->Arena.Buffer) {
+        NTFS__ArenaDestroy(&Cursor->Arena);
+    }
+
+    *Cursor = (ntfs_index_cursor) { .Error = Cursor->Error };
+}
+
+ntfs_error NTFS__IndexWalk(ntfs_file *File, uint16_t *Name, size_t NameLength,
+                           ntfs_index_callback *Callback, void *Context)
+{
+    ntfs_index_cursor Cursor = NTFS_IndexCursorBegin(File, Name, NameLength);
+
+    ntfs_index_entry Entry = { 0 };
+    while (NTFS_IndexCursorNext(&Cursor, &Entry) && Callback(Context, &Entry)) {
+    }
+
+    ntfs_error Result = Cursor.Error;
+    NTFS_IndexCursorEnd(&Cursor);
+
+    return Result;
+}
+
+ntfs_error NTFS__IndexFind(ntfs_file *File, uint16_t *Name, size_t NameLength,
+                           ntfs_index_compare *Compare, void *Context, bool *IsFound)
+{
+    ntfs_index_cursor Cursor = NTFS_IndexCursorBegin(File, Name, NameLength);
+    ntfs_volume      *Volume = File->Volume;
+
+    // Entries of a node are in collation order, the search stops at the
+    // first one not before the key and goes down its subnode
+    *IsFound = false;
+    for (size_t Depth = 0; !Cursor.Error; Depth++) {
+        ntfs_index_entry Entry = { 0 };
+        int              Order = 1;
+        while (Order > 0) {
+            uint8_t *Item = Cursor.Node + Cursor.NodeOffset;
+            if (Cursor.NodeEnd - Cursor.NodeOffset < 0x10) {
+                NTFS_RETURN(Cursor.Error, NTFS_Error_IndexFailedValidation);
+            }
+
+            Entry = (ntfs_index_entry) {
+                .Entry     = Item,
+                .Length    = *NTFS_CAST(uint16_t *, Item + 0x08),
+                .KeyLength = *NTFS_CAST(uint16_t *, Item + 0x0A),
+                .Flags     = *NTFS_CAST(uint16_t *, Item + 0x0C),
+                .Key       = Item + 0x10,
+            };
+
+            if (Entry.Length < 0x10 || Entry.Length > Cursor.NodeEnd - Cursor.NodeOffset ||
+                0x10u + Entry.KeyLength > Entry.Length) {
+                NTFS_RETURN(Cursor.Error, NTFS_Error_IndexFailedValidation);
+            }
+
+            if (Entry.Flags & NTFS_INDEX_ENTRY_LAST) {
+                break;
+            }
+
+            Order = Compare(Context, &Entry);
+            if (Order > 0) {
+                Cursor.NodeOffset += Entry.Length;
+            }
+        }
+
+        if (Order == 0) {
+            *IsFound = true;
+            break;
+        }
+
+        if (!(Entry.Flags & NTFS_INDEX_ENTRY_NODE)) {
+            break;
+        }
+
+        if (Cursor.Alloc == 0 || Entry.Length < 0x18 || Depth >= NTFS_INDEX_MAX_DEPTH) {
+            NTFS_RETURN(Cursor.Error, NTFS_Error_IndexFailedValidation);
+        }
+
+        // Subnode VCNs count clusters, or sectors when blocks are smaller
+        uint64_t Vcn      = *NTFS_CAST(uint64_t *, Entry.Entry + Entry.Length - 8);
+        uint64_t VcnSize  = Cursor.BlockSize >= Volume->BytesPerCluster
+                                ? Volume->BytesPerCluster : NTFS_BOOT_RECORD_SIZE;
+        uint8_t *Block    = Cursor.Buffer;
+        size_t   ReadSize = NTFS_FileReadAttr(File, Cursor.Alloc, Vcn * VcnSize, Block,
+                                              Cursor.BlockSize);
+        if (File->Error) {
+            NTFS_RETURN(Cursor.Error, File->Error);
+        }
+
+        if (ReadSize < Cursor.BlockSize ||
+            *NTFS_CAST(uint32_t *, Block) != NTFS_INDEX_RECORD_MAGIC ||
+            NTFS__RecordApplyFixups(Block, Cursor.BlockSize)) {
+            NTFS_RETURN(Cursor.Error, NTFS_Error_IndexFailedValidation);
+        }
+
+        NTFS__IndexCursorEnterNode(&Cursor, Block + 0x18, Cursor.BlockSize - 0x18);
+    }
+
+skip:;
+    ntfs_error Result = Cursor.Error;
+    NTFS_IndexCursorEnd(&Cursor);
+
+    return Result;
+}
+
+bool NTFS__IndexCursorEnterNode(ntfs_index_cursor *Cursor, uint8_t *Node, size_t Size)
+{
+    bool Result = false;
+
+    if (Size < 0x10) {
+        NTFS_RETURN(Cursor->Error, NTFS_Error_IndexFailedValidation);
+    }
+
+    // Offsets are relative to the node header
+    uint32_t EntriesOffset = *NTFS_CAST(uint32_t *, Node + 0x00);
+    uint32_t EntriesEnd    = *NTFS_CAST(uint32_t *, Node + 0x04);
+    if (EntriesEnd > Size || EntriesOffset > EntriesEnd) {
+        NTFS_RETURN(Cursor->Error, NTFS_Error_IndexFailedValidation);
+    }
+
+    Cursor->Node       = Node;
+    Cursor->NodeOffset = EntriesOffset;
+    Cursor->NodeEnd    = EntriesEnd;
+    Result             = true;
+
+skip:
+    return Result;
+}
+
+bool NTFS__IndexCursorNextBlock(ntfs_index_cursor *Cursor)
+{
+    bool Result = false;
+
+    uint64_t AllocSize = Cursor->Alloc ? Cursor->Alloc->NonResident.Size : 0;
+    for (; Cursor->NextBlock < AllocSize; Cursor->NextBlock += Cursor->BlockSize) {
+        // Chunks are a multiple of the block size, blocks never straddle them
+        uint64_t Offset = Cursor->NextBlock;
+        if (Offset < Cursor->BufferOffset ||
+            Offset >= Cursor->BufferOffset + Cursor->BufferSize) {
+            Cursor->BufferOffset = Offset - Offset % Cursor->ChunkSize;
+            Cursor->BufferSize   = NTFS_FileReadAttr(Cursor->File, Cursor->Alloc,
+                                                     Cursor->BufferOffset, Cursor->Buffer,
+                                                     Cursor->ChunkSize);
+            if (Cursor->File->Error) {
+                NTFS_RETURN(Cursor->Error, Cursor->File->Error);
+            }
+        }
+
+        uint64_t BlockOffset = Offset - Cursor->BufferOffset;
+        if (BlockOffset + Cursor->BlockSize > Cursor->BufferSize) {
+            break;
+        }
+
+        uint64_t BlockIndex = Offset / Cursor->BlockSize;
+        uint8_t *Block      = Cursor->Buffer + BlockOffset;
+        bool     IsUsed     = *NTFS_CAST(uint32_t *, Block) == NTFS_INDEX_RECORD_MAGIC;
+        if (Cursor->Bitmap) {
+            if (BlockIndex / 8 >= Cursor->BitmapSize ||
+                !(Cursor->Bitmap[BlockIndex / 8] >> (BlockIndex % 8) & 1)) {
+                continue;
+            }
+
+            if (!IsUsed) {
+                NTFS_RETURN(Cursor->Error, NTFS_Error_IndexFailedValidation);
+            }
+
+        } else if (!IsUsed) {
+            continue;
+        }
+
+        if (NTFS__RecordApplyFixups(Block, Cursor->BlockSize)) {
+            NTFS_RETURN(Cursor->Error, NTFS_Error_IndexFailedValidation);
+        }
+
+        Cursor->NextBlock += Cursor->BlockSize;
+        NTFS_RETURN(Result, NTFS__IndexCursorEnterNode(Cursor, Block + 0x18,
+                                                       Cursor->BlockSize - 0x18));
+    }
+
+skip:
+    return Result;
+}
+
+// Security API
+static inline uint32_t NTFS__SecuritySlot(ntfs_security_cache *Cache, uint32_t SecurityId)
+{
+    // Security IDs are handed out sequentially, an odd multiplier spreads
+    // them without collisions inside a power of two table
+    uint32_t Result = (SecurityId * 0x9E3779B1u) & Cache->SlotMask;
+    return Result;
+}
+
+static bool NTFS__SecurityCacheAdd(void *Context, ntfs_index_entry *Entry)
+{
+    ntfs_security_cache *Cache = Context;
+
+    // $SII entries map the security ID key to a copy of the $SDS header
+    uint16_t DataOffset = *NTFS_CAST(uint16_t *, Entry->Entry + 0x00);
+    uint16_t DataLength = *NTFS_CAST(uint16_t *, Entry->Entry + 0x02);
+    if (Entry->KeyLength < sizeof(uint32_t) || DataLength < NTFS_SDS_HEADER_SIZE ||
+        DataOffset + DataLength > Entry->Length) {
+        NTFS_RETURN(Cache->Error, NTFS_Error_SecurityFailedLoad);
+    }
+
+    uint8_t *Data   = Entry->Entry + DataOffset;
+    uint64_t Offset = *NTFS_CAST(uint64_t *, Data + 0x08);
+    uint32_t Length = *NTFS_CAST(uint32_t *, Data + 0x10);
+    if (Length < NTFS_SDS_HEADER_SIZE + NTFS_SECURITY_HEADER_SIZE ||
+        Offset > Cache->StreamSize || Length > Cache->StreamSize - Offset) {
+        NTFS_RETURN(Cache->Error, NTFS_Error_SecurityFailedLoad);
+    }
+
+    uint8_t                 *Header     = Cache->Stream + Offset;
+    ntfs_security_descriptor Descriptor = {
+        .Hash       = *NTFS_CAST(uint32_t *, Header + 0x00),
+        .SecurityId = *NTFS_CAST(uint32_t *, Header + 0x04),
+        .Data       = Header + NTFS_SDS_HEADER_SIZE,
+        .Size       = Length - NTFS_SDS_HEADER_SIZE,
+    };
+    if (Descriptor.SecurityId != *NTFS_CAST(uint32_t *, Entry->Key)) {
+        NTFS_RETURN(Cache->Error, NTFS_Error_SecurityFailedLoad);
+    }
+
+    Descriptor.Control = *NTFS_CAST(uint16_t *, Descriptor.Data + 0x02);
+
+    uint8_t **Parts[4] = {
+        &Descriptor.Owner, &Descriptor.Group, &Descriptor.Sacl, &Descriptor.Dacl,
+    };
+    for (size_t Index = 0; Index < 4; Index++) {
+        uint32_t PartOffset = *NTFS_CAST(uint32_t *, Descriptor.Data + 0x04 + Index * 4);
+        if (PartOffset >= Descriptor.Size) {
+            NTFS_RETURN(Cache->Error, NTFS_Error_SecurityFailedLoad);
+        }
+
+        *Parts[Index] = PartOffset ? Descriptor.Data + PartOffset : 0;
+    }
+
+    NTFS__ListPush(&Cache->Arena, Cache->Descriptors, Descriptor);
+
+skip:
+    return Cache->Error == NTFS_Error_Success;
+}
+
+ntfs_security_cache NTFS_SecurityCacheLoad(ntfs_volume *Volume)
+{
+    ntfs_security_cache Result = {
+        .Arena = NTFS__ArenaCreate(NTFS_SECURITY_RESERVED, NTFS__ARENA_DEFAULT_COMMIT),
+    };
+    ntfs_file Secure = NTFS_FileOpenFromIndex(Volume, NTFS_SystemFile_Secure);
+
+    static uint16_t SdsName[] = { '$', 'S', 'D', 'S' };
+    static uint16_t SiiName[] = { '$', 'S', 'I', 'I' };
+
+    if (Result.Arena.Buffer == 0) {
+        NTFS_RETURN(Result.Error, NTFS_Error_MemoryError);
+    }
+
+    if (Secure.Error) {
+        NTFS_RETURN(Result.Error, Secure.Error);
+    }
+
+    ntfs_attr *Sds = NTFS_FileFindAttr(&Secure, NTFS_AttributeType_Data, SdsName, 4);
+    if (Sds == 0) {
+        NTFS_RETURN(Result.Error, NTFS_Error_SecurityFailedLoad);
+    }
+
+    // The whole stream is read once, every lookup after is in memory
+    Result.StreamSize  = Sds->NonResFlag ? Sds->NonResident.Size : Sds->Resident.Size;
+    size_t AlignedSize = NTFS__Align(Result.StreamSize, Volume->BytesPerCluster);
+    Result.Stream      = NTFS__ArenaAlloc(&Result.Arena, AlignedSize);
+    if (Result.Stream == 0) {
+        NTFS_RETURN(Result.Error, NTFS_Error_MemoryError);
+    }
+
+    if (NTFS_FileReadAttr(&Secure, Sds, 0, Result.Stream, AlignedSize) < Result.StreamSize) {
+        NTFS_RETURN(Result.Error, Secure.Error ? Secure.Error : NTFS_Error_FileReadFailed);
+    }
+
+    ntfs_error Error = NTFS__IndexWalk(&Secure, SiiName, 4, NTFS__SecurityCacheAdd, &Result);
+    if (Result.Error || Error) {
+        NTFS_RETURN(Result.Error, Result.Error ? Result.Error : Error);
+    }
+
+    // Table is kept at most half full so probes stay short
+    size_t   Count     = NTFS__ListLen(Result.Descriptors);
+    uint32_t SlotCount = 16;
+    while (SlotCount < Count * 2) {
+        SlotCount *= 2;
+    }
+
+    Result.SlotMask = SlotCount - 1;
+    Result.Slots    = NTFS__ArenaAlloc(&Result.Arena, SlotCount * sizeof(uint32_t));
+    if (Result.Slots == 0) {
+        NTFS_RETURN(Result.Error, NTFS_Error_MemoryError);
+    }
+    NTFS_MEM_SET(Result.Slots, 0, SlotCount * sizeof(uint32_t));
+
+    for (uint32_t Index = 0; Index < Count; Index++) {
+        uint32_t SecurityId = Result.Descriptors[Index].SecurityId;
+        uint32_t Slot       = NTFS__SecuritySlot(&Result, SecurityId);
+        while (Result.Slots[Slot] &&
+               Result.Descriptors[Result.Slots[Slot] - 1].SecurityId != SecurityId) {
+            Slot = (Slot + 1) & Result.SlotMask;
+        }
+
+        if (Result.Slots[Slot] == 0) {
+            Result.Slots[Slot] = Index + 1;
+        }
+    }
+
+skip:
+    NTFS_FileClose(&Secure);
+    return Result;
+}
+
+void NTFS_SecurityCacheDestroy(ntfs_security_cache *Cache)
+{
+    if (Cache->Arena.Buffer) {
+        NTFS__ArenaDestroy(&Cache->Arena);
+    }
+
+    *Cache = (ntfs_security_cache) { .Error = Cache->Error };
+}
+
+ntfs_security_descriptor *NTFS_SecurityCacheFind(ntfs_security_cache *Cache,
+                                                 uint32_t SecurityId)
+{
+    ntfs_security_descriptor *Result = 0;
+
+    if (Cache->Slots == 0) {
+        NTFS_RETURN(Result, 0);
+    }
+
+    uint32_t Slot = NTFS__SecuritySlot(Cache, SecurityId);
+    while (Cache->Slots[Slot]) {
+        ntfs_security_descriptor *Descriptor = Cache->Descriptors + Cache->Slots[Slot] - 1;
+        if (Descriptor->SecurityId == SecurityId) {
+            NTFS_RETURN(Result, Descriptor);
+        }
+
+        Slot = (Slot + 1) & Cache->SlotMask;
+    }
+
+skip:
+    return Result;
+}
+
+// Reparse API
+ntfs_reparse_point NTFS_FileReparsePoint(ntfs_file *File)
+{
+    ntfs_reparse_point Result = { 0 };
+
+    ntfs_attr *Attr = NTFS_FileFindAttr(File, NTFS_AttributeType_SymbolicLink, 0, 0);
+    if (Attr == 0) {
+        NTFS_RETURN(Result.Error, NTFS_Error_ReparseInvalid);
+    }
+
+    uint8_t *Data = Attr->Resident.Data;
+    size_t   Size = Attr->Resident.Size;
+    if (Attr->NonResFlag) {
+        // Reparse data is at most 16KB, it spills out of the record when the
+        // target names are long
+        Size = NTFS_CAST(size_t, Attr->NonResident.Size);
+        Data = Size >= 0x08 && Size <= NTFS_REPARSE_MAX_SIZE && File->Arena.Buffer
+                   ? NTFS__ArenaAlloc(&File->Arena, Size) : 0;
+        if (Data == 0 || NTFS_FileReadAttr(File, Attr, 0, Data, Size) < Size) {
+            NTFS_RETURN(Result.Error, File->Error ? File->Error : NTFS_Error_ReparseInvalid);
+        }
+    }
+
+    if (Size < 0x08) {
+        NTFS_RETURN(Result.Error, NTFS_Error_ReparseInvalid);
+    }
+
+    uint16_t DataLength = *NTFS_CAST(uint16_t *, Data + 0x04);
+    Result.Tag          = *NTFS_CAST(uint32_t *, Data + 0x00);
+    if (0x08u + DataLength > Size) {
+        NTFS_RETURN(Result.Error, NTFS_Error_ReparseInvalid);
+    }
+
+    // Other tags belong to filter drivers and are only reported
+    bool IsSymlink = Result.Tag == NTFS_REPARSE_TAG_SYMLINK;
+    if (!IsSymlink && Result.Tag != NTFS_REPARSE_TAG_MOUNT_POINT) {
+        NTFS_RETURN(Result.Error, NTFS_Error_Success);
+    }
+
+    size_t BufferOffset = IsSymlink ? 0x14 : 0x10;
+    if (0x08u + DataLength < BufferOffset) {
+        NTFS_RETURN(Result.Error, NTFS_Error_ReparseInvalid);
+    }
+
+    uint16_t TargetOffset    = *NTFS_CAST(uint16_t *, Data + 0x08);
+    uint16_t TargetSize      = *NTFS_CAST(uint16_t *, Data + 0x0A);
+    uint16_t PrintNameOffset = *NTFS_CAST(uint16_t *, Data + 0x0C);
+    uint16_t PrintNameSize   = *NTFS_CAST(uint16_t *, Data + 0x0E);
+    size_t   BufferSize      = 0x08u + DataLength - BufferOffset;
+    if (TargetOffset + TargetSize > BufferSize || PrintNameOffset + PrintNameSize > BufferSize) {
+        NTFS_RETURN(Result.Error, NTFS_Error_ReparseInvalid);
+    }
+
+    Result.IsRelative      = IsSymlink && (*NTFS_CAST(uint32_t *, Data + 0x10) & 1);
+    Result.Target          = NTFS_CAST(uint16_t *, Data + BufferOffset + TargetOffset);
+    Result.TargetLength    = TargetSize / sizeof(uint16_t);
+    Result.PrintName       = NTFS_CAST(uint16_t *, Data + BufferOffset + PrintNameOffset);
+    Result.PrintNameLength = PrintNameSize / sizeof(uint16_t);
+
+skip:
+    return Result;
+}
+
+typedef struct {
+    ntfs_volume *Volume;
+    uint16_t    *Name;
+    size_t       NameLength;
+    uint64_t     RecordIndex;
+} ntfs__directory_lookup;
+
+static int NTFS__DirectoryCompare(void *Context, ntfs_index_entry *Entry)
+{
+    ntfs__directory_lookup *Lookup = Context;
+
+    // $I30 keys are copies of the $FILE_NAME attribute, DOS names included,
+    // keys too short to hold a name sort first
+    int Result = 1;
+    if (Entry->KeyLength >= 0x42) {
+        uint8_t NameLength = Entry->Key[0x40];
+        if (0x42u + NameLength * sizeof(uint16_t) <= Entry->KeyLength) {
+            Result = NTFS__NameCompare(Lookup->Volume, Lookup->Name, Lookup->NameLength,
+                                       NTFS_CAST(uint16_t *, Entry->Key + 0x42), NameLength);
+        }
+    }
+
+    if (Result == 0) {
+        Lookup->RecordIndex = *NTFS_CAST(uint64_t *, Entry->Entry) & 0xFFFFFFFFFFFF;
+    }
+
+    return Result;
+}
+
+ntfs_error NTFS__DirectoryFind(ntfs_file *Dir, uint16_t *Name, size_t NameLength,
+                               uint64_t *RecordIndex)
+{
+    ntfs_error Result  = NTFS_Error_Success;
+    bool       IsFound = false;
+
+    static uint16_t IndexName[] = { '$', 'I', '3', '0' };
+
+    if (!Dir->Record.IsDir) {
+        NTFS_RETURN(Result, NTFS_Error_PathNotFound);
+    }
+
+    ntfs__directory_lookup Lookup = {
+        .Volume     = Dir->Volume,
+        .Name       = Name,
+        .NameLength = NameLength,
+    };
+
+    Result = NTFS__IndexFind(Dir, IndexName, 4, NTFS__DirectoryCompare, &Lookup, &IsFound);
+    if (Result == NTFS_Error_Success && !IsFound) {
+        NTFS_RETURN(Result, NTFS_Error_PathNotFound);
+    }
+
+    *RecordIndex = Lookup.RecordIndex;
+
+skip:
+    return Result;
+}
+
+ntfs_error NTFS__DirectoryLookup(ntfs_volume *Volume, uint64_t DirIndex,
+                                 uint16_t *Name, size_t NameLength, uint64_t *RecordIndex)
+{
+    ntfs_error Result = NTFS_Error_Success;
+    ntfs_file  Dir    = NTFS_FileOpenFromIndex(Volume, DirIndex);
+
+    if (Dir.Error) {
+        NTFS_RETURN(Result, Dir.Error);
+    }
+
+    Result = NTFS__DirectoryFind(&Dir, Name, NameLength, RecordIndex);
+
+skip:
+    NTFS_FileClose(&Dir);
+    return Result;
+}
+
+ntfs_reparse_resolver NTFS_ReparseResolverCreate(ntfs_volume *Volume)
+{
+    ntfs_reparse_resolver Result = {
+        .Volume   = Volume,
+        .Arena    = NTFS__ArenaCreate(NTFS__ARENA_GIGABYTE(64), NTFS__ARENA_DEFAULT_COMMIT),
+        .SlotMask = NTFS_REPARSE_SLOT_COUNT - 1,
+    };
+
+    if (Result.Arena.Buffer == 0) {
+        NTFS_RETURN(Result.Error, NTFS_Error_MemoryError);
+    }
+
+    size_t SlotsSize = NTFS_REPARSE_SLOT_COUNT * sizeof(ntfs_reparse_memo);
+    Result.Slots     = NTFS__ArenaAlloc(&Result.Arena, SlotsSize);
+    if (Result.Slots == 0) {
+        NTFS_RETURN(Result.Error, NTFS_Error_MemoryError);
+    }
+    NTFS_MEM_SET(Result.Slots, 0, SlotsSize);
+
+    size_t LookupsSize = NTFS_REPARSE_SLOT_COUNT * sizeof(ntfs_reparse_lookup);
+    Result.Lookups     = NTFS__ArenaAlloc(&Result.Arena, LookupsSize);
+    Result.LookupMask  = NTFS_REPARSE_SLOT_COUNT - 1;
+    if (Result.Lookups == 0) {
+        NTFS_RETURN(Result.Error, NTFS_Error_MemoryError);
+    }
+    NTFS_MEM_SET(Result.Lookups, 0, LookupsSize);
+
+skip:
+    return Result;
+}
+
+void NTFS_ReparseResolverDestroy(ntfs_reparse_resolver *Resolver)
+{
+    if (Resolver->Arena.Buffer) {
+        NTFS__ArenaDestroy(&Resolver->Arena);
+    }
+
+    *Resolver = (ntfs_reparse_resolver) { .Error = Resolver->Error };
+}
+
+// Record indexes are stored plus one so zero marks an empty slot
+static ntfs_reparse_memo *NTFS__ReparseMemoSlot(ntfs_reparse_resolver *Resolver,
+                                                uint64_t RecordIndex)
+{
+    uint32_t Slot = NTFS_CAST(uint32_t, RecordIndex * 0x9E3779B97F4A7C15ull >> 32) &
+                    Resolver->SlotMask;
+    while (Resolver->Slots[Slot].RecordIndex &&
+           Resolver->Slots[Slot].RecordIndex != RecordIndex + 1) {
+        Slot = (Slot + 1) & Resolver->SlotMask;
+    }
+
+    ntfs_reparse_memo *Result = Resolver->Slots + Slot;
+    return Result;
+}
+
+static ntfs_reparse_memo *NTFS__ReparseMemoInsert(ntfs_reparse_resolver *Resolver,
+                                                  uint64_t RecordIndex)
+{
+    ntfs_reparse_memo *Result = 0;
+
+    // Table is kept at most half full, old slots stay in the arena
+    if ((Resolver->Count + 1) * 2 > Resolver->SlotMask + 1) {
+        ntfs_reparse_memo *OldSlots  = Resolver->Slots;
+        uint32_t           OldCount  = Resolver->SlotMask + 1;
+        size_t             SlotsSize = OldCount * 2 * sizeof(ntfs_reparse_memo);
+
+        Resolver->Slots = NTFS__ArenaAlloc(&Resolver->Arena, SlotsSize);
+        if (Resolver->Slots == 0) {
+            Resolver->Slots = OldSlots;
+            NTFS_RETURN(Result, 0);
+        }
+
+        NTFS_MEM_SET(Resolver->Slots, 0, SlotsSize);
+        Resolver->SlotMask = OldCount * 2 - 1;
+        for (uint32_t Index = 0; Index < OldCount; Index++) {
+            if (OldSlots[Index].RecordIndex) {
+                *NTFS__ReparseMemoSlot(Resolver, OldSlots[Index].RecordIndex - 1) =
+                    OldSlots[Index];
+            }
+        }
+    }
+
+    Result              = NTFS__ReparseMemoSlot(Resolver, RecordIndex);
+    Result->RecordIndex = RecordIndex + 1;
+    Resolver->Count++;
+
+skip:
+    return Result;
+}
+
+static uint32_t NTFS__ReparseLookupHash(ntfs_reparse_resolver *Resolver, uint64_t DirIndex,
+                                        uint16_t *Name, size_t NameLength)
+{
+    uint64_t Hash = DirIndex * 0x9E3779B97F4A7C15ull;
+    for (size_t Index = 0; Index < NameLength; Index++) {
+        uint16_t Char = Name[Index];
+        if (Resolver->Volume->CaseTable) {
+            Char = Resolver->Volume->CaseTable[Char];
+        }
+
+        Hash = (Hash ^ Char) * 0x100000001B3ull;
+    }
+
+    uint32_t Result = NTFS_CAST(uint32_t, Hash >> 32);
+    return Result;
+}
+
+// Directory indexes are stored plus one so zero marks an empty slot
+static ntfs_reparse_lookup *NTFS__ReparseLookupSlot(ntfs_reparse_resolver *Resolver,
+                                                    uint64_t DirIndex, uint32_t Hash,
+                                                    uint16_t *Name, size_t NameLength)
+{
+    uint32_t Slot = Hash & Resolver->LookupMask;
+    while (Resolver->Lookups[Slot].DirIndex) {
+        ntfs_reparse_lookup *Lookup = Resolver->Lookups + Slot;
+        if (Lookup->DirIndex == DirIndex + 1 && Lookup->Hash == Hash &&
+            NTFS__NameEquals(Resolver->Volume, Lookup->Name, Lookup->NameLength,
+                             Name, NameLength)) {
+            break;
+        }
+
+        Slot = (Slot + 1) & Resolver->LookupMask;
+    }
+
+    ntfs_reparse_lookup *Result = Resolver->Lookups + Slot;
+    return Result;
+}
+
+static void NTFS__ReparseLookupInsert(ntfs_reparse_resolver *Resolver, uint64_t DirIndex,
+                                      uint16_t *Name, size_t NameLength, uint64_t RecordIndex)
+{
+    // Table is kept at most half full, old slots stay in the arena. The
+    // cache only saves index reads, running out of memory is not an error
+    if ((Resolver->LookupCount + 1) * 2 > Resolver->LookupMask + 1) {
+        ntfs_reparse_lookup *OldLookups  = Resolver->Lookups;
+        uint32_t             OldCount    = Resolver->LookupMask + 1;
+        size_t               LookupsSize = OldCount * 2 * sizeof(ntfs_reparse_lookup);
+
+        Resolver->Lookups = NTFS__ArenaAlloc(&Resolver->Arena, LookupsSize);
+        if (Resolver->Lookups == 0) {
+            Resolver->Lookups = OldLookups;
+            return;
+        }
+
+        NTFS_MEM_SET(Resolver->Lookups, 0, LookupsSize);
+        Resolver->LookupMask = OldCount * 2 - 1;
+        for (uint32_t Index = 0; Index < OldCount; Index++) {
+            uint32_t Slot = OldLookups[Index].Hash & Resolver->LookupMask;
+            while (OldLookups[Index].DirIndex && Resolver->Lookups[Slot].DirIndex) {
+                Slot = (Slot + 1) & Resolver->LookupMask;
+            }
+
+            if (OldLookups[Index].DirIndex) {
+                Resolver->Lookups[Slot] = OldLookups[Index];
+            }
+        }
+    }
+
+    size_t    NameSize = NameLength * sizeof(uint16_t);
+    uint16_t *Copy     = NTFS__ArenaAlloc(&Resolver->Arena, NameSize ? NameSize : 1);
+    if (Copy == 0) {
+        return;
+    }
+
+    for (size_t Index = 0; Index < NameLength; Index++) {
+        Copy[Index] = Resolver->Volume->CaseTable ? Resolver->Volume->CaseTable[Name[Index]]
+                                                  : Name[Index];
+    }
+
+    uint32_t             Hash   = NTFS__ReparseLookupHash(Resolver, DirIndex, Name, NameLength);
+    ntfs_reparse_lookup *Lookup = NTFS__ReparseLookupSlot(Resolver, DirIndex, Hash,
+                                                          Name, NameLength);
+    *Lookup = (ntfs_reparse_lookup) {
+        .DirIndex    = DirIndex + 1,
+        .RecordIndex = RecordIndex,
+        .Name        = Copy,
+        .NameLength  = NTFS_CAST(uint32_t, NameLength),
+        .Hash        = Hash,
+    };
+    Resolver->LookupCount++;
+}
+
+static ntfs_error NTFS__PathWalk(ntfs_reparse_resolver *Resolver, uint64_t StartIndex,
+                                 uint16_t *Path, size_t Length, bool FollowLast,
+                                 size_t Depth, uint64_t *RecordIndex);
+
+// File is the already open record or zero to open it here
+static ntfs_error NTFS__ReparseResolve(ntfs_reparse_resolver *Resolver, uint64_t RecordIndex,
+                                       ntfs_file *File, size_t Depth, uint64_t *TargetIndex)
+{
+    ntfs_error Result = NTFS_Error_Success;
+    ntfs_file  Opened = { 0 };
+
+    ntfs_reparse_memo *Memo = NTFS__ReparseMemoSlot(Resolver, RecordIndex);
+    if (Memo->RecordIndex) {
+        if (Memo->IsResolving) {
+            NTFS_RETURN(Result, NTFS_Error_ReparseLoop);
+        }
+
+        Resolver->Hits++;
+        *TargetIndex = Memo->TargetIndex;
+        NTFS_RETURN(Result, Memo->Error);
+    }
+
+    if (File == 0) {
+        Opened = NTFS_FileOpenFromIndex(Resolver->Volume, RecordIndex);
+        File   = &Opened;
+        if (Opened.Error) {
+            NTFS_RETURN(Result, Opened.Error);
+        }
+    }
+
+    // Most records are not links and are not worth remembering
+    if (!File->Flags.F.ReparsePoint) {
+        *TargetIndex = RecordIndex;
+        NTFS_RETURN(Result, NTFS_Error_Success);
+    }
+
+    if (Depth >= NTFS_REPARSE_MAX_DEPTH) {
+        NTFS_RETURN(Result, NTFS_Error_ReparseLoop);
+    }
+
+    Resolver->Misses++;
+    Memo = NTFS__ReparseMemoInsert(Resolver, RecordIndex);
+    if (Memo == 0) {
+        NTFS_RETURN(Result, NTFS_Error_MemoryError);
+    }
+    Memo->IsResolving = true;
+
+    // Absolute targets name the volume by drive letter or volume GUID,
+    // drive letters are assumed to be this volume
+    uint64_t           Target  = RecordIndex;
+    ntfs_reparse_point Reparse = NTFS_FileReparsePoint(File);
+    uint16_t          *Path    = Reparse.Target;
+    size_t             Length  = Reparse.TargetLength;
+    if (Reparse.Error) {
+        Result = Reparse.Error;
+
+    } else if (Path == 0) {
+        Result = NTFS_Error_ReparseUnsupported;
+
+    } else if (Reparse.IsRelative) {
+        Result = NTFS__PathWalk(Resolver, File->ParentIndex, Path, Length, true, Depth + 1,
+                                &Target);
+
+    } else if (Length >= 6 && Path[0] == '\\' && Path[1] == '?' && Path[2] == '?' &&
+               Path[3] == '\\' && Path[5] == ':') {
+        Result = NTFS__PathWalk(Resolver, NTFS_SystemFile_RootFolder, Path + 6, Length - 6,
+                                true, Depth + 1, &Target);
+
+    } else {
+        Result = NTFS_Error_ReparseUnsupported;
+    }
+
+    // Growing the table during the walk moves the slots
+    Memo              = NTFS__ReparseMemoSlot(Resolver, RecordIndex);
+    Memo->TargetIndex = Target;
+    Memo->Error       = Result;
+    Memo->IsResolving = false;
+    *TargetIndex      = Target;
+
+skip:
+    NTFS_FileClose(&Opened);
+    return Result;
+}
+
+static ntfs_error NTFS__PathWalk(ntfs_reparse_resolver *Resolver, uint64_t StartIndex,
+                                 uint16_t *Path, size_t Length, bool FollowLast,
+                                 size_t Depth, uint64_t *RecordIndex)
+{
+    ntfs_error Result  = NTFS_Error_Success;
+    uint64_t   Current = StartIndex;
+    ntfs_file  Dir     = { 0 };
+
+    if (Length && Path[0] == '\\') {
+        Current = NTFS_SystemFile_RootFolder;
+    }
+
+    size_t Offset = 0;
+    while (Offset < Length) {
+        size_t End = Offset;
+        while (End < Length && Path[End] != '\\') {
+            End++;
+        }
+
+        uint16_t *Name       = Path + Offset;
+        size_t    NameLength = End - Offset;
+        bool      IsLast     = End >= Length;
+        Offset               = End + 1;
+
+        if (NameLength == 0 || (NameLength == 1 && Name[0] == '.')) {
+            continue;
+        }
+
+        // Only directories already followed are cached, so a hit needs no
+        // record read at all
+        bool                 IsParent = NameLength == 2 && Name[0] == '.' && Name[1] == '.';
+        uint32_t             Hash     = NTFS__ReparseLookupHash(Resolver, Current, Name,
+                                                                NameLength);
+        ntfs_reparse_lookup *Lookup   = NTFS__ReparseLookupSlot(Resolver, Current, Hash,
+                                                                Name, NameLength);
+        if (!IsParent && Lookup->DirIndex) {
+            Resolver->LookupHits++;
+            Current = Lookup->RecordIndex;
+
+        } else {
+            // Directories on the way are always followed before looking into
+            // them, each one is opened once unless it is a link
+            uint64_t Target = Current;
+            Dir             = NTFS_FileOpenFromIndex(Resolver->Volume, Current);
+            if (Dir.Error) {
+                NTFS_RETURN(Result, Dir.Error);
+            }
+
+            Result = NTFS__ReparseResolve(Resolver, Current, &Dir, Depth, &Target);
+            if (Result) {
+                NTFS_RETURN(Result, Result);
+            }
+
+            if (Target != Current) {
+                NTFS_FileClose(&Dir);
+                Current = Target;
+                Dir     = NTFS_FileOpenFromIndex(Resolver->Volume, Current);
+                if (Dir.Error) {
+                    NTFS_RETURN(Result, Dir.Error);
+                }
+            }
+
+            if (IsParent) {
+                Current = Dir.ParentIndex;
+            } else {
+                Result = NTFS__DirectoryFind(&Dir, Name, NameLength, &Target);
+                if (Result) {
+                    NTFS_RETURN(Result, Result);
+                }
+
+                NTFS__ReparseLookupInsert(Resolver, Current, Name, NameLength, Target);
+                Current = Target;
+            }
+
+            NTFS_FileClose(&Dir);
+        }
+
+        if (IsLast && FollowLast) {
+            Result = NTFS__ReparseResolve(Resolver, Current, 0, Depth, &Current);
+            if (Result) {
+                NTFS_RETURN(Result, Result);
+            }
+        }
+    }
+
+    *RecordIndex = Current;
+
+skip:
+    NTFS_FileClose(&Dir);
+    return Result;
+}
+
+ntfs_error NTFS_ReparseResolve(ntfs_reparse_resolver *Resolver, uint64_t RecordIndex,
+                               uint64_t *TargetIndex)
+{
+    ntfs_error Result = NTFS__ReparseResolve(Resolver, RecordIndex, 0, 0, TargetIndex);
+    return Result;
+}
+
+ntfs_error NTFS_PathLookup(ntfs_reparse_resolver *Resolver, uint16_t *Path, size_t Length,
+                           bool FollowLast, uint64_t *RecordIndex)
+{
+    ntfs_error Result = NTFS__PathWalk(Resolver, NTFS_SystemFile_RootFolder, Path, Length,
+                                       FollowLast, 0, RecordIndex);
+    return Result;
+}
+
+// Context API
+ntfs_context NTFS_ContextCreate(ntfs_volume *Volume)
+{
+    ntfs_context Result = { 0 };
+
+    if (Volume->Error || Volume->Handle == 0) {
+        NTFS_RETURN(Result.Error, NTFS_Error_VolumeOpen);
+    }
+
+    // Contexts created from contexts still point at the original volume
+    Result.Volume        = *Volume;
+    Result.Volume.Shared = Volume->Shared ? Volume->Shared : Volume;
+    Result.Volume.Handle = NTFS__Win32FileReopen(Volume->Handle, false);
+    if (Result.Volume.Handle == 0) {
+        Result = (ntfs_context) { .Error = NTFS_Error_VolumeOpen };
+        NTFS_RETURN(Result.Error, Result.Error);
+    }
+
+    // Bulk reads fall back to the cached handle when this one fails
+    if (Volume->DirectHandle) {
+        Result.Volume.DirectHandle = NTFS__Win32FileReopen(Volume->DirectHandle, true);
+    }
+
+skip:
+    return Result;
+}
+
+void NTFS_ContextDestroy(ntfs_context *Context)
+{
+    // Only the handles belong to the context, the rest is the shared volume
+    if (Context->Volume.Handle) {
+        CloseHandle(Context->Volume.Handle);
+    }
+
+    if (Context->Volume.DirectHandle) {
+        CloseHandle(Context->Volume.DirectHandle);
+    }
+
+    *Context = (ntfs_context) { .Error = Context->Error };
+}
+
+// Reader API
+struct ntfs__readahead {
+    ntfs_volume   *Volume;
+    ntfs_context   Context;
+    ntfs_data_run *RunList;
+    uint64_t       DataSize;
+
+    // Run cursor, sequential windows continue from the last run read
+    size_t   RunIndex;
+    uint64_t RunOffset;
+
+    SRWLOCK            Lock;
+    CONDITION_VARIABLE Changed;
+    void              *Thread;
+    bool               IsPending;
+    bool               IsStopping;
+
+    uint8_t   *Buffer;
+    uint64_t   Offset;
+    size_t     Size;
+    size_t     Length;
+    ntfs_error Error;
+};
+
+static void NTFS__ReadaheadFill(ntfs__readahead *Readahead)
+{
+    ntfs_volume   *Volume      = Readahead->Volume;
+    uint64_t       ClusterSize = Volume->BytesPerCluster;
+    ntfs_data_run *RunList     = Readahead->RunList;
+    size_t         RunCount    = NTFS__ListLen(RunList);
+
+    uint64_t Offset = Readahead->Offset;
+    uint64_t End    = Offset + Readahead->Size;
+    if (End > NTFS__Align(Readahead->DataSize, ClusterSize)) {
+        End = NTFS__Align(Readahead->DataSize, ClusterSize);
+    }
+
+    if (Offset < Readahead->RunOffset) {
+        Readahead->RunIndex  = 0;
+        Readahead->RunOffset = 0;
+    }
+
+    while (Readahead->RunIndex < RunCount &&
+           Offset >= Readahead->RunOffset + RunList[Readahead->RunIndex].Count * ClusterSize) {
+        Readahead->RunOffset += RunList[Readahead->RunIndex].Count * ClusterSize;
+        Readahead->RunIndex++;
+    }
+
+    // Ends the window on an extent boundary when one falls in its second
+    // half, so the next window does not start with a short read
+    uint64_t Boundary = Readahead->RunOffset;
+    for (size_t Index = Readahead->RunIndex; Index < RunCount; Index++) {
+        Boundary += RunList[Index].Count * ClusterSize;
+        if (Boundary >= End) {
+            break;
+        }
+
+        if (Boundary > Offset + (End - Offset) / 2) {
+            End = Boundary;
+            break;
+        }
+    }
+
+    ntfs_error Error    = NTFS_Error_Success;
+    size_t     Length   = 0;
+    size_t     RunIndex = Readahead->RunIndex;
+    uint64_t   RunStart = Readahead->RunOffset;
+    while (Offset + Length < End) {
+        if (RunIndex >= RunCount) {
+            NTFS_RETURN(Error, NTFS_Error_FileReadFailed);
+        }
+
+        ntfs_data_run *Run     = RunList + RunIndex;
+        uint64_t       RunSize = Run->Count * ClusterSize;
+        uint64_t       RunSkip = Offset + Length - RunStart;
+        size_t         Size    = RunSize - RunSkip;
+        if (Size > End - Offset - Length) {
+            Size = End - Offset - Length;
+        }
+
+        if (Run->IsSparse) {
+            NTFS_MEM_SET(Readahead->Buffer + Length, 0, Size);
+
+        } else if (!NTFS_VolumeRead(Volume, Run->StartVCN * ClusterSize + RunSkip,
+                                    Readahead->Buffer + Length, Size)) {
+            NTFS_RETURN(Error, NTFS_Error_FileReadFailed);
+        }
+
+        Length += Size;
+        if (RunSkip + Size == RunSize) {
+            RunStart += RunSize;
+            RunIndex++;
+        }
+    }
+
+skip:
+    Readahead->RunIndex  = RunIndex;
+    Readahead->RunOffset = RunStart;
+
+    // The last cluster is read whole, only the data part is handed out
+    if (Offset + Length > Readahead->DataSize) {
+        Length = Readahead->DataSize - Offset;
+    }
+
+    AcquireSRWLockExclusive(&Readahead->Lock);
+    Readahead->Length    = Error ? 0 : Length;
+    Readahead->Error     = Error;
+    Readahead->IsPending = false;
+    ReleaseSRWLockExclusive(&Readahead->Lock);
+    WakeAllConditionVariable(&Readahead->Changed);
+}
+
+static DWORD WINAPI NTFS__ReadaheadThread(void *Param)
+{
+    ntfs__readahead *Readahead = Param;
+
+    for (;;) {
+        AcquireSRWLockExclusive(&Readahead->Lock);
+        while (!Readahead->IsPending && !Readahead->IsStopping) {
+            SleepConditionVariableSRW(&Readahead->Changed, &Readahead->Lock, INFINITE, 0);
+        }
+        bool IsStopping = Readahead->IsStopping;
+        ReleaseSRWLockExclusive(&Readahead->Lock);
+
+        if (IsStopping) {
+            break;
+        }
+
+        NTFS__ReadaheadFill(Readahead);
+    }
+
+    return 0;
+}
+
+static void NTFS__ReadaheadRequest(ntfs__readahead *Readahead, uint8_t *Buffer,
+                                   uint64_t Offset, size_t Size)
+{
+    AcquireSRWLockExclusive(&Readahead->Lock);
+    Readahead->Buffer    = Buffer;
+    Readahead->Offset    = Offset;
+    Readahead->Size      = Size;
+    Readahead->IsPending = true;
+    ReleaseSRWLockExclusive(&Readahead->Lock);
+
+    // Without a thread the window is read right away
+    if (Readahead->Thread) {
+        WakeAllConditionVariable(&Readahead->Changed);
+    } else {
+        NTFS__ReadaheadFill(Readahead);
+    }
+}
+
+static void NTFS__ReadaheadWait(ntfs__readahead *Readahead)
+{
+    AcquireSRWLockExclusive(&Readahead->Lock);
+    while (Readahead->IsPending) {
+        SleepConditionVariableSRW(&Readahead->Changed, &Readahead->Lock, INFINITE, 0);
+    }
+    ReleaseSRWLockExclusive(&Readahead->Lock);
+}
+
+// Makes the window cover the reader offset, taking the window read ahead
+// when the access stayed sequential and reading a new one otherwise
+static bool NTFS__ReaderAdvance(ntfs_reader *Reader)
+{
+    ntfs__readahead *Readahead = Reader->Readahead;
+    uint64_t         Offset    = Reader->Offset;
+
+    NTFS__ReadaheadWait(Readahead);
+
+    bool IsSequential = Readahead->Error == NTFS_Error_Success &&
+                        Offset >= Readahead->Offset &&
+                        Offset <  Readahead->Offset + Readahead->Length;
+    if (IsSequential) {
+        if (Reader->WindowSize < NTFS_READER_MAX_WINDOW) {
+            Reader->WindowSize *= 2;
+        }
+    } else {
+        if (Reader->WindowSize > NTFS_READER_MIN_WINDOW) {
+            Reader->WindowSize /= 2;
+        }
+
+        uint64_t Aligned = Offset - Offset % Reader->Volume->BytesPerCluster;
+        NTFS__ReadaheadRequest(Readahead, Readahead->Buffer, Aligned, Reader->WindowSize);
+        NTFS__ReadaheadWait(Readahead);
+    }
+
+    uint8_t *Buffer      = Reader->Window;
+    Reader->Window       = Readahead->Buffer;
+    Reader->WindowOffset = Readahead->Offset;
+    Reader->WindowLength = Readahead->Length;
+    if (Readahead->Error) {
+        Reader->WindowLength = 0;
+        NTFS_RETURN(Reader->Error, Readahead->Error);
+    }
+
+    uint64_t Next = Reader->WindowOffset + Reader->WindowLength;
+    if (Next < Reader->Size) {
+        NTFS__ReadaheadRequest(Readahead, Buffer, Next, Reader->WindowSize);
+    } else {
+        Readahead->Buffer = Buffer;
+    }
+
+skip:
+    return Reader->Error == NTFS_Error_Success &&
+           Offset >= Reader->WindowOffset && Offset < Reader->WindowOffset + Reader->WindowLength;
+}
+
+ntfs_reader NTFS_ReaderOpen(ntfs_file *File, ntfs_attr *Attr)
+{
+    ntfs_reader Result = {
+        .Volume     = File->Volume,
+        .Attr       = Attr ? Attr : NTFS_FileFindAttr(File, NTFS_AttributeType_Data, 0, 0),
+        .WindowSize = NTFS_READER_MIN_WINDOW,
+    };
+
+    if (Result.Attr == 0) {
+        NTFS_RETURN(Result.Error, NTFS_Error_FileReadDataAttrNotFound);
+    }
+
+    if (!Result.Attr->NonResFlag) {
+        Result.Size = Result.Attr->Resident.Size;
+        NTFS_RETURN(Result.Error, NTFS_Error_Success);
+    }
+
+    Result.Size  = Result.Attr->NonResident.Size;
+    Result.Arena = NTFS__ArenaDefault();
+    if (Result.Arena.Buffer == 0) {
+        NTFS_RETURN(Result.Error, NTFS_Error_MemoryError);
+    }
+
+    ntfs__readahead *Readahead = NTFS__ArenaAlloc(&Result.Arena, sizeof(*Readahead));
+    *Readahead = (ntfs__readahead) {
+        .Volume   = Result.Volume,
+        .RunList  = Result.Attr->NonResident.RunList,
+        .DataSize = Result.Size,
+        .Buffer   = NTFS__ArenaAllocAligned(&Result.Arena, NTFS_READER_MAX_WINDOW,
+                                            NTFS_DIRECT_ALIGNMENT),
+    };
+    Result.Window    = NTFS__ArenaAllocAligned(&Result.Arena, NTFS_READER_MAX_WINDOW,
+                                               NTFS_DIRECT_ALIGNMENT);
+    Result.Readahead = Readahead;
+    InitializeSRWLock(&Readahead->Lock);
+    InitializeConditionVariable(&Readahead->Changed);
+
+    // The background reads go through their own handle, so they never
+    // queue behind reads of the caller on the same volume
+    Readahead->Context = NTFS_ContextCreate(Result.Volume);
+    if (Readahead->Context.Error == NTFS_Error_Success) {
+        Readahead->Volume = &Readahead->Context.Volume;
+    }
+
+    Readahead->Thread = NTFS__Win32ThreadCreate(NTFS__ReadaheadThread, Readahead);
+    if (Result.Size) {
+        NTFS__ReadaheadRequest(Readahead, Readahead->Buffer, 0, Result.WindowSize);
+    }
+
+skip:
+    return Result;
+}
+
+void NTFS_ReaderClose(ntfs_reader *Reader)
+{
+    ntfs__readahead *Readahead = Reader->Readahead;
+    if (Readahead) {
+        if (Readahead->Thread) {
+            AcquireSRWLockExclusive(&Readahead->Lock);
+            Readahead->IsStopping = true;
+            ReleaseSRWLockExclusive(&Readahead->Lock);
+            WakeAllConditionVariable(&Readahead->Changed);
+            NTFS__Win32ThreadJoin(Readahead->Thread);
+        }
+
+        NTFS_ContextDestroy(&Readahead->Context);
+    }
+
+    if (Reader->Arena.Buffer) {
+        NTFS__ArenaDestroy(&Reader->Arena);
+    }
+
+    *Reader = (ntfs_reader) { .Error = Reader->Error };
+}
+
+size_t NTFS_ReaderRead(ntfs_reader *Reader, uint8_t *Buffer, size_t Size)
+{
+    size_t Result = 0;
+
+    while (Result < Size) {
+        uint8_t *Data   = 0;
+        size_t   Length = NTFS_ReaderNext(Reader, &Data);
+        if (Length == 0) {
+            break;
+        }
+
+        // Whatever the caller did not ask for stays in the window
+        if (Length > Size - Result) {
+            Reader->Offset -= Length - (Size - Result);
+            Length          = Size - Result;
+        }
+
+        NTFS_MEM_COPY(Buffer + Result, Size - Result, Data, Length);
+        Result += Length;
+    }
+
+    return Result;
+}
+
+// Hands out the rest of the current window without copying it, the data
+// stays valid until the next call on the reader
+size_t NTFS_ReaderNext(ntfs_reader *Reader, uint8_t **Data)
+{
+    size_t   Result = 0;
+    uint64_t Offset = Reader->Offset;
+
+    if (Reader->Error || Reader->Attr == 0 || Offset >= Reader->Size) {
+        NTFS_RETURN(Result, 0);
+    }
+
+    if (!Reader->Attr->NonResFlag) {
+        *Data          = Reader->Attr->Resident.Data + Offset;
+        Result         = Reader->Size - Offset;
+        Reader->Offset = Reader->Size;
+        NTFS_RETURN(Result, Result);
+    }
+
+    bool IsInside = Offset >= Reader->WindowOffset &&
+                    Offset <  Reader->WindowOffset + Reader->WindowLength;
+    if (!IsInside && !NTFS__ReaderAdvance(Reader)) {
+        NTFS_RETURN(Result, 0);
+    }
+
+    size_t Skip     = Offset - Reader->WindowOffset;
+    *Data           = Reader->Window + Skip;
+    Result          = Reader->WindowLength - Skip;
+    Reader->Offset += Result;
+
+skip:
+    return Result;
+}
+
+void NTFS_ReaderSeek(ntfs_reader *Reader, uint64_t Offset)
+{
+    Reader->Offset = Offset;
+}
+
+// Direct I/O API
+struct ntfs__direct_pool {
+    SRWLOCK            Lock;
+    CONDITION_VARIABLE Released;
+    uint8_t           *Free[NTFS_DIRECT_BUFFER_COUNT];
+    size_t             FreeCount;
+};
+
+ntfs__direct_pool *NTFS__DirectPoolCreate(void)
+{
+    size_t HeaderSize = NTFS__Align(sizeof(ntfs__direct_pool), NTFS_DIRECT_ALIGNMENT);
+    size_t Size       = HeaderSize + NTFS_DIRECT_BUFFER_COUNT * NTFS_DIRECT_BUFFER_SIZE;
+
+    // Buffers follow the header, page aligned like the allocation itself
+    ntfs__direct_pool *Result = NTFS__Win32MemoryAllocate(Size, 0);
+    if (Result) {
+        InitializeSRWLock(&Result->Lock);
+        InitializeConditionVariable(&Result->Released);
+        for (size_t Index = 0; Index < NTFS_DIRECT_BUFFER_COUNT; Index++) {
+            Result->Free[Result->FreeCount++] = NTFS_CAST(uint8_t *, Result) + HeaderSize +
+                                                Index * NTFS_DIRECT_BUFFER_SIZE;
+        }
+    }
+
+    return Result;
+}
+
+// Aligned requests go straight into the caller buffer, anything else is
+// read in aligned pieces through a pool buffer and copied out
+bool NTFS__DirectRead(ntfs__direct_pool *Pool, void *Handle, uint64_t Offset,
+                      void *Buffer, size_t Size)
+{
+    bool IsAligned = NTFS__IsAligned(Offset, NTFS_DIRECT_ALIGNMENT) &&
+                     NTFS__IsAligned(Size, NTFS_DIRECT_ALIGNMENT) &&
+                     NTFS__IsAligned(NTFS_CAST(size_t, Buffer), NTFS_DIRECT_ALIGNMENT);
+    if (IsAligned) {
+        return NTFS__Win32FileRead(Handle, Offset, Buffer, Size);
+    }
+
+    AcquireSRWLockExclusive(&Pool->Lock);
+    while (Pool->FreeCount == 0) {
+        SleepConditionVariableSRW(&Pool->Released, &Pool->Lock, INFINITE, 0);
+    }
+    uint8_t *Bounce = Pool->Free[--Pool->FreeCount];
+    ReleaseSRWLockExclusive(&Pool->Lock);
+
+    bool     Result = true;
+    uint8_t *Dest   = Buffer;
+    while (Size && Result) {
+        size_t Skip   = Offset % NTFS_DIRECT_ALIGNMENT;
+        size_t Length = NTFS_DIRECT_BUFFER_SIZE - Skip;
+        if (Length > Size) {
+            Length = Size;
+        }
+
+        // The aligned read may run past the end of the file, only the
+        // requested part has to be there
+        size_t ReadSize = NTFS__Align(Skip + Length, NTFS_DIRECT_ALIGNMENT);
+        Result          = NTFS__Win32FileReadSome(Handle, Offset - Skip, Bounce, ReadSize) >=
+                          Skip + Length;
+        if (Result) {
+            NTFS_MEM_COPY(Dest, Size, Bounce + Skip, Length);
+        }
+
+        Offset += Length;
+        Dest   += Length;
+        Size   -= Length;
+    }
+
+    AcquireSRWLockExclusive(&Pool->Lock);
+    Pool->Free[Pool->FreeCount++] = Bounce;
+    ReleaseSRWLockExclusive(&Pool->Lock);
+    WakeConditionVariable(&Pool->Released);
+
+    return Result;
+}
+
+// WOF API
+typedef struct {
+    uint8_t *Data;
+    size_t   Size;
+    size_t   Position;
+    uint32_t Bits;
+    uint32_t Count;
+} ntfs__bit_reader;
+
+// Both formats read 16 bit little endian words from the most significant
+// bit down. At least 16 bits are kept buffered so a peek never refills,
+// words past the end read as zeros and the position keeps counting
+static inline uint32_t NTFS__BitReaderWord(ntfs__bit_reader *Reader)
+{
+    uint32_t Result = 0;
+    if (Reader->Position + 2 <= Reader->Size) {
+        Result = *NTFS_CAST(uint16_t *, Reader->Data + Reader->Position);
+    }
+
+    Reader->Position += 2;
+    return Result;
+}
+
+static inline void NTFS__BitReaderBegin(ntfs__bit_reader *Reader)
+{
+    Reader->Bits   = NTFS__BitReaderWord(Reader) << 16;
+    Reader->Bits  |= NTFS__BitReaderWord(Reader);
+    Reader->Count  = 32;
+}
+
+static inline uint32_t NTFS__BitReaderPeek(ntfs__bit_reader *Reader, uint32_t Count)
+{
+    return Reader->Bits >> (32 - Count);
+}
+
+static inline void NTFS__BitReaderConsume(ntfs__bit_reader *Reader, uint32_t Count)
+{
+    Reader->Bits  <<= Count;
+    Reader->Count  -= Count;
+    if (Reader->Count < 16) {
+        Reader->Bits  |= NTFS__BitReaderWord(Reader) << (16 - Reader->Count);
+        Reader->Count += 16;
+    }
+}
+
+static inline uint32_t NTFS__BitReaderRead(ntfs__bit_reader *Reader, uint32_t Count)
+{
+    uint32_t Result = 0;
+    if (Count) {
+        Result = NTFS__BitReaderPeek(Reader, Count);
+        NTFS__BitReaderConsume(Reader, Count);
+    }
+
+    return Result;
+}
+
+// Drops the rest of the current word and hands the words still buffered
+// back to the byte stream
+static void NTFS__BitReaderAlign(ntfs__bit_reader *Reader)
+{
+    uint32_t Skip     = Reader->Count % 16 ? Reader->Count % 16 : 16;
+    Reader->Position -= (Reader->Count - Skip) / 8;
+    Reader->Bits      = 0;
+    Reader->Count     = 0;
+}
+
+// Words loaded past the end are fine, bytes read past it are not
+static inline bool NTFS__BitReaderIsOverrun(ntfs__bit_reader *Reader)
+{
+    return Reader->Position > Reader->Size + 4;
+}
+
+#define NTFS__HUFFMAN_TABLE_BITS  11
+#define NTFS__HUFFMAN_MAX_LENGTH  16
+#define NTFS__HUFFMAN_MAX_SYMBOLS 512
+#define NTFS__HUFFMAN_INVALID     0xFFFF
+
+// Codes up to the table bits resolve with one lookup, entries are the
+// symbol shifted over the code length. Longer codes walk the counts
+typedef struct {
+    uint16_t Table[1 << NTFS__HUFFMAN_TABLE_BITS];
+    uint16_t Count[NTFS__HUFFMAN_MAX_LENGTH + 1];
+    uint16_t Symbols[NTFS__HUFFMAN_MAX_SYMBOLS];
+} ntfs__huffman;
+
+// Incomplete codes are valid, an unused code only fails once decoded
+static bool NTFS__HuffmanBuild(ntfs__huffman *Huffman, uint8_t *Lengths, uint32_t SymbolCount)
+{
+    bool Result = true;
+
+    NTFS_MEM_SET(Huffman->Count, 0, sizeof(Huffman->Count));
+    for (uint32_t Symbol = 0; Symbol < SymbolCount; Symbol++) {
+        Huffman->Count[Lengths[Symbol]]++;
+    }
+
+    Huffman->Count[0] = 0;
+
+    int32_t  Left = 1;
+    uint16_t Offsets[NTFS__HUFFMAN_MAX_LENGTH + 1] = { 0 };
+    for (uint32_t Length = 1; Length <= NTFS__HUFFMAN_MAX_LENGTH; Length++) {
+        Left = (Left << 1) - Huffman->Count[Length];
+        if (Left < 0) {
+            NTFS_RETURN(Result, false);
+        }
+
+        if (Length < NTFS__HUFFMAN_MAX_LENGTH) {
+            Offsets[Length + 1] = Offsets[Length] + Huffman->Count[Length];
+        }
+    }
+
+    for (uint32_t Symbol = 0; Symbol < SymbolCount; Symbol++) {
+        if (Lengths[Symbol]) {
+            Huffman->Symbols[Offsets[Lengths[Symbol]]++] = NTFS_CAST(uint16_t, Symbol);
+        }
+    }
+
+    NTFS_MEM_SET(Huffman->Table, 0, sizeof(Huffman->Table));
+
+    uint32_t Code  = 0;
+    uint32_t Index = 0;
+    for (uint32_t Length = 1; Length <= NTFS__HUFFMAN_TABLE_BITS; Length++) {
+        uint32_t Fill = 1u << (NTFS__HUFFMAN_TABLE_BITS - Length);
+        for (uint32_t Count = 0; Count < Huffman->Count[Length]; Count++, Code++) {
+            uint16_t Entry = NTFS_CAST(uint16_t, (Huffman->Symbols[Index++] << 5) | Length);
+            for (uint32_t Slot = 0; Slot < Fill; Slot++) {
+                Huffman->Table[Code * Fill + Slot] = Entry;
+            }
+        }
+
+        Code <<= 1;
+    }
+
+skip:
+    return Result;
+}
+
+static inline uint32_t NTFS__HuffmanDecode(ntfs__huffman *Huffman, ntfs__bit_reader *Reader)
+{
+    uint32_t Result = NTFS__HUFFMAN_INVALID;
+
+    uint32_t Entry = Huffman->Table[NTFS__BitReaderPeek(Reader, NTFS__HUFFMAN_TABLE_BITS)];
+    if (Entry) {
+        NTFS__BitReaderConsume(Reader, Entry & 0x1F);
+        NTFS_RETURN(Result, Entry >> 5);
+    }
+
+    uint32_t Bits  = NTFS__BitReaderPeek(Reader, NTFS__HUFFMAN_MAX_LENGTH);
+    uint32_t Code  = 0;
+    uint32_t Index = 0;
+    for (uint32_t Length = 1; Length <= NTFS__HUFFMAN_MAX_LENGTH; Length++) {
+        uint32_t Count = Huffman->Count[Length];
+        uint32_t Value = Bits >> (NTFS__HUFFMAN_MAX_LENGTH - Length);
+        if (Value - Code < Count) {
+            NTFS__BitReaderConsume(Reader, Length);
+            NTFS_RETURN(Result, Huffman->Symbols[Index + Value - Code]);
+        }
+
+        Index += Count;
+        Code   = (Code + Count) << 1;
+    }
+
+skip:
+    return Result;
+}
+
+// Matches may overlap the bytes they produce, those copy forward
+static inline void NTFS__MatchCopy(uint8_t *Output, size_t Offset, size_t Length)
+{
+    if (Offset >= Length) {
+        NTFS_MEM_COPY(Output, Length, Output - Offset, Length);
+    } else {
+        for (size_t Index = 0; Index < Length; Index++) {
+            Output[Index] = Output[Index - Offset];
+        }
+    }
+}
+
+#define NTFS__XPRESS_SYMBOLS     512
+#define NTFS__XPRESS_BLOCK_SIZE  NTFS__ARENA_KILOBYTE(64)
+#define NTFS__XPRESS_MIN_MATCH   3
+
+// LZ77 with Huffman coding from MS-XCA, every 64KB of output starts with
+// a table of 4 bit code lengths
+bool NTFS__XpressDecompress(uint8_t *Input, size_t InputSize, uint8_t *Output, size_t OutputSize)
+{
+    bool Result = true;
+
+    ntfs__huffman    Huffman;
+    uint8_t          Lengths[NTFS__XPRESS_SYMBOLS];
+    ntfs__bit_reader Reader = { .Data = Input, .Size = InputSize };
+
+    size_t Position = 0;
+    while (Position < OutputSize) {
+        if (Reader.Position + NTFS__XPRESS_SYMBOLS / 2 > InputSize) {
+            NTFS_RETURN(Result, false);
+        }
+
+        for (uint32_t Index = 0; Index < NTFS__XPRESS_SYMBOLS / 2; Index++) {
+            Lengths[Index * 2 + 0] = Input[Reader.Position + Index] & 0x0F;
+            Lengths[Index * 2 + 1] = Input[Reader.Position + Index] >> 4;
+        }
+
+        if (!NTFS__HuffmanBuild(&Huffman, Lengths, NTFS__XPRESS_SYMBOLS)) {
+            NTFS_RETURN(Result, false);
+        }
+
+        Reader.Position += NTFS__XPRESS_SYMBOLS / 2;
+        NTFS__BitReaderBegin(&Reader);
+
+        size_t BlockEnd = OutputSize - Position > NTFS__XPRESS_BLOCK_SIZE
+                              ? Position + NTFS__XPRESS_BLOCK_SIZE : OutputSize;
+        while (Position < BlockEnd) {
+            uint32_t Symbol = NTFS__HuffmanDecode(&Huffman, &Reader);
+            if (Symbol == NTFS__HUFFMAN_INVALID || NTFS__BitReaderIsOverrun(&Reader)) {
+                NTFS_RETURN(Result, false);
+            }
+
+            if (Symbol < 256) {
+                Output[Position++] = NTFS_CAST(uint8_t, Symbol);
+                continue;
+            }
+
+            // Long lengths continue in the byte stream, between the words
+            size_t   Length     = (Symbol - 256) & 0x0F;
+            uint32_t OffsetBits = (Symbol - 256) >> 4;
+            if (Length == 0x0F) {
+                if (Reader.Position + 1 > InputSize) {
+                    NTFS_RETURN(Result, false);
+                }
+
+                Length += Input[Reader.Position++];
+                if (Length == 0x0F + 0xFF) {
+                    if (Reader.Position + 2 > InputSize) {
+                        NTFS_RETURN(Result, false);
+                    }
+
+                    Length           = *NTFS_CAST(uint16_t *, Input + Reader.Position);
+                    Reader.Position += 2;
+                    if (Length < 0x0F) {
+                        NTFS_RETURN(Result, false);
+                    }
+                }
+            }
+
+            Length        += NTFS__XPRESS_MIN_MATCH;
+            size_t Offset  = NTFS__BitReaderRead(&Reader, OffsetBits) + (1u << OffsetBits);
+            if (Offset > Position || Length > OutputSize - Position) {
+                NTFS_RETURN(Result, false);
+            }
+
+            NTFS__MatchCopy(Output + Position, Offset, Length);
+            Position += Length;
+        }
+    }
+
+skip:
+    return Result;
+}
+
+#define NTFS__LZX_MAIN_SYMBOLS    496
+#define NTFS__LZX_LENGTH_SYMBOLS  249
+#define NTFS__LZX_ALIGNED_SYMBOLS 8
+#define NTFS__LZX_PRECODE_SYMBOLS 20
+#define NTFS__LZX_OFFSET_SLOTS    30
+#define NTFS__LZX_MIN_MATCH       2
+#define NTFS__LZX_DEFAULT_BLOCK   NTFS__ARENA_KILOBYTE(32)
+#define NTFS__LZX_E8_FILE_SIZE    12000000
+
+enum {
+    NTFS__LzxBlock_Verbatim     = 1,
+    NTFS__LzxBlock_Aligned      = 2,
+    NTFS__LzxBlock_Uncompressed = 3,
+};
+
+static const uint32_t NTFS__LzxOffsetBase[NTFS__LZX_OFFSET_SLOTS] = {
+    0,    1,    2,    3,    4,    6,    8,    12,   16,    24,    32,    48,    64,    96,    128,
+    192,  256,  384,  512,  768,  1024, 1536, 2048, 3072,  4096,  6144,  8192,  12288, 16384, 24576,
+};
+
+static const uint8_t NTFS__LzxExtraBits[NTFS__LZX_OFFSET_SLOTS] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13,
+};
+
+typedef struct {
+    ntfs__huffman Main;
+    ntfs__huffman Length;
+    ntfs__huffman Aligned;
+    ntfs__huffman Precode;
+
+    uint8_t MainLengths[NTFS__LZX_MAIN_SYMBOLS];
+    uint8_t LengthLengths[NTFS__LZX_LENGTH_SYMBOLS];
+    uint8_t AlignedLengths[NTFS__LZX_ALIGNED_SYMBOLS];
+} ntfs__lzx;
+
+// Code lengths are sent as changes to the lengths of the previous block,
+// coded with a pretree of their own
+static bool NTFS__LzxReadLengths(ntfs__lzx *Lzx, ntfs__bit_reader *Reader,
+                                 uint8_t *Lengths, uint32_t Count)
+{
+    bool Result = true;
+
+    uint8_t PrecodeLengths[NTFS__LZX_PRECODE_SYMBOLS];
+    for (uint32_t Index = 0; Index < NTFS__LZX_PRECODE_SYMBOLS; Index++) {
+        PrecodeLengths[Index] = NTFS_CAST(uint8_t, NTFS__BitReaderRead(Reader, 4));
+    }
+
+    if (!NTFS__HuffmanBuild(&Lzx->Precode, PrecodeLengths, NTFS__LZX_PRECODE_SYMBOLS)) {
+        NTFS_RETURN(Result, false);
+    }
+
+    for (uint32_t Index = 0; Index < Count;) {
+        uint32_t Symbol = NTFS__HuffmanDecode(&Lzx->Precode, Reader);
+        if (Symbol == NTFS__HUFFMAN_INVALID) {
+            NTFS_RETURN(Result, false);
+        }
+
+        if (Symbol < 17) {
+            Lengths[Index] = NTFS_CAST(uint8_t, (Lengths[Index] + 17 - Symbol) % 17);
+            Index++;
+            continue;
+        }
+
+        uint32_t Run   = 0;
+        uint8_t  Value = 0;
+        if (Symbol == 17) {
+            Run = 4 + NTFS__BitReaderRead(Reader, 4);
+        } else if (Symbol == 18) {
+            Run = 20 + NTFS__BitReaderRead(Reader, 5);
+        } else {
+            Run    = 4 + NTFS__BitReaderRead(Reader, 1);
+            Symbol = NTFS__HuffmanDecode(&Lzx->Precode, Reader);
+            if (Symbol > 17) {
+                NTFS_RETURN(Result, false);
+            }
+
+            Value = NTFS_CAST(uint8_t, (Lengths[Index] + 17 - Symbol) % 17);
+        }
+
+        for (; Run && Index < Count; Run--) {
+            Lengths[Index++] = Value;
+        }
+    }
+
+skip:
+    return Result;
+}
+
+// Calls were stored with absolute targets to compress better, converts
+// them back to relative
+static void NTFS__LzxTranslateCalls(uint8_t *Data, size_t Size)
+{
+    for (size_t Index = 0; Index + 10 < Size;) {
+        if (Data[Index] != 0xE8) {
+            Index++;
+            continue;
+        }
+
+        int32_t *Target   = NTFS_CAST(int32_t *, Data + Index + 1);
+        int32_t  Position = NTFS_CAST(int32_t, Index);
+        if (*Target >= 0 && *Target < NTFS__LZX_E8_FILE_SIZE) {
+            *Target -= Position;
+        } else if (*Target < 0 && *Target >= -Position) {
+            *Target += NTFS__LZX_E8_FILE_SIZE;
+        }
+
+        Index += 5;
+    }
+}
+
+// The WIM flavour of LZX, a 32KB window, no header and every chunk
+// starting from empty code lengths and recent offsets
+bool NTFS__LzxDecompress(uint8_t *Input, size_t InputSize, uint8_t *Output, size_t OutputSize)
+{
+    bool Result = true;
+
+    ntfs__lzx Lzx;
+    NTFS_MEM_SET(Lzx.MainLengths, 0, sizeof(Lzx.MainLengths));
+    NTFS_MEM_SET(Lzx.LengthLengths, 0, sizeof(Lzx.LengthLengths));
+
+    uint32_t         Recent[3] = { 1, 1, 1 };
+    ntfs__bit_reader Reader    = { .Data = Input, .Size = InputSize };
+    NTFS__BitReaderBegin(&Reader);
+
+    size_t Position = 0;
+    while (Position < OutputSize) {
+        uint32_t Type      = NTFS__BitReaderRead(&Reader, 3);
+        size_t   BlockSize = NTFS__BitReaderRead(&Reader, 1)
+                                 ? NTFS__LZX_DEFAULT_BLOCK : NTFS__BitReaderRead(&Reader, 16);
+        if (BlockSize == 0 || BlockSize > OutputSize - Position) {
+            NTFS_RETURN(Result, false);
+        }
+
+        if (Type == NTFS__LzxBlock_Uncompressed) {
+            NTFS__BitReaderAlign(&Reader);
+            if (Reader.Position + 12 + BlockSize > InputSize) {
+                NTFS_RETURN(Result, false);
+            }
+
+            for (uint32_t Index = 0; Index < 3; Index++) {
+                Recent[Index]    = *NTFS_CAST(uint32_t *, Input + Reader.Position);
+                Reader.Position += 4;
+                if (Recent[Index] == 0) {
+                    NTFS_RETURN(Result, false);
+                }
+            }
+
+            NTFS_MEM_COPY(Output + Position, BlockSize, Input + Reader.Position, BlockSize);
+            Position        += BlockSize;
+            Reader.Position += BlockSize + (BlockSize & 1);
+            NTFS__BitReaderBegin(&Reader);
+            continue;
+        }
+
+        if (Type != NTFS__LzxBlock_Verbatim && Type != NTFS__LzxBlock_Aligned) {
+            NTFS_RETURN(Result, false);
+        }
+
+        if (Type == NTFS__LzxBlock_Aligned) {
+            for (uint32_t Index = 0; Index < NTFS__LZX_ALIGNED_SYMBOLS; Index++) {
+                Lzx.AlignedLengths[Index] = NTFS_CAST(uint8_t, NTFS__BitReaderRead(&Reader, 3));
+            }
+
+            if (!NTFS__HuffmanBuild(&Lzx.Aligned, Lzx.AlignedLengths, NTFS__LZX_ALIGNED_SYMBOLS)) {
+                NTFS_RETURN(Result, false);
+            }
+        }
+
+        // Literals and matches of the main tree come with separate pretrees
+        if (!NTFS__LzxReadLengths(&Lzx, &Reader, Lzx.MainLengths, 256) ||
+            !NTFS__LzxReadLengths(&Lzx, &Reader, Lzx.MainLengths + 256,
+                                  NTFS__LZX_MAIN_SYMBOLS - 256) ||
+            !NTFS__LzxReadLengths(&Lzx, &Reader, Lzx.LengthLengths, NTFS__LZX_LENGTH_SYMBOLS) ||
+            !NTFS__HuffmanBuild(&Lzx.Main, Lzx.MainLengths, NTFS__LZX_MAIN_SYMBOLS) ||
+            !NTFS__HuffmanBuild(&Lzx.Length, Lzx.LengthLengths, NTFS__LZX_LENGTH_SYMBOLS)) {
+            NTFS_RETURN(Result, false);
+        }
+
+        size_t BlockEnd = Position + BlockSize;
+        while (Position < BlockEnd) {
+            uint32_t Symbol = NTFS__HuffmanDecode(&Lzx.Main, &Reader);
+            if (Symbol == NTFS__HUFFMAN_INVALID || NTFS__BitReaderIsOverrun(&Reader)) {
+                NTFS_RETURN(Result, false);
+            }
+
+            if (Symbol < 256) {
+                Output[Position++] = NTFS_CAST(uint8_t, Symbol);
+                continue;
+            }
+
+            size_t Length = ((Symbol - 256) & 7) + NTFS__LZX_MIN_MATCH;
+            if (((Symbol - 256) & 7) == 7) {
+                uint32_t Extra = NTFS__HuffmanDecode(&Lzx.Length, &Reader);
+                if (Extra == NTFS__HUFFMAN_INVALID) {
+                    NTFS_RETURN(Result, false);
+                }
+
+                Length += Extra;
+            }
+
+            // The three recent offsets work as a cache, a hit moves to front
+            uint32_t Slot   = (Symbol - 256) >> 3;
+            uint32_t Offset = 0;
+            if (Slot < 3) {
+                Offset       = Recent[Slot];
+                Recent[Slot] = Recent[0];
+                Recent[0]    = Offset;
+            } else {
+                uint32_t Extra = NTFS__LzxExtraBits[Slot];
+                Offset         = NTFS__LzxOffsetBase[Slot];
+                if (Type == NTFS__LzxBlock_Aligned && Extra >= 3) {
+                    Offset          += NTFS__BitReaderRead(&Reader, Extra - 3) << 3;
+                    uint32_t Aligned = NTFS__HuffmanDecode(&Lzx.Aligned, &Reader);
+                    if (Aligned == NTFS__HUFFMAN_INVALID) {
+                        NTFS_RETURN(Result, false);
+                    }
+
+                    Offset += Aligned;
+                } else {
+                    Offset += NTFS__BitReaderRead(&Reader, Extra);
+                }
+
+                Offset   -= 2;
+                Recent[2] = Recent[1];
+                Recent[1] = Recent[0];
+                Recent[0] = Offset;
+            }
+
+            if (Offset > Position || Length > BlockEnd - Position) {
+                NTFS_RETURN(Result, false);
+            }
+
+            NTFS__MatchCopy(Output + Position, Offset, Length);
+            Position += Length;
+        }
+    }
+
+    NTFS__LzxTranslateCalls(Output, OutputSize);
+
+skip:
+    return Result;
+}
+
+static uint64_t NTFS__WofChunkStart(ntfs_wof *Wof, uint64_t Chunk)
+{
+    uint64_t Result = Wof->TableSize;
+    if (Chunk == Wof->ChunkCount) {
+        Result = Wof->StreamSize;
+    } else if (Chunk && Wof->EntrySize == sizeof(uint32_t)) {
+        Result += NTFS_CAST(uint32_t *, Wof->Table)[Chunk - 1];
+    } else if (Chunk) {
+        Result += NTFS_CAST(uint64_t *, Wof->Table)[Chunk - 1];
+    }
+
+    return Result;
+}
+
+static size_t NTFS__WofChunkSize(ntfs_wof *Wof, uint64_t Chunk)
+{
+    uint64_t Offset = Chunk * Wof->ChunkSize;
+    size_t   Result = Wof->Size - Offset < Wof->ChunkSize
+                          ? NTFS_CAST(size_t, Wof->Size - Offset) : Wof->ChunkSize;
+    return Result;
+}
+
+ntfs_wof NTFS_WofOpen(ntfs_file *File)
+{
+    static uint16_t StreamName[] = {
+        'W', 'o', 'f', 'C', 'o', 'm', 'p', 'r', 'e', 's', 's', 'e', 'd', 'D', 'a', 't', 'a',
+    };
+
+    ntfs_wof Result = { .Volume = File->Volume };
+
+    // Reparse data is the WOF header followed by the file provider info
+    ntfs_attr *Reparse = NTFS_FileFindAttr(File, NTFS_AttributeType_SymbolicLink, 0, 0);
+    if (Reparse == 0 || Reparse->NonResFlag || Reparse->Resident.Size < 0x18) {
+        NTFS_RETURN(Result.Error, NTFS_Error_WofInvalid);
+    }
+
+    uint8_t *Data = Reparse->Resident.Data;
+    if (*NTFS_CAST(uint32_t *, Data + 0x00) != NTFS_REPARSE_TAG_WOF ||
+        *NTFS_CAST(uint32_t *, Data + 0x08) != 1) {
+        NTFS_RETURN(Result.Error, NTFS_Error_WofInvalid);
+    }
+
+    // Files backed by a WIM image keep their data outside the volume
+    if (*NTFS_CAST(uint32_t *, Data + 0x0C) != NTFS_WOF_PROVIDER_FILE) {
+        NTFS_RETURN(Result.Error, NTFS_Error_WofUnsupported);
+    }
+
+    Result.Algorithm = *NTFS_CAST(uint32_t *, Data + 0x14);
+    if (*NTFS_CAST(uint32_t *, Data + 0x10) != 1 ||
+        Result.Algorithm > NTFS_WofAlgorithm_Xpress16K) {
+        NTFS_RETURN(Result.Error, NTFS_Error_WofInvalid);
+    }
+
+    ntfs_attr *DataAttr = NTFS_FileFindAttr(File, NTFS_AttributeType_Data, 0, 0);
+    Result.Stream       = NTFS_FileFindAttr(File, NTFS_AttributeType_Data, StreamName,
+                                            17);
+    if (DataAttr == 0 || Result.Stream == 0) {
+        NTFS_RETURN(Result.Error, NTFS_Error_WofInvalid);
+    }
+
+    Result.ChunkSize  = Result.Algorithm == NTFS_WofAlgorithm_Lzx
+                            ? NTFS_WOF_LZX_CHUNK_SIZE
+                            : NTFS__ARENA_KILOBYTE(4) << (Result.Algorithm ? Result.Algorithm - 1 : 0);
+    Result.Size       = DataAttr->NonResFlag ? DataAttr->NonResident.Size : DataAttr->Resident.Size;
+    Result.StreamSize = Result.Stream->NonResFlag ? Result.Stream->NonResident.Size
+                                                  : Result.Stream->Resident.Size;
+    Result.ChunkCount = (Result.Size + Result.ChunkSize - 1) / Result.ChunkSize;
+    Result.EntrySize  = Result.Size > 0xFFFFFFFF ? sizeof(uint64_t) : sizeof(uint32_t);
+    Result.TableSize  = Result.ChunkCount ? (Result.ChunkCount - 1) * Result.EntrySize : 0;
+    if (Result.TableSize > Result.StreamSize) {
+        NTFS_RETURN(Result.Error, NTFS_Error_WofInvalid);
+    }
+
+    if (!Result.Stream->NonResFlag) {
+        Result.Table = Result.Stream->Resident.Data;
+    } else if (Result.TableSize) {
+        size_t ClusterSize = File->Volume->BytesPerCluster;
+        size_t TableSize   = NTFS__Align(NTFS_CAST(size_t, Result.TableSize), ClusterSize);
+        size_t Reserved    = NTFS__Align(TableSize + NTFS_DIRECT_ALIGNMENT, NTFS__ARENA_MEGABYTE(1));
+
+        Result.Arena = NTFS__ArenaCreate(Reserved, NTFS__ARENA_DEFAULT_COMMIT);
+        if (Result.Arena.Buffer == 0) {
+            NTFS_RETURN(Result.Error, NTFS_Error_MemoryError);
+        }
+
+        Result.Table = NTFS__ArenaAllocAligned(&Result.Arena, TableSize, NTFS_DIRECT_ALIGNMENT);
+        NTFS__DataRunsRead(File->Volume, Result.Stream->NonResident.RunList, 0,
+                           Result.Table, TableSize, &Result.Error);
+        if (Result.Error) {
+            NTFS_RETURN(Result.Error, NTFS_Error_FileReadFailed);
+        }
+    }
+
+    // Checked once here so reads can trust every chunk to be in the stream
+    // and no larger than what it decompresses to
+    for (uint64_t Chunk = 0; Chunk < Result.ChunkCount; Chunk++) {
+        uint64_t Start = NTFS__WofChunkStart(&Result, Chunk);
+        uint64_t End   = NTFS__WofChunkStart(&Result, Chunk + 1);
+        if (End <= Start || End > Result.StreamSize ||
+            End - Start > NTFS__WofChunkSize(&Result, Chunk)) {
+            NTFS_RETURN(Result.Error, NTFS_Error_WofInvalid);
+        }
+    }
+
+skip:
+    return Result;
+}
+
+void NTFS_WofClose(ntfs_wof *Wof)
+{
+    if (Wof->Arena.Buffer) {
+        NTFS__ArenaDestroy(&Wof->Arena);
+    }
+
+    *Wof = (ntfs_wof) { .Error = Wof->Error };
+}
+
+typedef struct {
+    ntfs_wof *Wof;
+    uint64_t  Offset;
+    uint8_t  *Buffer;
+    size_t    Size;
+
+    uint64_t       FirstChunk;
+    uint64_t       EndChunk;
+    uint64_t       BatchChunks;
+    volatile LONG64 NextBatch;
+} ntfs__wof_decode;
+
+typedef struct {
+    ntfs__wof_decode *Decode;
+    ntfs_error        Error;
+} ntfs__wof_worker;
+
+// Chunks that did not shrink are stored as they are
+static bool NTFS__WofDecodeChunk(ntfs_wof *Wof, uint8_t *Input, size_t InputSize,
+                                 uint8_t *Output, size_t OutputSize)
+{
+    bool Result = true;
+    if (InputSize == OutputSize) {
+        NTFS_MEM_COPY(Output, OutputSize, Input, InputSize);
+    } else if (Wof->Algorithm == NTFS_WofAlgorithm_Lzx) {
+        Result = NTFS__LzxDecompress(Input, InputSize, Output, OutputSize);
+    } else {
+        Result = NTFS__XpressDecompress(Input, InputSize, Output, OutputSize);
+    }
+
+    return Result;
+}
+
+// Claims batches of chunks until none are left. Each batch is one read of
+// the compressed span, chunks covered by the request whole decompress
+// straight into it and the partial ones at the edges go through scratch
+static ntfs_error NTFS__WofDecodeBatches(ntfs__wof_decode *Decode, ntfs_volume *Volume)
+{
+    ntfs_error Result = NTFS_Error_Success;
+
+    ntfs_wof *Wof         = Decode->Wof;
+    size_t    ClusterSize = Volume->BytesPerCluster;
+    size_t    SpanSize    = Decode->BatchChunks * Wof->ChunkSize + 2 * ClusterSize;
+    size_t    ArenaSize   = NTFS__Align(SpanSize + Wof->ChunkSize + 4 * NTFS_DIRECT_ALIGNMENT,
+                                        NTFS__ARENA_KILOBYTE(64));
+
+    ntfs_arena Arena = NTFS__ArenaCreate(ArenaSize, ArenaSize);
+    if (Arena.Buffer == 0) {
+        NTFS_RETURN(Result, NTFS_Error_MemoryError);
+    }
+
+    uint8_t *Compressed = NTFS__ArenaAllocAligned(&Arena, SpanSize, NTFS_DIRECT_ALIGNMENT);
+    uint8_t *Scratch    = NTFS__ArenaAllocAligned(&Arena, Wof->ChunkSize, NTFS_DIRECT_ALIGNMENT);
+
+    for (;;) {
+        uint64_t Batch = InterlockedIncrement64(&Decode->NextBatch) - 1;
+        uint64_t First = Decode->FirstChunk + Batch * Decode->BatchChunks;
+        if (First >= Decode->EndChunk) {
+            break;
+        }
+
+        uint64_t End = Decode->EndChunk - First > Decode->BatchChunks
+                           ? First + Decode->BatchChunks : Decode->EndChunk;
+
+        // Span holds the stream from SpanStart on
+        uint8_t *Span      = Wof->Stream->Resident.Data;
+        uint64_t SpanStart = 0;
+        if (Wof->Stream->NonResFlag) {
+            uint64_t Start = NTFS__WofChunkStart(Wof, First);
+            SpanStart      = Start - Start % ClusterSize;
+
+            size_t ReadSize = NTFS__Align(NTFS_CAST(size_t, NTFS__WofChunkStart(Wof, End)),
+                                          ClusterSize) - NTFS_CAST(size_t, SpanStart);
+            NTFS__DataRunsRead(Volume, Wof->Stream->NonResident.RunList, SpanStart,
+                               Compressed, ReadSize, &Result);
+            if (Result) {
+                NTFS_RETURN(Result, NTFS_Error_FileReadFailed);
+            }
+
+            Span = Compressed;
+        }
+
+        for (uint64_t Chunk = First; Chunk < End; Chunk++) {
+            uint64_t Start     = NTFS__WofChunkStart(Wof, Chunk);
+            size_t   InputSize = NTFS_CAST(size_t, NTFS__WofChunkStart(Wof, Chunk + 1) - Start);
+
+            uint64_t ChunkOffset = Chunk * Wof->ChunkSize;
+            size_t   ChunkSize   = NTFS__WofChunkSize(Wof, Chunk);
+            bool     IsWhole     = ChunkOffset >= Decode->Offset &&
+                                   ChunkOffset + ChunkSize <= Decode->Offset + Decode->Size;
+
+            uint8_t *Output = IsWhole ? Decode->Buffer + (ChunkOffset - Decode->Offset) : Scratch;
+            if (!NTFS__WofDecodeChunk(Wof, Span + (Start - SpanStart), InputSize, Output, ChunkSize)) {
+                NTFS_RETURN(Result, NTFS_Error_WofFailedDecompress);
+            }
+
+            if (!IsWhole) {
+                uint64_t From = ChunkOffset > Decode->Offset ? ChunkOffset : Decode->Offset;
+                uint64_t To   = ChunkOffset + ChunkSize < Decode->Offset + Decode->Size
+                                    ? ChunkOffset + ChunkSize : Decode->Offset + Decode->Size;
+                NTFS_MEM_COPY(Decode->Buffer + (From - Decode->Offset), NTFS_CAST(size_t, To - From),
+                              Scratch + (From - ChunkOffset), NTFS_CAST(size_t, To - From));
+            }
+        }
+    }
+
+skip:
+    if (Arena.Buffer) {
+        NTFS__ArenaDestroy(&Arena);
+    }
+
+    return Result;
+}
+
+static DWORD WINAPI NTFS__WofDecodeThread(void *Param)
+{
+    ntfs__wof_worker *Worker = Param;
+    ntfs_volume      *Volume = Worker->Decode->Wof->Volume;
+
+    // Every worker reads through a handle of its own
+    ntfs_context Context = NTFS_ContextCreate(Volume);
+    Worker->Error        = NTFS__WofDecodeBatches(Worker->Decode, Context.Error ? Volume
+                                                                                : &Context.Volume);
+    NTFS_ContextDestroy(&Context);
+
+    return 0;
+}
+
+size_t NTFS_WofRead(ntfs_wof *Wof, uint64_t Offset, uint8_t *Buffer, size_t Size)
+{
+    size_t Result = 0;
+
+    if (Wof->Error || Offset >= Wof->Size) {
+        NTFS_RETURN(Result, 0);
+    }
+
+    if (Size > Wof->Size - Offset) {
+        Size = NTFS_CAST(size_t, Wof->Size - Offset);
+    }
+
+    ntfs__wof_decode Decode = {
+        .Wof         = Wof,
+        .Offset      = Offset,
+        .Buffer      = Buffer,
+        .Size        = Size,
+        .FirstChunk  = Offset / Wof->ChunkSize,
+        .EndChunk    = (Offset + Size + Wof->ChunkSize - 1) / Wof->ChunkSize,
+        .BatchChunks = NTFS_WOF_BATCH_SIZE / Wof->ChunkSize,
+    };
+
+    uint64_t BatchCount  = (Decode.EndChunk - Decode.FirstChunk + Decode.BatchChunks - 1) /
+                           Decode.BatchChunks;
+    uint32_t ThreadCount = Size >= NTFS_WOF_PARALLEL_MIN_SIZE ? NTFS__Win32ProcessorCount() : 1;
+    if (ThreadCount > 64) {
+        ThreadCount = 64;
+    }
+
+    if (ThreadCount > BatchCount) {
+        ThreadCount = NTFS_CAST(uint32_t, BatchCount);
+    }
+
+    if (ThreadCount < 2) {
+        Wof->Error = NTFS__WofDecodeBatches(&Decode, Wof->Volume);
+    } else {
+        ntfs__wof_worker Workers[64] = { 0 };
+        void            *Threads[64] = { 0 };
+        for (uint32_t Index = 0; Index < ThreadCount; Index++) {
+            Workers[Index].Decode = &Decode;
+            Threads[Index]        = NTFS__Win32ThreadCreate(NTFS__WofDecodeThread, Workers + Index);
+            if (Threads[Index] == 0) {
+                NTFS__WofDecodeThread(Workers + Index);
+            }
+        }
+
+        for (uint32_t Index = 0; Index < ThreadCount; Index++) {
+            if (Threads[Index]) {
+                NTFS__Win32ThreadJoin(Threads[Index]);
+            }
+
+            if (Workers[Index].Error && Wof->Error == NTFS_Error_Success) {
+                Wof->Error = Workers[Index].Error;
+            }
+        }
+    }
+
+    Result = Wof->Error ? 0 : Size;
+
+skip:
+    return Result;
+}
+
+// Usage API
+enum {
+    NTFS__UsageFlag_InUse   = 0x01,
+    NTFS__UsageFlag_Dir     = 0x02,
+    NTFS__UsageFlag_HasName = 0x04,
+};
+
+ntfs_usage NTFS_UsageBuild(ntfs_volume *Volume)
+{
+    ntfs_usage Result = {
+        .Arena = NTFS__ArenaCreate(NTFS_USAGE_RESERVED, NTFS__ARENA_DEFAULT_COMMIT),
+    };
+    ntfs_arena    Temp = NTFS__ArenaCreate(NTFS_USAGE_RESERVED, NTFS__ARENA_DEFAULT_COMMIT);
+    ntfs_mft_scan Scan = NTFS_MftScanBegin(Volume);
+
+    if (Result.Arena.Buffer == 0 || Temp.Buffer == 0) {
+        NTFS_RETURN(Result.Error, NTFS_Error_MemoryError);
+    }
+
+    if (Scan.Error) {
+        NTFS_RETURN(Result.Error, Scan.Error);
+    }
+
+    // Parents are stored in 32 bits, the MFT can not hold more records
+    uint64_t Count     = Scan.RecordCount;
+    Result.RecordCount = Count;
+    Result.Entries     = NTFS__ArenaAlloc(&Result.Arena, Count * sizeof(*Result.Entries));
+    Result.Parents     = NTFS__ArenaAlloc(&Result.Arena, Count * sizeof(*Result.Parents));
+
+    uint16_t *Sequences       = NTFS__ArenaAlloc(&Temp, Count * sizeof(*Sequences));
+    uint16_t *ParentSequences = NTFS__ArenaAlloc(&Temp, Count * sizeof(*ParentSequences));
+    uint8_t  *Flags           = NTFS__ArenaAlloc(&Temp, Count * sizeof(*Flags));
+    uint8_t  *NameRanks       = NTFS__ArenaAlloc(&Temp, Count * sizeof(*NameRanks));
+    NTFS_MEM_SET(Result.Entries, 0, Count * sizeof(*Result.Entries));
+    NTFS_MEM_SET(Flags, 0, Count * sizeof(*Flags));
+
+    // Extension records add their names and data to the base record, the
+    // size of an attribute is only kept in its first extent
+    Scan.HeadersOnly   = true;
+    ntfs_record Record = { 0 };
+    while (NTFS_MftScanNext(&Scan, &Record)) {
+        uint64_t Base = Record.BaseIndex;
+        if (Base >= Count) {
+            continue;
+        }
+
+        if (Record.Index == Base) {
+            Flags[Base]    |= NTFS__UsageFlag_InUse | (Record.IsDir ? NTFS__UsageFlag_Dir : 0);
+            Sequences[Base] = *NTFS_CAST(uint16_t *, Record.Buffer + 0x10);
+        }
+
+        ntfs_attr        Attr   = { 0 };
+        ntfs_attr_cursor Cursor = NTFS_AttrCursorBegin(Volume, &Record);
+        while (NTFS_AttrCursorNext(&Cursor, 0, &Attr)) {
+            ntfs_file_name FileName = { 0 };
+            if (Attr.Type == NTFS_AttributeType_FileName && NTFS__FileNameParse(&Attr, &FileName)) {
+                uint8_t Rank = NTFS_CAST(uint8_t, NTFS__NameSpaceRank(FileName.NameSpace));
+                if (!(Flags[Base] & NTFS__UsageFlag_HasName) || Rank < NameRanks[Base]) {
+                    Flags[Base]          |= NTFS__UsageFlag_HasName;
+                    NameRanks[Base]       = Rank;
+                    ParentSequences[Base] = FileName.ParentSequence;
+                    Result.Parents[Base]  = FileName.ParentIndex < Count
+                                                ? NTFS_CAST(uint32_t, FileName.ParentIndex)
+                                                : NTFS_USAGE_NO_PARENT;
+                }
+
+            } else if (Attr.Type == NTFS_AttributeType_Data && !Attr.Name) {
+                ntfs_usage_entry *Entry = Result.Entries + Base;
+                if (!Attr.NonResFlag) {
+                    Entry->Size          = Attr.Resident.Size;
+                    Entry->AllocatedSize = NTFS__Align(Attr.Resident.Size, Volume->BytesPerCluster);
+                } else if (Attr.NonResident.FirstVCN == 0) {
+                    Entry->Size          = Attr.NonResident.Size;
+                    Entry->AllocatedSize = Attr.NonResident.AlignedSize;
+                }
+            }
+        }
+    }
+
+    if (Scan.Error) {
+        NTFS_RETURN(Result.Error, Scan.Error);
+    }
+
+    // Children are counted per parent, records without any start the queue
+    // and every parent joins it once its last child was added to it
+    uint32_t *Pending = NTFS__ArenaAlloc(&Temp, Count * sizeof(*Pending));
+    uint32_t *Queue   = NTFS__ArenaAlloc(&Temp, Count * sizeof(*Queue));
+    NTFS_MEM_SET(Pending, 0, Count * sizeof(*Pending));
+
+    for (uint64_t Index = 0; Index < Count; Index++) {
+        uint32_t Parent = Result.Parents[Index];
+        bool     IsUsed = (Flags[Index] & (NTFS__UsageFlag_InUse | NTFS__UsageFlag_HasName)) ==
+                          (NTFS__UsageFlag_InUse | NTFS__UsageFlag_HasName);
+        if (!IsUsed) {
+            Result.Entries[Index] = (ntfs_usage_entry) { 0 };
+            Result.Parents[Index] = NTFS_USAGE_NO_PARENT;
+            continue;
+        }
+
+        if (Flags[Index] & NTFS__UsageFlag_Dir) {
+            Result.Entries[Index].Dirs = 1;
+        } else {
+            Result.Entries[Index].Files = 1;
+        }
+
+        bool IsValid = Parent != NTFS_USAGE_NO_PARENT && Parent != Index;
+        IsValid      = IsValid && (Flags[Parent] & NTFS__UsageFlag_Dir) &&
+                       Sequences[Parent] == ParentSequences[Index];
+        if (!IsValid) {
+            Result.Parents[Index] = NTFS_USAGE_NO_PARENT;
+        }
+    }
+
+    for (uint64_t Index = 0; Index < Count; Index++) {
+        if (Result.Parents[Index] != NTFS_USAGE_NO_PARENT) {
+            Pending[Result.Parents[Index]]++;
+        }
+    }
+
+    uint64_t Tail = 0;
+    for (uint64_t Index = 0; Index < Count; Index++) {
+        if (Result.Entries[Index].Files + Result.Entries[Index].Dirs && Pending[Index] == 0) {
+            Queue[Tail++] = NTFS_CAST(uint32_t, Index);
+        }
+    }
+
+    for (uint64_t Head = 0; Head < Tail; Head++) {
+        uint32_t Index  = Queue[Head];
+        uint32_t Parent = Result.Parents[Index];
+        if (Parent == NTFS_USAGE_NO_PARENT) {
+            continue;
+        }
+
+        ntfs_usage_entry *Child = Result.Entries + Index;
+        ntfs_usage_entry *Entry = Result.Entries + Parent;
+        Entry->Size          += Child->Size;
+        Entry->AllocatedSize += Child->AllocatedSize;
+        Entry->Files         += Child->Files;
+        Entry->Dirs          += Child->Dirs;
+        if (--Pending[Parent] == 0) {
+            Queue[Tail++] = Parent;
+        }
+    }
+
+    // Only records on a loop are left with children waiting, the queue is
+    // no measure since directories without a name of their own join it too
+    for (uint64_t Index = 0; Index < Count; Index++) {
+        Result.Unresolved += Pending[Index] != 0;
+    }
+
+skip:
+    NTFS_MftScanEnd(&Scan);
+    if (Temp.Buffer) {
+        NTFS__ArenaDestroy(&Temp);
+    }
+
+    return Result;
+}
+
+void NTFS_UsageDestroy(ntfs_usage *Usage)
+{
+    if (Usage->Arena.Buffer) {
+        NTFS__ArenaDestroy(&Usage->Arena);
+    }
+
+    *Usage = (ntfs_usage) { .Error = Usage->Error };
+}
+
+ntfs_usage_entry *NTFS_UsageGet(ntfs_usage *Usage, uint64_t RecordIndex)
+{
+    ntfs_usage_entry *Result = 0;
+
+    if (RecordIndex < Usage->RecordCount) {
+        Result = Usage->Entries + RecordIndex;
+        if (Result->Files + Result->Dirs == 0) {
+            Result = 0;
+        }
+    }
+
+    return Result;
+}
+
+static void NTFS__UsageSiftDown(ntfs_usage *Usage, uint64_t *Heap, size_t Count, size_t Index)
+{
+    for (;;) {
+        size_t Smallest = Index;
+        for (size_t Child = Index * 2 + 1; Child <= Index * 2 + 2 && Child < Count; Child++) {
+            if (Usage->Entries[Heap[Child]].AllocatedSize <
+                Usage->Entries[Heap[Smallest]].AllocatedSize) {
+                Smallest = Child;
+            }
+        }
+
+        if (Smallest == Index) {
+            break;
+        }
+
+        uint64_t Swap  = Heap[Index];
+        Heap[Index]    = Heap[Smallest];
+        Heap[Smallest] = Swap;
+        Index          = Smallest;
+    }
+}
+
+// Largest directories by allocated size, largest first. The output is a
+// min heap of the best so far while scanning, sorted in place at the end
+size_t NTFS_UsageTop(ntfs_usage *Usage, uint64_t *RecordIndexes, size_t Count)
+{
+    size_t Result = 0;
+
+    for (uint64_t Index = 0; Index < Usage->RecordCount && Count; Index++) {
+        ntfs_usage_entry *Entry = Usage->Entries + Index;
+        if (Entry->Dirs == 0) {
+            continue;
+        }
+
+        if (Result < Count) {
+            RecordIndexes[Result++] = Index;
+            if (Result == Count) {
+                for (size_t Node = Count / 2; Node-- > 0;) {
+                    NTFS__UsageSiftDown(Usage, RecordIndexes, Count, Node);
+                }
+            }
+        } else if (Entry->AllocatedSize > Usage->Entries[RecordIndexes[0]].AllocatedSize) {
+            RecordIndexes[0] = Index;
+            NTFS__UsageSiftDown(Usage, RecordIndexes, Count, 0);
+        }
+    }
+
+    if (Result < Count) {
+        for (size_t Node = Result / 2; Node-- > 0;) {
+            NTFS__UsageSiftDown(Usage, RecordIndexes, Result, Node);
+        }
+    }
+
+    for (size_t Last = Result; Last-- > 1;) {
+        uint64_t Swap       = RecordIndexes[0];
+        RecordIndexes[0]    = RecordIndexes[Last];
+        RecordIndexes[Last] = Swap;
+        NTFS__UsageSiftDown(Usage, RecordIndexes, Last, 0);
+    }
+
+    return Result;
+}
+
+// Duplicates API
+enum {
+    NTFS__DupeFlag_Complete = 0x01,
+    NTFS__DupeFlag_Failed   = 0x02,
+};
+
+typedef struct {
+    uint64_t Size;
+    uint64_t Key;
+    uint64_t FirstLCN;
+    uint64_t VolumeIndex;
+    uint64_t RecordIndex;
+    uint32_t Flags;
+    uint8_t  Digest[32];
+} ntfs__dupe;
+
+typedef struct {
+    ntfs_error   Error;
+    ntfs_volume *Volume;
+    void        *Provider;
+    ntfs__dupe  *Dupes;
+    size_t       Count;
+    size_t       Window;
+    bool         IsFull;
+
+    uint64_t Files;
+    uint64_t FailedFiles;
+    uint64_t BytesRead;
+} ntfs__dupe_job;
+
+// The partial hash covers the first window and the window holding the last
+// byte. Windows are a multiple of every cluster size, so identical files on
+// different volumes hash the same bytes
+static void NTFS__DupeHash(ntfs__dupe_job *Job, ntfs_volume *Volume, ntfs__dupe *Dupe,
+                           uint8_t *Buffer)
+{
+    ntfs_file File = NTFS_FileOpenFromIndex(Volume, Dupe->RecordIndex);
+    void     *Hash = NTFS__Win32HashCreate(Job->Provider);
+    bool      IsOk = File.Error == NTFS_Error_Success && Hash != 0;
+
+    uint64_t Size       = Dupe->Size;
+    bool     IsComplete = Job->IsFull || Size <= 2 * Job->Window;
+    uint64_t Ranges[2][2] = {
+        { 0, IsComplete ? Size : Job->Window },
+        { IsComplete ? Size : (Size - 1) / Job->Window * Job->Window, Size },
+    };
+
+    for (size_t Range = 0; Range < 2; Range++) {
+        for (uint64_t Offset = Ranges[Range][0]; IsOk && Offset < Ranges[Range][1];) {
+            size_t HashSize = NTFS_DUPES_BUFFER_SIZE;
+            if (HashSize > Ranges[Range][1] - Offset) {
+                HashSize = NTFS_CAST(size_t, Ranges[Range][1] - Offset);
+            }
+
+            size_t ReadSize = NTFS__Align(HashSize, Volume->BytesPerCluster);
+            size_t Read     = NTFS_FileRead(&File, Offset, Buffer, ReadSize);
+            IsOk            = File.Error == NTFS_Error_Success && Read >= HashSize &&
+                              NTFS__Win32HashUpdate(Hash, Buffer, HashSize);
+
+            Job->BytesRead += Read;
+            Offset         += HashSize;
+        }
+    }
+
+    uint8_t Digest[32] = { 0 };
+    if (Hash) {
+        IsOk &= NTFS__Win32HashFinish(Hash, Digest, sizeof(Digest));
+    }
+
+    if (IsOk) {
+        NTFS_MEM_COPY(Dupe->Digest, sizeof(Dupe->Digest), Digest, sizeof(Digest));
+        Dupe->Key    = *NTFS_CAST(uint64_t *, Digest);
+        Dupe->Flags |= IsComplete ? NTFS__DupeFlag_Complete : 0;
+    } else {
+        Dupe->Flags |= NTFS__DupeFlag_Failed;
+        Job->FailedFiles++;
+    }
+
+    Job->Files++;
+    NTFS_FileClose(&File);
+}
+
+static DWORD WINAPI NTFS__DupesHashThread(void *Param)
+{
+    ntfs__dupe_job *Job    = Param;
+    ntfs_volume    *Volume = Job->Volume;
+
+    // Readers fall back to the shared handle when it cannot be reopened
+    ntfs_context Context = NTFS_ContextCreate(Volume);
+    if (Context.Error == NTFS_Error_Success) {
+        Volume = &Context.Volume;
+    }
+
+    ntfs_arena Arena = NTFS__ArenaCreate(2 * NTFS_DUPES_BUFFER_SIZE, NTFS__ARENA_DEFAULT_COMMIT);
+    if (Arena.Buffer == 0) {
+        NTFS_RETURN(Job->Error, NTFS_Error_MemoryError);
+    }
+
+    uint8_t *Buffer = NTFS__ArenaAllocAligned(&Arena, NTFS_DUPES_BUFFER_SIZE, NTFS_DIRECT_ALIGNMENT);
+    for (size_t Index = 0; Index < Job->Count; Index++) {
+        ntfs__dupe *Dupe = Job->Dupes + Index;
+        if (!(Dupe->Flags & NTFS__DupeFlag_Complete)) {
+            NTFS__DupeHash(Job, Volume, Dupe, Buffer);
+        }
+    }
+
+skip:
+    if (Arena.Buffer) {
+        NTFS__ArenaDestroy(&Arena);
+    }
+
+    NTFS_ContextDestroy(&Context);
+    return 0;
+}
+
+// Reads of every volume run on their own thread in the order of the first
+// cluster of each file, so a disk is swept once instead of seeking per file
+static ntfs_error NTFS__DupesHashAll(ntfs_volume **Volumes, size_t VolumeCount, void *Provider,
+                                     ntfs__dupe *Dupes, ntfs__dupe *Scratch, size_t Count,
+                                     size_t Window, bool IsFull, ntfs_dupes *Result)
+{
+    ntfs_error     Error = NTFS_Error_Success;
+    ntfs__dupe_job Jobs[NTFS_DUPES_MAX_VOLUMES];
+    void          *Threads[NTFS_DUPES_MAX_VOLUMES];
+
+    NTFS__RadixSortParallel(Dupes, Scratch, Count, sizeof(*Dupes),
+                            offsetof(ntfs__dupe, FirstLCN), NTFS__Win32ProcessorCount());
+    NTFS__RadixSort(Dupes, Scratch, Count, sizeof(*Dupes), offsetof(ntfs__dupe, VolumeIndex));
+
+    size_t Begin = 0;
+    for (size_t Index = 0; Index < VolumeCount; Index++) {
+        size_t End = Begin;
+        while (End < Count && Dupes[End].VolumeIndex == Index) {
+            End++;
+        }
+
+        Jobs[Index] = (ntfs__dupe_job) {
+            .Volume   = Volumes[Index],
+            .Provider = Provider,
+            .Dupes    = Dupes + Begin,
+            .Count    = End - Begin,
+            .Window   = Window,
+            .IsFull   = IsFull,
+        };
+
+        Threads[Index] = 0;
+        if (Jobs[Index].Count) {
+            Threads[Index] = NTFS__Win32ThreadCreate(NTFS__DupesHashThread, Jobs + Index);
+            if (Threads[Index] == 0) {
+                NTFS__DupesHashThread(Jobs + Index);
+            }
+        }
+
+        Begin = End;
+    }
+
+    for (size_t Index = 0; Index < VolumeCount; Index++) {
+        if (Threads[Index]) {
+            NTFS__Win32ThreadJoin(Threads[Index]);
+        }
+
+        if (Jobs[Index].Error) {
+            Error = Jobs[Index].Error;
+        }
+
+        if (IsFull) {
+            Result->FullFiles += Jobs[Index].Files;
+        } else {
+            Result->PartialFiles += Jobs[Index].Files;
+        }
+
+        Result->FailedFiles += Jobs[Index].FailedFiles;
+        Result->BytesRead   += Jobs[Index].BytesRead;
+    }
+
+    return Error;
+}
+
+static bool NTFS__DupesEqual(ntfs__dupe *Left, ntfs__dupe *Right, bool IsHashed)
+{
+    bool Result = Left->Size == Right->Size;
+    if (IsHashed) {
+        Result = Result && NTFS_MEM_COMPARE(Left->Digest, Right->Digest, sizeof(Left->Digest)) == 0;
+    }
+
+    return Result;
+}
+
+// Keeps the files that share their size, or their size and digest once
+// hashed, with another file. Sorting by key then size leaves equal digests
+// apart only when two digests share a key, so every run of a key is ordered
+// by the whole digest first
+static size_t NTFS__DupesKeep(ntfs__dupe *Dupes, ntfs__dupe *Scratch, size_t Count, bool IsHashed)
+{
+    size_t Result = 0;
+
+    if (IsHashed) {
+        size_t Hashed = 0;
+        for (size_t Index = 0; Index < Count; Index++) {
+            if (!(Dupes[Index].Flags & NTFS__DupeFlag_Failed)) {
+                Dupes[Hashed++] = Dupes[Index];
+            }
+        }
+
+        Count = Hashed;
+        NTFS__RadixSortParallel(Dupes, Scratch, Count, sizeof(*Dupes),
+                                offsetof(ntfs__dupe, Key), NTFS__Win32ProcessorCount());
+    }
+
+    NTFS__RadixSortParallel(Dupes, Scratch, Count, sizeof(*Dupes),
+                            offsetof(ntfs__dupe, Size), NTFS__Win32ProcessorCount());
+
+    for (size_t Begin = 0, End = 0; Begin < Count; Begin = End) {
+        End = Begin + 1;
+        while (End < Count && Dupes[End].Size == Dupes[Begin].Size &&
+               (!IsHashed || Dupes[End].Key == Dupes[Begin].Key)) {
+            End++;
+        }
+
+        for (size_t Index = Begin + 1; IsHashed && Index < End; Index++) {
+            ntfs__dupe Dupe = Dupes[Index];
+            size_t     Slot = Index;
+            while (Slot > Begin &&
+                   NTFS_MEM_COMPARE(Dupes[Slot - 1].Digest, Dupe.Digest, sizeof(Dupe.Digest)) > 0) {
+                Dupes[Slot] = Dupes[Slot - 1];
+                Slot--;
+            }
+
+            Dupes[Slot] = Dupe;
+        }
+
+        for (size_t Run = Begin, RunEnd = Begin; Run < End; Run = RunEnd) {
+            RunEnd = Run + 1;
+            while (RunEnd < End && NTFS__DupesEqual(Dupes + Run, Dupes + RunEnd, IsHashed)) {
+                RunEnd++;
+            }
+
+            for (size_t Index = Run; RunEnd - Run > 1 && Index < RunEnd; Index++) {
+                Dupes[Result++] = Dupes[Index];
+            }
+        }
+    }
+
+    return Result;
+}
+
+ntfs_dupes NTFS_DupesFind(ntfs_volume **Volumes, size_t VolumeCount, uint64_t MinSize)
+{
+    ntfs_dupes Result = {
+        .Arena = NTFS__ArenaCreate(NTFS_DUPES_RESERVED, NTFS__ARENA_DEFAULT_COMMIT),
+    };
+    ntfs_arena  Temp     = NTFS__ArenaCreate(NTFS_DUPES_RESERVED, NTFS__ARENA_DEFAULT_COMMIT);
+    ntfs_arena  Runs     = NTFS__ArenaDefault();
+    void       *Provider = NTFS__Win32HashProviderOpen(2);  // SHA-256
+    ntfs__dupe *Dupes    = 0;
+    size_t      Window   = 0;
+
+    if (VolumeCount > NTFS_DUPES_MAX_VOLUMES) {
+        NTFS_RETURN(Result.Error, NTFS_Error_DupesTooManyVolumes);
+    }
+
+    if (Result.Arena.Buffer == 0 || Temp.Buffer == 0 || Runs.Buffer == 0) {
+        NTFS_RETURN(Result.Error, NTFS_Error_MemoryError);
+    }
+
+    if (Provider == 0) {
+        NTFS_RETURN(Result.Error, NTFS_Error_HashFailedInit);
+    }
+
+    // Empty files are all equal and never worth reporting
+    if (MinSize == 0) {
+        MinSize = 1;
+    }
+
+    for (size_t VolumeIndex = 0; VolumeIndex < VolumeCount; VolumeIndex++) {
+        ntfs_volume *Volume = Volumes[VolumeIndex];
+        if (Window < Volume->BytesPerCluster) {
+            Window = Volume->BytesPerCluster;
+        }
+
+        ntfs_mft_scan Scan = NTFS_MftScanBegin(Volume);
+        Scan.HeadersOnly   = true;
+        ntfs_record Record = { 0 };
+        while (!Scan.Error && NTFS_MftScanNext(&Scan, &Record)) {
+            if (Record.BaseIndex < NTFS_DUPES_FIRST_RECORD || Record.IsDir) {
+                continue;
+            }
+
+            // The unnamed data of WOF compressed files is sparse, their
+            // first cluster is taken from the compressed stream instead
+            ntfs__dupe Dupe = {
+                .FirstLCN    = UINT64_MAX,
+                .VolumeIndex = VolumeIndex,
+                .RecordIndex = Record.BaseIndex,
+            };
+            uint64_t StreamLCN   = UINT64_MAX;
+            bool     HasData     = false;
+            bool     IsSupported = true;
+
+            ntfs_attr        Attr   = { 0 };
+            ntfs_attr_cursor Cursor = NTFS_AttrCursorBegin(Volume, &Record);
+            while (NTFS_AttrCursorNext(&Cursor, NTFS_AttributeType_Data, &Attr)) {
+                if (Attr.NonResFlag && Attr.NonResident.FirstVCN != 0) {
+                    continue;
+                }
+
+                uint64_t       LCN     = Attr.NonResFlag ? UINT64_MAX : 0;
+                ntfs_data_run *RunList = NTFS_AttrCursorRuns(&Cursor, &Runs);
+                for (size_t Index = 0; Index < NTFS__ListLen(RunList); Index++) {
+                    if (!RunList[Index].IsSparse) {
+                        LCN = RunList[Index].StartVCN;
+                        break;
+                    }
+                }
+
+                if (!Attr.Name) {
+                    HasData       = true;
+                    Dupe.Size     = Attr.NonResFlag ? Attr.NonResident.Size : Attr.Resident.Size;
+                    Dupe.FirstLCN = LCN;
+                    IsSupported   = !(Attr.Flags & (NTFS_AttributeFlag_Compressed |
+                                                    NTFS_AttributeFlag_Encrypted));
+                } else if (StreamLCN == UINT64_MAX) {
+                    StreamLCN = LCN;
+                }
+            }
+            NTFS__ArenaReset(&Runs);
+
+            if (!HasData || !IsSupported || Dupe.Size < MinSize) {
+                continue;
+            }
+
+            if (Dupe.FirstLCN == UINT64_MAX) {
+                Dupe.FirstLCN = StreamLCN;
+            }
+
+            Result.Files++;
+            Result.TotalBytes += Dupe.Size;
+            NTFS__ListPush(&Temp, Dupes, Dupe);
+        }
+
+        ntfs_error Error = Scan.Error;
+        NTFS_MftScanEnd(&Scan);
+        if (Error) {
+            NTFS_RETURN(Result.Error, Error);
+        }
+    }
+
+    // Files of a unique size are dropped before any data is read, files
+    // still colliding on the partial hash are the only ones read in full
+    size_t      Count   = NTFS__ListLen(Dupes);
+    ntfs__dupe *Scratch = NTFS__ArenaAlloc(&Temp, (Count + 1) * sizeof(*Dupes));
+    Count = NTFS__DupesKeep(Dupes, Scratch, Count, false);
+
+    Result.Error = NTFS__DupesHashAll(Volumes, VolumeCount, Provider, Dupes, Scratch, Count,
+                                      Window, false, &Result);
+    if (Result.Error) {
+        goto skip;
+    }
+    Count = NTFS__DupesKeep(Dupes, Scratch, Count, true);
+
+    Result.Error = NTFS__DupesHashAll(Volumes, VolumeCount, Provider, Dupes, Scratch, Count,
+                                      Window, true, &Result);
+    if (Result.Error) {
+        goto skip;
+    }
+    Count = NTFS__DupesKeep(Dupes, Scratch, Count, true);
+
+    ntfs_dupe_file *Files = NTFS__ArenaAlloc(&Result.Arena, (Count + 1) * sizeof(*Files));
+    for (size_t End = Count, Begin = Count; End > 0; End = Begin) {
+        Begin = End - 1;
+        while (Begin > 0 && NTFS__DupesEqual(Dupes + Begin - 1, Dupes + End - 1, true)) {
+            Begin--;
+        }
+
+        ntfs_dupe_group Group = {
+            .Size      = Dupes[Begin].Size,
+            .Files     = Files,
+            .FileCount = End - Begin,
+        };
+        NTFS_MEM_COPY(Group.Sha256, sizeof(Group.Sha256), Dupes[Begin].Digest,
+                      sizeof(Dupes[Begin].Digest));
+
+        for (size_t Index = Begin; Index < End; Index++) {
+            *Files++ = (ntfs_dupe_file) {
+                .VolumeIndex = NTFS_CAST(uint32_t, Dupes[Index].VolumeIndex),
+                .RecordIndex = Dupes[Index].RecordIndex,
+            };
+        }
+
+        NTFS__ListPush(&Result.Arena, Result.Groups, Group);
+    }
+    Result.GroupCount = NTFS__ListLen(Result.Groups);
+
+skip:
+    if (Provider) {
+        NTFS__Win32HashProviderClose(Provider);
+    }
+    if (Temp.Buffer) {
+        NTFS__ArenaDestroy(&Temp);
+    }
+    if (Runs.Buffer) {
+        NTFS__ArenaDestroy(&Runs);
+    }
+
+    return Result;
+}
+
+void NTFS_DupesDestroy(ntfs_dupes *Dupes)
+{
+    if (Dupes->Arena.Buffer) {
+        NTFS__ArenaDestroy(&Dupes->Arena);
+    }
+
+    *Dupes = (ntfs_dupes) { .Error = Dupes->Error };
+}
+
+// Check API
+enum {
+    NTFS__CheckFlag_InUse   = 0x01,
+    NTFS__CheckFlag_Dir     = 0x02,
+    NTFS__CheckFlag_HasName = 0x04,
+};
+
+enum {
+    NTFS__CheckRef_Base,
+    NTFS__CheckRef_Parent,
+};
+
+typedef struct {
+    uint64_t RecordIndex;
+    uint64_t TargetIndex;
+    uint16_t TargetSequence;
+    uint8_t  Type;
+} ntfs__check_ref;
+
+typedef struct {
+    ntfs_volume         *Volume;
+    ntfs_check_callback *Callback;
+    void                *Context;
+    ntfs_check_summary   Summary;
+
+    // Clusters claimed by any run list, one bit each, set atomically
+    uint64_t *Claimed;
+    uint16_t *Sequences;
+    uint8_t  *Flags;
+    uint64_t  RecordCount;
+} ntfs__check;
+
+typedef struct {
+    ntfs__check     *Check;
+    ntfs_error       Error;
+    ntfs_arena       Arena;
+    ntfs__check_ref *Refs;
+
+    uint64_t RecordBegin;
+    uint64_t RecordEnd;
+    uint64_t LCNBegin;
+    uint64_t LCNEnd;
+    uint64_t Records;
+    uint64_t Clusters;
+} ntfs__check_worker;
+
+static void NTFS__CheckReport(ntfs__check *Check, ntfs_check_issue *Issue)
+{
+    InterlockedIncrement64(NTFS_CAST(volatile LONG64 *, Check->Summary.Issues + Issue->Type));
+    if (Check->Callback) {
+        Check->Callback(Check->Context, Issue);
+    }
+}
+
+static void NTFS__CheckFlush(ntfs__check *Check, ntfs_check_issue *Pending)
+{
+    if (Pending->Count) {
+        NTFS__CheckReport(Check, Pending);
+        Pending->Count = 0;
+    }
+}
+
+// Set bits of a word starting at LCN extend the pending range, which is
+// reported once the next range does not continue it
+static void NTFS__CheckRanges(ntfs__check *Check, ntfs_check_issue *Pending, uint64_t LCN,
+                              uint64_t Bits)
+{
+    while (Bits) {
+        uint64_t First  = NTFS__CountTrailingZeros64(Bits);
+        uint64_t Run    = Bits >> First;
+        uint64_t Length = Run == UINT64_MAX ? 64 : NTFS__CountTrailingZeros64(~Run);
+        if (Pending->Count && Pending->LCN + Pending->Count == LCN + First) {
+            Pending->Count += Length;
+        } else {
+            NTFS__CheckFlush(Check, Pending);
+            Pending->LCN   = LCN + First;
+            Pending->Count = Length;
+        }
+
+        Bits = First + Length >= 64 ? 0 : Bits & (UINT64_MAX << (First + Length));
+    }
+}
+
+// Every word of a run is claimed with one atomic or, bits that were set
+// before belong to another run and are cross linked
+static void NTFS__CheckClaim(ntfs__check *Check, uint64_t RecordIndex, uint64_t LCN,
+                             uint64_t Count)
+{
+    uint64_t TotalClusters = Check->Volume->TotalClusters;
+    if (LCN >= TotalClusters || Count > TotalClusters - LCN) {
+        ntfs_check_issue Issue = {
+            .Type        = NTFS_CheckIssue_ClusterOutOfBounds,
+            .RecordIndex = RecordIndex,
+            .TargetIndex = RecordIndex,
+            .LCN         = LCN,
+            .Count       = Count,
+        };
+        NTFS__CheckReport(Check, &Issue);
+        Count = LCN < TotalClusters ? TotalClusters - LCN : 0;
+    }
+
+    ntfs_check_issue Pending = {
+        .Type        = NTFS_CheckIssue_ClusterCrossLinked,
+        .RecordIndex = RecordIndex,
+        .TargetIndex = RecordIndex,
+    };
+    for (uint64_t End = LCN + Count; LCN < End;) {
+        uint64_t Bit  = LCN % 64;
+        uint64_t Bits = End - LCN < 64 - Bit ? End - LCN : 64 - Bit;
+        uint64_t Mask = (UINT64_MAX >> (64 - Bits)) << Bit;
+        uint64_t Old  = InterlockedOr64(NTFS_CAST(volatile LONG64 *, Check->Claimed + LCN / 64),
+                                        NTFS_CAST(LONG64, Mask));
+
+        NTFS__CheckRanges(Check, &Pending, LCN - Bit, Old & Mask);
+        LCN += Bits;
+    }
+    NTFS__CheckFlush(Check, &Pending);
+}
+
+// The mirror keeps the first records as they were last written to the MFT,
+// both are compared raw so a stale update sequence is caught as well
+static void NTFS__CheckMirror(ntfs__check *Check, ntfs_arena *Arena)
+{
+    ntfs_volume *Volume     = Check->Volume;
+    ntfs_file    Mft        = NTFS_FileOpenFromIndex(Volume, NTFS_SystemFile_Mft);
+    ntfs_file    Mirror     = NTFS_FileOpenFromIndex(Volume, NTFS_SystemFile_MftMirror);
+    size_t       RecordSize = Volume->BytesPerMftEntry;
+    size_t       Size       = NTFS__Align(NTFS_CHECK_MIRROR_RECORDS * RecordSize,
+                                          Volume->BytesPerCluster);
+
+    uint8_t *Records    = NTFS__ArenaAllocAligned(Arena, Size, NTFS_DIRECT_ALIGNMENT);
+    uint8_t *Copies     = NTFS__ArenaAllocAligned(Arena, Size, NTFS_DIRECT_ALIGNMENT);
+    size_t   RecordsEnd = 0;
+    size_t   CopiesEnd  = 0;
+    if (Mft.Error == NTFS_Error_Success) {
+        RecordsEnd = NTFS_FileRead(&Mft, 0, Records,
+                                   Size < Mft.AlignedSize ? Size : Mft.AlignedSize);
+        RecordsEnd = Mft.Error ? 0 : RecordsEnd;
+    }
+    if (Mirror.Error == NTFS_Error_Success) {
+        CopiesEnd = NTFS_FileRead(&Mirror, 0, Copies,
+                                  Size < Mirror.AlignedSize ? Size : Mirror.AlignedSize);
+        CopiesEnd = Mirror.Error ? 0 : CopiesEnd;
+    }
+
+    for (size_t Index = 0; Index < NTFS_CHECK_MIRROR_RECORDS; Index++) {
+        size_t End     = (Index + 1) * RecordSize;
+        bool   IsEqual = End <= RecordsEnd && End <= CopiesEnd;
+        IsEqual        = IsEqual && NTFS_MEM_COMPARE(Records + Index * RecordSize,
+                                                     Copies + Index * RecordSize, RecordSize) == 0;
+        if (!IsEqual) {
+            ntfs_check_issue Issue = {
+                .Type        = NTFS_CheckIssue_MirrorMismatch,
+                .RecordIndex = Index,
+                .TargetIndex = Index,
+            };
+            NTFS__CheckReport(Check, &Issue);
+        }
+    }
+
+    NTFS_FileClose(&Mft);
+    NTFS_FileClose(&Mirror);
+}
+
+static DWORD WINAPI NTFS__CheckRecordsThread(void *Param)
+{
+    ntfs__check_worker *Worker = Param;
+    ntfs__check        *Check  = Worker->Check;
+    ntfs_volume        *Volume = Check->Volume;
+
+    // Readers fall back to the shared handle when it cannot be reopened
+    ntfs_context Context = NTFS_ContextCreate(Volume);
+    if (Context.Error == NTFS_Error_Success) {
+        Volume = &Context.Volume;
+    }
+
+    ntfs_arena    Runs = NTFS__ArenaDefault();
+    ntfs_mft_scan Scan = NTFS_MftScanBegin(Volume);
+    if (Runs.Buffer == 0) {
+        NTFS_RETURN(Worker->Error, NTFS_Error_MemoryError);
+    }
+
+    if (Scan.Error) {
+        NTFS_RETURN(Worker->Error, Scan.Error);
+    }
+
+    Scan.HeadersOnly   = true;
+    Scan.NextIndex     = Worker->RecordBegin;
+    Scan.RecordCount   = Worker->RecordEnd;
+    ntfs_record Record = { 0 };
+    while (NTFS_MftScanNext(&Scan, &Record)) {
+        Worker->Records++;
+
+        // Base references keep the sequence the base record had when the
+        // extension was written
+        if (Record.Index == Record.BaseIndex) {
+            Check->Flags[Record.Index]     = NTFS__CheckFlag_InUse |
+                                             (Record.IsDir ? NTFS__CheckFlag_Dir : 0);
+            Check->Sequences[Record.Index] = *NTFS_CAST(uint16_t *, Record.Buffer + 0x10);
+        } else {
+            ntfs__check_ref Ref = {
+                .RecordIndex    = Record.Index,
+                .TargetIndex    = Record.BaseIndex,
+                .TargetSequence = *NTFS_CAST(uint16_t *, Record.Buffer + 0x26),
+                .Type           = NTFS__CheckRef_Base,
+            };
+            NTFS__ListPush(&Worker->Arena, Worker->Refs, Ref);
+        }
+
+        ntfs_attr        Attr   = { 0 };
+        ntfs_attr_cursor Cursor = NTFS_AttrCursorBegin(Volume, &Record);
+        while (NTFS_AttrCursorNext(&Cursor, 0, &Attr)) {
+            ntfs_file_name FileName = { 0 };
+            if (Attr.Type == NTFS_AttributeType_FileName && NTFS__FileNameParse(&Attr, &FileName)) {
+                ntfs__check_ref Ref = {
+                    .RecordIndex    = Record.BaseIndex,
+                    .TargetIndex    = FileName.ParentIndex,
+                    .TargetSequence = FileName.ParentSequence,
+                    .Type           = NTFS__CheckRef_Parent,
+                };
+                NTFS__ListPush(&Worker->Arena, Worker->Refs, Ref);
+
+            } else if (Attr.NonResFlag) {
+                ntfs_data_run *RunList = NTFS_AttrCursorRuns(&Cursor, &Runs);
+                for (size_t Index = 0; Index < NTFS__ListLen(RunList); Index++) {
+                    ntfs_data_run *Run = RunList + Index;
+                    if (!Run->IsSparse && Run->Count) {
+                        NTFS__CheckClaim(Check, Record.BaseIndex, Run->StartVCN, Run->Count);
+                        Worker->Clusters += Run->Count;
+                    }
+                }
+            }
+        }
+        NTFS__ArenaReset(&Runs);
+    }
+
+    if (Scan.Error) {
+        Worker->Error = Scan.Error;
+    }
+
+skip:
+    NTFS_MftScanEnd(&Scan);
+    if (Runs.Buffer) {
+        NTFS__ArenaDestroy(&Runs);
+    }
+
+    NTFS_ContextDestroy(&Context);
+    return 0;
+}
+
+static DWORD WINAPI NTFS__CheckClustersThread(void *Param)
+{
+    ntfs__check_worker *Worker = Param;
+    ntfs__check        *Check  = Worker->Check;
+    ntfs_volume        *Volume = Check->Volume;
+
+    // Record tables are complete once every record worker is done, the
+    // references found by this worker are checked against them
+    for (size_t Index = 0; Index < NTFS__ListLen(Worker->Refs); Index++) {
+        ntfs__check_ref *Ref   = Worker->Refs + Index;
+        uint8_t          Flags = Ref->TargetIndex < Check->RecordCount
+                                     ? Check->Flags[Ref->TargetIndex] : 0;
+
+        bool IsValid = (Flags & NTFS__CheckFlag_InUse) &&
+                       Check->Sequences[Ref->TargetIndex] == Ref->TargetSequence;
+        if (Ref->Type == NTFS__CheckRef_Parent) {
+            IsValid = IsValid && (Flags & NTFS__CheckFlag_Dir);
+        }
+
+        if (!IsValid) {
+            ntfs_check_issue Issue = {
+                .Type        = Ref->Type == NTFS__CheckRef_Parent ? NTFS_CheckIssue_DanglingParent
+                                                                  : NTFS_CheckIssue_OrphanRecord,
+                .RecordIndex = Ref->RecordIndex,
+                .TargetIndex = Ref->TargetIndex,
+            };
+            NTFS__CheckReport(Check, &Issue);
+        }
+    }
+
+    for (uint64_t Index = Worker->RecordBegin; Index < Worker->RecordEnd; Index++) {
+        if ((Check->Flags[Index] & (NTFS__CheckFlag_InUse | NTFS__CheckFlag_HasName)) ==
+            NTFS__CheckFlag_InUse) {
+            ntfs_check_issue Issue = {
+                .Type        = NTFS_CheckIssue_OrphanRecord,
+                .RecordIndex = Index,
+                .TargetIndex = Index,
+            };
+            NTFS__CheckReport(Check, &Issue);
+        }
+    }
+
+    if (Worker->LCNBegin >= Worker->LCNEnd) {
+        return 0;
+    }
+
+    ntfs_context Context = NTFS_ContextCreate(Volume);
+    if (Context.Error == NTFS_Error_Success) {
+        Volume = &Context.Volume;
+    }
+
+    // Each worker owns whole bitmap windows, so the claimed words it reads
+    // were all written before the record phase ended
+    ntfs_check_issue NotAllocated = { .Type = NTFS_CheckIssue_ClusterNotAllocated };
+    ntfs_check_issue Leaked       = { .Type = NTFS_CheckIssue_ClusterLeaked };
+    ntfs_bitmap      Bitmap       = NTFS_BitmapOpen(Volume);
+    if (Bitmap.Error) {
+        NTFS_RETURN(Worker->Error, Bitmap.Error);
+    }
+
+    for (uint64_t LCN = Worker->LCNBegin; LCN < Worker->LCNEnd;) {
+        if (!NTFS__BitmapLoadWindow(&Bitmap, LCN)) {
+            NTFS_RETURN(Worker->Error, Bitmap.Error ? Bitmap.Error : NTFS_Error_BitmapFailedRead);
+        }
+
+        uint64_t *Words = NTFS_CAST(uint64_t *, Bitmap.Window);
+        uint64_t  End   = Bitmap.WindowLCN + Bitmap.WindowClusters;
+        if (End > Worker->LCNEnd) {
+            End = Worker->LCNEnd;
+        }
+
+        for (; LCN < End; LCN += 64) {
+            uint64_t Marked  = Words[(LCN - Bitmap.WindowLCN) / 64];
+            uint64_t Claimed = Check->Claimed[LCN / 64];
+            uint64_t Valid   = End - LCN < 64 ? UINT64_MAX >> (64 - (End - LCN)) : UINT64_MAX;
+
+            NTFS__CheckRanges(Check, &NotAllocated, LCN, Claimed & ~Marked & Valid);
+            NTFS__CheckRanges(Check, &Leaked, LCN, Marked & ~Claimed & Valid);
+        }
+
+        if (Bitmap.WindowClusters == 0) {
+            break;
+        }
+    }
+
+    NTFS__CheckFlush(Check, &NotAllocated);
+    NTFS__CheckFlush(Check, &Leaked);
+
+skip:
+    NTFS_BitmapClose(&Bitmap);
+    NTFS_ContextDestroy(&Context);
+    return 0;
+}
+
+static void NTFS__CheckPhase(ntfs__check_worker *Workers, uint32_t WorkerCount,
+                             LPTHREAD_START_ROUTINE Proc)
+{
+    void *Threads[64];
+    for (uint32_t Index = 0; Index < WorkerCount; Index++) {
+        Threads[Index] = NTFS__Win32ThreadCreate(Proc, Workers + Index);
+        if (Threads[Index] == 0) {
+            Proc(Workers + Index);
+        }
+    }
+
+    for (uint32_t Index = 0; Index < WorkerCount; Index++) {
+        if (Threads[Index]) {
+            NTFS__Win32ThreadJoin(Threads[Index]);
+        }
+    }
+}
+
+// Workers first sweep a range of MFT records each, claiming the clusters of
+// every run list in a shared bitmap, then each owns a range of clusters to
+// compare against $Bitmap while checking the references it collected
+ntfs_check_summary NTFS_VolumeCheck(ntfs_volume *Volume, ntfs_check_callback *Callback,
+                                    void *Context)
+{
+    ntfs__check Check = {
+        .Volume   = Volume,
+        .Callback = Callback,
+        .Context  = Context,
+    };
+    ntfs_arena         Arena = NTFS__ArenaCreate(NTFS_CHECK_RESERVED, NTFS__ARENA_DEFAULT_COMMIT);
+    ntfs__check_worker Workers[64] = { 0 };
+    uint32_t           WorkerCount = NTFS__Win32ProcessorCount();
+    if (WorkerCount > 64) {
+        WorkerCount = 64;
+    }
+    if (WorkerCount == 0) {
+        WorkerCount = 1;
+    }
+
+    for (uint32_t Index = 0; Index < WorkerCount; Index++) {
+        Workers[Index] = (ntfs__check_worker) {
+            .Check = &Check,
+            .Arena = NTFS__ArenaCreate(NTFS_CHECK_RESERVED, NTFS__ARENA_DEFAULT_COMMIT),
+        };
+        if (Workers[Index].Arena.Buffer == 0) {
+            NTFS_RETURN(Check.Summary.Error, NTFS_Error_MemoryError);
+        }
+    }
+
+    if (Arena.Buffer == 0) {
+        NTFS_RETURN(Check.Summary.Error, NTFS_Error_MemoryError);
+    }
+
+    NTFS__CheckMirror(&Check, &Arena);
+
+    uint64_t Count    = Volume->MftRecordCount;
+    uint64_t Words    = (Volume->TotalClusters + 63) / 64;
+    Check.RecordCount = Count;
+    Check.Flags       = NTFS__ArenaAlloc(&Arena, Count * sizeof(*Check.Flags));
+    Check.Sequences   = NTFS__ArenaAlloc(&Arena, Count * sizeof(*Check.Sequences));
+    Check.Claimed     = NTFS__ArenaAlloc(&Arena, Words * sizeof(*Check.Claimed));
+    NTFS_MEM_SET(Check.Flags, 0, Count * sizeof(*Check.Flags));
+    NTFS_MEM_SET(Check.Claimed, 0, Words * sizeof(*Check.Claimed));
+
+    // Record ranges follow the scan buffer and cluster ranges the bitmap
+    // window, so no two workers read the same chunk
+    uint64_t ScanRecords = NTFS__Align(NTFS_MFT_SCAN_BUFFER_SIZE, Volume->BytesPerCluster) /
+                           Volume->BytesPerMftEntry;
+    uint64_t WindowBits  = NTFS__Align(NTFS_BITMAP_WINDOW_SIZE, Volume->BytesPerCluster) * 8;
+    uint64_t RecordStep  = NTFS__Align(Count / WorkerCount + 1, ScanRecords);
+    uint64_t ClusterStep = NTFS__Align(Volume->TotalClusters / WorkerCount + 1, WindowBits);
+    for (uint32_t Index = 0; Index < WorkerCount; Index++) {
+        ntfs__check_worker *Worker = Workers + Index;
+        Worker->RecordBegin = Index * RecordStep < Count ? Index * RecordStep : Count;
+        Worker->RecordEnd   = Worker->RecordBegin + RecordStep < Count
+                                  ? Worker->RecordBegin + RecordStep : Count;
+        Worker->LCNBegin    = Index * ClusterStep < Volume->TotalClusters
+                                  ? Index * ClusterStep : Volume->TotalClusters;
+        Worker->LCNEnd      = Worker->LCNBegin + ClusterStep < Volume->TotalClusters
+                                  ? Worker->LCNBegin + ClusterStep : Volume->TotalClusters;
+    }
+
+    NTFS__CheckPhase(Workers, WorkerCount, NTFS__CheckRecordsThread);
+    for (uint32_t Index = 0; Index < WorkerCount; Index++) {
+        ntfs__check_worker *Worker = Workers + Index;
+        if (Worker->Error) {
+            NTFS_RETURN(Check.Summary.Error, Worker->Error);
+        }
+
+        Check.Summary.Records  += Worker->Records;
+        Check.Summary.Clusters += Worker->Clusters;
+        for (size_t Ref = 0; Ref < NTFS__ListLen(Worker->Refs); Ref++) {
+            if (Worker->Refs[Ref].Type == NTFS__CheckRef_Parent &&
+                Worker->Refs[Ref].RecordIndex < Count) {
+                Check.Flags[Worker->Refs[Ref].RecordIndex] |= NTFS__CheckFlag_HasName;
+            }
+        }
+    }
+
+    NTFS__CheckPhase(Workers, WorkerCount, NTFS__CheckClustersThread);
+    for (uint32_t Index = 0; Index < WorkerCount; Index++) {
+        if (Workers[Index].Error) {
+            NTFS_RETURN(Check.Summary.Error, Workers[Index].Error);
+        }
+    }
+
+skip:
+    for (uint32_t Index = 0; Index < WorkerCount; Index++) {
+        if (Workers[Index].Arena.Buffer) {
+            NTFS__ArenaDestroy(&Workers[Index].Arena);
+        }
+    }
+    if (Arena.Buffer) {
+        NTFS__ArenaDestroy(&Arena);
+    }
+
+    return Check.Summary;
+}
+
+// Match API
+enum {
+    NTFS__MatchSet_First,
+    NTFS__MatchSet_Second,
+    NTFS__MatchSet_Single,
+};
+
+typedef struct {
+    ntfs_volume         *Volume;
+    ntfs_matcher        *Matcher;
+    ntfs_owner_map      *Map;
+    ntfs_match_callback *Callback;
+    void                *Context;
+    ntfs_match_summary  *Summary;
+
+    // Resident hits are filled from the record, cluster hits from the
+    // volume offset of the scanned data
+    ntfs_match_hit Hit;
+    ntfs_record   *Record;
+    uint64_t       Base;
+} ntfs__match_state;
+
+ntfs_matcher NTFS_MatcherCreate(ntfs_pattern *Patterns, size_t Count)
+{
+    ntfs_matcher Result = {
+        .Arena        = NTFS__ArenaCreate(NTFS_MATCH_RESERVED, NTFS__ARENA_DEFAULT_COMMIT),
+        .PatternCount = Count,
+    };
+
+    if (Result.Arena.Buffer == 0) {
+        NTFS_RETURN(Result.Error, NTFS_Error_MemoryError);
+    }
+
+    size_t PairCount = 65536;
+    Result.Patterns    = NTFS__ArenaAlloc(&Result.Arena, Count * sizeof(*Result.Patterns));
+    Result.PairStart   = NTFS__ArenaAlloc(&Result.Arena, (PairCount + 1) * sizeof(uint32_t));
+    Result.PairOrder   = NTFS__ArenaAlloc(&Result.Arena, Count * sizeof(uint32_t));
+    Result.SingleOrder = NTFS__ArenaAlloc(&Result.Arena, Count * sizeof(uint32_t));
+    NTFS_MEM_SET(Result.PairStart, 0, (PairCount + 1) * sizeof(uint32_t));
+
+    // Buckets are counted first, the prefix sums end each bucket and
+    // filling them backwards leaves every sum at the start of its bucket
+    for (size_t Index = 0; Index < Count; Index++) {
+        ntfs_pattern *Pattern = Patterns + Index;
+        if (Pattern->Size == 0 || Pattern->Size > NTFS_MATCH_MAX_PATTERN_SIZE) {
+            NTFS_RETURN(Result.Error, NTFS_Error_MatchInvalidPattern);
+        }
+
+        uint8_t *Data = NTFS__ArenaAlloc(&Result.Arena, Pattern->Size);
+        NTFS_MEM_COPY(Data, Pattern->Size, Pattern->Data, Pattern->Size);
+        Result.Patterns[Index] = (ntfs_pattern) { .Data = Data, .Size = Pattern->Size };
+        if (Result.MaxSize < Pattern->Size) {
+            Result.MaxSize = Pattern->Size;
+        }
+
+        if (Pattern->Size == 1) {
+            Result.Bytes[Data[0]] |= 1 << NTFS__MatchSet_Single;
+            Result.SingleStart[Data[0]]++;
+        } else {
+            uint16_t Pair = NTFS_CAST(uint16_t, Data[0] | Data[1] << 8);
+            Result.Bytes[Data[0]] |= 1 << NTFS__MatchSet_First;
+            Result.Bytes[Data[1]] |= 1 << NTFS__MatchSet_Second;
+            Result.Pairs[Pair / 64] |= NTFS_CAST(uint64_t, 1) << (Pair % 64);
+            Result.PairStart[Pair]++;
+        }
+    }
+
+    for (size_t Index = 1; Index <= PairCount; Index++) {
+        Result.PairStart[Index] += Result.PairStart[Index - 1];
+    }
+    for (size_t Index = 1; Index <= 256; Index++) {
+        Result.SingleStart[Index] += Result.SingleStart[Index - 1];
+    }
+
+    for (size_t Index = Count; Index-- > 0;) {
+        uint8_t *Data = Result.Patterns[Index].Data;
+        if (Result.Patterns[Index].Size == 1) {
+            Result.SingleOrder[--Result.SingleStart[Data[0]]] = NTFS_CAST(uint32_t, Index);
+        } else {
+            uint16_t Pair = NTFS_CAST(uint16_t, Data[0] | Data[1] << 8);
+            Result.PairOrder[--Result.PairStart[Pair]] = NTFS_CAST(uint32_t, Index);
+        }
+    }
+
+    // Membership of a byte is looked up by its low nibble, in the first
+    // table when its high bit is clear, as the bit of the rest of the high
+    // nibble
+    for (size_t Byte = 0; Byte < 256; Byte++) {
+        for (size_t Set = 0; Set < 3; Set++) {
+            if (Result.Bytes[Byte] & (1 << Set)) {
+                Result.Sets[Set][Byte >> 7][Byte & 0x0F] |= NTFS_CAST(uint8_t, 1 << ((Byte >> 4) & 7));
+            }
+        }
+    }
+
+skip:
+    return Result;
+}
+
+void NTFS_MatcherDestroy(ntfs_matcher *Matcher)
+{
+    if (Matcher->Arena.Buffer) {
+        NTFS__ArenaDestroy(&Matcher->Arena);
+    }
+
+    *Matcher = (ntfs_matcher) { .Error = Matcher->Error };
+}
+
+static void NTFS__MatchReport(ntfs__match_state *State, uint32_t Pattern, size_t Position)
+{
+    ntfs_match_hit Hit = State->Hit;
+    Hit.Pattern        = Pattern;
+
+    if (Hit.IsResident) {
+        Hit.FileOffset = Position;
+
+        ntfs_record *Record = State->Record;
+        uint8_t     *Start  = Record->Buffer + Position;
+        for (size_t Index = 0; Index < NTFS__ListLen(Record->AttrList); Index++) {
+            ntfs_attr *Attr = Record->AttrList + Index;
+            if (!Attr->NonResFlag && Start >= Attr->Resident.Data &&
+                Start < Attr->Resident.Data + Attr->Resident.Size) {
+                Hit.HasOwner    = true;
+                Hit.RecordIndex = Record->BaseIndex;
+                Hit.Type        = Attr->Type;
+                Hit.AttrId      = Attr->Id;
+                Hit.FileOffset  = NTFS_CAST(uint64_t, Start - Attr->Resident.Data);
+                break;
+            }
+        }
+    } else {
+        uint64_t BytesPerCluster = State->Volume->BytesPerCluster;
+        Hit.Offset = State->Base + Position;
+        Hit.LCN    = Hit.Offset / BytesPerCluster;
+
+        ntfs_owner_extent *Extent = NTFS_OwnerMapFind(State->Map, Hit.LCN);
+        if (Extent) {
+            Hit.HasOwner    = true;
+            Hit.RecordIndex = Extent->RecordIndex;
+            Hit.Type        = Extent->Type;
+            Hit.AttrId      = Extent->AttrId;
+            Hit.FileOffset  = (Extent->VCN + Hit.LCN - Extent->StartLCN) * BytesPerCluster +
+                              Hit.Offset % BytesPerCluster;
+        }
+    }
+
+    State->Summary->Hits++;
+    if (State->Callback) {
+        State->Callback(State->Context, &Hit);
+    }
+}
+
+// Matches must end past Skip, the ones before were found with the data
+// that Skip bytes were carried over from
+static void NTFS__MatchVerify(ntfs__match_state *State, uint8_t *Data, size_t Size, size_t Skip,
+                              size_t Position)
+{
+    ntfs_matcher *Matcher = State->Matcher;
+    uint8_t       First   = Data[Position];
+
+    for (uint32_t Index = Matcher->SingleStart[First]; Index < Matcher->SingleStart[First + 1];
+         Index++) {
+        if (Position + 1 > Skip) {
+            NTFS__MatchReport(State, Matcher->SingleOrder[Index], Position);
+        }
+    }
+
+    if (Position + 1 < Size) {
+        uint16_t Pair = NTFS_CAST(uint16_t, First | Data[Position + 1] << 8);
+        if (!(Matcher->Pairs[Pair / 64] & (NTFS_CAST(uint64_t, 1) << (Pair % 64)))) {
+            return;
+        }
+
+        for (uint32_t Index = Matcher->PairStart[Pair]; Index < Matcher->PairStart[Pair + 1];
+             Index++) {
+            ntfs_pattern *Pattern = Matcher->Patterns + Matcher->PairOrder[Index];
+            size_t        End     = Position + Pattern->Size;
+            if (End <= Size && End > Skip &&
+                NTFS_MEM_COMPARE(Data + Position + 2, Pattern->Data + 2, Pattern->Size - 2) == 0) {
+                NTFS__MatchReport(State, Matcher->PairOrder[Index], Position);
+            }
+        }
+    }
+}
+
+#if defined(__AVX2__)
+static inline __m256i NTFS__MatchInSet(uint8_t (*Set)[16], __m256i Value)
+{
+    const __m256i LowMask = _mm256_set1_epi8(0x0F);
+    const __m256i Bits    = _mm256_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128,
+                                             1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+    __m256i Low  = _mm256_broadcastsi128_si256(_mm_loadu_si128(NTFS_CAST(__m128i *, Set[0])));
+    __m256i High = _mm256_broadcastsi128_si256(_mm_loadu_si128(NTFS_CAST(__m128i *, Set[1])));
+
+    __m256i Nibble = _mm256_and_si256(Value, LowMask);
+    __m256i Upper  = _mm256_and_si256(_mm256_srli_epi16(Value, 4), LowMask);
+    __m256i Row    = _mm256_blendv_epi8(_mm256_shuffle_epi8(Low, Nibble),
+                                        _mm256_shuffle_epi8(High, Nibble), Value);
+    __m256i Bit    = _mm256_shuffle_epi8(Bits, Upper);
+
+    __m256i Result = _mm256_cmpeq_epi8(_mm256_and_si256(Row, Bit), Bit);
+    return Result;
+}
+#endif
+
+// Candidates are positions whose byte can start a pattern and, for longer
+// patterns, whose next byte can follow it. With AVX2 32 positions are
+// tested at once and only candidates reach the pair filter
+static void NTFS__MatchScan(ntfs__match_state *State, uint8_t *Data, size_t Size, size_t Skip)
+{
+    ntfs_matcher *Matcher  = State->Matcher;
+    size_t        Position = 0;
+
+#if defined(__AVX2__)
+    for (; Position + 33 <= Size; Position += 32) {
+        __m256i Value = _mm256_loadu_si256(NTFS_CAST(__m256i *, Data + Position));
+        __m256i Next  = _mm256_loadu_si256(NTFS_CAST(__m256i *, Data + Position + 1));
+        __m256i Pairs = _mm256_and_si256(NTFS__MatchInSet(Matcher->Sets[NTFS__MatchSet_First], Value),
+                                         NTFS__MatchInSet(Matcher->Sets[NTFS__MatchSet_Second], Next));
+        __m256i Found = _mm256_or_si256(Pairs,
+                                        NTFS__MatchInSet(Matcher->Sets[NTFS__MatchSet_Single], Value));
+
+        uint32_t Mask = NTFS_CAST(uint32_t, _mm256_movemask_epi8(Found));
+        while (Mask) {
+            NTFS__MatchVerify(State, Data, Size, Skip, Position + NTFS__CountTrailingZeros64(Mask));
+            Mask &= Mask - 1;
+        }
+    }
+#endif
+
+    for (; Position < Size; Position++) {
+        uint8_t Flags   = Matcher->Bytes[Data[Position]];
+        bool    IsFound = Flags & (1 << NTFS__MatchSet_Single);
+        if ((Flags & (1 << NTFS__MatchSet_First)) && Position + 1 < Size) {
+            IsFound |= (Matcher->Bytes[Data[Position + 1]] & (1 << NTFS__MatchSet_Second)) != 0;
+        }
+
+        if (IsFound) {
+            NTFS__MatchVerify(State, Data, Size, Skip, Position);
+        }
+    }
+}
+
+// Clusters of the MFT are left to the MFT pass, which sees records after
+// their fixups. Moves LCN past the MFT and returns how many clusters from
+// there are outside of it
+static uint64_t NTFS__MatchClip(ntfs_volume *Volume, uint64_t *LCN, uint64_t End)
+{
+    for (bool IsMoved = true; IsMoved;) {
+        IsMoved = false;
+        for (size_t Index = 0; Index < Volume->MftRunCount; Index++) {
+            ntfs_data_run *Run = Volume->MftRunList + Index;
+            if (!Run->IsSparse && Run->StartVCN <= *LCN && *LCN < Run->StartVCN + Run->Count) {
+                *LCN    = Run->StartVCN + Run->Count < End ? Run->StartVCN + Run->Count : End;
+                IsMoved = *LCN < End;
+            }
+        }
+    }
+
+    uint64_t Result = End - *LCN;
+    for (size_t Index = 0; Index < Volume->MftRunCount; Index++) {
+        ntfs_data_run *Run = Volume->MftRunList + Index;
+        if (!Run->IsSparse && Run->StartVCN > *LCN && Run->StartVCN - *LCN < Result) {
+            Result = Run->StartVCN - *LCN;
+        }
+    }
+
+    return Result;
+}
+
+// One MFT pass collects the run lists and scans every allocated record
+// after its fixups, then the other allocated clusters are read once in LCN
+// order. The last bytes of a read
+// are carried in front of the next one when it continues on the volume
+ntfs_match_summary NTFS_MatchVolume(ntfs_volume *Volume, ntfs_matcher *Matcher,
+                                    ntfs_match_callback *Callback, void *Context)
+{
+    ntfs_match_summary Result = { 0 };
+    ntfs_owner_map     Map    = {
+        .Arena = NTFS__ArenaCreate(NTFS_OWNER_MAP_RESERVED, NTFS__ARENA_DEFAULT_COMMIT),
+    };
+    ntfs_arena    Arena  = NTFS__ArenaCreate(NTFS_MATCH_RESERVED, NTFS__ARENA_DEFAULT_COMMIT);
+    ntfs_mft_scan Scan   = NTFS_MftScanBegin(Volume);
+    ntfs_bitmap   Bitmap = NTFS_BitmapOpen(Volume);
+
+    ntfs__match_state State = {
+        .Volume   = Volume,
+        .Matcher  = Matcher,
+        .Map      = &Map,
+        .Callback = Callback,
+        .Context  = Context,
+        .Summary  = &Result,
+    };
+
+    if (Matcher->Error) {
+        NTFS_RETURN(Result.Error, Matcher->Error);
+    }
+
+    if (Map.Arena.Buffer == 0 || Arena.Buffer == 0) {
+        NTFS_RETURN(Result.Error, NTFS_Error_MemoryError);
+    }
+
+    if (Scan.Error) {
+        NTFS_RETURN(Result.Error, Scan.Error);
+    }
+
+    if (Bitmap.Error) {
+        NTFS_RETURN(Result.Error, Bitmap.Error);
+    }
+
+    // Free records and the allocated records past the $MFT size are fixed
+    // up and scanned too, records failing validation are scanned as read
+    uint64_t BytesPerRecord = Volume->BytesPerMftEntry;
+    uint64_t RecordCount    = Scan.Mft.AlignedSize / BytesPerRecord;
+    for (uint64_t Index = 0; Index < RecordCount; Index++) {
+        uint8_t *FileRecord = NTFS__MftScanRecordBuffer(&Scan, Index);
+        if (FileRecord == 0) {
+            NTFS_RETURN(Result.Error, Scan.Error);
+        }
+
+        uint32_t Magic = *NTFS_CAST(uint32_t *, FileRecord + 0x00);
+        uint16_t Flags = *NTFS_CAST(uint16_t *, FileRecord + 0x16);
+
+        NTFS__ArenaReset(&Scan.Arena);
+        ntfs_record Record = NTFS__RecordParseEx(Volume, &Scan.Arena, FileRecord, Index, false);
+        if (Record.Error == NTFS_Error_Success) {
+            NTFS__OwnerMapAdd(&Map, &Record);
+        } else {
+            Record = (ntfs_record) { .Buffer = FileRecord, .Index = Index };
+            if (Magic == NTFS_FILE_RECORD_MAGIC && !(Flags & 0x01)) {
+                NTFS__RecordApplyFixups(FileRecord, BytesPerRecord);
+            }
+        }
+
+        State.Record = &Record;
+        State.Hit    = (ntfs_match_hit) { .RecordIndex = Index, .IsResident = true };
+        NTFS__MatchScan(&State, FileRecord, BytesPerRecord, 0);
+        Result.RecordBytes += BytesPerRecord;
+    }
+
+    NTFS__OwnerMapFinish(&Map);
+
+    uint64_t BufferClusters = NTFS_MATCH_BUFFER_SIZE / Volume->BytesPerCluster;
+    if (BufferClusters == 0) {
+        BufferClusters = 1;
+    }
+
+    size_t   CarrySize = Matcher->MaxSize ? Matcher->MaxSize - 1 : 0;
+    size_t   Reserved  = NTFS__Align(CarrySize, NTFS_DIRECT_ALIGNMENT);
+    uint8_t *Buffer    = NTFS__ArenaAllocAligned(&Arena, Reserved + BufferClusters *
+                                                 Volume->BytesPerCluster, NTFS_DIRECT_ALIGNMENT);
+    uint8_t *ReadBuffer = Buffer + Reserved;
+
+    State.Hit           = (ntfs_match_hit) { 0 };
+    State.Record        = 0;
+    uint64_t    PrevEnd = UINT64_MAX;
+    size_t      Carried = 0;
+    ntfs_extent Extent  = { 0 };
+    while (NTFS_BitmapNextExtent(&Bitmap, true, &Extent)) {
+        uint64_t End = Extent.StartLCN + Extent.Count;
+        for (uint64_t LCN = Extent.StartLCN; LCN < End;) {
+            uint64_t Clusters = NTFS__MatchClip(Volume, &LCN, End);
+            if (Clusters == 0) {
+                break;
+            }
+            if (Clusters > BufferClusters) {
+                Clusters = BufferClusters;
+            }
+
+            size_t ReadSize = Clusters * Volume->BytesPerCluster;
+            if (!NTFS_VolumeRead(Volume, LCN * Volume->BytesPerCluster, ReadBuffer, ReadSize)) {
+                NTFS_RETURN(Result.Error, NTFS_Error_MatchFailedRead);
+            }
+            Result.BytesScanned += ReadSize;
+
+            if (LCN != PrevEnd) {
+                Carried = 0;
+            }
+
+            State.Base = LCN * Volume->BytesPerCluster - Carried;
+            NTFS__MatchScan(&State, ReadBuffer - Carried, Carried + ReadSize, Carried);
+
+            // Carried bytes come from the end of this read and the ones
+            // before it when reads are shorter than the longest pattern, so
+            // they may overlap and are copied forward
+            size_t Total = Carried + ReadSize;
+            Carried      = Total < CarrySize ? Total : CarrySize;
+
+            uint8_t *Source = ReadBuffer + ReadSize - Carried;
+            uint8_t *Dest   = ReadBuffer - Carried;
+            for (size_t Index = 0; Index < Carried; Index++) {
+                Dest[Index] = Source[Index];
+            }
+
+            LCN    += Clusters;
+            PrevEnd = LCN;
+        }
+    }
+
+    if (Bitmap.Error) {
+        NTFS_RETURN(Result.Error, Bitmap.Error);
+    }
+
+skip:
+    NTFS_BitmapClose(&Bitmap);
+    NTFS_MftScanEnd(&Scan);
+    NTFS_OwnerMapDestroy(&Map);
+    if (Arena.Buffer) {
+        NTFS__ArenaDestroy(&Arena);
+    }
+
+    return Result;
+}
+
+// Diff API
+typedef struct {
+    ntfs_attr_type Type;
+    uint16_t       Id;
+    uint8_t       *Data;
+    size_t         Size;
+    bool           IsMatched;
+} ntfs__diff_attr;
+
+typedef struct {
+    ntfs_record      Record;
+    ntfs__diff_attr *Attrs;
+    size_t           AttrCount;
+    uint32_t         Types;
+    uint16_t         Sequence;
+    bool             IsCorrupt;
+} ntfs__diff_side;
+
+static void NTFS__DiffReport(ntfs_diff_summary *Summary, ntfs_diff_callback *Callback,
+                             void *Context, ntfs_diff_entry *Entry)
+{
+    Summary->Changes[Entry->Change]++;
+    if (Callback) {
+        Callback(Context, Entry);
+    }
+}
+
+// Attributes are kept as the raw bytes between their headers, enough to
+// tell whether the same attribute changed without decoding it
+static bool NTFS__DiffParse(ntfs_volume *Volume, uint8_t *FileRecord, uint64_t Index,
+                            ntfs__diff_side *Side)
+{
+    bool Result = false;
+
+    Side->AttrCount = 0;
+    Side->Types     = 0;
+    Side->IsCorrupt = false;
+    Side->Record    = NTFS__RecordParseHeader(Volume, FileRecord, Index, false);
+    if (Side->Record.Error) {
+        // Never used records are zeroed and freed ones only lose their in
+        // use flag, anything else failing is a damaged record
+        uint32_t Magic  = *NTFS_CAST(uint32_t *, FileRecord + 0x00);
+        uint16_t Flags  = *NTFS_CAST(uint16_t *, FileRecord + 0x16);
+        bool     IsFree = Magic == 0 || (Magic == NTFS_FILE_RECORD_MAGIC && !(Flags & 0x01));
+
+        Side->IsCorrupt = !IsFree;
+        NTFS_RETURN(Result, false);
+    }
+
+    // Extension records carry the sequence number of their base record
+    Side->Sequence = *NTFS_CAST(uint16_t *, FileRecord + 0x10);
+    if (Side->Record.BaseIndex != Index) {
+        Side->Sequence = *NTFS_CAST(uint16_t *, FileRecord + 0x26);
+    }
+
+    ntfs_attr        Attr   = { 0 };
+    ntfs_attr_cursor Cursor = NTFS_AttrCursorBegin(Volume, &Side->Record);
+    for (uint8_t *AttrPtr = Cursor.AttrPtr; NTFS_AttrCursorNext(&Cursor, 0, &Attr);
+         AttrPtr = Cursor.AttrPtr) {
+        Side->Attrs[Side->AttrCount++] = (ntfs__diff_attr) {
+            .Type = Attr.Type,
+            .Id   = Attr.Id,
+            .Data = AttrPtr,
+            .Size = Cursor.AttrPtr - AttrPtr,
+        };
+        Side->Types |= NTFS_DIFF_ATTR_BIT(Attr.Type);
+    }
+    Result = true;
+
+skip:
+    return Result;
+}
+
+// Attributes are paired by their type and id, which stay the same for the
+// life of an attribute in a record
+static uint32_t NTFS__DiffAttrs(ntfs__diff_side *Old, ntfs__diff_side *New)
+{
+    uint32_t Result = 0;
+
+    for (size_t Index = 0; Index < Old->AttrCount; Index++) {
+        ntfs__diff_attr *OldAttr = Old->Attrs + Index;
+        ntfs__diff_attr *NewAttr = 0;
+        for (size_t Other = 0; Other < New->AttrCount && NewAttr == 0; Other++) {
+            ntfs__diff_attr *Attr = New->Attrs + Other;
+            if (!Attr->IsMatched && Attr->Type == OldAttr->Type && Attr->Id == OldAttr->Id) {
+                NewAttr            = Attr;
+                NewAttr->IsMatched = true;
+            }
+        }
+
+        if (NewAttr == 0 || NewAttr->Size != OldAttr->Size ||
+            NTFS_MEM_COMPARE(NewAttr->Data, OldAttr->Data, OldAttr->Size) != 0) {
+            Result |= NTFS_DIFF_ATTR_BIT(OldAttr->Type);
+        }
+    }
+
+    for (size_t Index = 0; Index < New->AttrCount; Index++) {
+        if (!New->Attrs[Index].IsMatched) {
+            Result |= NTFS_DIFF_ATTR_BIT(New->Attrs[Index].Type);
+        }
+    }
+
+    return Result;
+}
+
+// Both $MFTs are read in lockstep through their scan buffers, equal records
+// are recognized by comparing their bytes before fixups and never decoded.
+// A record that changed owner, by sequence number or base record, removes
+// what it held in the old volume and adds what it holds in the new one
+ntfs_diff_summary NTFS_VolumeDiff(ntfs_volume *Old, ntfs_volume *New,
+                                  ntfs_diff_callback *Callback, void *Context)
+{
+    ntfs_diff_summary Result  = { 0 };
+    ntfs_arena        Arena   = NTFS__ArenaDefault();
+    ntfs_mft_scan     OldScan = NTFS_MftScanBegin(Old);
+    ntfs_mft_scan     NewScan = NTFS_MftScanBegin(New);
+
+    if (Arena.Buffer == 0) {
+        NTFS_RETURN(Result.Error, NTFS_Error_MemoryError);
+    }
+
+    if (OldScan.Error || NewScan.Error) {
+        NTFS_RETURN(Result.Error, OldScan.Error ? OldScan.Error : NewScan.Error);
+    }
+
+    size_t RecordSize = Old->BytesPerMftEntry;
+    if (New->BytesPerMftEntry != RecordSize) {
+        NTFS_RETURN(Result.Error, NTFS_Error_DiffMismatchedRecordSize);
+    }
+
+    // Every attribute takes at least its 0x18 bytes header
+    size_t          MaxAttrs = RecordSize / 0x18;
+    ntfs__diff_side Sides[2] = {
+        { .Attrs = NTFS__ArenaAlloc(&Arena, MaxAttrs * sizeof(ntfs__diff_attr)) },
+        { .Attrs = NTFS__ArenaAlloc(&Arena, MaxAttrs * sizeof(ntfs__diff_attr)) },
+    };
+
+    uint64_t RecordCount = OldScan.RecordCount > NewScan.RecordCount ? OldScan.RecordCount :
+                                                                      NewScan.RecordCount;
+    for (uint64_t Index = 0; Index < RecordCount; Index++) {
+        uint8_t *OldRecord = 0;
+        uint8_t *NewRecord = 0;
+        if (Index < OldScan.RecordCount) {
+            OldRecord = NTFS__MftScanRecordBuffer(&OldScan, Index);
+        }
+        if (Index < NewScan.RecordCount) {
+            NewRecord = NTFS__MftScanRecordBuffer(&NewScan, Index);
+        }
+        if (OldScan.Error || NewScan.Error) {
+            NTFS_RETURN(Result.Error, OldScan.Error ? OldScan.Error : NewScan.Error);
+        }
+
+        Result.Records++;
+        if (OldRecord && NewRecord && NTFS_MEM_COMPARE(OldRecord, NewRecord, RecordSize) == 0) {
+            continue;
+        }
+        Result.Parsed++;
+
+        ntfs__diff_side *OldSide = Sides + 0;
+        ntfs__diff_side *NewSide = Sides + 1;
+        bool HasOld = OldRecord && NTFS__DiffParse(Old, OldRecord, Index, OldSide);
+        bool HasNew = NewRecord && NTFS__DiffParse(New, NewRecord, Index, NewSide);
+
+        // A damaged record tells nothing about the file it held, reporting
+        // it removed or added would hide the damage as a change
+        bool IsOldCorrupt = OldRecord && OldSide->IsCorrupt;
+        bool IsNewCorrupt = NewRecord && NewSide->IsCorrupt;
+        if (IsOldCorrupt || IsNewCorrupt) {
+            Result.Corrupt += IsOldCorrupt + IsNewCorrupt;
+            continue;
+        }
+
+        if (HasOld && HasNew && OldSide->Sequence == NewSide->Sequence &&
+            OldSide->Record.BaseIndex == NewSide->Record.BaseIndex) {
+            ntfs_diff_entry Entry = {
+                .Change      = NTFS_DiffChange_Modified,
+                .RecordIndex = NewSide->Record.BaseIndex,
+                .Sequence    = NewSide->Sequence,
+                .Attributes  = NTFS__DiffAttrs(OldSide, NewSide),
+            };
+            if (Entry.Attributes) {
+                NTFS__DiffReport(&Result, Callback, Context, &Entry);
+            }
+            continue;
+        }
+
+        for (size_t Side = 0; Side < 2; Side++) {
+            ntfs__diff_side *Current = Sides + Side;
+            if (!(Side ? HasNew : HasOld)) {
+                continue;
+            }
+
+            ntfs_diff_entry Entry = {
+                .Change      = Side ? NTFS_DiffChange_Added : NTFS_DiffChange_Removed,
+                .RecordIndex = Current->Record.BaseIndex,
+                .Sequence    = Current->Sequence,
+                .Attributes  = Current->Types,
+            };
+            if (Current->Record.BaseIndex != Index) {
+                Entry.Change = NTFS_DiffChange_Modified;
+            }
+            NTFS__DiffReport(&Result, Callback, Context, &Entry);
+        }
+    }
+
+skip:
+    NTFS_MftScanEnd(&NewScan);
+    NTFS_MftScanEnd(&OldScan);
+    if (Arena.Buffer) {
+        NTFS__ArenaDestroy(&Arena);
+    }
+
+    return Result;
+}
+
 #endif  // NTFS_PARSER_IMPLEMENTATION
@@ -0,0 +1,515 @@
+#ifndef NTFS_PARSER_HPP
+#define NTFS_PARSER_HPP
+
+// C++17 layer over ntfs_parser.h. Every type owns one C handle, closes it
+// exactly once and can only be moved. Everything is inline over the C API,
+// the implementation is still built from a C translation unit defining
+// NTFS_PARSER_IMPLEMENTATION
+#include "ntfs_parser.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+#if __has_include(<span>)
+    #include <span>
+#endif
+
+namespace ntfs {
+
+#if defined(__cpp_lib_span)
+template <typename T>
+using Span = std::span<T>;
+#else
+// Subset of std::span used by the reads until C++20
+template <typename T>
+class Span {
+public:
+    constexpr Span() noexcept = default;
+    constexpr Span(T *Data, size_t Size) noexcept : Data(Data), Size(Size) {}
+
+    template <size_t Count>
+    constexpr Span(T (&Array)[Count]) noexcept : Data(Array), Size(Count) {}
+
+    constexpr T     *data() const noexcept { return Data; }
+    constexpr size_t size() const noexcept { return Size; }
+    constexpr size_t size_bytes() const noexcept { return Size * sizeof(T); }
+    constexpr bool   empty() const noexcept { return Size == 0; }
+    constexpr T     *begin() const noexcept { return Data; }
+    constexpr T     *end() const noexcept { return Data + Size; }
+
+    constexpr T &operator[](size_t Index) const noexcept { return Data[Index]; }
+
+private:
+    T     *Data = nullptr;
+    size_t Size = 0;
+};
+#endif
+
+// Owns any C struct released by a single destroy function, the destroy
+// functions all accept a zeroed struct so moved from values are harmless
+template <typename T, void (*Destroy)(T *)>
+class Owned {
+public:
+    Owned() noexcept = default;
+    explicit Owned(T Value) noexcept : Value(Value) {}
+
+    Owned(Owned &&Other) noexcept : Value(std::exchange(Other.Value, T {})) {}
+    Owned &operator=(Owned &&Other) noexcept
+    {
+        if (this != &Other) {
+            Destroy(&Value);
+            Value = std::exchange(Other.Value, T {});
+        }
+
+        return *this;
+    }
+
+    Owned(const Owned &)            = delete;
+    Owned &operator=(const Owned &) = delete;
+
+    ~Owned() { Destroy(&Value); }
+
+    ntfs_error error() const noexcept { return Value.Error; }
+    explicit operator bool() const noexcept { return Value.Error == NTFS_Error_Success; }
+
+    T *get() noexcept { return &Value; }
+    T *operator->() noexcept { return &Value; }
+    T &operator*() noexcept { return Value; }
+
+private:
+    T Value = {};
+};
+
+using Bitmap          = Owned<ntfs_bitmap, NTFS_BitmapClose>;
+using MftScan         = Owned<ntfs_mft_scan, NTFS_MftScanEnd>;
+using OwnerMap        = Owned<ntfs_owner_map, NTFS_OwnerMapDestroy>;
+using Timeline        = Owned<ntfs_timeline, NTFS_TimelineDestroy>;
+using PathIndex       = Owned<ntfs_path_index, NTFS_PathIndexDestroy>;
+using SecurityCache   = Owned<ntfs_security_cache, NTFS_SecurityCacheDestroy>;
+using ReparseResolver = Owned<ntfs_reparse_resolver, NTFS_ReparseResolverDestroy>;
+using Reader          = Owned<ntfs_reader, NTFS_ReaderClose>;
+using Usage           = Owned<ntfs_usage, NTFS_UsageDestroy>;
+using Dupes           = Owned<ntfs_dupes, NTFS_DupesDestroy>;
+using Matcher         = Owned<ntfs_matcher, NTFS_MatcherDestroy>;
+
+// Arena backed lists of the C API
+template <typename T>
+class ListRange {
+public:
+    constexpr ListRange() noexcept = default;
+    explicit ListRange(T *Items) noexcept : Items(Items), Count(NTFS__ListLen(Items)) {}
+
+    T     *begin() const noexcept { return Items; }
+    T     *end() const noexcept { return Items + Count; }
+    size_t size() const noexcept { return Count; }
+    bool   empty() const noexcept { return Count == 0; }
+
+private:
+    T     *Items = nullptr;
+    size_t Count = 0;
+};
+
+inline ListRange<ntfs_data_run> runs(const ntfs_attr &Attr) noexcept
+{
+    return Attr.NonResFlag ? ListRange<ntfs_data_run>(Attr.NonResident.RunList)
+                           : ListRange<ntfs_data_run>();
+}
+
+inline Span<uint16_t> name(const ntfs_attr &Attr) noexcept
+{
+    return Span<uint16_t>(Attr.Name, Attr.NameLength);
+}
+
+// Attribute views, picked at compile time from the attribute type.
+// Parse rejects attributes too short for the view, they are skipped
+constexpr ntfs_attr_type AnyAttr = static_cast<ntfs_attr_type>(0);
+
+struct StandardInformation {
+    uint64_t CreationTime;
+    uint64_t ModifiedTime;
+    uint64_t ChangedTime;
+    uint64_t ReadTime;
+    uint32_t Flags;
+    uint32_t SecurityId;
+};
+
+template <ntfs_attr_type Type>
+struct AttrTraits {
+    using storage_type = ntfs_attr *;
+    using value_type   = ntfs_attr &;
+
+    static bool Parse(ntfs_attr &Attr, ntfs_attr **Value) noexcept
+    {
+        *Value = &Attr;
+        return true;
+    }
+    static ntfs_attr &Get(ntfs_attr *Value) noexcept { return *Value; }
+};
+
+template <>
+struct AttrTraits<NTFS_AttributeType_FileName> {
+    using storage_type = ntfs_file_name;
+    using value_type   = const ntfs_file_name &;
+
+    static bool Parse(ntfs_attr &Attr, ntfs_file_name *Value) noexcept
+    {
+        return NTFS__FileNameParse(&Attr, Value);
+    }
+    static const ntfs_file_name &Get(const ntfs_file_name &Value) noexcept { return Value; }
+};
+
+template <>
+struct AttrTraits<NTFS_AttributeType_StandardInformation> {
+    using storage_type = StandardInformation;
+    using value_type   = const StandardInformation &;
+
+    static bool Parse(ntfs_attr &Attr, StandardInformation *Value) noexcept
+    {
+        bool Result = !Attr.NonResFlag && Attr.Resident.Size >= 0x24;
+        if (Result) {
+            uint8_t *Data = Attr.Resident.Data;
+            *Value        = StandardInformation {
+                *reinterpret_cast<uint64_t *>(Data + 0x00),
+                *reinterpret_cast<uint64_t *>(Data + 0x08),
+                *reinterpret_cast<uint64_t *>(Data + 0x10),
+                *reinterpret_cast<uint64_t *>(Data + 0x18),
+                *reinterpret_cast<uint32_t *>(Data + 0x20),
+                Attr.Resident.Size >= 0x38 ? *reinterpret_cast<uint32_t *>(Data + 0x34) : 0,
+            };
+        }
+
+        return Result;
+    }
+    static const StandardInformation &Get(const StandardInformation &Value) noexcept
+    {
+        return Value;
+    }
+};
+
+// End of an attribute range, compared against the iterator position only
+struct AttrSentinel {
+    ntfs_attr *End;
+};
+
+template <ntfs_attr_type Type>
+class AttrIterator {
+public:
+    using Traits     = AttrTraits<Type>;
+    using value_type = typename Traits::value_type;
+
+    AttrIterator(ntfs_attr *Current, ntfs_attr *End) noexcept : Current(Current), End(End)
+    {
+        Settle();
+    }
+
+    value_type operator*() const noexcept { return Traits::Get(Value); }
+
+    AttrIterator &operator++() noexcept
+    {
+        ++Current;
+        Settle();
+        return *this;
+    }
+
+    bool operator==(AttrSentinel Sentinel) const noexcept { return Current == Sentinel.End; }
+    bool operator!=(AttrSentinel Sentinel) const noexcept { return Current != Sentinel.End; }
+
+private:
+    void Settle() noexcept
+    {
+        for (; Current != End; ++Current) {
+            if constexpr (Type == AnyAttr) {
+                Value = Current;
+                break;
+            } else if (Current->Type == Type) {
+                // Parsed through a local so the iterator never escapes
+                // and stays in registers
+                typename Traits::storage_type Parsed;
+                if (Traits::Parse(*Current, &Parsed)) {
+                    Value = Parsed;
+                    break;
+                }
+            }
+        }
+    }
+
+    ntfs_attr                    *Current;
+    ntfs_attr                    *End;
+    // Only read after Parse filled it
+    typename Traits::storage_type Value;
+};
+
+template <ntfs_attr_type Type>
+class AttrRange {
+public:
+    AttrRange(ntfs_attr *Items) noexcept : Items(Items), Count(NTFS__ListLen(Items)) {}
+
+    AttrIterator<Type> begin() const noexcept { return { Items, Items + Count }; }
+    AttrSentinel       end() const noexcept { return { Items + Count }; }
+
+private:
+    ntfs_attr *Items;
+    size_t     Count;
+};
+
+// Single pass over an index, directories use $I30
+class DirectoryEntry {
+public:
+    explicit DirectoryEntry(const ntfs_index_entry &Entry) noexcept : Entry(Entry) {}
+
+    uint64_t recordIndex() const noexcept
+    {
+        return *reinterpret_cast<uint64_t *>(Entry.Entry) & 0xFFFFFFFFFFFF;
+    }
+    uint8_t nameSpace() const noexcept { return Entry.KeyLength >= 0x42 ? Entry.Key[0x41] : 0; }
+    Span<uint16_t> name() const noexcept
+    {
+        size_t Length = Entry.KeyLength >= 0x42 ? Entry.Key[0x40] : 0;
+        if (0x42 + Length * sizeof(uint16_t) > Entry.KeyLength) {
+            Length = 0;
+        }
+
+        return Span<uint16_t>(reinterpret_cast<uint16_t *>(Entry.Key + 0x42), Length);
+    }
+
+    const ntfs_index_entry &raw() const noexcept { return Entry; }
+
+private:
+    ntfs_index_entry Entry;
+};
+
+class IndexRange {
+public:
+    class Iterator {
+    public:
+        Iterator() noexcept = default;
+        explicit Iterator(ntfs_index_cursor *Cursor) noexcept : Cursor(Cursor) { ++*this; }
+
+        DirectoryEntry operator*() const noexcept { return DirectoryEntry(Entry); }
+
+        Iterator &operator++() noexcept
+        {
+            if (!NTFS_IndexCursorNext(Cursor, &Entry)) {
+                Cursor = nullptr;
+            }
+
+            return *this;
+        }
+
+        bool operator==(const Iterator &Other) const noexcept { return Cursor == Other.Cursor; }
+        bool operator!=(const Iterator &Other) const noexcept { return Cursor != Other.Cursor; }
+
+    private:
+        ntfs_index_cursor *Cursor = nullptr;
+        ntfs_index_entry   Entry  = {};
+    };
+
+    IndexRange(ntfs_file *File, uint16_t *Name, size_t NameLength) noexcept
+        : Cursor(NTFS_IndexCursorBegin(File, Name, NameLength))
+    {
+    }
+
+    IndexRange(IndexRange &&Other) noexcept
+        : Cursor(std::exchange(Other.Cursor, ntfs_index_cursor {}))
+    {
+    }
+    IndexRange(const IndexRange &)            = delete;
+    IndexRange &operator=(const IndexRange &) = delete;
+    IndexRange &operator=(IndexRange &&)      = delete;
+
+    ~IndexRange() { NTFS_IndexCursorEnd(&Cursor); }
+
+    // Stays set after the loop when the walk stopped on corruption
+    ntfs_error error() const noexcept { return Cursor.Error; }
+
+    Iterator begin() noexcept { return Cursor.Error ? Iterator() : Iterator(&Cursor); }
+    Iterator end() noexcept { return Iterator(); }
+
+private:
+    ntfs_index_cursor Cursor;
+};
+
+class Volume;
+
+class File {
+public:
+    File() noexcept = default;
+    explicit File(ntfs_file Handle) noexcept : Handle(Handle) {}
+
+    File(File &&Other) noexcept : Handle(std::exchange(Other.Handle, ntfs_file {})) {}
+    File &operator=(File &&Other) noexcept
+    {
+        if (this != &Other) {
+            NTFS_FileClose(&Handle);
+            Handle = std::exchange(Other.Handle, ntfs_file {});
+        }
+
+        return *this;
+    }
+
+    File(const File &)            = delete;
+    File &operator=(const File &) = delete;
+
+    ~File() { NTFS_FileClose(&Handle); }
+
+    ntfs_error error() const noexcept { return Handle.Error; }
+    explicit operator bool() const noexcept { return Handle.Error == NTFS_Error_Success; }
+
+    ntfs_file       *get() noexcept { return &Handle; }
+    const ntfs_file *operator->() const noexcept { return &Handle; }
+
+    // Offset and buffer size need no alignment, like NTFS_FileRead
+    size_t read(uint64_t Offset, Span<std::byte> Buffer) noexcept
+    {
+        return NTFS_FileRead(&Handle, Offset, reinterpret_cast<uint8_t *>(Buffer.data()),
+                             Buffer.size());
+    }
+
+    size_t read(ntfs_attr &Attr, uint64_t Offset, Span<std::byte> Buffer) noexcept
+    {
+        return NTFS_FileReadAttr(&Handle, &Attr, Offset,
+                                 reinterpret_cast<uint8_t *>(Buffer.data()), Buffer.size());
+    }
+
+    template <ntfs_attr_type Type = AnyAttr>
+    AttrRange<Type> attributes() const noexcept
+    {
+        return AttrRange<Type>(Handle.Record.AttrList);
+    }
+
+    template <ntfs_attr_type Type>
+    ntfs_attr *find(Span<uint16_t> Name = {}) noexcept
+    {
+        return NTFS_FileFindAttr(&Handle, Type, Name.data(), Name.size());
+    }
+
+    ListRange<ntfs_file_name> names() const noexcept
+    {
+        return ListRange<ntfs_file_name>(Handle.Names);
+    }
+
+    IndexRange entries() noexcept
+    {
+        static uint16_t IndexName[] = { '$', 'I', '3', '0' };
+        return IndexRange(&Handle, IndexName, 4);
+    }
+
+    IndexRange index(Span<uint16_t> Name) noexcept
+    {
+        return IndexRange(&Handle, Name.data(), Name.size());
+    }
+
+    ntfs_reparse_point reparsePoint() noexcept { return NTFS_FileReparsePoint(&Handle); }
+
+    // Sequential reader with readahead, the file has to outlive it
+    Reader reader(ntfs_attr *Attr = nullptr) noexcept
+    {
+        return Reader(NTFS_ReaderOpen(&Handle, Attr));
+    }
+
+private:
+    ntfs_file Handle = {};
+};
+
+// Files keep a pointer to the volume, so it lives on the heap and moving
+// the owner does not invalidate them
+class Volume {
+public:
+    Volume() noexcept = default;
+
+    static Volume open(wchar_t DriveLetter)
+    {
+        return Volume(new ntfs_volume(NTFS_VolumeOpen(DriveLetter)));
+    }
+
+    static Volume openFile(const wchar_t *Path)
+    {
+        return Volume(new ntfs_volume(NTFS_VolumeOpenFromFile(const_cast<wchar_t *>(Path))));
+    }
+
+    ntfs_error error() const noexcept
+    {
+        return Handle ? Handle->Error : NTFS_Error_VolumeOpen;
+    }
+    explicit operator bool() const noexcept { return error() == NTFS_Error_Success; }
+
+    ntfs_volume *get() const noexcept { return Handle.get(); }
+    ntfs_volume *operator->() const noexcept { return Handle.get(); }
+
+    bool read(uint64_t Offset, Span<std::byte> Buffer) const noexcept
+    {
+        return NTFS_VolumeRead(Handle.get(), Offset, Buffer.data(), Buffer.size());
+    }
+
+    File file(uint64_t RecordIndex) const noexcept
+    {
+        return File(NTFS_FileOpenFromIndex(Handle.get(), RecordIndex));
+    }
+
+    MftScan scan() const noexcept { return MftScan(NTFS_MftScanBegin(Handle.get())); }
+
+    // Set before contexts are created, see NTFS_VolumeSetDirectIo
+    bool setDirectIo(bool IsEnabled) noexcept
+    {
+        return NTFS_VolumeSetDirectIo(Handle.get(), IsEnabled);
+    }
+
+private:
+    struct Close {
+        void operator()(ntfs_volume *Volume) const noexcept
+        {
+            NTFS_VolumeClose(Volume);
+            delete Volume;
+        }
+    };
+
+    explicit Volume(ntfs_volume *Handle) noexcept : Handle(Handle) {}
+
+    std::unique_ptr<ntfs_volume, Close> Handle;
+};
+
+// Per thread view of a shared Volume, heap allocated for the same reason,
+// the Volume has to outlive it
+class Context {
+public:
+    Context() noexcept = default;
+    explicit Context(const Volume &Shared)
+        : Handle(new ntfs_context(NTFS_ContextCreate(Shared.get())))
+    {
+    }
+
+    ntfs_error error() const noexcept
+    {
+        return Handle ? Handle->Error : NTFS_Error_VolumeOpen;
+    }
+    explicit operator bool() const noexcept { return error() == NTFS_Error_Success; }
+
+    ntfs_volume *get() const noexcept { return &Handle->Volume; }
+
+    bool read(uint64_t Offset, Span<std::byte> Buffer) const noexcept
+    {
+        return NTFS_VolumeRead(get(), Offset, Buffer.data(), Buffer.size());
+    }
+
+    File file(uint64_t RecordIndex) const noexcept
+    {
+        return File(NTFS_FileOpenFromIndex(get(), RecordIndex));
+    }
+
+private:
+    struct Close {
+        void operator()(ntfs_context *Context) const noexcept
+        {
+            NTFS_ContextDestroy(Context);
+            delete Context;
+        }
+    };
+
+    std::unique_ptr<ntfs_context, Close> Handle;
+};
+
+}   // namespace ntfs
+
+#endif   // NTFS_PARSER_HPP
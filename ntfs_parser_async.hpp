@@ -0,0 +1,523 @@
+#ifndef NTFS_PARSER_ASYNC_HPP
+#define NTFS_PARSER_ASYNC_HPP
+
+// C++20 coroutine layer over ntfs_parser.hpp. A single threaded scheduler
+// resumes the coroutines, the blocking C calls they await run on a
+// completion source, a thread pool unless another source is plugged in
+#include "ntfs_parser.hpp"
+
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace ntfs {
+
+class Scheduler;
+
+// Unit of blocking work, Execute runs on the completion source and the
+// awaiting coroutine is resumed on the scheduler thread afterwards
+struct Operation {
+    void (*Execute)(Operation *Op, size_t Worker) noexcept = nullptr;
+    void                   *Context                        = nullptr;
+    std::coroutine_handle<> Continuation;
+};
+
+class CompletionSource {
+public:
+    virtual ~CompletionSource() = default;
+
+    // Called from the scheduler thread, must eventually run Op->Execute
+    // and hand Op back through Scheduler::complete from any thread
+    virtual void submit(Scheduler &Sched, Operation *Op) = 0;
+
+    // Execute is given the index of the worker running it, below this
+    // count, and a worker runs one operation at a time
+    virtual size_t workers() const noexcept { return 1; }
+};
+
+class Scheduler {
+public:
+    explicit Scheduler(CompletionSource &Source) noexcept : Source(Source) {}
+
+    Scheduler(const Scheduler &)            = delete;
+    Scheduler &operator=(const Scheduler &) = delete;
+
+    template <typename T>
+    void spawn(T &&Task);
+
+    // Returns once every spawned coroutine finished
+    void run()
+    {
+        for (;;) {
+            while (!Ready.empty()) {
+                std::coroutine_handle<> Handle = Ready.front();
+                Ready.pop_front();
+                Handle.resume();
+            }
+
+            if (Pending == 0) {
+                break;
+            }
+
+            std::unique_lock<std::mutex> Guard(Lock);
+            Wake.wait(Guard, [this] { return !Completed.empty(); });
+            for (Operation *Op : Completed) {
+                Ready.push_back(Op->Continuation);
+            }
+
+            Pending -= Completed.size();
+            Completed.clear();
+        }
+    }
+
+    // Notifies under the lock, run may return and the scheduler go away as
+    // soon as the lock is released
+    void complete(Operation *Op)
+    {
+        std::lock_guard<std::mutex> Guard(Lock);
+        Completed.push_back(Op);
+        Wake.notify_one();
+    }
+
+    void submit(Operation *Op)
+    {
+        Pending++;
+        Source.submit(*this, Op);
+    }
+
+    void schedule(std::coroutine_handle<> Handle) { Ready.push_back(Handle); }
+
+    size_t workers() const noexcept { return Source.workers(); }
+
+private:
+    CompletionSource &Source;
+
+    // Only touched from the scheduler thread
+    std::deque<std::coroutine_handle<>> Ready;
+    size_t                              Pending = 0;
+
+    std::mutex              Lock;
+    std::condition_variable Wake;
+    std::vector<Operation *> Completed;
+};
+
+// Runs every operation right away on the scheduler thread, for debugging
+// and single threaded tools
+class InlineSource : public CompletionSource {
+public:
+    void submit(Scheduler &Sched, Operation *Op) override
+    {
+        Op->Execute(Op, 0);
+        Sched.complete(Op);
+    }
+};
+
+// Default source, blocking positional reads spread over worker threads
+class ThreadPoolSource : public CompletionSource {
+public:
+    explicit ThreadPoolSource(uint32_t ThreadCount = std::thread::hardware_concurrency())
+    {
+        for (uint32_t Index = 0; Index < (ThreadCount ? ThreadCount : 1); Index++) {
+            Workers.emplace_back([this, Index] { Work(Index); });
+        }
+    }
+
+    ~ThreadPoolSource() override
+    {
+        {
+            std::lock_guard<std::mutex> Guard(Lock);
+            IsStopping = true;
+        }
+
+        Wake.notify_all();
+        for (std::thread &Worker : Workers) {
+            Worker.join();
+        }
+    }
+
+    void submit(Scheduler &Sched, Operation *Op) override
+    {
+        {
+            std::lock_guard<std::mutex> Guard(Lock);
+            Queue.push_back({ &Sched, Op });
+        }
+
+        Wake.notify_one();
+    }
+
+    size_t workers() const noexcept override { return Workers.size(); }
+
+private:
+    struct Job {
+        Scheduler *Sched;
+        Operation *Op;
+    };
+
+    void Work(size_t Worker)
+    {
+        for (;;) {
+            Job Next;
+            {
+                std::unique_lock<std::mutex> Guard(Lock);
+                Wake.wait(Guard, [this] { return IsStopping || !Queue.empty(); });
+                if (Queue.empty()) {
+                    return;
+                }
+
+                Next = Queue.front();
+                Queue.pop_front();
+            }
+
+            Next.Op->Execute(Next.Op, Worker);
+            Next.Sched->complete(Next.Op);
+        }
+    }
+
+    std::vector<std::thread> Workers;
+    std::mutex               Lock;
+    std::condition_variable  Wake;
+    std::deque<Job>          Queue;
+    bool                     IsStopping = false;
+};
+
+// Lazily started coroutine, awaiting it runs it to completion and resumes
+// the awaiter right after through symmetric transfer
+template <typename T = void>
+class Task;
+
+namespace detail {
+struct PromiseBase {
+    struct FinalAwaiter {
+        bool await_ready() const noexcept { return false; }
+        void await_resume() const noexcept {}
+
+        template <typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> Handle) noexcept
+        {
+            PromiseBase &Base = Handle.promise();
+            if (Base.Continuation) {
+                return Base.Continuation;
+            }
+
+            // Spawned tasks have no owner left to destroy them
+            if (Base.IsDetached) {
+                Handle.destroy();
+            }
+
+            return std::noop_coroutine();
+        }
+    };
+
+    std::suspend_always initial_suspend() const noexcept { return {}; }
+    FinalAwaiter        final_suspend() const noexcept { return {}; }
+
+    void unhandled_exception() noexcept
+    {
+        if (IsDetached) {
+            std::terminate();
+        }
+
+        Exception = std::current_exception();
+    }
+
+    std::coroutine_handle<> Continuation;
+    std::exception_ptr      Exception;
+    bool                    IsDetached = false;
+};
+
+template <typename T>
+struct Promise : PromiseBase {
+    Task<T> get_return_object() noexcept;
+
+    template <typename U>
+    void return_value(U &&Value)
+    {
+        Result.emplace(std::forward<U>(Value));
+    }
+
+    std::optional<T> Result;
+};
+
+template <>
+struct Promise<void> : PromiseBase {
+    Task<void> get_return_object() noexcept;
+
+    void return_void() const noexcept {}
+};
+}   // namespace detail
+
+template <typename T>
+class Task {
+public:
+    using promise_type = detail::Promise<T>;
+
+    explicit Task(std::coroutine_handle<promise_type> Handle) noexcept : Handle(Handle) {}
+
+    Task(Task &&Other) noexcept : Handle(std::exchange(Other.Handle, nullptr)) {}
+    Task(const Task &)            = delete;
+    Task &operator=(const Task &) = delete;
+    Task &operator=(Task &&)      = delete;
+
+    ~Task()
+    {
+        if (Handle) {
+            Handle.destroy();
+        }
+    }
+
+    bool await_ready() const noexcept { return false; }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> Caller) noexcept
+    {
+        Handle.promise().Continuation = Caller;
+        return Handle;
+    }
+
+    T await_resume()
+    {
+        promise_type &Promise = Handle.promise();
+        if (Promise.Exception) {
+            std::rethrow_exception(Promise.Exception);
+        }
+
+        if constexpr (!std::is_void_v<T>) {
+            return std::move(*Promise.Result);
+        }
+    }
+
+    // Hands the frame over to the scheduler, it frees itself once done
+    std::coroutine_handle<> detach() noexcept
+    {
+        Handle.promise().IsDetached = true;
+        return std::exchange(Handle, nullptr);
+    }
+
+private:
+    std::coroutine_handle<promise_type> Handle;
+};
+
+namespace detail {
+template <typename T>
+Task<T> Promise<T>::get_return_object() noexcept
+{
+    return Task<T>(std::coroutine_handle<Promise<T>>::from_promise(*this));
+}
+
+inline Task<void> Promise<void>::get_return_object() noexcept
+{
+    return Task<void>(std::coroutine_handle<Promise<void>>::from_promise(*this));
+}
+}   // namespace detail
+
+template <typename T>
+void Scheduler::spawn(T &&Task)
+{
+    schedule(Task.detach());
+}
+
+namespace detail {
+template <typename F, bool = std::is_invocable_v<F &, size_t>>
+struct OffloadResult {
+    using Type = std::invoke_result_t<F &, size_t>;
+};
+
+template <typename F>
+struct OffloadResult<F, false> {
+    using Type = std::invoke_result_t<F &>;
+};
+}   // namespace detail
+
+// Awaitable running Fn on the completion source, Fn may take the index of
+// the worker running it. The operation lives in the awaiting coroutine
+// frame, nothing is allocated per call
+template <typename F>
+class Offload {
+public:
+    using Result = typename detail::OffloadResult<F>::Type;
+
+    Offload(Scheduler &Sched, F Fn) : Sched(Sched), Fn(std::move(Fn))
+    {
+        Op.Execute = &Offload::Execute;
+        Op.Context = this;
+    }
+
+    bool await_ready() const noexcept { return false; }
+
+    void await_suspend(std::coroutine_handle<> Caller)
+    {
+        Op.Continuation = Caller;
+        Sched.submit(&Op);
+    }
+
+    Result await_resume()
+    {
+        if constexpr (!std::is_void_v<Result>) {
+            return std::move(*Value);
+        }
+    }
+
+private:
+    using Storage = std::conditional_t<std::is_void_v<Result>, bool, Result>;
+
+    static void Execute(Operation *Base, size_t Worker) noexcept
+    {
+        Offload *Self = static_cast<Offload *>(Base->Context);
+        if constexpr (std::is_invocable_v<F &, size_t>) {
+            if constexpr (std::is_void_v<Result>) {
+                Self->Fn(Worker);
+            } else {
+                Self->Value.emplace(Self->Fn(Worker));
+            }
+        } else if constexpr (std::is_void_v<Result>) {
+            Self->Fn();
+        } else {
+            Self->Value.emplace(Self->Fn());
+        }
+    }
+
+    Operation              Op;
+    Scheduler             &Sched;
+    F                      Fn;
+    std::optional<Storage> Value;
+};
+
+template <typename F>
+Offload<F> offload(Scheduler &Sched, F Fn)
+{
+    return Offload<F>(Sched, std::move(Fn));
+}
+
+struct LookupResult {
+    ntfs_error Error;
+    uint64_t   RecordIndex;
+};
+
+class AsyncVolume;
+
+// Reads go through the context of whichever worker runs them, the file is
+// pointed at it first. Like File, one read at a time
+class AsyncFile {
+public:
+    AsyncFile(AsyncVolume &Owner, File Handle) noexcept : Owner(&Owner), Handle(std::move(Handle))
+    {
+    }
+
+    ntfs_error error() const noexcept { return Handle.error(); }
+    explicit operator bool() const noexcept { return bool(Handle); }
+
+    File &get() noexcept { return Handle; }
+
+    auto read(uint64_t Offset, Span<std::byte> Buffer);
+    auto read(ntfs_attr &Attr, uint64_t Offset, Span<std::byte> Buffer);
+
+private:
+    bool Bind(size_t Worker) noexcept;
+
+    AsyncVolume *Owner;
+    File         Handle;
+};
+
+// Volume reads, record loads and directory lookups as awaitables. Every
+// worker of the completion source has a context of its own, created on its
+// first operation, so workers never share a handle. The volume must
+// outlive every operation in flight
+class AsyncVolume {
+public:
+    AsyncVolume(Scheduler &Sched, Volume &Handle)
+        : Sched(Sched), Handle(Handle), Contexts(Sched.workers())
+    {
+    }
+
+    Scheduler &scheduler() noexcept { return Sched; }
+    Volume    &get() noexcept { return Handle; }
+
+    // Only called from the worker owning the slot
+    Context &context(size_t Worker)
+    {
+        Context &Result = Contexts[Worker];
+        if (!Result) {
+            Result = Context(Handle);
+        }
+
+        return Result;
+    }
+
+    auto read(uint64_t Offset, Span<std::byte> Buffer)
+    {
+        return offload(Sched, [this, Offset, Buffer](size_t Worker) {
+            Context &Ctx = context(Worker);
+            return Ctx ? Ctx.read(Offset, Buffer) : false;
+        });
+    }
+
+    auto open(uint64_t RecordIndex)
+    {
+        return offload(Sched, [this, RecordIndex](size_t Worker) {
+            Context  &Ctx    = context(Worker);
+            ntfs_file Failed = {};
+            Failed.Error     = Ctx.error();
+            return AsyncFile(*this, Ctx ? Ctx.file(RecordIndex) : File(Failed));
+        });
+    }
+
+    auto lookup(uint64_t DirIndex, Span<uint16_t> Name)
+    {
+        return offload(Sched, [this, DirIndex, Name](size_t Worker) {
+            Context     &Ctx    = context(Worker);
+            LookupResult Result = { Ctx.error(), 0 };
+            if (Ctx) {
+                Result.Error = NTFS__DirectoryLookup(Ctx.get(), DirIndex, Name.data(),
+                                                     Name.size(), &Result.RecordIndex);
+            }
+
+            return Result;
+        });
+    }
+
+private:
+    Scheduler           &Sched;
+    Volume              &Handle;
+    std::vector<Context> Contexts;
+};
+
+inline bool AsyncFile::Bind(size_t Worker) noexcept
+{
+    Context   &Ctx = Owner->context(Worker);
+    ntfs_file *Raw = Handle.get();
+    if (!Ctx) {
+        Raw->Error = Ctx.error();
+        return false;
+    }
+
+    // Contexts share everything loaded at open, only the handle differs
+    Raw->Volume = Ctx.get();
+    if (Raw->Wof) {
+        Raw->Wof->Volume = Raw->Volume;
+    }
+
+    return true;
+}
+
+inline auto AsyncFile::read(uint64_t Offset, Span<std::byte> Buffer)
+{
+    return offload(Owner->scheduler(), [this, Offset, Buffer](size_t Worker) {
+        return Bind(Worker) ? Handle.read(Offset, Buffer) : size_t(0);
+    });
+}
+
+inline auto AsyncFile::read(ntfs_attr &Attr, uint64_t Offset, Span<std::byte> Buffer)
+{
+    return offload(Owner->scheduler(), [this, &Attr, Offset, Buffer](size_t Worker) {
+        return Bind(Worker) ? Handle.read(Attr, Offset, Buffer) : size_t(0);
+    });
+}
+
+}   // namespace ntfs
+
+#endif   // NTFS_PARSER_ASYNC_HPP
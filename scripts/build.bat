@@ -3,3 +3,5 @@
 if /i "%1"==""      call build_clang.bat
 if /i "%1"=="clang" call build_clang.bat
 if /i "%1"=="cl"    call build_cl.bat
+if /i "%1"=="fuzz"  call build_fuzz.bat
+if /i "%1"=="bench" call build_bench.bat
@@ -0,0 +1,20 @@
+@echo off
+
+setlocal
+
+if "%ProjectDir%" == "" set "ProjectDir=%~dp0..\"
+set "BinDir=%ProjectDir%bin\bench\"
+set "SourceDir=%ProjectDir%bench\"
+
+set "Warnings=-Werror -Wall -pedantic-errors -D_CRT_SECURE_NO_WARNINGS"
+set "CompilerFlags=-m64 %Warnings% -I^"%ProjectDir%\^""
+set "LinkerFlags=-fuse-ld=lld -Wl,-subsystem:console"
+
+if not exist "%BinDir%" mkdir "%BinDir%"
+
+pushd %BinDir%
+
+clang %CompilerFlags% -std=c11 -O2 -g -c "%SourceDir%ntfs_parser.c" -o "ntfs_parser.o"
+clang++ %CompilerFlags% -std=c++17 -O2 -g "%SourceDir%bench_hpp.cpp" "ntfs_parser.o" -o "bench_hpp.exe" %LinkerFlags%
+
+popd
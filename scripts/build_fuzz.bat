@@ -0,0 +1,20 @@
+@echo off
+
+setlocal
+
+if "%ProjectDir%" == "" set "ProjectDir=%~dp0..\"
+set "BinDir=%ProjectDir%bin\fuzz\"
+set "SourceDir=%ProjectDir%fuzz\"
+
+set "Warnings=-Werror -Wall -pedantic-errors -D_CRT_SECURE_NO_WARNINGS"
+set "CompilerFlags=-m64 %Warnings% -std=c11 -I^"%ProjectDir%\^""
+set "LinkerFlags=-fuse-ld=lld -Wl,-subsystem:console"
+
+if not exist "%BinDir%" mkdir "%BinDir%"
+
+pushd %BinDir%
+
+clang %CompilerFlags% -O1 -g -fsanitize=fuzzer,address "%SourceDir%fuzz_record.c" -o "fuzz_record.exe"
+clang %CompilerFlags% -O2 -g "%SourceDir%replay_record.c" -o "replay_record.exe" %LinkerFlags%
+
+popd